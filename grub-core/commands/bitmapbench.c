@@ -0,0 +1,80 @@
+/* bitmapbench.c - measure how fast images are loaded */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/command.h>
+#include <grub/misc.h>
+#include <grub/bitmap.h>
+#include <grub/time.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static grub_err_t
+grub_cmd_bitmapbench (grub_command_t cmd __attribute__ ((unused)),
+		      int argc, char **args)
+{
+  struct grub_video_bitmap *bitmap;
+  grub_uint64_t start, elapsed;
+  unsigned long count = 10, i;
+
+  if (argc < 1)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+  if (argc > 1)
+    {
+      count = grub_strtoul (args[1], 0, 0);
+      if (grub_errno)
+	return grub_errno;
+      if (count == 0)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid count");
+    }
+
+  start = grub_get_time_ms ();
+  for (i = 0; i < count; i++)
+    {
+      if (grub_video_bitmap_load (&bitmap, args[0]))
+	return grub_errno;
+      if (i + 1 == count)
+	grub_printf_ (N_("%ux%u pixels\n"),
+		      grub_video_bitmap_get_width (bitmap),
+		      grub_video_bitmap_get_height (bitmap));
+      grub_video_bitmap_destroy (bitmap);
+    }
+  elapsed = grub_get_time_ms () - start;
+
+  grub_printf_ (N_("%lu loads in %llu ms, %llu ms each\n"), count,
+		(unsigned long long) elapsed,
+		(unsigned long long) grub_divmod64 (elapsed, count, 0));
+  return GRUB_ERR_NONE;
+}
+
+static grub_command_t cmd;
+
+GRUB_MOD_INIT(bitmapbench)
+{
+  cmd = grub_register_command ("bitmapbench", grub_cmd_bitmapbench,
+			       N_("FILE [COUNT]"),
+			       N_("Measure how fast an image is loaded and "
+				  "decoded."));
+}
+
+GRUB_MOD_FINI(bitmapbench)
+{
+  grub_unregister_command (cmd);
+}
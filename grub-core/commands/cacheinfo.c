@@ -22,29 +22,104 @@
 #include <grub/command.h>
 #include <grub/i18n.h>
 #include <grub/disk.h>
+#include <grub/env.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static void
+print_stats (const struct grub_disk_cache_stats *stats)
+{
+  unsigned long hits = stats->hits, misses = stats->misses;
+  unsigned long ratio = 0;
+
+  if (hits + misses)
+    ratio = (unsigned long) (((grub_uint64_t) hits * 10000) / (hits + misses));
+  grub_printf_ (N_("hits = %lu (%lu.%02lu%%), misses = %lu, evictions = %lu,"
+		   " cached = %lu KiB\n"), hits, ratio / 100, ratio % 100,
+		misses, stats->evictions,
+		stats->entries << (GRUB_DISK_CACHE_BITS
+				   + GRUB_DISK_SECTOR_BITS - 10));
+  if (stats->readaheads || stats->bulk_units)
+    grub_printf_ (N_("    read-ahead requests = %lu (%lu KiB),"
+		     " bulk reads = %lu KiB\n"), stats->readaheads,
+		  stats->readahead_units << (GRUB_DISK_CACHE_BITS
+					     + GRUB_DISK_SECTOR_BITS - 10),
+		  stats->bulk_units << (GRUB_DISK_CACHE_BITS
+					+ GRUB_DISK_SECTOR_BITS - 10));
+}
+
+static int
+print_dev_stats (const struct grub_disk_cache_stats *stats)
+{
+  grub_disk_dev_t dev;
+  const char *name = "unknown";
+
+  for (dev = grub_disk_dev_list; dev; dev = dev->next)
+    if (dev->id == stats->dev_id)
+      {
+	name = dev->name;
+	break;
+      }
+
+  grub_printf ("  %s/%lu: ", name, stats->disk_id);
+  print_stats (stats);
+  return 0;
+}
 
 static grub_err_t
 grub_rescue_cmd_info (struct grub_command *cmd __attribute__ ((unused)),
     int argc __attribute__ ((unused)),
     char *argv[] __attribute__ ((unused)))
 {
-  unsigned long hits, misses;
+  struct grub_disk_cache_stats total;
 
-  grub_disk_cache_get_performance (&hits, &misses);
-  if (hits + misses)
+  grub_printf_ (N_("Disk cache size: %u entries of %u KiB\n"),
+		grub_disk_cache_get_size (),
+		GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS >> 10);
+  grub_printf_ (N_("Read-ahead window: %lu KiB\n"),
+		(unsigned long) (grub_disk_readahead
+				 >> (10 - GRUB_DISK_SECTOR_BITS)));
+
+  grub_disk_cache_get_performance (&total);
+  if (total.hits + total.misses)
     {
-      unsigned long ratio = hits * 10000 / (hits + misses);
-      grub_printf ("(%lu.%lu%%)\n", ratio / 100, ratio % 100);
-      grub_printf_ (N_("Disk cache statistics: hits = %lu (%lu.%02lu%%),"
-		     " misses = %lu\n"), ratio / 100, ratio % 100,
-		    hits, misses);
+      grub_printf ("%s", _("Disk cache statistics: "));
+      print_stats (&total);
+      grub_disk_cache_iterate_performance (print_dev_stats);
     }
   else
-    grub_printf ("%s\n", _("No disk cache statistics available\n"));    
+    grub_printf ("%s\n", _("No disk cache statistics available"));
 
  return 0;
 }
 
+static char *
+write_cache_size (struct grub_env_var *var __attribute__ ((unused)),
+		  const char *val)
+{
+  unsigned long num;
+
+  num = grub_strtoul (val, 0, 0);
+  if (grub_errno)
+    return 0;
+  if (grub_disk_cache_resize (num))
+    return 0;
+  return grub_strdup (val);
+}
+
+static char *
+write_readahead (struct grub_env_var *var __attribute__ ((unused)),
+		 const char *val)
+{
+  grub_size_t sectors;
+
+  sectors = grub_strtoul (val, 0, 0) << (10 - GRUB_DISK_SECTOR_BITS);
+  if (grub_errno)
+    return 0;
+  grub_disk_readahead = ALIGN_UP (sectors, GRUB_DISK_CACHE_SIZE);
+  return grub_strdup (val);
+}
+
 static grub_command_t cmd_cacheinfo;
 
 GRUB_MOD_INIT(cacheinfo)
@@ -52,9 +127,13 @@ GRUB_MOD_INIT(cacheinfo)
   cmd_cacheinfo =
     grub_register_command ("cacheinfo", grub_rescue_cmd_info,
 			   0, N_("Get disk cache info."));
+  grub_register_variable_hook ("disk_cache_size", 0, write_cache_size);
+  grub_register_variable_hook ("disk_readahead", 0, write_readahead);
 }
 
 GRUB_MOD_FINI(cacheinfo)
 {
+  grub_register_variable_hook ("disk_cache_size", 0, 0);
+  grub_register_variable_hook ("disk_readahead", 0, 0);
   grub_unregister_command (cmd_cacheinfo);
 }
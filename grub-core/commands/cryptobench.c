@@ -0,0 +1,169 @@
+/* cryptobench.c - measure the speed of key derivation and ciphers */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/extcmd.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+#include <grub/time.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Iterations per PBKDF2 call, small enough to check the time often.  */
+#define CRYPTOBENCH_ROUND 1000
+/* Bytes deciphered per call, as much as a big disk read.  */
+#define CRYPTOBENCH_BUFSIZE 65536
+
+static const struct grub_arg_option options[] = {
+  {"hash", 'h', 0, N_("Specify hash to use."), N_("HASH"), ARG_TYPE_STRING},
+  {"cipher", 'c', 0, N_("Measure CIPHER instead of key derivation."),
+   N_("CIPHER"), ARG_TYPE_STRING},
+  {"time", 't', 0, N_("Run for SECONDS seconds (default 1)."), N_("SECONDS"),
+   ARG_TYPE_INT},
+  {0, 0, 0, 0, 0, 0}
+};
+
+static grub_err_t
+bench_pbkdf2 (const gcry_md_spec_t *hash, grub_uint64_t duration)
+{
+  grub_uint8_t salt[32];
+  grub_uint8_t key[32];
+  grub_uint64_t start, elapsed, iterations = 0;
+  gcry_err_code_t gcry_err;
+
+  grub_memset (salt, 0x5a, sizeof (salt));
+
+  start = grub_get_time_ms ();
+  do
+    {
+      gcry_err = grub_crypto_pbkdf2 (hash, (const grub_uint8_t *) "password",
+				     sizeof ("password") - 1, salt,
+				     sizeof (salt), CRYPTOBENCH_ROUND,
+				     key, sizeof (key));
+      if (gcry_err)
+	return grub_crypto_gcry_error (gcry_err);
+      iterations += CRYPTOBENCH_ROUND;
+      elapsed = grub_get_time_ms () - start;
+    }
+  while (elapsed < duration);
+
+  grub_printf_ (N_("PBKDF2-HMAC-%s: %llu iterations/s\n"), hash->name,
+		(unsigned long long) grub_divmod64 (iterations * 1000,
+						    elapsed, 0));
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+bench_cipher (const gcry_cipher_spec_t *cipher, grub_uint64_t duration)
+{
+  grub_crypto_cipher_handle_t hnd;
+  grub_uint8_t key[32];
+  grub_uint8_t *buf;
+  grub_uint64_t start, elapsed, total = 0;
+  gcry_err_code_t gcry_err;
+
+  buf = grub_zalloc (CRYPTOBENCH_BUFSIZE);
+  if (!buf)
+    return grub_errno;
+
+  hnd = grub_crypto_cipher_open (cipher);
+  if (!hnd)
+    {
+      grub_free (buf);
+      return grub_errno;
+    }
+
+  grub_memset (key, 0x5a, sizeof (key));
+  gcry_err = grub_crypto_cipher_set_key (hnd, key, cipher->keylen / 8);
+
+  start = grub_get_time_ms ();
+  do
+    {
+      if (!gcry_err)
+	gcry_err = grub_crypto_ecb_decrypt (hnd, buf, buf,
+					    CRYPTOBENCH_BUFSIZE);
+      total += CRYPTOBENCH_BUFSIZE;
+      elapsed = grub_get_time_ms () - start;
+    }
+  while (!gcry_err && elapsed < duration);
+
+  grub_crypto_cipher_close (hnd);
+  grub_free (buf);
+  if (gcry_err)
+    return grub_crypto_gcry_error (gcry_err);
+
+  grub_printf_ (N_("%s: %llu KiB/s\n"), cipher->name,
+		(unsigned long long) grub_divmod64 (total * 1000 / 1024,
+						    elapsed, 0));
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+grub_cmd_cryptobench (grub_extcmd_context_t ctxt,
+		      int argc __attribute__ ((unused)),
+		      char **args __attribute__ ((unused)))
+{
+  struct grub_arg_list *state = ctxt->state;
+  const gcry_md_spec_t *hash;
+  const char *hashname = "sha256";
+  grub_uint64_t duration = 1000;
+
+  if (state[0].set)
+    hashname = state[0].arg;
+  if (state[2].set)
+    duration = grub_strtoul (state[2].arg, 0, 0) * 1000;
+  if (grub_errno)
+    return grub_errno;
+  if (duration == 0)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "invalid time");
+
+  if (state[1].set)
+    {
+      const gcry_cipher_spec_t *cipher;
+
+      cipher = grub_crypto_lookup_cipher_by_name (state[1].arg);
+      if (!cipher)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown cipher");
+      return bench_cipher (cipher, duration);
+    }
+
+  hash = grub_crypto_lookup_md_by_name (hashname);
+  if (!hash)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
+
+  return bench_pbkdf2 (hash, duration);
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(cryptobench)
+{
+  cmd = grub_register_extcmd ("cryptobench", grub_cmd_cryptobench, 0,
+			      N_("[-h HASH|-c CIPHER] [-t SECONDS]"),
+			      N_("Measure how fast keys are derived or data "
+				 "deciphered."),
+			      options);
+}
+
+GRUB_MOD_FINI(cryptobench)
+{
+  grub_unregister_extcmd (cmd);
+}
@@ -0,0 +1,67 @@
+/* hashinfo.c - lookup table statistics  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/command.h>
+#include <grub/i18n.h>
+#include <grub/hashmap.h>
+#include <grub/env_private.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static void
+print_stats (const char *name, const struct grub_hashmap *map)
+{
+  unsigned long probes = 0;
+
+  /* In hundredths.  */
+  if (map->lookups)
+    probes = (unsigned long) (((grub_uint64_t) map->probes * 100)
+			      / map->lookups);
+  grub_printf_ (N_("%s: %lu entries in %lu slots, %lu lookups,"
+		   " %lu.%02lu probes each, %lu resizes\n"),
+		name, (unsigned long) map->count, (unsigned long) map->size,
+		map->lookups, probes / 100, probes % 100, map->resizes);
+}
+
+static grub_err_t
+grub_cmd_hashinfo (grub_command_t cmd __attribute__ ((unused)),
+		   int argc __attribute__ ((unused)),
+		   char **args __attribute__ ((unused)))
+{
+  print_stats (_("Commands"), &grub_command_map);
+  print_stats (_("Variables"), &grub_current_context->vars);
+  print_stats (_("Symbols"), &grub_dl_symtab);
+  return GRUB_ERR_NONE;
+}
+
+static grub_command_t cmd;
+
+GRUB_MOD_INIT(hashinfo)
+{
+  cmd = grub_register_command ("hashinfo", grub_cmd_hashinfo, 0,
+			       N_("Show statistics of the command, variable"
+				  " and symbol tables."));
+}
+
+GRUB_MOD_FINI(hashinfo)
+{
+  grub_unregister_command (cmd);
+}
@@ -42,6 +42,20 @@ struct cache_entry
 
 static struct cache_entry *cache;
 
+#ifdef DO_SEARCH_FS_UUID
+#define compare_fn grub_strcasecmp
+#else
+#define compare_fn grub_strcmp
+#endif
+
+/* Names both the filesystem function and the search index field giving the
+   value searched for.  */
+#ifdef DO_SEARCH_FS_UUID
+#define read_fn uuid
+#elif !defined (DO_SEARCH_FILE)
+#define read_fn label
+#endif
+
 void
 FUNC_NAME (const char *key, const char *var, int no_floppy,
 	   char **hints, unsigned nhints)
@@ -60,12 +74,6 @@ FUNC_NAME (const char *key, const char *var, int no_floppy,
 	name[0] == 'f' && name[1] == 'd' && name[2] >= '0' && name[2] <= '9')
       return 0;
 
-#ifdef DO_SEARCH_FS_UUID
-#define compare_fn grub_strcasecmp
-#else
-#define compare_fn grub_strcmp
-#endif
-
 #ifdef DO_SEARCH_FILE
       {
 	char *buf;
@@ -96,12 +104,6 @@ FUNC_NAME (const char *key, const char *var, int no_floppy,
 	  {
 	    fs = grub_fs_probe (dev);
 
-#ifdef DO_SEARCH_FS_UUID
-#define read_fn uuid
-#else
-#define read_fn label
-#endif
-
 	    if (fs && fs->read_fn)
 	      {
 		fs->read_fn (dev, &quid);
@@ -178,6 +180,33 @@ FUNC_NAME (const char *key, const char *var, int no_floppy,
     return ret;
   }
 
+  /* Check the devices the index says hold what we're looking for.  */
+  auto int index_hook (const struct grub_search_index_info *info);
+  int index_hook (const struct grub_search_index_info *info)
+  {
+#ifdef DO_SEARCH_FILE
+    /* No filesystem, so no file.  */
+    if (! info->fs)
+      return 0;
+
+    return iterate_device (info->name);
+#else
+    int old_count = count;
+    int ret;
+
+    if (! info->read_fn || compare_fn (info->read_fn, key) != 0)
+      return 0;
+
+    ret = iterate_device (info->name);
+
+    /* The device doesn't match anymore, the index is outdated.  */
+    if (count == old_count)
+      grub_search_index_invalidate ();
+
+    return ret;
+#endif
+  }
+
   auto void try (void);
   void try (void)    
   {
@@ -248,7 +277,7 @@ FUNC_NAME (const char *key, const char *var, int no_floppy,
 	      return;
 	  }
       }
-    grub_device_iterate (iterate_device);
+    grub_search_index_iterate (no_floppy, var != 0, index_hook);
   }
 
   /* First try without autoloading if we're setting variable. */
@@ -0,0 +1,309 @@
+/* search_index.c - remember filesystems found on devices for search */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/types.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+#include <grub/err.h>
+#include <grub/dl.h>
+#include <grub/device.h>
+#include <grub/disk.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/env.h>
+#include <grub/search.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Name of the hint file written by grub-install, relative to $prefix.  */
+#define SEARCH_INDEX_SEED_FILE "search.lst"
+
+struct index_entry
+{
+  struct index_entry *next;
+  struct grub_search_index_info info;
+  /* Set if the device was probed with filesystem autoloading enabled,
+     so that a missing filesystem really means there is none.  */
+  int autoload;
+};
+
+/* Every device, in the order grub_device_iterate returns them.  */
+static struct index_entry *index_list;
+static int index_built;
+static int index_has_floppies;
+static grub_uint32_t index_generation;
+
+/* Unverified entries from the hint file.  */
+static struct index_entry *seed_list;
+static int seed_loaded;
+
+static int
+is_floppy (const char *name)
+{
+  return (name[0] == 'f' && name[1] == 'd'
+	  && name[2] >= '0' && name[2] <= '9');
+}
+
+static void
+free_entries (struct index_entry **list)
+{
+  struct index_entry *ent, *next;
+
+  for (ent = *list; ent; ent = next)
+    {
+      next = ent->next;
+      grub_free (ent->info.name);
+      grub_free (ent->info.fs);
+      grub_free (ent->info.uuid);
+      grub_free (ent->info.label);
+      grub_free (ent);
+    }
+  *list = 0;
+}
+
+/* Find out which filesystem ENT->name holds.  */
+static void
+probe_entry (struct index_entry *ent)
+{
+  grub_device_t dev;
+  grub_fs_t fs;
+
+  ent->autoload = (grub_fs_autoload_hook != 0);
+
+  dev = grub_device_open (ent->info.name);
+  if (! dev)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  fs = grub_fs_probe (dev);
+  if (fs)
+    {
+      ent->info.fs = grub_strdup (fs->name);
+      if (fs->uuid)
+	{
+	  fs->uuid (dev, &ent->info.uuid);
+	  grub_errno = GRUB_ERR_NONE;
+	}
+      if (fs->label)
+	{
+	  fs->label (dev, &ent->info.label);
+	  grub_errno = GRUB_ERR_NONE;
+	}
+    }
+
+  grub_device_close (dev);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+/* Probe every device once.  */
+static void
+build_index (int no_floppy)
+{
+  struct index_entry **tail = &index_list;
+
+  auto int add_device (const char *name);
+  int add_device (const char *name)
+  {
+    struct index_entry *ent;
+
+    if (no_floppy && is_floppy (name))
+      return 0;
+
+    ent = grub_zalloc (sizeof (*ent));
+    if (! ent)
+      {
+	grub_errno = GRUB_ERR_NONE;
+	return 0;
+      }
+    ent->info.name = grub_strdup (name);
+    if (! ent->info.name)
+      {
+	grub_free (ent);
+	grub_errno = GRUB_ERR_NONE;
+	return 0;
+      }
+
+    probe_entry (ent);
+
+    *tail = ent;
+    tail = &ent->next;
+    return 0;
+  }
+
+  free_entries (&index_list);
+
+  /* Devices may appear while iterating, e.g. when USB is scanned.  */
+  index_generation = grub_disk_dev_generation;
+  grub_device_iterate (add_device);
+  index_generation = grub_disk_dev_generation;
+
+  index_built = 1;
+  index_has_floppies = ! no_floppy;
+
+  /* The full index supersedes the hints.  */
+  free_entries (&seed_list);
+}
+
+/* Load the hint file, one device per line:
+
+   DEVICE FILESYSTEM UUID LABEL
+
+   where an unknown UUID is written as `-' and the label is the rest of the
+   line, possibly empty.  */
+static void
+load_seed (void)
+{
+  const char *prefix;
+  char *path, *buf, *line, *next;
+  grub_file_t file;
+  grub_ssize_t size;
+  struct index_entry **tail = &seed_list;
+
+  seed_loaded = 1;
+
+  prefix = grub_env_get ("prefix");
+  if (! prefix)
+    return;
+
+  path = grub_xasprintf ("%s/" SEARCH_INDEX_SEED_FILE, prefix);
+  if (! path)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  grub_file_filter_disable_compression ();
+  file = grub_file_open (path);
+  grub_free (path);
+  if (! file)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  size = grub_file_size (file);
+  buf = grub_malloc (size + 1);
+  if (! buf || grub_file_read (file, buf, size) != size)
+    {
+      grub_free (buf);
+      grub_file_close (file);
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_file_close (file);
+  buf[size] = 0;
+
+  for (line = buf; *line; line = next)
+    {
+      char *fields[3];
+      struct index_entry *ent;
+      unsigned i;
+
+      next = grub_strchr (line, '\n');
+      if (next)
+	*next++ = 0;
+      else
+	next = line + grub_strlen (line);
+
+      for (i = 0; i < ARRAY_SIZE (fields); i++)
+	{
+	  while (*line == ' ')
+	    line++;
+	  fields[i] = line;
+	  while (*line && *line != ' ')
+	    line++;
+	  if (*line)
+	    *line++ = 0;
+	}
+      if (! *fields[0] || ! *fields[1] || ! *fields[2])
+	continue;
+
+      ent = grub_zalloc (sizeof (*ent));
+      if (! ent)
+	break;
+      ent->info.name = grub_strdup (fields[0]);
+      ent->info.fs = grub_strdup (fields[1]);
+      if (grub_strcmp (fields[2], "-") != 0)
+	ent->info.uuid = grub_strdup (fields[2]);
+      if (*line)
+	ent->info.label = grub_strdup (line);
+      *tail = ent;
+      tail = &ent->next;
+    }
+
+  grub_free (buf);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+void
+grub_search_index_invalidate (void)
+{
+  index_built = 0;
+}
+
+void
+grub_search_index_iterate (int no_floppy, int use_seed,
+			   int (*hook) (const struct grub_search_index_info *info))
+{
+  struct index_entry *ent;
+
+  if (index_built && (index_generation != grub_disk_dev_generation
+		      || (! no_floppy && ! index_has_floppies)))
+    index_built = 0;
+
+  /* The hints can spare probing every device if they're still right.  */
+  if (! index_built && use_seed)
+    {
+      if (! seed_loaded)
+	load_seed ();
+
+      for (ent = seed_list; ent; ent = ent->next)
+	if (! (no_floppy && is_floppy (ent->info.name))
+	    && hook (&ent->info))
+	  return;
+    }
+
+  if (! index_built)
+    build_index (no_floppy);
+
+  for (ent = index_list; ent; ent = ent->next)
+    {
+      if (no_floppy && is_floppy (ent->info.name))
+	continue;
+
+      /* A filesystem module may have become loadable.  */
+      if (! ent->info.fs && ! ent->autoload && grub_fs_autoload_hook)
+	probe_entry (ent);
+
+      if (hook (&ent->info))
+	return;
+    }
+}
+
+GRUB_MOD_INIT(search_index)
+{
+}
+
+GRUB_MOD_FINI(search_index)
+{
+  free_entries (&index_list);
+  free_entries (&seed_list);
+}
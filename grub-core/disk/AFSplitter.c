@@ -24,9 +24,12 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 
-gcry_err_code_t AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * src,
-			  grub_uint8_t * dst, grub_size_t blocksize,
-			  grub_size_t blocknumbers);
+gcry_err_code_t AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * dst,
+			  grub_size_t blocksize, grub_size_t blocknumbers,
+			  grub_uint8_t * chunk, grub_size_t chunksize,
+			  gcry_err_code_t NESTED_FUNC_ATTR
+			  (*read_chunk) (grub_size_t offset,
+					 grub_size_t len));
 
 static void
 diffuse (const gcry_md_spec_t * hash, grub_uint8_t * src,
@@ -63,27 +66,63 @@ diffuse (const gcry_md_spec_t * hash, grub_uint8_t * src,
 }
 
 /**
- * Merges the splitted master key stored on disk into the original key
+ * Merges the splitted master key stored on disk into the original key.
+ * READ_CHUNK fills CHUNK with up to CHUNKSIZE bytes of the stripes at
+ * OFFSET, so that they're processed as they're read rather than all kept
+ * in memory.
  */
 gcry_err_code_t
-AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * src, grub_uint8_t * dst,
-	  grub_size_t blocksize, grub_size_t blocknumbers)
+AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * dst,
+	  grub_size_t blocksize, grub_size_t blocknumbers,
+	  grub_uint8_t * chunk, grub_size_t chunksize,
+	  gcry_err_code_t NESTED_FUNC_ATTR
+	  (*read_chunk) (grub_size_t offset, grub_size_t len))
 {
-  grub_size_t i;
+  grub_size_t total = blocksize * blocknumbers;
+  grub_size_t offset, len, i, n;
+  grub_size_t block = 0, pos = 0;
   grub_uint8_t *bufblock;
+  gcry_err_code_t err = GPG_ERR_NO_ERROR;
 
   bufblock = grub_zalloc (blocksize);
   if (bufblock == NULL)
     return GPG_ERR_OUT_OF_MEMORY;
 
-  grub_memset (bufblock, 0, blocksize);
-  for (i = 0; i < blocknumbers - 1; i++)
+  for (offset = 0; offset < total; offset += len)
     {
-      grub_crypto_xor (bufblock, src + (blocksize * i), bufblock, blocksize);
-      diffuse (hash, bufblock, bufblock, blocksize);
+      len = total - offset;
+      if (len > chunksize)
+	len = chunksize;
+
+      err = read_chunk (offset, len);
+      if (err)
+	break;
+
+      for (i = 0; i < len; i += n)
+	{
+	  n = blocksize - pos;
+	  if (n > len - i)
+	    n = len - i;
+
+	  /* Every stripe but the last is mixed in and diffused, the last
+	     one gives the key.  */
+	  if (block == blocknumbers - 1)
+	    grub_crypto_xor (dst + pos, chunk + i, bufblock + pos, n);
+	  else
+	    grub_crypto_xor (bufblock + pos, chunk + i, bufblock + pos, n);
+
+	  pos += n;
+	  if (pos == blocksize)
+	    {
+	      if (block != blocknumbers - 1)
+		diffuse (hash, bufblock, bufblock, blocksize);
+	      block++;
+	      pos = 0;
+	    }
+	}
     }
-  grub_crypto_xor (dst, src + (i * blocksize), bufblock, blocksize);
 
+  grub_memset (bufblock, 0, blocksize);
   grub_free (bufblock);
-  return GPG_ERR_NO_ERROR;
+  return err;
 }
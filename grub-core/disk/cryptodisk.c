@@ -22,6 +22,8 @@
 #include <grub/dl.h>
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
+#include <grub/file.h>
+#include <grub/loader.h>
 
 #ifdef GRUB_UTIL
 #include <errno.h>
@@ -43,6 +45,13 @@ static const struct grub_arg_option options[] =
     /* TRANSLATORS: It's still restricted to cryptodisks only.  */
     {"all", 'a', 0, N_("Mount all."), 0, 0},
     {"boot", 'b', 0, N_("Mount all volumes with `boot' flag set."), 0, 0},
+    {"slot", 's', 0, N_("Only try key slot NUM."), N_("NUM"), ARG_TYPE_INT},
+    {"keyfile", 'k', 0, N_("Read the key from FILE."), N_("FILE"),
+     ARG_TYPE_STRING},
+    {"keyfile-offset", 'O', 0, N_("Skip OFFSET bytes of the key file."),
+     N_("OFFSET"), ARG_TYPE_INT},
+    {"keyfile-size", 'S', 0, N_("Read SIZE bytes of the key file."),
+     N_("SIZE"), ARG_TYPE_INT},
     {0, 0, 0, 0, 0, 0}
   };
 
@@ -59,18 +68,22 @@ static grub_uint8_t n = 0;
 static void
 gf_mul_x (grub_uint8_t *g)
 {
-  int over = 0, over2 = 0;
-  unsigned j;
-
-  for (j = 0; j < GRUB_CRYPTODISK_GF_BYTES; j++)
-    {
-      over2 = !!(g[j] & 0x80);
-      g[j] <<= 1;
-      g[j] |= over;
-      over = over2;
-    }
-  if (over)
-    g[0] ^= GF_POLYNOM;
+  grub_uint64_t lo, hi, over;
+
+  /* The element is a little-endian 128-bit number.  */
+  grub_memcpy (&lo, g, sizeof (lo));
+  grub_memcpy (&hi, g + sizeof (lo), sizeof (hi));
+  lo = grub_le_to_cpu64 (lo);
+  hi = grub_le_to_cpu64 (hi);
+
+  over = hi >> 63;
+  hi = (hi << 1) | (lo >> 63);
+  lo = (lo << 1) ^ (over * GF_POLYNOM);
+
+  lo = grub_cpu_to_le64 (lo);
+  hi = grub_cpu_to_le64 (hi);
+  grub_memcpy (g, &lo, sizeof (lo));
+  grub_memcpy (g + sizeof (lo), &hi, sizeof (hi));
 }
 
 
@@ -317,11 +330,23 @@ grub_cryptodisk_endecrypt (struct grub_cryptodisk *dev,
 	case GRUB_CRYPTODISK_MODE_XTS:
 	  {
 	    unsigned j;
+	    gcry_cipher_blocks_iv_t xts;
+
 	    err = grub_crypto_ecb_encrypt (dev->secondary_cipher, iv, iv,
 					   dev->cipher->cipher->blocksize);
 	    if (err)
 	      return err;
-	    
+
+	    xts = do_encrypt ? dev->cipher->cipher->xts_encrypt
+	      : dev->cipher->cipher->xts_decrypt;
+	    if (xts)
+	      {
+		xts (dev->cipher->ctx, data + i, data + i,
+		     (1U << dev->log_sector_size)
+		     / dev->cipher->cipher->blocksize, (grub_uint8_t *) iv);
+		break;
+	      }
+
 	    for (j = 0; j < (1U << dev->log_sector_size);
 		 j += dev->cipher->cipher->blocksize)
 	      {
@@ -676,6 +701,245 @@ cryptodisk_cleanup (void)
 #endif
 }
 
+/* Passphrases which opened a volume, keys derived from them and volume
+   keys, kept so that volumes sharing a passphrase are opened without
+   asking again and each derivation is done once.  */
+struct keyring_pass
+{
+  struct keyring_pass *next;
+  grub_size_t len;
+  grub_uint8_t pass[0];
+};
+
+struct keyring_derived
+{
+  struct keyring_derived *next;
+  const gcry_md_spec_t *md;
+  unsigned int iterations;
+  grub_size_t passlen, saltlen, keylen;
+  /* The passphrase, salt and derived key, in that order.  */
+  grub_uint8_t data[0];
+};
+
+struct keyring_key
+{
+  struct keyring_key *next;
+  grub_size_t idlen, keylen;
+  /* The identifier and the key, in that order.  */
+  grub_uint8_t data[0];
+};
+
+static struct keyring_pass *keyring_passphrases;
+static struct keyring_pass **keyring_passphrases_tail = &keyring_passphrases;
+static struct keyring_derived *keyring_derived;
+static struct keyring_key *keyring_keys;
+
+const grub_uint8_t *
+grub_cryptodisk_keyring_get_passphrase (unsigned idx, grub_size_t *len)
+{
+  struct keyring_pass *p;
+
+  for (p = keyring_passphrases; p && idx; p = p->next)
+    idx--;
+  if (!p)
+    return NULL;
+  *len = p->len;
+  return p->pass;
+}
+
+void
+grub_cryptodisk_keyring_add_passphrase (const grub_uint8_t *pass,
+					grub_size_t len)
+{
+  struct keyring_pass *p;
+
+  for (p = keyring_passphrases; p; p = p->next)
+    if (p->len == len && grub_memcmp (p->pass, pass, len) == 0)
+      return;
+
+  p = grub_malloc (sizeof (*p) + len);
+  if (!p)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  p->next = NULL;
+  p->len = len;
+  grub_memcpy (p->pass, pass, len);
+  *keyring_passphrases_tail = p;
+  keyring_passphrases_tail = &p->next;
+}
+
+/* PASS was tried and didn't open a volume.  Wipe the keys derived from it and,
+   if it's kept, itself, so that it isn't tried on every other volume.  */
+void
+grub_cryptodisk_keyring_forget_passphrase (const grub_uint8_t *pass,
+					   grub_size_t len)
+{
+  struct keyring_pass *p, **pp;
+  struct keyring_derived *d, **dp;
+
+  for (dp = &keyring_derived; (d = *dp); )
+    if (d->passlen == len && grub_memcmp (d->data, pass, len) == 0)
+      {
+	*dp = d->next;
+	grub_memset (d, 0, sizeof (*d) + d->passlen + d->saltlen + d->keylen);
+	grub_free (d);
+      }
+    else
+      dp = &d->next;
+
+  /* PASS may be the kept copy, so it's the last thing looked at.  */
+  for (pp = &keyring_passphrases; (p = *pp); pp = &p->next)
+    if (p->len == len && grub_memcmp (p->pass, pass, len) == 0)
+      {
+	*pp = p->next;
+	if (keyring_passphrases_tail == &p->next)
+	  keyring_passphrases_tail = pp;
+	grub_memset (p, 0, sizeof (*p) + p->len);
+	grub_free (p);
+	break;
+      }
+}
+
+gcry_err_code_t
+grub_cryptodisk_keyring_pbkdf2 (const gcry_md_spec_t *md,
+				const grub_uint8_t *pass, grub_size_t passlen,
+				const grub_uint8_t *salt, grub_size_t saltlen,
+				unsigned int iterations,
+				grub_uint8_t *key, grub_size_t keylen)
+{
+  struct keyring_derived *d;
+  gcry_err_code_t err;
+
+  for (d = keyring_derived; d; d = d->next)
+    if (d->md == md && d->iterations == iterations
+	&& d->passlen == passlen && d->saltlen == saltlen
+	&& d->keylen == keylen
+	&& grub_memcmp (d->data, pass, passlen) == 0
+	&& grub_memcmp (d->data + passlen, salt, saltlen) == 0)
+      {
+	grub_memcpy (key, d->data + passlen + saltlen, keylen);
+	return GPG_ERR_NO_ERROR;
+      }
+
+  err = grub_crypto_pbkdf2 (md, pass, passlen, salt, saltlen, iterations,
+			    key, keylen);
+  if (err)
+    return err;
+
+  d = grub_malloc (sizeof (*d) + passlen + saltlen + keylen);
+  if (!d)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GPG_ERR_NO_ERROR;
+    }
+  d->md = md;
+  d->iterations = iterations;
+  d->passlen = passlen;
+  d->saltlen = saltlen;
+  d->keylen = keylen;
+  grub_memcpy (d->data, pass, passlen);
+  grub_memcpy (d->data + passlen, salt, saltlen);
+  grub_memcpy (d->data + passlen + saltlen, key, keylen);
+  d->next = keyring_derived;
+  keyring_derived = d;
+
+  return GPG_ERR_NO_ERROR;
+}
+
+int
+grub_cryptodisk_keyring_find_key (const void *id, grub_size_t idlen,
+				  grub_uint8_t *key, grub_size_t keylen)
+{
+  struct keyring_key *k;
+
+  for (k = keyring_keys; k; k = k->next)
+    if (k->idlen == idlen && k->keylen == keylen
+	&& grub_memcmp (k->data, id, idlen) == 0)
+      {
+	grub_memcpy (key, k->data + idlen, keylen);
+	return 1;
+      }
+  return 0;
+}
+
+void
+grub_cryptodisk_keyring_add_key (const void *id, grub_size_t idlen,
+				 const grub_uint8_t *key, grub_size_t keylen)
+{
+  struct keyring_key *k;
+  grub_uint8_t tmp[keylen];
+
+  if (grub_cryptodisk_keyring_find_key (id, idlen, tmp, keylen))
+    {
+      grub_memset (tmp, 0, keylen);
+      return;
+    }
+
+  k = grub_malloc (sizeof (*k) + idlen + keylen);
+  if (!k)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  k->idlen = idlen;
+  k->keylen = keylen;
+  grub_memcpy (k->data, id, idlen);
+  grub_memcpy (k->data + idlen, key, keylen);
+  k->next = keyring_keys;
+  keyring_keys = k;
+}
+
+void
+grub_cryptodisk_keyring_clear (void)
+{
+  struct keyring_pass *p;
+  struct keyring_derived *d;
+  struct keyring_key *k;
+
+  while ((p = keyring_passphrases))
+    {
+      keyring_passphrases = p->next;
+      grub_memset (p, 0, sizeof (*p) + p->len);
+      grub_free (p);
+    }
+  keyring_passphrases_tail = &keyring_passphrases;
+
+  while ((d = keyring_derived))
+    {
+      keyring_derived = d->next;
+      grub_memset (d, 0, sizeof (*d) + d->passlen + d->saltlen + d->keylen);
+      grub_free (d);
+    }
+
+  while ((k = keyring_keys))
+    {
+      keyring_keys = k->next;
+      grub_memset (k, 0, sizeof (*k) + k->idlen + k->keylen);
+      grub_free (k);
+    }
+}
+
+#ifndef GRUB_UTIL
+static struct grub_preboot *keyring_preboot;
+
+/* Nothing in the keyring is passed on to the OS, so don't leave it in the
+   memory the OS gets.  */
+static grub_err_t
+keyring_wipe (int noret __attribute__ ((unused)))
+{
+  grub_cryptodisk_keyring_clear ();
+  return GRUB_ERR_NONE;
+}
+
+static grub_err_t
+keyring_wipe_restore (void)
+{
+  return GRUB_ERR_NONE;
+}
+#endif
+
 grub_err_t
 grub_cryptodisk_insert (grub_cryptodisk_t newdev, const char *name,
 			grub_disk_t source)
@@ -692,6 +956,7 @@ grub_cryptodisk_insert (grub_cryptodisk_t newdev, const char *name,
   newdev->source_dev_id = source->dev->id;
   newdev->next = cryptodisk_list;
   cryptodisk_list = newdev;
+  grub_disk_dev_changed ();
 
   return GRUB_ERR_NONE;
 }
@@ -740,6 +1005,20 @@ grub_cryptodisk_cheat_insert (grub_cryptodisk_t newdev, const char *name,
   return GRUB_ERR_NONE;
 }
 
+static void
+print_cipher_abstraction (grub_crypto_cipher_handle_t cipher)
+{
+  grub_printf ("%s ", cipher->cipher->modname);
+
+  /* With gcry_rijndael already loaded AES is found without autoloading,
+     so aesni has to be loaded explicitly, after it, to take over.  */
+  if (grub_strcmp (cipher->cipher->modname, "gcry_rijndael") == 0
+      && grub_strcmp (GRUB_PLATFORM, "emu") != 0
+      && (grub_strcmp (GRUB_TARGET_CPU, "i386") == 0
+	  || grub_strcmp (GRUB_TARGET_CPU, "x86_64") == 0))
+    grub_printf ("aesni ");
+}
+
 void
 grub_util_cryptodisk_print_abstraction (grub_disk_t disk)
 {
@@ -748,11 +1027,11 @@ grub_util_cryptodisk_print_abstraction (grub_disk_t disk)
   grub_printf ("cryptodisk %s ", dev->modname);
 
   if (dev->cipher)
-    grub_printf ("%s ", dev->cipher->cipher->modname);
+    print_cipher_abstraction (dev->cipher);
   if (dev->secondary_cipher)
-    grub_printf ("%s ", dev->secondary_cipher->cipher->modname);
+    print_cipher_abstraction (dev->secondary_cipher);
   if (dev->essiv_cipher)
-    grub_printf ("%s ", dev->essiv_cipher->cipher->modname);
+    print_cipher_abstraction (dev->essiv_cipher);
   if (dev->hash)
     grub_printf ("%s ", dev->hash->modname);
   if (dev->essiv_hash)
@@ -772,6 +1051,10 @@ grub_util_cryptodisk_print_uuid (grub_disk_t disk)
 
 static int check_boot, have_it;
 static char *search_uuid;
+static struct grub_cryptodisk_key_options key_options = { .slot = -1 };
+
+/* Don't read huge key files whole.  */
+#define MAX_KEYFILE_SIZE (8 * 1024 * 1024)
 
 static void
 cryptodisk_close (grub_cryptodisk_t dev)
@@ -802,7 +1085,7 @@ grub_cryptodisk_scan_device_real (const char *name, grub_disk_t source)
     if (!dev)
       continue;
     
-    err = cr->recover_key (source, dev);
+    err = cr->recover_key (source, dev, &key_options);
     if (err)
     {
       cryptodisk_close (dev);
@@ -886,13 +1169,59 @@ grub_cryptodisk_scan_device (const char *name)
 }
 
 static grub_err_t
-grub_cmd_cryptomount (grub_extcmd_context_t ctxt, int argc, char **args)
+read_keyfile (const char *name, grub_off_t offset, grub_size_t size)
 {
-  struct grub_arg_list *state = ctxt->state;
+  grub_file_t file;
+  grub_uint8_t *key;
+  grub_ssize_t len;
+
+  /* Key files are read byte for byte, never decompressed.  */
+  grub_file_filter_disable_compression ();
+  file = grub_file_open (name);
+  if (!file)
+    return grub_errno;
 
-  if (argc < 1 && !state[1].set && !state[2].set)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, "device name required");
+  if (offset > grub_file_size (file))
+    {
+      grub_file_close (file);
+      return grub_error (GRUB_ERR_OUT_OF_RANGE,
+			 N_("key file offset is past its end"));
+    }
+  if (!size)
+    size = grub_file_size (file) - offset;
+  if (size > MAX_KEYFILE_SIZE)
+    {
+      grub_file_close (file);
+      return grub_error (GRUB_ERR_OUT_OF_RANGE, N_("key file is too big"));
+    }
+
+  key = grub_malloc (size ? : 1);
+  if (!key)
+    {
+      grub_file_close (file);
+      return grub_errno;
+    }
+
+  grub_file_seek (file, offset);
+  len = grub_file_read (file, key, size);
+  grub_file_close (file);
+  if (len < 0 || (grub_size_t) len != size)
+    {
+      grub_free (key);
+      if (!grub_errno)
+	grub_error (GRUB_ERR_FILE_READ_ERROR, N_("premature end of file %s"),
+		    name);
+      return grub_errno;
+    }
+
+  key_options.key = key;
+  key_options.key_len = size;
+  return GRUB_ERR_NONE;
+}
 
+static grub_err_t
+grub_cmd_cryptomount_real (struct grub_arg_list *state, int argc, char **args)
+{
   have_it = 0;
   if (state[0].set)
     {
@@ -951,6 +1280,63 @@ grub_cmd_cryptomount (grub_extcmd_context_t ctxt, int argc, char **args)
     }
 }
 
+static grub_err_t
+grub_cmd_cryptomount (grub_extcmd_context_t ctxt, int argc, char **args)
+{
+  struct grub_arg_list *state = ctxt->state;
+  grub_err_t err;
+
+  if (argc < 1 && !state[1].set && !state[2].set)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "device name required");
+
+  key_options.slot = -1;
+  if (state[3].set)
+    {
+      key_options.slot = grub_strtoul (state[3].arg, 0, 0);
+      if (grub_errno)
+	return grub_errno;
+    }
+
+  if (state[4].set)
+    {
+      grub_off_t offset = 0;
+      grub_size_t size = 0;
+
+      if (state[5].set)
+	{
+	  offset = grub_strtoull (state[5].arg, 0, 0);
+	  if (grub_errno)
+	    return grub_errno;
+	}
+      if (state[6].set)
+	{
+	  size = grub_strtoul (state[6].arg, 0, 0);
+	  if (grub_errno)
+	    return grub_errno;
+	}
+
+      err = read_keyfile (state[4].arg, offset, size);
+      if (err)
+	return err;
+    }
+  else if (state[5].set || state[6].set)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT,
+		       N_("--keyfile-offset and --keyfile-size need --keyfile"));
+
+  err = grub_cmd_cryptomount_real (state, argc, args);
+
+  if (key_options.key)
+    {
+      grub_memset ((grub_uint8_t *) key_options.key, 0, key_options.key_len);
+      grub_free ((grub_uint8_t *) key_options.key);
+    }
+  key_options.key = NULL;
+  key_options.key_len = 0;
+  key_options.slot = -1;
+
+  return err;
+}
+
 static struct grub_disk_dev grub_cryptodisk_dev = {
   .name = "cryptodisk",
   .id = GRUB_DISK_DEVICE_CRYPTODISK_ID,
@@ -971,12 +1357,24 @@ GRUB_MOD_INIT (cryptodisk)
 {
   grub_disk_dev_register (&grub_cryptodisk_dev);
   cmd = grub_register_extcmd ("cryptomount", grub_cmd_cryptomount, 0,
-			      N_("SOURCE|-u UUID|-a|-b"),
+			      N_("[-s NUM] [-k FILE [-O OFFSET] [-S SIZE]] "
+				 "SOURCE|-u UUID|-a|-b"),
 			      N_("Mount a crypto device."), options);
+#ifndef GRUB_UTIL
+  keyring_preboot
+    = grub_loader_register_preboot_hook (keyring_wipe, keyring_wipe_restore,
+					 GRUB_LOADER_PREBOOT_HOOK_PRIO_NORMAL);
+#endif
 }
 
 GRUB_MOD_FINI (cryptodisk)
 {
   grub_disk_dev_unregister (&grub_cryptodisk_dev);
+#ifndef GRUB_UTIL
+  if (keyring_preboot)
+    grub_loader_unregister_preboot_hook (keyring_preboot);
+  keyring_preboot = 0;
+#endif
+  grub_cryptodisk_keyring_clear ();
   cryptodisk_cleanup ();
 }
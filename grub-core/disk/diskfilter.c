@@ -24,6 +24,7 @@
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
 #include <grub/partition.h>
+#include <grub/time.h>
 #ifdef GRUB_UTIL
 #include <grub/i18n.h>
 #include <grub/util/misc.h>
@@ -31,6 +32,15 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+/* Striped reads are gathered per member up to this many sectors.  */
+#define STRIPED_BATCH_SECTORS 512
+/* Mirrors are read in turn a range of this many sectors each, so that every
+   member sees sequential reads and its read-ahead pays off.  */
+#define MIRROR_RANGE_SHIFT 11
+/* A mirror member's speed is known after reading this many sectors.  */
+#define MIRROR_MIN_SAMPLE 4096
+#define MIRROR_COST_UNKNOWN (~(grub_uint64_t) 0)
+
 /* Linked list of DISKFILTER arrays. */
 static struct grub_diskfilter_vg *array_list;
 grub_raid5_recover_func_t grub_raid5_recover_func;
@@ -479,9 +489,20 @@ grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
   if (node->pv)
     {
       if (node->pv->disk)
-	return grub_disk_read (node->pv->disk, sector + node->start
-			       + node->pv->start_sector,
-			       0, size << GRUB_DISK_SECTOR_BITS, buf);
+	{
+	  grub_uint64_t start = grub_get_time_ms ();
+	  grub_err_t err;
+
+	  err = grub_disk_read (node->pv->disk, sector + node->start
+				+ node->pv->start_sector,
+				0, size << GRUB_DISK_SECTOR_BITS, buf);
+	  if (!err)
+	    {
+	      node->pv->read_ms += grub_get_time_ms () - start;
+	      node->pv->read_sectors += size;
+	    }
+	  return err;
+	}
       else
 	return grub_error (GRUB_ERR_UNKNOWN_DEVICE,
 			   N_("physical volume %s not found"), node->pv->name);
@@ -492,6 +513,185 @@ grub_diskfilter_read_node (const struct grub_diskfilter_node *node,
   return grub_error (GRUB_ERR_UNKNOWN_DEVICE, "unknown node '%s'", node->name);
 }
 
+/* Read the chunks of a RAID0 request with one read per member.  The chunks
+   a member holds are consecutive on it, so its share of up to
+   STRIPED_BATCH_SECTORS per member is contiguous.  */
+static grub_err_t
+read_striped (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
+	      grub_size_t size, char *buf)
+{
+  grub_uint64_t n = seg->node_count, ss = seg->stripe_size;
+  grub_uint64_t rows = 1;
+  char *tmp = NULL;
+  grub_err_t err = GRUB_ERR_NONE;
+
+  if (ss < STRIPED_BATCH_SECTORS)
+    rows = STRIPED_BATCH_SECTORS / ss;
+
+  while (size)
+    {
+      grub_uint64_t first, last, b, e, m, row;
+      grub_size_t piece;
+      unsigned k;
+
+      /* Take the request up to the end of ROWS rows of chunks.  */
+      first = grub_divmod64 (sector, ss, &b);
+      row = grub_divmod64 (first, n, &m);
+      piece = ((row + rows) * n * ss) - sector;
+      if (piece > size)
+	piece = size;
+      last = grub_divmod64 (sector + piece - 1, ss, &e);
+      e++;
+
+      for (k = 0; k < n; k++)
+	{
+	  grub_uint64_t c, c0, c1, start, end;
+
+	  /* First and last chunk of the piece on member K.  */
+	  grub_divmod64 (first, n, &m);
+	  c0 = first + (k + n - m) % n;
+	  if (c0 > last)
+	    continue;
+	  grub_divmod64 (last, n, &m);
+	  c1 = last - (m + n - k) % n;
+
+	  start = grub_divmod64 (c0, n, 0) * ss + (c0 == first ? b : 0);
+	  end = grub_divmod64 (c1, n, 0) * ss + (c1 == last ? e : ss);
+
+	  if (c0 == c1)
+	    {
+	      err = grub_diskfilter_read_node (&seg->nodes[k], start,
+					       end - start,
+					       buf + (c0 == first ? 0
+						      : ((c0 - first) * ss - b)
+						      << GRUB_DISK_SECTOR_BITS));
+	      if (err)
+		goto fail;
+	      continue;
+	    }
+
+	  if (!tmp)
+	    {
+	      tmp = grub_malloc ((rows * ss) << GRUB_DISK_SECTOR_BITS);
+	      if (!tmp)
+		return grub_errno;
+	    }
+
+	  err = grub_diskfilter_read_node (&seg->nodes[k], start, end - start,
+					   tmp);
+	  if (err)
+	    goto fail;
+
+	  for (c = c0; c <= c1; c += n)
+	    {
+	      grub_uint64_t from = (c == first ? b : 0);
+	      grub_uint64_t to = (c == last ? e : ss);
+
+	      grub_memcpy (buf + ((c == first ? 0 : (c - first) * ss - b)
+				  << GRUB_DISK_SECTOR_BITS),
+			   tmp + ((grub_divmod64 (c, n, 0) * ss + from - start)
+				  << GRUB_DISK_SECTOR_BITS),
+			   (to - from) << GRUB_DISK_SECTOR_BITS);
+	    }
+	}
+
+      buf += piece << GRUB_DISK_SECTOR_BITS;
+      sector += piece;
+      size -= piece;
+    }
+
+ fail:
+  grub_free (tmp);
+  return err;
+}
+
+static int
+mirror_present (const struct grub_diskfilter_node *node)
+{
+  return node->pv && node->pv->disk;
+}
+
+static grub_uint64_t
+mirror_cost (const struct grub_diskfilter_node *node)
+{
+  /* Milliseconds per MiB.  */
+  if (!mirror_present (node) || node->pv->read_sectors < MIRROR_MIN_SAMPLE)
+    return MIRROR_COST_UNKNOWN;
+  return grub_divmod64 (node->pv->read_ms << 11, node->pv->read_sectors, 0);
+}
+
+/* Whether NODE is present and either not measured yet or not much slower
+   than BEST, the cost of the fastest member measured.  */
+static int
+mirror_fast (const struct grub_diskfilter_node *node, grub_uint64_t best)
+{
+  grub_uint64_t cost;
+
+  if (!mirror_present (node))
+    return 0;
+  cost = mirror_cost (node);
+  return (cost == MIRROR_COST_UNKNOWN || best == MIRROR_COST_UNKNOWN
+	  || cost <= 2 * best + 1);
+}
+
+/* Pick the mirror member to read SECTOR from first: members present take
+   turns by range, leaving out those much slower than the fastest one.
+   Members not measured yet take their turns so that they get measured,
+   but don't count as the fastest.  */
+static unsigned
+pick_mirror (const struct grub_diskfilter_segment *seg,
+	     grub_disk_addr_t sector)
+{
+  grub_uint64_t best = MIRROR_COST_UNKNOWN, r;
+  unsigned i, nfast = 0;
+
+  for (i = 0; i < seg->node_count; i++)
+    if (mirror_cost (&seg->nodes[i]) < best)
+      best = mirror_cost (&seg->nodes[i]);
+
+  for (i = 0; i < seg->node_count; i++)
+    if (mirror_fast (&seg->nodes[i], best))
+      nfast++;
+
+  /* None is present, let read_mirror fail on each.  */
+  if (!nfast)
+    return 0;
+
+  grub_divmod64 (sector >> MIRROR_RANGE_SHIFT, nfast, &r);
+  for (i = 0; i < seg->node_count; i++)
+    if (mirror_fast (&seg->nodes[i], best) && r-- == 0)
+      break;
+  return i;
+}
+
+/* Every mirror member has all of the data, so read it whole from one.  */
+static grub_err_t
+read_mirror (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
+	     grub_size_t size, char *buf)
+{
+  grub_err_t err = GRUB_ERR_NONE;
+  unsigned i, k;
+
+  k = pick_mirror (seg, sector);
+  for (i = 0; i < seg->node_count; i++)
+    {
+      if (grub_errno == GRUB_ERR_READ_ERROR
+	  || grub_errno == GRUB_ERR_UNKNOWN_DEVICE)
+	grub_errno = GRUB_ERR_NONE;
+
+      err = grub_diskfilter_read_node (&seg->nodes[k], sector, size, buf);
+      if (! err)
+	return GRUB_ERR_NONE;
+      if (err != GRUB_ERR_READ_ERROR && err != GRUB_ERR_UNKNOWN_DEVICE)
+	return err;
+
+      k++;
+      if (k == seg->node_count)
+	k = 0;
+    }
+  return err;
+}
+
 static grub_err_t
 read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
 	      grub_size_t size, char *buf)
@@ -503,7 +703,9 @@ read_segment (struct grub_diskfilter_segment *seg, grub_disk_addr_t sector,
       if (seg->node_count == 1)
 	return grub_diskfilter_read_node (&seg->nodes[0],
 					  sector, size, buf);
+      return read_striped (seg, sector, size, buf);
     case GRUB_DISKFILTER_MIRROR:
+      return read_mirror (seg, sector, size, buf);
     case GRUB_DISKFILTER_RAID10:
       {
 	grub_disk_addr_t read_sector, far_ofs;
@@ -392,7 +392,8 @@ configure_ciphers (grub_disk_t disk, const char *check_uuid,
 }
 
 static grub_err_t
-recover_key (grub_disk_t source, grub_cryptodisk_t dev)
+recover_key (grub_disk_t source, grub_cryptodisk_t dev,
+	     const struct grub_cryptodisk_key_options *opts)
 {
   grub_size_t keysize;
   grub_uint8_t digest[dev->hash->mdlen];
@@ -416,6 +417,17 @@ recover_key (grub_disk_t source, grub_cryptodisk_t dev)
   if (err)
     return err;
 
+  /* GELI mixes key files into the key rather than using them as the
+     passphrase.  */
+  if (opts->key)
+    return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		       "key files aren't supported for geli");
+
+  if (opts->slot >= (int) ARRAY_SIZE (header.keys)
+      || (opts->slot >= 0 && ! (header.keys_used & (1 << opts->slot))))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("key slot %d isn't active"),
+		       opts->slot);
+
   keysize = grub_le_to_cpu16 (header.keylen) / 8;
   grub_memset (zero, 0, sizeof (zero));
 
@@ -488,6 +500,8 @@ recover_key (grub_disk_t source, grub_cryptodisk_t dev)
       /* Check if keyslot is enabled.  */
       if (! (header.keys_used & (1 << i)))
 	  continue;
+      if (opts->slot >= 0 && (int) i != opts->slot)
+	continue;
 
       grub_dprintf ("geli", "Trying keyslot %d\n", i);
 
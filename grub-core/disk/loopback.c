@@ -63,6 +63,7 @@ delete_loopback (const char *name)
 
   /* Remove the device from the list.  */
   *prev = dev->next;
+  grub_disk_dev_changed ();
 
   grub_free (dev->devname);
   grub_file_close (dev->file);
@@ -124,6 +125,7 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
   /* Add the new entry to the list.  */
   newdev->next = loopback_list;
   loopback_list = newdev;
+  grub_disk_dev_changed ();
 
   return 0;
 
@@ -26,6 +26,8 @@
 #include <grub/crypto.h>
 #include <grub/partition.h>
 #include <grub/i18n.h>
+#include <grub/time.h>
+#include <grub/env.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -60,9 +62,23 @@ struct grub_luks_phdr
 
 typedef struct grub_luks_phdr *grub_luks_phdr_t;
 
-gcry_err_code_t AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * src,
-			  grub_uint8_t * dst, grub_size_t blocksize,
-			  grub_size_t blocknumbers);
+gcry_err_code_t AF_merge (const gcry_md_spec_t * hash, grub_uint8_t * dst,
+			  grub_size_t blocksize, grub_size_t blocknumbers,
+			  grub_uint8_t * chunk, grub_size_t chunksize,
+			  gcry_err_code_t NESTED_FUNC_ATTR
+			  (*read_chunk) (grub_size_t offset,
+					 grub_size_t len));
+
+/* Key material is read and decrypted this many bytes at a time.  */
+#define LUKS_CHUNK_SIZE 4096
+
+/* The key slot which opened a volume is kept in the variable luks_slot_UUID
+   and tried first when the volume is mounted again.  save_env can keep it
+   across boots.  */
+#define LUKS_SLOT_VAR_PREFIX "luks_slot_"
+
+/* Slot which opened the last volume, volumes made alike use the same.  */
+static int last_slot = -1;
 
 static grub_cryptodisk_t
 configure_ciphers (grub_disk_t disk, const char *check_uuid,
@@ -297,161 +313,329 @@ configure_ciphers (grub_disk_t disk, const char *check_uuid,
   return newdev;
 }
 
+static int
+get_slot_hint (const char *uuid)
+{
+  char *name, *end;
+  const char *val;
+  unsigned long slot;
+
+  name = grub_xasprintf (LUKS_SLOT_VAR_PREFIX "%s", uuid);
+  if (!name)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return last_slot;
+    }
+  val = grub_env_get (name);
+  grub_free (name);
+  if (!val)
+    return last_slot;
+
+  slot = grub_strtoul (val, &end, 10);
+  if (grub_errno || *end
+      || slot >= ARRAY_SIZE (((struct grub_luks_phdr *) 0)->keyblock))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return last_slot;
+    }
+  return slot;
+}
+
+static void
+set_slot_hint (const char *uuid, int slot)
+{
+  char *name;
+  char buf[sizeof ("-2147483648")];
+
+  last_slot = slot;
+
+  name = grub_xasprintf (LUKS_SLOT_VAR_PREFIX "%s", uuid);
+  if (!name)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_snprintf (buf, sizeof (buf), "%d", slot);
+  grub_env_set (name, buf);
+  grub_free (name);
+  grub_errno = GRUB_ERR_NONE;
+}
+
+/* Fill ORDER with the active slots to try: the one which opened the volume
+   before first, then the cheapest ones.  Return how many there are.  */
+static unsigned
+order_slots (const struct grub_luks_phdr *header, int hint, int only,
+	     int order[ARRAY_SIZE (header->keyblock)])
+{
+  unsigned i, j, n = 0;
+
+  for (i = 0; i < ARRAY_SIZE (header->keyblock); i++)
+    {
+      grub_uint32_t iterations;
+
+      if (grub_be_to_cpu32 (header->keyblock[i].active) != LUKS_KEY_ENABLED)
+	continue;
+      if (only >= 0 && (int) i != only)
+	continue;
+
+      iterations = grub_be_to_cpu32 (header->keyblock[i].passwordIterations);
+      for (j = n; j > 0; j--)
+	{
+	  if (order[j - 1] == hint)
+	    break;
+	  if ((int) i != hint
+	      && grub_be_to_cpu32 (header->keyblock[order[j - 1]]
+				   .passwordIterations) <= iterations)
+	    break;
+	  order[j] = order[j - 1];
+	}
+      order[j] = i;
+      n++;
+    }
+
+  return n;
+}
+
 static grub_err_t
 luks_recover_key (grub_disk_t source,
-		  grub_cryptodisk_t dev)
+		  grub_cryptodisk_t dev,
+		  const struct grub_cryptodisk_key_options *opts)
 {
   struct grub_luks_phdr header;
   grub_size_t keysize;
-  grub_uint8_t *split_key = NULL;
+  grub_uint8_t *chunk = NULL, *candidate_key;
   char passphrase[MAX_PASSPHRASE] = "";
+  const grub_uint8_t *key;
+  grub_size_t key_len;
   grub_uint8_t candidate_digest[sizeof (header.mkDigest)];
-  unsigned i;
-  grub_size_t length;
+  /* The master key digest, salt and iterations tell the key apart.  */
+  grub_uint8_t key_id[sizeof (header.mkDigest) + sizeof (header.mkDigestSalt)
+		      + sizeof (header.mkDigestIterations)];
+  int order[ARRAY_SIZE (header.keyblock)];
+  unsigned i, nslots;
+  int opened;
   grub_err_t err;
-  grub_size_t max_stripes = 1;
+  gcry_err_code_t gcry_err;
+  grub_disk_addr_t material;
   char *tmp;
 
+  auto gcry_err_code_t NESTED_FUNC_ATTR read_chunk (grub_size_t offset,
+						     grub_size_t len);
+  gcry_err_code_t NESTED_FUNC_ATTR read_chunk (grub_size_t offset,
+					       grub_size_t len)
+  {
+    /* Key material is padded to whole sectors on disk.  */
+    len = ALIGN_UP (len, (1U << dev->log_sector_size));
+    if (grub_disk_read (source, material, offset, len, chunk))
+      return GPG_ERR_GENERAL;
+    return grub_cryptodisk_decrypt (dev, chunk, len,
+				    offset >> dev->log_sector_size);
+  }
+
+  /* Try to recover the master key into CANDIDATE_KEY from each slot with
+     the passphrase PASS.  Return 1 if it worked, 0 if it didn't and -1 on
+     errors.  */
+  auto int try_passphrase (const grub_uint8_t *pass, grub_size_t passlen);
+  int try_passphrase (const grub_uint8_t *pass, grub_size_t passlen)
+  {
+    for (i = 0; i < nslots; i++)
+      {
+	grub_uint8_t digest[keysize];
+	int slot = order[i];
+	grub_uint32_t iterations;
+	grub_uint64_t start;
+
+	iterations = grub_be_to_cpu32 (header.keyblock[slot].passwordIterations);
+	grub_dprintf ("luks", "Trying keyslot %d (%u iterations)\n", slot,
+		      iterations);
+	start = grub_get_time_ms ();
+
+	/* Calculate the PBKDF2 of the user supplied passphrase.  */
+	gcry_err = grub_cryptodisk_keyring_pbkdf2 (dev->hash, pass, passlen,
+						   header.keyblock[slot]
+						   .passwordSalt,
+						   sizeof (header.keyblock[slot]
+							   .passwordSalt),
+						   iterations, digest,
+						   keysize);
+	if (gcry_err)
+	  {
+	    grub_crypto_gcry_error (gcry_err);
+	    return -1;
+	  }
+
+	grub_dprintf ("luks", "PBKDF2 done in %llu ms\n",
+		      (unsigned long long) (grub_get_time_ms () - start));
+
+	gcry_err = grub_cryptodisk_setkey (dev, digest, keysize);
+	grub_memset (digest, 0, keysize);
+	if (gcry_err)
+	  {
+	    grub_crypto_gcry_error (gcry_err);
+	    return -1;
+	  }
+
+	/* Read, decrypt and merge the key material from the disk to get the
+	   candidate master key.  */
+	material = grub_be_to_cpu32 (header.keyblock[slot].keyMaterialOffset);
+	gcry_err = AF_merge (dev->hash, candidate_key, keysize,
+			     grub_be_to_cpu32 (header.keyblock[slot].stripes),
+			     chunk, LUKS_CHUNK_SIZE, read_chunk);
+	if (gcry_err)
+	  {
+	    if (!grub_errno)
+	      grub_crypto_gcry_error (gcry_err);
+	    return -1;
+	  }
+
+	grub_dprintf ("luks", "candidate key recovered\n");
+
+	/* Calculate the PBKDF2 of the candidate master key.  */
+	gcry_err = grub_crypto_pbkdf2 (dev->hash, candidate_key,
+				       grub_be_to_cpu32 (header.keyBytes),
+				       header.mkDigestSalt,
+				       sizeof (header.mkDigestSalt),
+				       grub_be_to_cpu32
+				       (header.mkDigestIterations),
+				       candidate_digest,
+				       sizeof (candidate_digest));
+	if (gcry_err)
+	  {
+	    grub_crypto_gcry_error (gcry_err);
+	    return -1;
+	  }
+
+	grub_dprintf ("luks", "keyslot %d took %llu ms\n", slot,
+		      (unsigned long long) (grub_get_time_ms () - start));
+
+	/* Compare the calculated PBKDF2 to the digest stored
+	   in the header to see if it's correct.  */
+	if (grub_memcmp (candidate_digest, header.mkDigest,
+			 sizeof (header.mkDigest)) != 0)
+	  {
+	    grub_dprintf ("luks", "bad digest\n");
+	    continue;
+	  }
+
+	/* TRANSLATORS: It's a cryptographic key slot: one element of an array
+	   where each element is either empty or holds a key.  */
+	grub_printf_ (N_("Slot %d opened\n"), slot);
+	set_slot_hint (dev->uuid, slot);
+	return 1;
+      }
+
+    return 0;
+  }
+
   err = grub_disk_read (source, 0, 0, sizeof (header), &header);
   if (err)
     return err;
 
-  grub_puts_ (N_("Attempting to decrypt master key..."));
   keysize = grub_be_to_cpu32 (header.keyBytes);
 
-  for (i = 0; i < ARRAY_SIZE (header.keyblock); i++)
-    if (grub_be_to_cpu32 (header.keyblock[i].active) == LUKS_KEY_ENABLED
-	&& grub_be_to_cpu32 (header.keyblock[i].stripes) > max_stripes)
-      max_stripes = grub_be_to_cpu32 (header.keyblock[i].stripes);
+  if (opts->slot >= (int) ARRAY_SIZE (header.keyblock)
+      || (opts->slot >= 0
+	  && grub_be_to_cpu32 (header.keyblock[opts->slot].active)
+	  != LUKS_KEY_ENABLED))
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("key slot %d isn't active"),
+		       opts->slot);
 
-  split_key = grub_malloc (keysize * max_stripes);
-  if (!split_key)
+  nslots = order_slots (&header, get_slot_hint (dev->uuid), opts->slot,
+			order);
+  if (nslots == 0)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("no active key slot"));
+
+  chunk = grub_malloc (LUKS_CHUNK_SIZE + keysize);
+  if (!chunk)
     return grub_errno;
+  candidate_key = chunk + LUKS_CHUNK_SIZE;
+
+  grub_memcpy (key_id, header.mkDigest, sizeof (header.mkDigest));
+  grub_memcpy (key_id + sizeof (header.mkDigest), header.mkDigestSalt,
+	       sizeof (header.mkDigestSalt));
+  grub_memcpy (key_id + sizeof (header.mkDigest) + sizeof (header.mkDigestSalt),
+	       &header.mkDigestIterations, sizeof (header.mkDigestIterations));
 
-  /* Get the passphrase from the user.  */
-  tmp = NULL;
-  if (source->partition)
-    tmp = grub_partition_get_name (source->partition);
-  grub_printf_ (N_("Enter passphrase for %s%s%s (%s): "), source->name,
-	       source->partition ? "," : "", tmp ? : "",
-	       dev->uuid);
-  grub_free (tmp);
-  if (!grub_password_get (passphrase, MAX_PASSPHRASE))
+  /* A volume with the same master key was opened before.  */
+  if (grub_cryptodisk_keyring_find_key (key_id, sizeof (key_id),
+					candidate_key, keysize))
     {
-      grub_free (split_key);
-      return grub_error (GRUB_ERR_BAD_ARGUMENT, "Passphrase not supplied");
+      grub_dprintf ("luks", "master key found in keyring\n");
+      opened = 1;
     }
-
-  /* Try to recover master key from each active keyslot.  */
-  for (i = 0; i < ARRAY_SIZE (header.keyblock); i++)
+  else
     {
-      gcry_err_code_t gcry_err;
-      grub_uint8_t candidate_key[keysize];
-      grub_uint8_t digest[keysize];
+      grub_puts_ (N_("Attempting to decrypt master key..."));
 
-      /* Check if keyslot is enabled.  */
-      if (grub_be_to_cpu32 (header.keyblock[i].active) != LUKS_KEY_ENABLED)
-	continue;
-
-      grub_dprintf ("luks", "Trying keyslot %d\n", i);
-
-      /* Calculate the PBKDF2 of the user supplied passphrase.  */
-      gcry_err = grub_crypto_pbkdf2 (dev->hash, (grub_uint8_t *) passphrase,
-				     grub_strlen (passphrase),
-				     header.keyblock[i].passwordSalt,
-				     sizeof (header.keyblock[i].passwordSalt),
-				     grub_be_to_cpu32 (header.keyblock[i].
-						       passwordIterations),
-				     digest, keysize);
-
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
-
-      grub_dprintf ("luks", "PBKDF2 done\n");
-
-      gcry_err = grub_cryptodisk_setkey (dev, digest, keysize); 
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
-
-      length = (keysize * grub_be_to_cpu32 (header.keyblock[i].stripes));
-
-      /* Read and decrypt the key material from the disk.  */
-      err = grub_disk_read (source,
-			    grub_be_to_cpu32 (header.keyblock
-					      [i].keyMaterialOffset), 0,
-			    length, split_key);
-      if (err)
-	{
-	  grub_free (split_key);
-	  return err;
-	}
-
-      gcry_err = grub_cryptodisk_decrypt (dev, split_key, length, 0);
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
-
-      /* Merge the decrypted key material to get the candidate master key.  */
-      gcry_err = AF_merge (dev->hash, split_key, candidate_key, keysize,
-			   grub_be_to_cpu32 (header.keyblock[i].stripes));
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
-
-      grub_dprintf ("luks", "candidate key recovered\n");
-
-      /* Calculate the PBKDF2 of the candidate master key.  */
-      gcry_err = grub_crypto_pbkdf2 (dev->hash, candidate_key,
-				     grub_be_to_cpu32 (header.keyBytes),
-				     header.mkDigestSalt,
-				     sizeof (header.mkDigestSalt),
-				     grub_be_to_cpu32
-				     (header.mkDigestIterations),
-				     candidate_digest,
-				     sizeof (candidate_digest));
-      if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
-
-      /* Compare the calculated PBKDF2 to the digest stored
-         in the header to see if it's correct.  */
-      if (grub_memcmp (candidate_digest, header.mkDigest,
-		       sizeof (header.mkDigest)) != 0)
+      if (opts->key)
+	opened = try_passphrase (opts->key, opts->key_len);
+      else
 	{
-	  grub_dprintf ("luks", "bad digest\n");
-	  continue;
+	  /* Passphrases which opened other volumes come first.  One which
+	     doesn't open this volume is dropped, which also moves the next
+	     one to the front.  */
+	  opened = 0;
+	  while (!opened
+		 && (key = grub_cryptodisk_keyring_get_passphrase (0, &key_len)))
+	    {
+	      opened = try_passphrase (key, key_len);
+	      if (!opened)
+		grub_cryptodisk_keyring_forget_passphrase (key, key_len);
+	    }
+
+	  if (!opened)
+	    {
+	      /* Get the passphrase from the user.  */
+	      tmp = NULL;
+	      if (source->partition)
+		tmp = grub_partition_get_name (source->partition);
+	      grub_printf_ (N_("Enter passphrase for %s%s%s (%s): "),
+			    source->name, source->partition ? "," : "",
+			    tmp ? : "", dev->uuid);
+	      grub_free (tmp);
+	      if (!grub_password_get (passphrase, MAX_PASSPHRASE))
+		{
+		  grub_free (chunk);
+		  return grub_error (GRUB_ERR_BAD_ARGUMENT,
+				     "Passphrase not supplied");
+		}
+
+	      opened = try_passphrase ((grub_uint8_t *) passphrase,
+				       grub_strlen (passphrase));
+	      if (opened > 0)
+		grub_cryptodisk_keyring_add_passphrase ((grub_uint8_t *)
+							passphrase,
+							grub_strlen
+							(passphrase));
+	      else if (!opened)
+		grub_cryptodisk_keyring_forget_passphrase ((grub_uint8_t *)
+							   passphrase,
+							   grub_strlen
+							   (passphrase));
+	      grub_memset (passphrase, 0, sizeof (passphrase));
+	    }
 	}
+    }
 
-      /* TRANSLATORS: It's a cryptographic key slot: one element of an array
-	 where each element is either empty or holds a key.  */
-      grub_printf_ (N_("Slot %d opened\n"), i);
-
+  if (opened > 0)
+    {
       /* Set the master key.  */
-      gcry_err = grub_cryptodisk_setkey (dev, candidate_key, keysize); 
+      gcry_err = grub_cryptodisk_setkey (dev, candidate_key, keysize);
       if (gcry_err)
-	{
-	  grub_free (split_key);
-	  return grub_crypto_gcry_error (gcry_err);
-	}
-
-      grub_free (split_key);
-
-      return GRUB_ERR_NONE;
+	grub_crypto_gcry_error (gcry_err);
+      else
+	grub_cryptodisk_keyring_add_key (key_id, sizeof (key_id),
+					 candidate_key, keysize);
     }
 
-  return GRUB_ACCESS_DENIED;
+  grub_memset (chunk, 0, LUKS_CHUNK_SIZE + keysize);
+  grub_free (chunk);
+
+  if (opened < 0 || grub_errno)
+    return grub_errno;
+  if (!opened)
+    return GRUB_ACCESS_DENIED;
+  return GRUB_ERR_NONE;
 }
 
 struct grub_cryptodisk_dev luks_crypto = {
@@ -23,46 +23,10 @@
 #include <grub/err.h>
 #include <grub/misc.h>
 #include <grub/diskfilter.h>
-#include <grub/crypto.h>
+#include <grub/gf256.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
-/* x**y.  */
-static grub_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static int powx_inv[256];
-static const grub_uint8_t poly = 0x1d;
-
-static void
-grub_raid_block_mulx (int mul, char *buf, int size)
-{
-  int i;
-  grub_uint8_t *p;
-
-  p = (grub_uint8_t *) buf;
-  for (i = 0; i < size; i++, p++)
-    if (*p)
-      *p = powx[mul + powx_inv[*p]];
-}
-
-static void
-grub_raid6_init_table (void)
-{
-  int i;
-
-  grub_uint8_t cur = 1;
-  for (i = 0; i < 255; i++)
-    {
-      powx[i] = cur;
-      powx[i + 255] = cur;
-      powx_inv[cur] = i;
-      if (cur & 0x80)
-	cur = (cur << 1) ^ poly;
-      else
-	cur <<= 1;
-    }
-}
-
 static grub_err_t
 grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
                     char *buf, grub_disk_addr_t sector, int size)
@@ -102,9 +66,10 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
           if (! grub_diskfilter_read_node (&array->nodes[pos], sector,
 					   size >> GRUB_DISK_SECTOR_BITS, buf))
             {
-              grub_crypto_xor (pbuf, pbuf, buf, size);
-              grub_raid_block_mulx (c, buf, size);
-              grub_crypto_xor (qbuf, qbuf, buf, size);
+              grub_gf256_xor_block (pbuf, pbuf, buf, size);
+              grub_gf256_mul_xor_block ((grub_uint8_t *) qbuf,
+					(grub_uint8_t *) buf,
+					grub_gf256_pow (c), size);
             }
           else
             {
@@ -132,7 +97,7 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
       if ((! grub_diskfilter_read_node (&array->nodes[p], sector,
 					size >> GRUB_DISK_SECTOR_BITS, buf)))
         {
-          grub_crypto_xor (buf, buf, pbuf, size);
+          grub_gf256_xor_block (buf, buf, pbuf, size);
           goto quit;
         }
 
@@ -141,9 +106,9 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
 				     size >> GRUB_DISK_SECTOR_BITS, buf))
         goto quit;
 
-      grub_crypto_xor (buf, buf, qbuf, size);
-      grub_raid_block_mulx (255 - bad1, buf,
-                           size);
+      grub_gf256_xor_block (buf, buf, qbuf, size);
+      grub_gf256_mul_block ((grub_uint8_t *) buf, (grub_uint8_t *) buf,
+			    grub_gf256_pow (255 - bad1), size);
     }
   else
     {
@@ -154,22 +119,23 @@ grub_raid6_recover (struct grub_diskfilter_segment *array, int disknr, int p,
 				     size >> GRUB_DISK_SECTOR_BITS, buf))
         goto quit;
 
-      grub_crypto_xor (pbuf, pbuf, buf, size);
+      grub_gf256_xor_block (pbuf, pbuf, buf, size);
 
       if (grub_diskfilter_read_node (&array->nodes[q], sector,
 				     size >> GRUB_DISK_SECTOR_BITS, buf))
         goto quit;
 
-      grub_crypto_xor (qbuf, qbuf, buf, size);
+      grub_gf256_xor_block (qbuf, qbuf, buf, size);
 
-      c = (255 - bad1 + (255 - powx_inv[(powx[bad2 - bad1 + 255] ^ 1)])) % 255;
-      grub_raid_block_mulx (c, qbuf, size);
+      c = (255 - bad1
+	   + (255 - grub_gf256_log (grub_gf256_pow (bad2 - bad1 + 255) ^ 1)))
+	% 255;
+      grub_gf256_mul_block ((grub_uint8_t *) buf, (grub_uint8_t *) qbuf,
+			    grub_gf256_pow (c), size);
 
       c = (bad2 + c) % 255;
-      grub_raid_block_mulx (c, pbuf, size);
-
-      grub_crypto_xor (pbuf, pbuf, qbuf, size);
-      grub_memcpy (buf, pbuf, size);
+      grub_gf256_mul_xor_block ((grub_uint8_t *) buf, (grub_uint8_t *) pbuf,
+				grub_gf256_pow (c), size);
     }
 
 quit:
@@ -181,7 +147,6 @@ quit:
 
 GRUB_MOD_INIT(raid6rec)
 {
-  grub_raid6_init_table ();
   grub_raid6_recover_func = grub_raid6_recover;
 }
 
@@ -138,6 +138,7 @@ grub_usbms_detach (grub_usb_device_t usbdev, int config, int interface)
       {
 	grub_free (grub_usbms_devices[i]);
 	grub_usbms_devices[i] = 0;
+	grub_disk_dev_changed ();
       }
 }
 
@@ -245,6 +246,7 @@ grub_usbms_attach (grub_usb_device_t usbdev, int configno, int interfno)
   grub_dprintf ("usbms", "alive\n");
 
   usbdev->config[configno].interf[interfno].detach_hook = grub_usbms_detach;
+  grub_disk_dev_changed ();
 
 #if 0 /* All this part should be probably deleted.
        * This make trouble on some devices if they are not in
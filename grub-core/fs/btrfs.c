@@ -87,6 +87,17 @@ struct grub_btrfs_device_desc
   grub_uint64_t id;
 };
 
+/* A chunk maps the logical range [START, START + SIZE) to its stripes.  */
+struct grub_btrfs_chunk_map_entry
+{
+  grub_uint64_t start;
+  grub_uint64_t size;
+  /* The chunk item followed by its stripes.  */
+  struct grub_btrfs_chunk_item *chunk;
+  /* The device of each stripe, NULL until needed.  */
+  grub_device_t *devices;
+};
+
 struct grub_btrfs_data
 {
   struct grub_btrfs_superblock sblock;
@@ -97,6 +108,11 @@ struct grub_btrfs_data
   unsigned n_devices_attached;
   unsigned n_devices_allocated;
 
+  /* The chunks used so far, sorted by start.  */
+  struct grub_btrfs_chunk_map_entry *chunks;
+  unsigned n_chunks;
+  unsigned n_chunks_allocated;
+
   /* Cached extent data.  */
   grub_uint64_t extstart;
   grub_uint64_t extend;
@@ -610,84 +626,206 @@ find_device (struct grub_btrfs_data *data, grub_uint64_t id, int do_rescan)
   return dev_found;
 }
 
+/* Return the chunk containing ADDR if it is in the map.  */
+static struct grub_btrfs_chunk_map_entry *
+chunk_map_find (struct grub_btrfs_data *data, grub_uint64_t addr)
+{
+  unsigned lo = 0, hi = data->n_chunks;
+
+  /* Find the first chunk starting after ADDR.  */
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+      if (data->chunks[mid].start <= addr)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0 || addr - data->chunks[lo - 1].start >= data->chunks[lo - 1].size)
+    return NULL;
+  return &data->chunks[lo - 1];
+}
+
+/* Add the chunk item CHUNK of CHSIZE bytes for the range starting at
+   START to the map.  CHUNK is freed on failure.  */
+static struct grub_btrfs_chunk_map_entry *
+chunk_map_insert (struct grub_btrfs_data *data, grub_uint64_t start,
+		  struct grub_btrfs_chunk_item *chunk, grub_size_t chsize)
+{
+  struct grub_btrfs_chunk_map_entry *entry;
+  grub_device_t *devices;
+  unsigned nstripes, pos;
+
+  nstripes = grub_le_to_cpu16 (chunk->nstripes);
+  if (chsize < sizeof (*chunk)
+      || nstripes == 0
+      || chsize < sizeof (*chunk)
+      + nstripes * sizeof (struct grub_btrfs_chunk_stripe)
+      || ((grub_le_to_cpu64 (chunk->type) & GRUB_BTRFS_CHUNK_TYPE_RAID10)
+	  && grub_le_to_cpu16 (chunk->nsubstripes) == 0))
+    {
+      grub_free (chunk);
+      grub_error (GRUB_ERR_BAD_FS, "invalid chunk descriptor");
+      return NULL;
+    }
+
+  if (data->n_chunks == data->n_chunks_allocated)
+    {
+      struct grub_btrfs_chunk_map_entry *tmp;
+      unsigned n = 2 * data->n_chunks_allocated + 16;
+
+      tmp = grub_realloc (data->chunks, n * sizeof (data->chunks[0]));
+      if (!tmp)
+	{
+	  grub_free (chunk);
+	  return NULL;
+	}
+      data->chunks = tmp;
+      data->n_chunks_allocated = n;
+    }
+
+  devices = grub_zalloc (nstripes * sizeof (devices[0]));
+  if (!devices)
+    {
+      grub_free (chunk);
+      return NULL;
+    }
+
+  for (pos = data->n_chunks; pos > 0 && data->chunks[pos - 1].start > start;
+       pos--);
+  entry = &data->chunks[pos];
+  grub_memmove (entry + 1, entry,
+		(data->n_chunks - pos) * sizeof (data->chunks[0]));
+  data->n_chunks++;
+  entry->start = start;
+  entry->size = grub_le_to_cpu64 (chunk->size);
+  entry->chunk = chunk;
+  entry->devices = devices;
+  return entry;
+}
+
+/* Add the system chunks the superblock carries, which cover the chunk
+   tree itself.  */
+static grub_err_t
+chunk_map_init (struct grub_btrfs_data *data)
+{
+  grub_uint8_t *ptr = data->sblock.bootstrap_mapping;
+  grub_uint8_t *end = ptr + sizeof (data->sblock.bootstrap_mapping);
+
+  while (ptr + sizeof (struct grub_btrfs_key)
+	 + sizeof (struct grub_btrfs_chunk_item) <= end)
+    {
+      struct grub_btrfs_key *key = (struct grub_btrfs_key *) ptr;
+      struct grub_btrfs_chunk_item *chunk;
+      grub_size_t chsize;
+
+      if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK)
+	break;
+      chunk = (struct grub_btrfs_chunk_item *) (key + 1);
+      chsize = sizeof (*chunk) + sizeof (struct grub_btrfs_chunk_stripe)
+	* grub_le_to_cpu16 (chunk->nstripes);
+      if ((grub_uint8_t *) chunk + chsize > end)
+	break;
+      grub_dprintf ("btrfs",
+		    "%" PRIxGRUB_UINT64_T " %" PRIxGRUB_UINT64_T " \n",
+		    grub_le_to_cpu64 (key->offset),
+		    grub_le_to_cpu64 (chunk->size));
+
+      chunk = grub_malloc (chsize);
+      if (!chunk)
+	return grub_errno;
+      grub_memcpy (chunk, key + 1, chsize);
+      if (!chunk_map_insert (data, grub_le_to_cpu64 (key->offset),
+			     chunk, chsize))
+	return grub_errno;
+      ptr += sizeof (*key) + chsize;
+    }
+  return GRUB_ERR_NONE;
+}
+
+/* Look up the chunk containing ADDR in the chunk tree and add it to the
+   map.  */
+static struct grub_btrfs_chunk_map_entry *
+chunk_map_load (struct grub_btrfs_data *data, grub_uint64_t addr,
+		int recursion_depth)
+{
+  struct grub_btrfs_key key_in, key_out;
+  struct grub_btrfs_chunk_item *chunk;
+  struct grub_btrfs_chunk_map_entry *entry;
+  grub_size_t chsize;
+  grub_disk_addr_t chaddr;
+  grub_err_t err;
+
+  key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
+  key_in.type = GRUB_BTRFS_ITEM_TYPE_CHUNK;
+  key_in.offset = grub_cpu_to_le64 (addr);
+  err = lower_bound (data, &key_in, &key_out,
+		     data->sblock.chunk_tree,
+		     &chaddr, &chsize, NULL, recursion_depth);
+  if (err)
+    return NULL;
+  if (key_out.type != GRUB_BTRFS_ITEM_TYPE_CHUNK
+      || !(grub_le_to_cpu64 (key_out.offset) <= addr))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "couldn't find the chunk descriptor");
+      return NULL;
+    }
+
+  chunk = grub_malloc (chsize);
+  if (!chunk)
+    return NULL;
+
+  err = grub_btrfs_read_logical (data, chaddr, chunk, chsize,
+				 recursion_depth);
+  if (err)
+    {
+      grub_free (chunk);
+      return NULL;
+    }
+
+  /* Reading the chunk may have added it already.  */
+  entry = chunk_map_find (data, grub_le_to_cpu64 (key_out.offset));
+  if (entry && entry->start == grub_le_to_cpu64 (key_out.offset))
+    {
+      grub_free (chunk);
+      return entry;
+    }
+
+  return chunk_map_insert (data, grub_le_to_cpu64 (key_out.offset),
+			   chunk, chsize);
+}
+
 static grub_err_t
 grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			 void *buf, grub_size_t size, int recursion_depth)
 {
   while (size > 0)
     {
-      grub_uint8_t *ptr;
-      struct grub_btrfs_key *key;
+      struct grub_btrfs_chunk_map_entry *entry;
       struct grub_btrfs_chunk_item *chunk;
       grub_uint64_t csize;
       grub_err_t err = 0;
-      struct grub_btrfs_key key_out;
-      int challoc = 0;
       grub_device_t dev;
-      struct grub_btrfs_key key_in;
-      grub_size_t chsize;
-      grub_disk_addr_t chaddr;
 
       grub_dprintf ("btrfs", "searching for laddr %" PRIxGRUB_UINT64_T "\n",
 		    addr);
-      for (ptr = data->sblock.bootstrap_mapping;
-	   ptr < data->sblock.bootstrap_mapping
-	   + sizeof (data->sblock.bootstrap_mapping)
-	   - sizeof (struct grub_btrfs_key);)
+      entry = chunk_map_find (data, addr);
+      if (!entry)
 	{
-	  key = (struct grub_btrfs_key *) ptr;
-	  if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK)
-	    break;
-	  chunk = (struct grub_btrfs_chunk_item *) (key + 1);
-	  grub_dprintf ("btrfs",
-			"%" PRIxGRUB_UINT64_T " %" PRIxGRUB_UINT64_T " \n",
-			grub_le_to_cpu64 (key->offset),
-			grub_le_to_cpu64 (chunk->size));
-	  if (grub_le_to_cpu64 (key->offset) <= addr
-	      && addr < grub_le_to_cpu64 (key->offset)
-	      + grub_le_to_cpu64 (chunk->size))
-	    goto chunk_found;
-	  ptr += sizeof (*key) + sizeof (*chunk)
-	    + sizeof (struct grub_btrfs_chunk_stripe)
-	    * grub_le_to_cpu16 (chunk->nstripes);
-	}
-
-      key_in.object_id = grub_cpu_to_le64_compile_time (GRUB_BTRFS_OBJECT_ID_CHUNK);
-      key_in.type = GRUB_BTRFS_ITEM_TYPE_CHUNK;
-      key_in.offset = grub_cpu_to_le64 (addr);
-      err = lower_bound (data, &key_in, &key_out,
-			 data->sblock.chunk_tree,
-			 &chaddr, &chsize, NULL, recursion_depth);
-      if (err)
-	return err;
-      key = &key_out;
-      if (key->type != GRUB_BTRFS_ITEM_TYPE_CHUNK
-	  || !(grub_le_to_cpu64 (key->offset) <= addr))
-	return grub_error (GRUB_ERR_BAD_FS,
-			   "couldn't find the chunk descriptor");
-
-      chunk = grub_malloc (chsize);
-      if (!chunk)
-	return grub_errno;
-
-      challoc = 1;
-      err = grub_btrfs_read_logical (data, chaddr, chunk, chsize,
-				     recursion_depth);
-      if (err)
-	{
-	  grub_free (chunk);
-	  return err;
+	  entry = chunk_map_load (data, addr, recursion_depth);
+	  if (!entry)
+	    return grub_errno;
 	}
+      chunk = entry->chunk;
 
-    chunk_found:
       {
 	grub_uint64_t stripen;
 	grub_uint64_t stripe_offset;
-	grub_uint64_t off = addr - grub_le_to_cpu64 (key->offset);
+	grub_uint64_t off = addr - entry->start;
 	unsigned redundancy = 1;
 	unsigned i, j;
 
-	if (grub_le_to_cpu64 (chunk->size) <= off)
+	if (entry->size <= off)
 	  {
 	    grub_dprintf ("btrfs", "no chunk\n");
 	    return grub_error (GRUB_ERR_BAD_FS,
@@ -698,7 +836,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 		      "+0x%" PRIxGRUB_UINT64_T
 		      " (%d stripes (%d substripes) of %"
 		      PRIxGRUB_UINT64_T ")\n",
-		      grub_le_to_cpu64 (key->offset),
+		      entry->start,
 		      grub_le_to_cpu64 (chunk->size),
 		      grub_le_to_cpu16 (chunk->nstripes),
 		      grub_le_to_cpu16 (chunk->nsubstripes),
@@ -774,6 +912,8 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			     "couldn't find the chunk descriptor");
 	if (csize > (grub_uint64_t) size)
 	  csize = size;
+	if (stripen + redundancy > grub_le_to_cpu16 (chunk->nstripes))
+	  return grub_error (GRUB_ERR_BAD_FS, "invalid chunk descriptor");
 
 	for (j = 0; j < 2; j++)
 	  {
@@ -794,7 +934,7 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			      " (%d stripes (%d substripes) of %"
 			      PRIxGRUB_UINT64_T ") stripe %" PRIxGRUB_UINT64_T
 			      " maps to 0x%" PRIxGRUB_UINT64_T "\n",
-			      grub_le_to_cpu64 (key->offset),
+			      entry->start,
 			      grub_le_to_cpu64 (chunk->size),
 			      grub_le_to_cpu16 (chunk->nstripes),
 			      grub_le_to_cpu16 (chunk->nsubstripes),
@@ -804,13 +944,16 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
 			      " for laddr 0x%" PRIxGRUB_UINT64_T "\n", paddr,
 			      addr);
 
-		dev = find_device (data, stripe->device_id, j);
+		dev = entry->devices[stripen + i];
+		if (!dev)
+		  dev = find_device (data, stripe->device_id, j);
 		if (!dev)
 		  {
 		    err = grub_errno;
 		    grub_errno = GRUB_ERR_NONE;
 		    continue;
 		  }
+		entry->devices[stripen + i] = dev;
 
 		err = grub_disk_read (dev->disk, paddr >> GRUB_DISK_SECTOR_BITS,
 				      paddr & (GRUB_DISK_SECTOR_SIZE - 1),
@@ -828,12 +971,28 @@ grub_btrfs_read_logical (struct grub_btrfs_data *data, grub_disk_addr_t addr,
       size -= csize;
       buf = (grub_uint8_t *) buf + csize;
       addr += csize;
-      if (challoc)
-	grub_free (chunk);
     }
   return GRUB_ERR_NONE;
 }
 
+static void
+grub_btrfs_unmount (struct grub_btrfs_data *data)
+{
+  unsigned i;
+  /* The device 0 is closed one layer upper.  */
+  for (i = 1; i < data->n_devices_attached; i++)
+    grub_device_close (data->devices_attached[i].dev);
+  grub_free (data->devices_attached);
+  for (i = 0; i < data->n_chunks; i++)
+    {
+      grub_free (data->chunks[i].chunk);
+      grub_free (data->chunks[i].devices);
+    }
+  grub_free (data->chunks);
+  grub_free (data->extent);
+  grub_free (data);
+}
+
 static struct grub_btrfs_data *
 grub_btrfs_mount (grub_device_t dev)
 {
@@ -869,19 +1028,13 @@ grub_btrfs_mount (grub_device_t dev)
   data->devices_attached[0].dev = dev;
   data->devices_attached[0].id = data->sblock.this_device.device_id;
 
-  return data;
-}
+  if (chunk_map_init (data))
+    {
+      grub_btrfs_unmount (data);
+      return NULL;
+    }
 
-static void
-grub_btrfs_unmount (struct grub_btrfs_data *data)
-{
-  unsigned i;
-  /* The device 0 is closed one layer upper.  */
-  for (i = 1; i < data->n_devices_attached; i++)
-    grub_device_close (data->devices_attached[i].dev);
-  grub_free (data->devices_attached);
-  grub_free (data->extent);
-  grub_free (data);
+  return data;
 }
 
 static grub_err_t
@@ -1672,6 +1825,13 @@ grub_btrfs_embed (grub_device_t device __attribute__ ((unused)),
 }
 #endif
 
+/* Signature of the primary superblock.  */
+static const struct grub_fs_magic grub_btrfs_magic[] = {
+  { 64 * 1024 + 0x40, GRUB_BTRFS_SIGNATURE,
+    sizeof (GRUB_BTRFS_SIGNATURE) - 1 },
+  { 0, 0, 0 }
+};
+
 static struct grub_fs grub_btrfs_fs = {
   .name = "btrfs",
   .dir = grub_btrfs_dir,
@@ -1680,6 +1840,7 @@ static struct grub_fs grub_btrfs_fs = {
   .close = grub_btrfs_close,
   .uuid = grub_btrfs_uuid,
   .label = grub_btrfs_label,
+  .magic = grub_btrfs_magic,
 #ifdef GRUB_UTIL
   .embed = grub_btrfs_embed,
   .reserved_first_sector = 1,
@@ -720,6 +720,19 @@ grub_cpio_close (grub_file_t file)
   return grub_errno;
 }
 
+/* The magic of the first header.  */
+static const struct grub_fs_magic grub_cpio_magic[] = {
+#ifdef MODE_USTAR
+  { 257, MAGIC, sizeof (MAGIC) - 1 },
+#else
+  { 0, MAGIC, sizeof (MAGIC) - 1 },
+#endif
+#ifdef MAGIC2
+  { 0, MAGIC2, sizeof (MAGIC2) - 1 },
+#endif
+  { 0, 0, 0 }
+};
+
 static struct grub_fs grub_cpio_fs = {
 #ifdef MODE_USTAR
   .name = "tarfs",
@@ -734,6 +747,7 @@ static struct grub_fs grub_cpio_fs = {
   .open = grub_cpio_open,
   .read = grub_cpio_read,
   .close = grub_cpio_close,
+  .magic = grub_cpio_magic,
 #ifdef GRUB_UTIL
   .reserved_first_sector = 0,
   .blocklist_install = 0,
@@ -372,8 +372,12 @@ grub_ext4_find_leaf (struct grub_ext2_data *data, grub_properly_aligned_t *buf,
     }
 }
 
+/* Translate FILEBLOCK of NODE to a disk block.  For extent-mapped files
+   also store in *COUNT how many blocks from FILEBLOCK are contiguous on
+   disk, so a whole extent is resolved with one tree walk.  */
 static grub_disk_addr_t
-grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		      grub_disk_addr_t *count)
 {
   struct grub_ext2_data *data = node->data;
   struct grub_ext2_inode *inode = &node->inode;
@@ -406,9 +410,15 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 
       if (--i >= 0)
         {
-          fileblock -= grub_le_to_cpu32 (ext[i].block);
-          if (fileblock >= grub_le_to_cpu16 (ext[i].len))
-            return 0;
+          grub_disk_addr_t off = fileblock - grub_le_to_cpu32 (ext[i].block);
+
+          if (off >= grub_le_to_cpu16 (ext[i].len))
+            {
+              /* A hole, up to the next extent of this leaf.  */
+              if (i + 1 < grub_le_to_cpu16 (leaf->entries))
+                *count = grub_le_to_cpu32 (ext[i + 1].block) - fileblock;
+              return 0;
+            }
           else
             {
               grub_disk_addr_t start;
@@ -416,7 +426,8 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
               start = grub_le_to_cpu16 (ext[i].start_hi);
               start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
 
-              return fileblock + start;
+              *count = grub_le_to_cpu16 (ext[i].len) - off;
+              return off + start;
             }
         }
       else
@@ -516,8 +527,8 @@ grub_ext2_read_file (grub_fshelp_node_t node,
 					unsigned offset, unsigned length),
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_ext2_read_block,
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_ext2_read_block,
 				grub_cpu_to_le32 (node->inode.size)
 				| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
 				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
@@ -656,6 +667,20 @@ grub_ext2_read_symlink (grub_fshelp_node_t node)
   return symlink;
 }
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.  */
+static grub_fshelp_node_t
+grub_ext2_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+
+  copy = grub_malloc (sizeof (*node));
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, sizeof (*node));
+  copy->data = root->data;
+  return copy;
+}
+
 static int
 grub_ext2_iterate_dir (grub_fshelp_node_t dir,
 		       int NESTED_FUNC_ATTR
@@ -770,9 +795,10 @@ grub_ext2_open (struct grub_file *file, const char *name)
       goto fail;
     }
 
-  err = grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			       grub_ext2_iterate_dir,
-			       grub_ext2_read_symlink, GRUB_FSHELP_REG);
+  err = grub_fshelp_find_file_cached (name, &data->diropen, &fdiro,
+				      grub_ext2_iterate_dir,
+				      grub_ext2_read_symlink, GRUB_FSHELP_REG,
+				      data->disk, "ext2", grub_ext2_dup_node);
   if (err)
     goto fail;
 
@@ -866,8 +892,10 @@ grub_ext2_dir (grub_device_t device, const char *path,
   if (! data)
     goto fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro, grub_ext2_iterate_dir,
-			 grub_ext2_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->diropen, &fdiro,
+				grub_ext2_iterate_dir, grub_ext2_read_symlink,
+				GRUB_FSHELP_DIR, data->disk, "ext2",
+				grub_ext2_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -961,6 +989,13 @@ grub_ext2_mtime (grub_device_t device, grub_int32_t *tm)
 
 
 
+/* The magic field of the superblock, which starts at 1024.  */
+static const struct grub_fs_magic grub_ext2_magic[] =
+  {
+    { 1024 + 56, "\x53\xef", 2 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_ext2_fs =
   {
     .name = "ext2",
@@ -971,6 +1006,7 @@ static struct grub_fs grub_ext2_fs =
     .label = grub_ext2_label,
     .uuid = grub_ext2_uuid,
     .mtime = grub_ext2_mtime,
+    .magic = grub_ext2_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
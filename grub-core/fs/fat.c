@@ -452,6 +452,61 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+/* Look up the cluster following CLUSTER in the FAT and store it in *NEXT.
+   A value of at least DATA->cluster_eof_mark marks the end of the chain.  */
+static grub_err_t
+grub_fat_next_cluster (grub_disk_t disk, struct grub_fat_data *data,
+		       grub_uint32_t cluster, grub_uint32_t *next)
+{
+  grub_uint32_t next_cluster = 0;
+  unsigned long fat_offset;
+
+  switch (data->fat_size)
+    {
+    case 32:
+      fat_offset = cluster << 2;
+      break;
+    case 16:
+      fat_offset = cluster << 1;
+      break;
+    default:
+      /* case 12: */
+      fat_offset = cluster + (cluster >> 1);
+      break;
+    }
+
+  /* Read the FAT.  */
+  if (grub_disk_read (disk, data->fat_sector, fat_offset,
+		      (data->fat_size + 7) >> 3,
+		      (char *) &next_cluster))
+    return grub_errno;
+
+  next_cluster = grub_le_to_cpu32 (next_cluster);
+  switch (data->fat_size)
+    {
+    case 16:
+      next_cluster &= 0xFFFF;
+      break;
+    case 12:
+      if (cluster & 1)
+	next_cluster >>= 4;
+
+      next_cluster &= 0x0FFF;
+      break;
+    }
+
+  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
+		data->fat_size, next_cluster);
+
+  if (next_cluster < data->cluster_eof_mark
+      && (next_cluster < 2 || next_cluster >= data->num_clusters))
+    return grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
+		       next_cluster);
+
+  *next = next_cluster;
+  return GRUB_ERR_NONE;
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
 		    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
@@ -494,69 +549,41 @@ grub_fat_read_data (grub_disk_t disk, struct grub_fat_data *data,
 
   while (len)
     {
+      grub_uint32_t next_cluster;
+
       while (logical_cluster > data->cur_cluster_num)
 	{
 	  /* Find next cluster.  */
-	  grub_uint32_t next_cluster;
-	  unsigned long fat_offset;
-
-	  switch (data->fat_size)
-	    {
-	    case 32:
-	      fat_offset = data->cur_cluster << 2;
-	      break;
-	    case 16:
-	      fat_offset = data->cur_cluster << 1;
-	      break;
-	    default:
-	      /* case 12: */
-	      fat_offset = data->cur_cluster + (data->cur_cluster >> 1);
-	      break;
-	    }
-
-	  /* Read the FAT.  */
-	  if (grub_disk_read (disk, data->fat_sector, fat_offset,
-			      (data->fat_size + 7) >> 3,
-			      (char *) &next_cluster))
+	  if (grub_fat_next_cluster (disk, data, data->cur_cluster,
+				     &next_cluster))
 	    return -1;
 
-	  next_cluster = grub_le_to_cpu32 (next_cluster);
-	  switch (data->fat_size)
-	    {
-	    case 16:
-	      next_cluster &= 0xFFFF;
-	      break;
-	    case 12:
-	      if (data->cur_cluster & 1)
-		next_cluster >>= 4;
-
-	      next_cluster &= 0x0FFF;
-	      break;
-	    }
-
-	  grub_dprintf ("fat", "fat_size=%d, next_cluster=%u\n",
-			data->fat_size, next_cluster);
-
 	  /* Check the end.  */
 	  if (next_cluster >= data->cluster_eof_mark)
 	    return ret;
 
-	  if (next_cluster < 2 || next_cluster >= data->num_clusters)
-	    {
-	      grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u",
-			  next_cluster);
-	      return -1;
-	    }
-
 	  data->cur_cluster = next_cluster;
 	  data->cur_cluster_num++;
 	}
 
-      /* Read the data here.  */
+      /* Read the data here, extended over the following clusters as long
+	 as they are contiguous on disk.  */
       sector = (data->cluster_sector
 		+ ((data->cur_cluster - 2)
 		   << data->cluster_bits));
       size = (1 << logical_cluster_bits) - offset;
+      while (size < len)
+	{
+	  if (grub_fat_next_cluster (disk, data, data->cur_cluster,
+				     &next_cluster))
+	    return -1;
+	  if (next_cluster != data->cur_cluster + 1)
+	    break;
+	  data->cur_cluster = next_cluster;
+	  data->cur_cluster_num++;
+	  logical_cluster++;
+	  size += 1 << logical_cluster_bits;
+	}
       if (size > len)
 	size = len;
 
@@ -1139,6 +1166,15 @@ grub_fat_uuid (grub_device_t device, char **uuid)
   return grub_errno;
 }
 
+#ifdef MODE_EXFAT
+/* OEM name in the boot sector.  Plain FAT has no reliable signature.  */
+static const struct grub_fs_magic grub_exfat_magic[] =
+  {
+    { 3, "EXFAT   ", 8 },
+    { 0, 0, 0 }
+  };
+#endif
+
 static struct grub_fs grub_fat_fs =
   {
 #ifdef MODE_EXFAT
@@ -1152,6 +1188,9 @@ static struct grub_fs grub_fat_fs =
     .close = grub_fat_close,
     .label = grub_fat_label,
     .uuid = grub_fat_uuid,
+#ifdef MODE_EXFAT
+    .magic = grub_exfat_magic,
+#endif
 #ifdef GRUB_UTIL
 #ifdef MODE_EXFAT
     /* ExFAT BPB is 30 larger than FAT32 one.  */
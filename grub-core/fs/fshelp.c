@@ -21,31 +21,202 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/fshelp.h>
 #include <grub/dl.h>
 #include <grub/i18n.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
-/* Lookup the node PATH.  The node ROOTNODE describes the root of the
-   directory tree.  The node found is returned in FOUNDNODE, which is
-   either a ROOTNODE or a new malloc'ed node.  ITERATE_DIR is used to
-   iterate over all directory entries in the current node.
-   READ_SYMLINK is used to read the symlink if a node is a symlink.
-   EXPECTTYPE is the type node that is expected by the called, an
-   error is generated if the node is not of the expected type.  Make
-   sure you use the NESTED_FUNC_ATTR macro for HOOK, this is required
-   because GCC has a nasty bug when using regparm=3.  */
-grub_err_t
-grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
-		       grub_fshelp_node_t *foundnode,
-		       int (*iterate_dir) (grub_fshelp_node_t dir,
-					   int NESTED_FUNC_ATTR (*hook)
-					   (const char *filename,
-					    enum grub_fshelp_filetype filetype,
-					    grub_fshelp_node_t node)),
-		       char *(*read_symlink) (grub_fshelp_node_t node),
-		       enum grub_fshelp_filetype expecttype)
+/* Lookups are remembered across mounts, keyed by the disk, the filesystem
+   and the path from the root, until the disk cache is dropped.  */
+#define GRUB_FSHELP_CACHE_BUCKETS	64
+#define GRUB_FSHELP_CACHE_MAX		256
+
+/* What a cached lookup was done on.  */
+struct grub_fshelp_mount
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+  const char *fsname;
+  grub_fshelp_node_t rootnode;
+  grub_fshelp_node_t (*dup_node) (grub_fshelp_node_t node,
+				  grub_fshelp_node_t root);
+};
+
+struct grub_fshelp_dentry
+{
+  struct grub_fshelp_dentry *next;
+  struct grub_fshelp_dentry *lru_prev;
+  struct grub_fshelp_dentry *lru_next;
+  grub_uint32_t hash;
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t part_start;
+  /* The node with symlinks followed, or NULL if the path doesn't exist.
+     It refers to the mount it was found on, which may be gone.  */
+  grub_fshelp_node_t node;
+  enum grub_fshelp_filetype type;
+  /* The filesystem name, then the path.  */
+  char key[0];
+};
+
+static struct grub_fshelp_dentry *dentry_table[GRUB_FSHELP_CACHE_BUCKETS];
+/* Most recently used first.  */
+static struct grub_fshelp_dentry *dentry_lru_head, *dentry_lru_tail;
+static unsigned dentry_count;
+static grub_uint32_t dentry_disk_generation, dentry_dev_generation;
+
+static grub_uint32_t
+dentry_hash (struct grub_fshelp_mount *mount, const char *path)
+{
+  grub_uint32_t hash = mount->dev_id * 31 + mount->disk_id;
+  const char *p;
+
+  hash = hash * 31 + (grub_uint32_t) mount->part_start;
+  for (p = mount->fsname; *p; p++)
+    hash = hash * 31 + (grub_uint8_t) *p;
+  for (p = path; *p; p++)
+    hash = hash * 31 + (grub_uint8_t) *p;
+  return hash;
+}
+
+static void
+dentry_lru_unlink (struct grub_fshelp_dentry *d)
+{
+  if (d->lru_prev)
+    d->lru_prev->lru_next = d->lru_next;
+  else
+    dentry_lru_head = d->lru_next;
+  if (d->lru_next)
+    d->lru_next->lru_prev = d->lru_prev;
+  else
+    dentry_lru_tail = d->lru_prev;
+}
+
+static void
+dentry_lru_link (struct grub_fshelp_dentry *d)
+{
+  d->lru_prev = NULL;
+  d->lru_next = dentry_lru_head;
+  if (dentry_lru_head)
+    dentry_lru_head->lru_prev = d;
+  else
+    dentry_lru_tail = d;
+  dentry_lru_head = d;
+}
+
+static void
+dentry_remove (struct grub_fshelp_dentry *d)
+{
+  struct grub_fshelp_dentry **p;
+
+  for (p = &dentry_table[d->hash % GRUB_FSHELP_CACHE_BUCKETS]; *p;
+       p = &(*p)->next)
+    if (*p == d)
+      {
+	*p = d->next;
+	break;
+      }
+  dentry_lru_unlink (d);
+  dentry_count--;
+  grub_free (d->node);
+  grub_free (d);
+}
+
+static void
+dentry_flush (void)
+{
+  while (dentry_lru_head)
+    dentry_remove (dentry_lru_head);
+}
+
+static struct grub_fshelp_dentry *
+dentry_find (struct grub_fshelp_mount *mount, const char *path)
+{
+  struct grub_fshelp_dentry *d;
+  grub_uint32_t hash;
+
+  if (dentry_disk_generation != grub_disk_cache_generation
+      || dentry_dev_generation != grub_disk_dev_generation)
+    {
+      dentry_flush ();
+      dentry_disk_generation = grub_disk_cache_generation;
+      dentry_dev_generation = grub_disk_dev_generation;
+      return NULL;
+    }
+
+  hash = dentry_hash (mount, path);
+  for (d = dentry_table[hash % GRUB_FSHELP_CACHE_BUCKETS]; d; d = d->next)
+    if (d->hash == hash && d->dev_id == mount->dev_id
+	&& d->disk_id == mount->disk_id && d->part_start == mount->part_start
+	&& grub_strcmp (d->key, mount->fsname) == 0
+	&& grub_strcmp (d->key + grub_strlen (d->key) + 1, path) == 0)
+      {
+	dentry_lru_unlink (d);
+	dentry_lru_link (d);
+	return d;
+      }
+  return NULL;
+}
+
+/* Remember that PATH is NODE of TYPE, or doesn't exist if NODE is NULL.
+   Failing to is not an error.  */
+static void
+dentry_add (struct grub_fshelp_mount *mount, const char *path,
+	    grub_fshelp_node_t node, enum grub_fshelp_filetype type)
+{
+  struct grub_fshelp_dentry *d;
+  grub_size_t fsname_len = grub_strlen (mount->fsname) + 1;
+
+  while (dentry_count >= GRUB_FSHELP_CACHE_MAX)
+    dentry_remove (dentry_lru_tail);
+
+  d = grub_malloc (sizeof (*d) + fsname_len + grub_strlen (path) + 1);
+  if (!d)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  d->node = NULL;
+  if (node)
+    {
+      d->node = mount->dup_node (node, mount->rootnode);
+      if (!d->node)
+	{
+	  grub_free (d);
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+    }
+  d->type = type;
+  d->hash = dentry_hash (mount, path);
+  d->dev_id = mount->dev_id;
+  d->disk_id = mount->disk_id;
+  d->part_start = mount->part_start;
+  grub_memcpy (d->key, mount->fsname, fsname_len);
+  grub_strcpy (d->key + fsname_len, path);
+
+  d->next = dentry_table[d->hash % GRUB_FSHELP_CACHE_BUCKETS];
+  dentry_table[d->hash % GRUB_FSHELP_CACHE_BUCKETS] = d;
+  dentry_lru_link (d);
+  dentry_count++;
+}
+
+/* Look up PATH, remembering what is found in the cache if MOUNT is not
+   NULL.  */
+static grub_err_t
+find_file_real (const char *path, grub_fshelp_node_t rootnode,
+		grub_fshelp_node_t *foundnode,
+		int (*iterate_dir) (grub_fshelp_node_t dir,
+				    int NESTED_FUNC_ATTR (*hook)
+				    (const char *filename,
+				     enum grub_fshelp_filetype filetype,
+				     grub_fshelp_node_t node)),
+		char *(*read_symlink) (grub_fshelp_node_t node),
+		enum grub_fshelp_filetype expecttype,
+		struct grub_fshelp_mount *mount)
 {
   grub_err_t err;
   enum grub_fshelp_filetype foundtype = GRUB_FSHELP_DIR;
@@ -53,11 +224,14 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 
   auto grub_err_t NESTED_FUNC_ATTR find_file (const char *currpath,
 					      grub_fshelp_node_t currroot,
-					      grub_fshelp_node_t *currfound);
+					      grub_fshelp_node_t *currfound,
+					      const char *currprefix);
 
+  /* CURRPREFIX is the path of CURRROOT from the root.  */
   grub_err_t NESTED_FUNC_ATTR find_file (const char *currpath,
 					 grub_fshelp_node_t currroot,
-					 grub_fshelp_node_t *currfound)
+					 grub_fshelp_node_t *currfound,
+					 const char *currprefix)
     {
       char fpath[grub_strlen (currpath) + 1];
       char *name = fpath;
@@ -65,6 +239,10 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
       enum grub_fshelp_filetype type = GRUB_FSHELP_DIR;
       grub_fshelp_node_t currnode = currroot;
       grub_fshelp_node_t oldnode = currroot;
+      /* The path of the current node from the root.  */
+      char cpath[mount ? grub_strlen (currprefix) + grub_strlen (currpath) + 2
+		 : 1];
+      grub_size_t cpath_len = 0;
 
       auto int NESTED_FUNC_ATTR iterate (const char *filename,
 					 enum grub_fshelp_filetype filetype,
@@ -100,6 +278,11 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	}
 
       grub_strncpy (fpath, currpath, grub_strlen (currpath) + 1);
+      if (mount)
+	{
+	  grub_strcpy (cpath, currprefix);
+	  cpath_len = grub_strlen (cpath);
+	}
 
       /* Remove all leading slashes.  */
       while (*name == '/')
@@ -114,6 +297,7 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
       for (;;)
 	{
 	  int found;
+	  grub_size_t parent_len = cpath_len;
 
 	  /* Extract the actual part from the pathname.  */
 	  next = grub_strchr (name, '/');
@@ -132,6 +316,37 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	      return grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("not a directory"));
 	    }
 
+	  if (mount)
+	    {
+	      struct grub_fshelp_dentry *d;
+
+	      cpath[cpath_len++] = '/';
+	      grub_strcpy (cpath + cpath_len, name);
+	      cpath_len += grub_strlen (name);
+
+	      d = dentry_find (mount, cpath);
+	      if (d && !d->node)
+		{
+		  free_node (currnode);
+		  break;
+		}
+	      if (d)
+		{
+		  grub_fshelp_node_t node;
+
+		  node = mount->dup_node (d->node, rootnode);
+		  if (!node)
+		    {
+		      free_node (currnode);
+		      return grub_errno;
+		    }
+		  type = d->type;
+		  oldnode = currnode;
+		  currnode = node;
+		  goto cached;
+		}
+	    }
+
 	  /* Iterate over the directory.  */
 	  found = iterate_dir (currnode, iterate);
 	  if (! found)
@@ -140,6 +355,8 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	      if (grub_errno)
 		return grub_errno;
 
+	      if (mount)
+		dentry_add (mount, cpath, NULL, GRUB_FSHELP_UNKNOWN);
 	      break;
 	    }
 
@@ -147,6 +364,7 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 	  if (type == GRUB_FSHELP_SYMLINK)
 	    {
 	      char *symlink;
+	      char parent[parent_len + 1];
 
 	      /* Test if the symlink does not loop.  */
 	      if (++symlinknest == 8)
@@ -166,15 +384,20 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 		  return grub_errno;
 		}
 
+	      /* The symlink is relative to the directory it is in.  */
+	      grub_memcpy (parent, cpath, parent_len);
+	      parent[parent_len] = '\0';
+
 	      /* The symlink is an absolute path, go back to the root inode.  */
 	      if (symlink[0] == '/')
 		{
 		  free_node (oldnode);
 		  oldnode = rootnode;
+		  parent[0] = '\0';
 		}
 
 	      /* Lookup the node the symlink points to.  */
-	      find_file (symlink, oldnode, &currnode);
+	      find_file (symlink, oldnode, &currnode, parent);
 	      type = foundtype;
 	      grub_free (symlink);
 
@@ -185,6 +408,10 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
 		}
 	    }
 
+	  if (mount)
+	    dentry_add (mount, cpath, currnode, type);
+
+	cached:
 	  free_node (oldnode);
 
 	  /* Found the node!  */
@@ -207,7 +434,7 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
       return grub_errno;
     }
 
-  err = find_file (path, rootnode, foundnode);
+  err = find_file (path, rootnode, foundnode, "");
   if (err)
     return err;
 
@@ -220,83 +447,214 @@ grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
   return 0;
 }
 
+/* Lookup the node PATH.  The node ROOTNODE describes the root of the
+   directory tree.  The node found is returned in FOUNDNODE, which is
+   either a ROOTNODE or a new malloc'ed node.  ITERATE_DIR is used to
+   iterate over all directory entries in the current node.
+   READ_SYMLINK is used to read the symlink if a node is a symlink.
+   EXPECTTYPE is the type node that is expected by the called, an
+   error is generated if the node is not of the expected type.  Make
+   sure you use the NESTED_FUNC_ATTR macro for HOOK, this is required
+   because GCC has a nasty bug when using regparm=3.  */
+grub_err_t
+grub_fshelp_find_file (const char *path, grub_fshelp_node_t rootnode,
+		       grub_fshelp_node_t *foundnode,
+		       int (*iterate_dir) (grub_fshelp_node_t dir,
+					   int NESTED_FUNC_ATTR (*hook)
+					   (const char *filename,
+					    enum grub_fshelp_filetype filetype,
+					    grub_fshelp_node_t node)),
+		       char *(*read_symlink) (grub_fshelp_node_t node),
+		       enum grub_fshelp_filetype expecttype)
+{
+  return find_file_real (path, rootnode, foundnode, iterate_dir,
+			 read_symlink, expecttype, NULL);
+}
+
+grub_err_t
+grub_fshelp_find_file_cached (const char *path, grub_fshelp_node_t rootnode,
+			      grub_fshelp_node_t *foundnode,
+			      int (*iterate_dir) (grub_fshelp_node_t dir,
+						  int NESTED_FUNC_ATTR (*hook)
+						  (const char *filename,
+						   enum grub_fshelp_filetype filetype,
+						   grub_fshelp_node_t node)),
+			      char *(*read_symlink) (grub_fshelp_node_t node),
+			      enum grub_fshelp_filetype expecttype,
+			      grub_disk_t disk, const char *fsname,
+			      grub_fshelp_node_t (*dup_node) (grub_fshelp_node_t node,
+							      grub_fshelp_node_t root))
+{
+  struct grub_fshelp_mount mount;
+
+  mount.dev_id = disk->dev->id;
+  mount.disk_id = disk->id;
+  mount.part_start = grub_partition_get_start (disk->partition);
+  mount.fsname = fsname;
+  mount.rootnode = rootnode;
+  mount.dup_node = dup_node;
+
+  return find_file_real (path, rootnode, foundnode, iterate_dir,
+			 read_symlink, expecttype, &mount);
+}
+
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
-   beginning with the block POS.  READ_HOOK should be set before
-   reading a block from the file.  GET_BLOCK is used to translate file
-   blocks to disk blocks.  The file is FILESIZE bytes big and the
-   blocks have a size of LOG2BLOCKSIZE (in log2).  */
-grub_ssize_t
-grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
-		       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
-                                                           unsigned offset,
-                                                           unsigned length),
-		       grub_off_t pos, grub_size_t len, char *buf,
-		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
-                                                      grub_disk_addr_t block),
-		       grub_off_t filesize, int log2blocksize,
-		       grub_disk_addr_t blocks_start)
+   beginning with the byte POS.  File blocks are translated to disk blocks
+   either one at a time with GET_BLOCK or a run at a time with GET_EXTENT.
+   Blocks which are contiguous on disk are read with a single request.  */
+static grub_ssize_t
+grub_fshelp_read_file_real (grub_disk_t disk, grub_fshelp_node_t node,
+			    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+								unsigned offset,
+								unsigned length),
+			    grub_off_t pos, grub_size_t len, char *buf,
+			    grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+							   grub_disk_addr_t block),
+			    grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+							    grub_disk_addr_t block,
+							    grub_disk_addr_t *count),
+			    grub_off_t filesize, int log2blocksize,
+			    grub_disk_addr_t blocks_start)
 {
-  grub_disk_addr_t i, blockcnt;
-  int blocksize = 1 << (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  grub_disk_addr_t i, firstblock, blockcnt;
+  int log2bytes = log2blocksize + GRUB_DISK_SECTOR_BITS;
+  grub_size_t blocksize = (grub_size_t) 1 << log2bytes;
+  /* The pending run of contiguous data: disk sector, offset in it, length
+     and destination.  */
+  grub_disk_addr_t run_sector = 0;
+  grub_off_t run_offset = 0;
+  grub_size_t run_len = 0;
+  char *run_buf = buf;
+
+  auto int flush_run (void);
+  int flush_run (void)
+  {
+    if (!run_len)
+      return 0;
+    disk->read_hook = read_hook;
+    grub_disk_read (disk, run_sector, run_offset, run_len, run_buf);
+    disk->read_hook = 0;
+    run_len = 0;
+    return grub_errno;
+  }
 
   /* Adjust LEN so it we can't read past the end of the file.  */
+  if (pos > filesize)
+    return 0;
   if (pos + len > filesize)
     len = filesize - pos;
+  if (!len)
+    return 0;
 
-  blockcnt = ((len + pos) + blocksize - 1) >> (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  firstblock = pos >> log2bytes;
+  blockcnt = ((len + pos) + blocksize - 1) >> log2bytes;
 
-  for (i = pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS); i < blockcnt; i++)
+  for (i = firstblock; i < blockcnt; )
     {
-      grub_disk_addr_t blknr;
-      int blockoff = pos & (blocksize - 1);
-      int blockend = blocksize;
-
-      int skipfirst = 0;
+      grub_disk_addr_t blknr, count = 1;
+      grub_size_t skipfirst = 0, chunk;
 
-      blknr = get_block (node, i);
+      if (get_extent)
+	blknr = get_extent (node, i, &count);
+      else
+	blknr = get_block (node, i);
       if (grub_errno)
 	return -1;
 
-      blknr = blknr << log2blocksize;
+      if (count == 0 || count > blockcnt - i)
+	count = blockcnt - i;
 
-      /* Last block.  */
-      if (i == blockcnt - 1)
-	{
-	  blockend = (len + pos) & (blocksize - 1);
-
-	  /* The last portion is exactly blocksize.  */
-	  if (! blockend)
-	    blockend = blocksize;
-	}
+      chunk = count << log2bytes;
 
       /* First block.  */
-      if (i == (pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS)))
+      if (i == firstblock)
 	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
+	  skipfirst = pos & (blocksize - 1);
+	  chunk -= skipfirst;
 	}
 
-      /* If the block number is 0 this block is not stored on disk but
-	 is zero filled instead.  */
+      /* Last block.  */
+      if (i + count == blockcnt && ((len + pos) & (blocksize - 1)))
+	chunk -= blocksize - ((len + pos) & (blocksize - 1));
+
+      /* If the block number is 0 these blocks are not stored on disk but
+	 are zero filled instead.  */
       if (blknr)
 	{
-	  disk->read_hook = read_hook;
+	  grub_disk_addr_t sector = (blknr << log2blocksize) + blocks_start;
 
-	  grub_disk_read (disk, blknr + blocks_start, skipfirst,
-			  blockend, buf);
-	  disk->read_hook = 0;
-	  if (grub_errno)
-	    return -1;
+	  if (run_len
+	      && (run_sector << GRUB_DISK_SECTOR_BITS) + run_offset + run_len
+	      == (sector << GRUB_DISK_SECTOR_BITS) + skipfirst)
+	    run_len += chunk;
+	  else
+	    {
+	      if (flush_run ())
+		return -1;
+	      run_sector = sector;
+	      run_offset = skipfirst;
+	      run_len = chunk;
+	      run_buf = buf;
+	    }
 	}
       else
-	grub_memset (buf, 0, blockend);
+	{
+	  if (flush_run ())
+	    return -1;
+	  grub_memset (buf, 0, chunk);
+	}
 
-      buf += blocksize - skipfirst;
+      buf += chunk;
+      i += count;
     }
 
+  if (flush_run ())
+    return -1;
+
   return len;
 }
 
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the block POS.  READ_HOOK should be set before
+   reading a block from the file.  GET_BLOCK is used to translate file
+   blocks to disk blocks.  The file is FILESIZE bytes big and the
+   blocks have a size of LOG2BLOCKSIZE (in log2).  */
+grub_ssize_t
+grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
+		       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+                                                           unsigned offset,
+                                                           unsigned length),
+		       grub_off_t pos, grub_size_t len, char *buf,
+		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+                                                      grub_disk_addr_t block),
+		       grub_off_t filesize, int log2blocksize,
+		       grub_disk_addr_t blocks_start)
+{
+  return grub_fshelp_read_file_real (disk, node, read_hook, pos, len, buf,
+				     get_block, 0, filesize, log2blocksize,
+				     blocks_start);
+}
+
+/* Like grub_fshelp_read_file, but GET_EXTENT translates the file block
+   BLOCK to a disk block and stores in *COUNT how many file blocks starting
+   at BLOCK are contiguous on disk, so a whole extent costs one lookup.  */
+grub_ssize_t
+grub_fshelp_read_file_extents (grub_disk_t disk, grub_fshelp_node_t node,
+			       void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+								   unsigned offset,
+								   unsigned length),
+			       grub_off_t pos, grub_size_t len, char *buf,
+			       grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+							       grub_disk_addr_t block,
+							       grub_disk_addr_t *count),
+			       grub_off_t filesize, int log2blocksize,
+			       grub_disk_addr_t blocks_start)
+{
+  return grub_fshelp_read_file_real (disk, node, read_hook, pos, len, buf,
+				     0, get_extent, filesize, log2blocksize,
+				     blocks_start);
+}
+
 unsigned int
 grub_fshelp_log2blksize (unsigned int blksize, unsigned int *pow)
 {
@@ -317,3 +675,8 @@ grub_fshelp_log2blksize (unsigned int blksize, unsigned int *pow)
 
   return GRUB_ERR_NONE;
 }
+
+GRUB_MOD_FINI(fshelp)
+{
+  dentry_flush ();
+}
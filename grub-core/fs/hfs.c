@@ -1348,6 +1348,12 @@ grub_hfs_uuid (grub_device_t device, char **uuid)
 
 
 
+static const struct grub_fs_magic grub_hfs_magic[] =
+  {
+    { GRUB_HFS_SBLOCK << GRUB_DISK_SECTOR_BITS, "BD", 2 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_hfs_fs =
   {
     .name = "hfs",
@@ -1358,6 +1364,7 @@ static struct grub_fs grub_hfs_fs =
     .label = grub_hfs_label,
     .uuid = grub_hfs_uuid,
     .mtime = grub_hfs_mtime,
+    .magic = grub_hfs_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
@@ -757,6 +757,20 @@ grub_hfsplus_btree_search (struct grub_hfsplus_btree *btree,
     }
 }
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.  */
+static grub_fshelp_node_t
+grub_hfsplus_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+
+  copy = grub_malloc (sizeof (*node));
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, sizeof (*node));
+  copy->data = root->data;
+  return copy;
+}
+
 static int
 grub_hfsplus_iterate_dir (grub_fshelp_node_t dir,
 			  int NESTED_FUNC_ATTR
@@ -894,9 +908,10 @@ grub_hfsplus_open (struct grub_file *file, const char *name)
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (name, &data->dirroot, &fdiro,
-			 grub_hfsplus_iterate_dir,
-			 grub_hfsplus_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (name, &data->dirroot, &fdiro,
+				grub_hfsplus_iterate_dir,
+				grub_hfsplus_read_symlink, GRUB_FSHELP_REG,
+				data->disk, "hfsplus", grub_hfsplus_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -974,9 +989,10 @@ grub_hfsplus_dir (grub_device_t device, const char *path,
     goto fail;
 
   /* Find the directory that should be opened.  */
-  grub_fshelp_find_file (path, &data->dirroot, &fdiro,
-			 grub_hfsplus_iterate_dir,
-			 grub_hfsplus_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->dirroot, &fdiro,
+				grub_hfsplus_iterate_dir,
+				grub_hfsplus_read_symlink, GRUB_FSHELP_DIR,
+				data->disk, "hfsplus", grub_hfsplus_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -1100,6 +1116,15 @@ grub_hfsplus_uuid (grub_device_t device, char **uuid)
 
 
 
+/* HFS+, HFSX, or an HFS wrapper around an embedded HFS+.  */
+static const struct grub_fs_magic grub_hfsplus_magic[] =
+  {
+    { GRUB_HFSPLUS_SBLOCK << GRUB_DISK_SECTOR_BITS, "H+", 2 },
+    { GRUB_HFSPLUS_SBLOCK << GRUB_DISK_SECTOR_BITS, "HX", 2 },
+    { GRUB_HFSPLUS_SBLOCK << GRUB_DISK_SECTOR_BITS, "BD", 2 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_hfsplus_fs =
   {
     .name = "hfsplus",
@@ -1110,6 +1135,7 @@ static struct grub_fs grub_hfsplus_fs =
     .label = grub_hfsplus_label,
     .mtime = grub_hfsplus_mtime,
     .uuid = grub_hfsplus_uuid,
+    .magic = grub_hfsplus_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
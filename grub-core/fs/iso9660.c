@@ -519,6 +519,39 @@ get_node_size (grub_fshelp_node_t node)
   return ret;
 }
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.
+   The symlink, if any, follows the directory entries in use.  */
+static grub_fshelp_node_t
+grub_iso9660_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+  grub_size_t ndirents, size;
+
+  ndirents = node->have_dirents;
+  if (ndirents < ARRAY_SIZE (node->dirents))
+    ndirents = ARRAY_SIZE (node->dirents);
+  size = sizeof (*node)
+    + (ndirents - ARRAY_SIZE (node->dirents)) * sizeof (node->dirents[0]);
+  if (node->have_symlink)
+    {
+      const char *symlink = node->symlink
+	+ node->have_dirents * sizeof (node->dirents[0])
+	- sizeof (node->dirents);
+      grub_size_t end = symlink - (const char *) node
+	+ grub_strlen (symlink) + 1;
+      if (end > size)
+	size = end;
+    }
+
+  copy = grub_malloc (size);
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, size);
+  copy->data = root->data;
+  copy->alloc_dirents = ndirents;
+  return copy;
+}
+
 static int
 grub_iso9660_iterate_dir (grub_fshelp_node_t dir,
 			  int NESTED_FUNC_ATTR
@@ -883,11 +916,11 @@ grub_iso9660_dir (grub_device_t device, const char *path,
   rootnode.dirents[0] = data->voldesc.rootdir;
 
   /* Use the fshelp function to traverse the path.  */
-  if (grub_fshelp_find_file (path, &rootnode,
-			     &foundnode,
-			     grub_iso9660_iterate_dir,
-			     grub_iso9660_read_symlink,
-			     GRUB_FSHELP_DIR))
+  if (grub_fshelp_find_file_cached (path, &rootnode, &foundnode,
+				    grub_iso9660_iterate_dir,
+				    grub_iso9660_read_symlink, GRUB_FSHELP_DIR,
+				    data->disk, "iso9660",
+				    grub_iso9660_dup_node))
     goto fail;
 
   /* List the files in the directory.  */
@@ -926,11 +959,11 @@ grub_iso9660_open (struct grub_file *file, const char *name)
   rootnode.dirents[0] = data->voldesc.rootdir;
 
   /* Use the fshelp function to traverse the path.  */
-  if (grub_fshelp_find_file (name, &rootnode,
-			     &foundnode,
-			     grub_iso9660_iterate_dir,
-			     grub_iso9660_read_symlink,
-			     GRUB_FSHELP_REG))
+  if (grub_fshelp_find_file_cached (name, &rootnode, &foundnode,
+				    grub_iso9660_iterate_dir,
+				    grub_iso9660_read_symlink, GRUB_FSHELP_REG,
+				    data->disk, "iso9660",
+				    grub_iso9660_dup_node))
     goto fail;
 
   data->node = foundnode;
@@ -1093,6 +1126,14 @@ grub_iso9660_mtime (grub_device_t device, grub_int32_t *timebuf)
 
 
 
+/* The first volume descriptor.  */
+static const struct grub_fs_magic grub_iso9660_magic[] =
+  {
+    { (16 << (GRUB_ISO9660_LOG2_BLKSZ + GRUB_DISK_SECTOR_BITS)) + 1,
+      "CD001", 5 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_iso9660_fs =
   {
     .name = "iso9660",
@@ -1103,6 +1144,7 @@ static struct grub_fs grub_iso9660_fs =
     .label = grub_iso9660_label,
     .uuid = grub_iso9660_uuid,
     .mtime = grub_iso9660_mtime,
+    .magic = grub_iso9660_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
@@ -927,6 +927,12 @@ grub_jfs_label (grub_device_t device, char **label)
 }
 
 
+static const struct grub_fs_magic grub_jfs_magic[] =
+  {
+    { GRUB_JFS_SBLOCK << GRUB_DISK_SECTOR_BITS, "JFS1", 4 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_jfs_fs =
   {
     .name = "jfs",
@@ -936,6 +942,7 @@ static struct grub_fs grub_jfs_fs =
     .close = grub_jfs_close,
     .label = grub_jfs_label,
     .uuid = grub_jfs_uuid,
+    .magic = grub_jfs_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
@@ -864,6 +864,20 @@ grub_nilfs2_read_symlink (grub_fshelp_node_t node)
   return symlink;
 }
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.  */
+static grub_fshelp_node_t
+grub_nilfs2_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+
+  copy = grub_malloc (sizeof (*node));
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, sizeof (*node));
+  copy->data = root->data;
+  return copy;
+}
+
 static int
 grub_nilfs2_iterate_dir (grub_fshelp_node_t dir,
 			 int NESTED_FUNC_ATTR
@@ -976,9 +990,10 @@ grub_nilfs2_open (struct grub_file *file, const char *name)
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (name, &data->diropen, &fdiro,
-			 grub_nilfs2_iterate_dir, grub_nilfs2_read_symlink,
-			 GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (name, &data->diropen, &fdiro,
+				grub_nilfs2_iterate_dir,
+				grub_nilfs2_read_symlink, GRUB_FSHELP_REG,
+				data->disk, "nilfs2", grub_nilfs2_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -1070,9 +1085,10 @@ grub_nilfs2_dir (grub_device_t device, const char *path,
   if (!data)
     goto fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro,
-			 grub_nilfs2_iterate_dir, grub_nilfs2_read_symlink,
-			 GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->diropen, &fdiro,
+				grub_nilfs2_iterate_dir,
+				grub_nilfs2_read_symlink, GRUB_FSHELP_DIR,
+				data->disk, "nilfs2", grub_nilfs2_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -1253,6 +1253,13 @@ grub_ntfs_uuid (grub_device_t device, char **uuid)
   return grub_errno;
 }
 
+/* OEM name in the boot sector.  */
+static const struct grub_fs_magic grub_ntfs_magic[] =
+  {
+    { 3, "NTFS", 4 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_ntfs_fs =
   {
     .name = "ntfs",
@@ -1262,6 +1269,7 @@ static struct grub_fs grub_ntfs_fs =
     .close = grub_ntfs_close,
     .label = grub_ntfs_label,
     .uuid = grub_ntfs_uuid,
+    .magic = grub_ntfs_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
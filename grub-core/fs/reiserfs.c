@@ -1372,6 +1372,13 @@ grub_reiserfs_uuid (grub_device_t device, char **uuid)
   return grub_errno;
 }
 
+static const struct grub_fs_magic grub_reiserfs_magic[] =
+  {
+    { REISERFS_SUPER_BLOCK_OFFSET + 52, REISERFS_MAGIC_STRING,
+      sizeof (REISERFS_MAGIC_STRING) - 1 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_reiserfs_fs =
   {
     .name = "reiserfs",
@@ -1381,6 +1388,7 @@ static struct grub_fs grub_reiserfs_fs =
     .close = grub_reiserfs_close,
     .label = grub_reiserfs_label,
     .uuid = grub_reiserfs_uuid,
+    .magic = grub_reiserfs_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 1,
     .blocklist_install = 1,
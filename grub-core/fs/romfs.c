@@ -454,6 +454,12 @@ grub_romfs_label (grub_device_t device, char **label)
 }
 
 
+static const struct grub_fs_magic grub_romfs_magic[] =
+  {
+    { 0, GRUB_ROMFS_MAGIC, sizeof (GRUB_ROMFS_MAGIC) - 1 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_romfs_fs =
   {
     .name = "romfs",
@@ -462,6 +468,7 @@ static struct grub_fs grub_romfs_fs =
     .read = grub_romfs_read,
     .close = grub_romfs_close,
     .label = grub_romfs_label,
+    .magic = grub_romfs_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 0,
     .blocklist_install = 0,
@@ -26,6 +26,7 @@
 #include <grub/types.h>
 #include <grub/fshelp.h>
 #include <grub/deflate.h>
+#include <grub/lz4.h>
 #include <minilzo.h>
 
 #include "xz.h"
@@ -183,6 +184,7 @@ enum
     COMPRESSION_ZLIB = 1,
     COMPRESSION_LZO = 3,
     COMPRESSION_XZ = 4,
+    COMPRESSION_LZ4 = 5,
   };
 
 
@@ -315,6 +317,32 @@ lzo_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
   return len;
 }
 
+static grub_ssize_t
+lz4_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
+		char *outbuf, grub_size_t len, struct grub_squash_data *data)
+{
+  grub_size_t usize = data->blksz;
+  grub_uint8_t *udata;
+
+  if (usize < 8192)
+    usize = 8192;
+
+  udata = grub_malloc (usize);
+  if (!udata)
+    return -1;
+
+  if (grub_lz4_decompress (inbuf, insize, udata, usize)
+      < (grub_ssize_t) (off + len))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "incorrect compressed chunk");
+      grub_free (udata);
+      return -1;
+    }
+  grub_memcpy (outbuf, udata + off, len);
+  grub_free (udata);
+  return len;
+}
+
 static grub_ssize_t
 xz_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
 	       char *outbuf, grub_size_t len, struct grub_squash_data *data)
@@ -419,6 +447,9 @@ squash_mount (grub_disk_t disk)
     case grub_cpu_to_le16_compile_time (COMPRESSION_LZO):
       data->decompress = lzo_decompress;
       break;
+    case grub_cpu_to_le16_compile_time (COMPRESSION_LZ4):
+      data->decompress = lz4_decompress;
+      break;
     case grub_cpu_to_le16_compile_time (COMPRESSION_XZ):
       data->decompress = xz_decompress;
       data->xzbuf = grub_malloc (XZBUFSIZ);
@@ -472,6 +503,20 @@ grub_squash_read_symlink (grub_fshelp_node_t node)
   return ret;
 }
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.  */
+static grub_fshelp_node_t
+grub_squash_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+
+  copy = grub_malloc (sizeof (*node));
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, sizeof (*node));
+  copy->data = root->data;
+  return copy;
+}
+
 static int
 grub_squash_iterate_dir (grub_fshelp_node_t dir,
 			 int NESTED_FUNC_ATTR
@@ -631,8 +676,9 @@ grub_squash_dir (grub_device_t device, const char *path,
   if (err)
     return err;
 
-  grub_fshelp_find_file (path, &root, &fdiro, grub_squash_iterate_dir,
-			 grub_squash_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &root, &fdiro, grub_squash_iterate_dir,
+				grub_squash_read_symlink, GRUB_FSHELP_DIR,
+				data->disk, "squash4", grub_squash_dup_node);
   if (!grub_errno)
     grub_squash_iterate_dir (fdiro, iterate);
 
@@ -657,8 +703,9 @@ grub_squash_open (struct grub_file *file, const char *name)
   if (err)
     return err;
 
-  grub_fshelp_find_file (name, &root, &fdiro, grub_squash_iterate_dir,
-			 grub_squash_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (name, &root, &fdiro, grub_squash_iterate_dir,
+				grub_squash_read_symlink, GRUB_FSHELP_REG,
+				data->disk, "squash4", grub_squash_dup_node);
   if (grub_errno)
     {
       squash_unmount (data);
@@ -927,6 +974,13 @@ grub_squash_mtime (grub_device_t dev, grub_int32_t *tm)
   return GRUB_ERR_NONE;
 } 
 
+static const struct grub_fs_magic grub_squash_magic[] =
+  {
+    /* SQUASH_MAGIC, little endian.  */
+    { 0, "hsqs", 4 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_squash_fs =
   {
     .name = "squash4",
@@ -935,6 +989,7 @@ static struct grub_fs grub_squash_fs =
     .read = grub_squash_read,
     .close = grub_squash_close,
     .mtime = grub_squash_mtime,
+    .magic = grub_squash_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 0,
     .blocklist_install = 0,
@@ -841,6 +841,20 @@ read_string (const grub_uint8_t *raw, grub_size_t sz, char *outbuf)
   return outbuf;
 }
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.  */
+static grub_fshelp_node_t
+grub_udf_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+
+  copy = grub_malloc (get_fshelp_size (root->data));
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, get_fshelp_size (root->data));
+  copy->data = root->data;
+  return copy;
+}
+
 static int
 grub_udf_iterate_dir (grub_fshelp_node_t dir,
 		      int NESTED_FUNC_ATTR
@@ -1077,10 +1091,10 @@ grub_udf_dir (grub_device_t device, const char *path,
   if (grub_udf_read_icb (data, &data->root_icb, rootnode))
     goto fail;
 
-  if (grub_fshelp_find_file (path, rootnode,
-			     &foundnode,
-			     grub_udf_iterate_dir, grub_udf_read_symlink,
-			     GRUB_FSHELP_DIR))
+  if (grub_fshelp_find_file_cached (path, rootnode, &foundnode,
+				    grub_udf_iterate_dir,
+				    grub_udf_read_symlink, GRUB_FSHELP_DIR,
+				    data->disk, "udf", grub_udf_dup_node))
     goto fail;
 
   grub_udf_iterate_dir (foundnode, iterate);
@@ -1118,10 +1132,10 @@ grub_udf_open (struct grub_file *file, const char *name)
   if (grub_udf_read_icb (data, &data->root_icb, rootnode))
     goto fail;
 
-  if (grub_fshelp_find_file (name, rootnode,
-			     &foundnode,
-			     grub_udf_iterate_dir, grub_udf_read_symlink,
-			     GRUB_FSHELP_REG))
+  if (grub_fshelp_find_file_cached (name, rootnode, &foundnode,
+				    grub_udf_iterate_dir,
+				    grub_udf_read_symlink, GRUB_FSHELP_REG,
+				    data->disk, "udf", grub_udf_dup_node))
     goto fail;
 
   file->data = foundnode;
@@ -275,8 +275,11 @@ grub_xfs_read_inode (struct grub_xfs_data *data, grub_uint64_t ino,
 }
 
 
+/* Translate FILEBLOCK of NODE to a disk block and store in *COUNT how many
+   blocks from FILEBLOCK belong to the same extent (or hole).  */
 static grub_disk_addr_t
-grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		     grub_disk_addr_t *count)
 {
   struct grub_xfs_btree_node *leaf = 0;
   int ex, nrec;
@@ -363,10 +366,14 @@ grub_xfs_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 
       /* Sparse block.  */
       if (fileblock < offset)
-        break;
+        {
+          *count = offset - fileblock;
+          break;
+        }
       else if (fileblock < offset + size)
         {
           ret = (fileblock - offset + start);
+          *count = offset + size - fileblock;
           break;
         }
     }
@@ -385,11 +392,11 @@ grub_xfs_read_file (grub_fshelp_node_t node,
 					unsigned offset, unsigned length),
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node, read_hook,
-				pos, len, buf, grub_xfs_read_block,
-				grub_be_to_cpu64 (node->inode.size),
-				node->data->sblock.log2_bsize
-				- GRUB_DISK_SECTOR_BITS, 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node, read_hook,
+					pos, len, buf, grub_xfs_read_block,
+					grub_be_to_cpu64 (node->inode.size),
+					node->data->sblock.log2_bsize
+					- GRUB_DISK_SECTOR_BITS, 0);
 }
 
 
@@ -443,6 +450,22 @@ grub_xfs_mode_to_filetype (grub_uint16_t mode)
 }
 
 
+/* Copy NODE, which may be from an earlier mount, for the mount of ROOT.  */
+static grub_fshelp_node_t
+grub_xfs_dup_node (grub_fshelp_node_t node, grub_fshelp_node_t root)
+{
+  grub_fshelp_node_t copy;
+  grub_size_t size = sizeof (struct grub_fshelp_node)
+    - sizeof (struct grub_xfs_inode) + (1 << root->data->sblock.log2_inode);
+
+  copy = grub_malloc (size);
+  if (!copy)
+    return NULL;
+  grub_memcpy (copy, node, size);
+  copy->data = root->data;
+  return copy;
+}
+
 static int
 grub_xfs_iterate_dir (grub_fshelp_node_t dir,
 		       int NESTED_FUNC_ATTR
@@ -737,8 +760,10 @@ grub_xfs_dir (grub_device_t device, const char *path,
   if (!data)
     goto mount_fail;
 
-  grub_fshelp_find_file (path, &data->diropen, &fdiro, grub_xfs_iterate_dir,
-			 grub_xfs_read_symlink, GRUB_FSHELP_DIR);
+  grub_fshelp_find_file_cached (path, &data->diropen, &fdiro,
+				grub_xfs_iterate_dir, grub_xfs_read_symlink,
+				GRUB_FSHELP_DIR, data->disk, "xfs",
+				grub_xfs_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -770,8 +795,10 @@ grub_xfs_open (struct grub_file *file, const char *name)
   if (!data)
     goto mount_fail;
 
-  grub_fshelp_find_file (name, &data->diropen, &fdiro, grub_xfs_iterate_dir,
-			 grub_xfs_read_symlink, GRUB_FSHELP_REG);
+  grub_fshelp_find_file_cached (name, &data->diropen, &fdiro,
+				grub_xfs_iterate_dir, grub_xfs_read_symlink,
+				GRUB_FSHELP_REG, data->disk, "xfs",
+				grub_xfs_dup_node);
   if (grub_errno)
     goto fail;
 
@@ -885,6 +912,12 @@ grub_xfs_uuid (grub_device_t device, char **uuid)
 
 
 
+static const struct grub_fs_magic grub_xfs_magic[] =
+  {
+    { 0, "XFSB", 4 },
+    { 0, 0, 0 }
+  };
+
 static struct grub_fs grub_xfs_fs =
   {
     .name = "xfs",
@@ -894,6 +927,7 @@ static struct grub_fs grub_xfs_fs =
     .close = grub_xfs_close,
     .label = grub_xfs_label,
     .uuid = grub_xfs_uuid,
+    .magic = grub_xfs_magic,
 #ifdef GRUB_UTIL
     .reserved_first_sector = 0,
     .blocklist_install = 1,
@@ -53,6 +53,8 @@
 #include <grub/zfs/dsl_dataset.h>
 #include <grub/deflate.h>
 #include <grub/crypto.h>
+#include <grub/gf256.h>
+#include <grub/lz4.h>
 #include <grub/i18n.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
@@ -208,6 +210,8 @@ struct grub_zfs_device_desc
   grub_disk_addr_t vdev_phys_sector;
   uberblock_t current_uberblock;
   int original;
+  /* DEV belongs to the pool cache.  */
+  int cached;
 };
 
 struct subvolume
@@ -251,6 +255,9 @@ struct grub_zfs_data
 
   int mounted;
   grub_uint64_t guid;
+
+  /* Cached pool whose devices this mount uses.  */
+  struct zfs_pool *pool;
 };
 
 grub_err_t (*grub_zfs_decrypt) (grub_crypto_cipher_handle_t cipher,
@@ -306,6 +313,30 @@ zle_decompress (void *s, void *d,
   return GRUB_ERR_NONE;
 }
 
+/* The LZ4 block is preceded by its big-endian size, the rest of the
+   sector is padding.  */
+static grub_err_t
+lz4_decompress (void *s, void *d,
+		grub_size_t slen, grub_size_t dlen)
+{
+  grub_uint32_t clen;
+  grub_ssize_t len;
+
+  if (slen < sizeof (clen))
+    return grub_error (GRUB_ERR_BAD_FS, "lz4 decompression failed");
+  clen = grub_be_to_cpu32 (grub_get_unaligned32 (s));
+  if (clen > slen - sizeof (clen))
+    return grub_error (GRUB_ERR_BAD_FS, "lz4 decompression failed");
+  len = grub_lz4_decompress ((grub_uint8_t *) s + sizeof (clen), clen,
+			     d, dlen);
+  if (len < 0)
+    return grub_errno;
+  /* The block must fill the whole logical size.  */
+  if ((grub_size_t) len != dlen)
+    return grub_error (GRUB_ERR_BAD_FS, "lz4 decompression failed");
+  return GRUB_ERR_NONE;
+}
+
 static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
   {"inherit", NULL},		/* ZIO_COMPRESS_INHERIT */
   {"on", lzjb_decompress},	/* ZIO_COMPRESS_ON */
@@ -322,10 +353,21 @@ static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
   {"gzip-8", zlib_decompress},  /* ZIO_COMPRESS_GZIP8 */
   {"gzip-9", zlib_decompress},  /* ZIO_COMPRESS_GZIP9 */
   {"zle", zle_decompress},      /* ZIO_COMPRESS_ZLE   */
+  {"lz4", lz4_decompress},      /* ZIO_COMPRESS_LZ4   */
+};
+
+/* Features which may be active on pools we read.  The others change the
+   on-disk format in ways we don't know about.  */
+static const char *const spa_feature_names[] = {
+  "org.illumos:lz4_compress",
+  "com.delphix:hole_birth",
+  "com.delphix:extensible_dataset",
+  NULL
 };
 
 static grub_err_t zio_read_data (blkptr_t * bp, grub_zfs_endian_t endian,
 				 void *buf, struct grub_zfs_data *data);
+static grub_err_t check_features (const char *nvlist);
 
 /*
  * Our own version of log2().  Same thing as highbit()-1.
@@ -482,15 +524,13 @@ uberblock_verify (uberblock_phys_t * ub, grub_uint64_t offset,
 
   if (grub_zfs_to_cpu64 (uber->ub_magic, GRUB_ZFS_LITTLE_ENDIAN)
       == UBERBLOCK_MAGIC
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_LITTLE_ENDIAN) > 0 
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_LITTLE_ENDIAN)
-      <= SPA_VERSION)
+      && SPA_VERSION_IS_SUPPORTED (grub_zfs_to_cpu64 (uber->ub_version,
+						      GRUB_ZFS_LITTLE_ENDIAN)))
     endian = GRUB_ZFS_LITTLE_ENDIAN;
 
   if (grub_zfs_to_cpu64 (uber->ub_magic, GRUB_ZFS_BIG_ENDIAN) == UBERBLOCK_MAGIC
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_BIG_ENDIAN) > 0 
-      && grub_zfs_to_cpu64 (uber->ub_version, GRUB_ZFS_BIG_ENDIAN)
-      <= SPA_VERSION)
+      && SPA_VERSION_IS_SUPPORTED (grub_zfs_to_cpu64 (uber->ub_version,
+						      GRUB_ZFS_BIG_ENDIAN)))
     endian = GRUB_ZFS_BIG_ENDIAN;
 
   if (endian == GRUB_ZFS_UNKNOWN_ENDIAN)
@@ -837,16 +877,34 @@ check_pool_label (struct grub_zfs_data *data,
     }
   grub_dprintf ("zfs", "check 8 passed\n");
 
-  if (version > SPA_VERSION)
+  if (!SPA_VERSION_IS_SUPPORTED (version))
     {
       grub_free (nvlist);
       return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
-			 "too new version %llu > %llu",
-			 (unsigned long long) version,
-			 (unsigned long long) SPA_VERSION);
+			 "unsupported version %llu",
+			 (unsigned long long) version);
     }
   grub_dprintf ("zfs", "check 9 passed\n");
 
+  if (version >= SPA_VERSION_FEATURES)
+    {
+      char *features;
+
+      features = grub_zfs_nvlist_lookup_nvlist (nvlist,
+						ZPOOL_CONFIG_FEATURES_FOR_READ);
+      if (features)
+	{
+	  err = check_features (features);
+	  grub_free (features);
+	  if (err)
+	    {
+	      grub_free (nvlist);
+	      return err;
+	    }
+	}
+      grub_errno = GRUB_ERR_NONE;
+    }
+
   found = grub_zfs_nvlist_lookup_uint64 (nvlist, ZPOOL_CONFIG_GUID,
 					 &(diskdesc->guid));
   if (! found)
@@ -951,6 +1009,13 @@ scan_disk (grub_device_t dev, struct grub_zfs_data *data,
       grub_dprintf ("zfs", "label ok %d\n", label);
 
       err = check_pool_label (data, &desc, inserted);
+      /* Say why the pool we were asked for can't be read.  */
+      if (err == GRUB_ERR_NOT_IMPLEMENTED_YET && original)
+	{
+	  grub_free (ub_array);
+	  grub_free (bh);
+	  return err;
+	}
       if (err || !*inserted)
 	{
 	  grub_errno = GRUB_ERR_NONE;
@@ -1028,37 +1093,43 @@ scan_devices (struct grub_zfs_data *data)
   return GRUB_ERR_NONE;
 }
 
-/* x**y.  */
-static grub_uint8_t powx[255 * 2];
-/* Such an s that x**s = y */
-static int powx_inv[256];
-static const grub_uint8_t poly = 0x1d;
-
 /* perform the operation a ^= b * (x ** (known_idx * recovery_pow) ) */
 static inline void
 xor_out (grub_uint8_t *a, const grub_uint8_t *b, grub_size_t s,
 	 int known_idx, int recovery_pow)
 {
-  int add;
-
-  /* Simple xor.  */
-  if (known_idx == 0 || recovery_pow == 0)
-    {
-      grub_crypto_xor (a, a, b, s);
-      return;
-    }
-  add = (known_idx * recovery_pow) % 255;
-  for (;s--; b++, a++)
-    if (*b)
-      *a ^= powx[powx_inv[*b] + add];
+  grub_gf256_mul_xor_block (a, b,
+			    grub_gf256_pow ((known_idx * recovery_pow) % 255),
+			    s);
 }
 
-static inline grub_uint8_t
-gf_mul (grub_uint8_t a, grub_uint8_t b)
+/* Recovered data is computed this many bytes at a time.  */
+#define RECOVERY_CHUNK 1024
+
+/* bufs_j = sum (matrix_jk * bufs_k).  */
+static void
+apply_matrix (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
+	      grub_uint8_t matrix[nbufs][nbufs])
 {
-  if (a == 0 || b == 0)
-    return 0;
-  return powx[powx_inv[a] + powx_inv[b]];
+  grub_uint8_t tmp[nbufs][RECOVERY_CHUNK];
+  grub_size_t off, len;
+  int j, k;
+
+  for (off = 0; off < s; off += len)
+    {
+      len = s - off;
+      if (len > RECOVERY_CHUNK)
+	len = RECOVERY_CHUNK;
+      for (j = 0; j < nbufs; j++)
+	{
+	  grub_gf256_mul_block (tmp[j], bufs[0] + off, matrix[j][0], len);
+	  for (k = 1; k < nbufs; k++)
+	    grub_gf256_mul_xor_block (tmp[j], bufs[k] + off, matrix[j][k],
+				      len);
+	}
+      for (j = 0; j < nbufs; j++)
+	grub_memcpy (bufs[j] + off, tmp[j], len);
+    }
 }
 
 static inline grub_err_t
@@ -1076,13 +1147,10 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
     case 1:
       {
 	int add;
-	grub_uint8_t *a;
 	if (powers[0] == 0 || idx[0] == 0)
 	  return GRUB_ERR_NONE;
 	add = 255 - ((powers[0] * idx[0]) % 255);
-	for (a = bufs[0]; s--; a++)
-	  if (*a)
-	    *a = powx[powx_inv[*a] + add];
+	grub_gf256_mul_block (bufs[0], bufs[0], grub_gf256_pow (add), s);
 	return GRUB_ERR_NONE;
       }
       /* Case 2x2: Let's use the determinant formula.  */
@@ -1090,28 +1158,21 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
       {
 	grub_uint8_t det, det_inv;
 	grub_uint8_t matrixinv[2][2];
-	unsigned i;
 	/* The determinant is: */
-	det = (powx[(powers[0] * idx[0] + powers[1] * idx[1]) % 255]
-	       ^ powx[(powers[0] * idx[1] + powers[1] * idx[0]) % 255]);
+	det = (grub_gf256_pow (powers[0] * idx[0] + powers[1] * idx[1])
+	       ^ grub_gf256_pow (powers[0] * idx[1] + powers[1] * idx[0]));
 	if (det == 0)
 	  return grub_error (GRUB_ERR_BAD_FS, "singular recovery matrix");
-	det_inv = powx[255 - powx_inv[det]];
-	matrixinv[0][0] = gf_mul (powx[(powers[1] * idx[1]) % 255], det_inv);
-	matrixinv[1][1] = gf_mul (powx[(powers[0] * idx[0]) % 255], det_inv);
-	matrixinv[0][1] = gf_mul (powx[(powers[0] * idx[1]) % 255], det_inv);
-	matrixinv[1][0] = gf_mul (powx[(powers[1] * idx[0]) % 255], det_inv);
-	for (i = 0; i < s; i++)
-	  {
-	    grub_uint8_t b0, b1;
-	    b0 = bufs[0][i];
-	    b1 = bufs[1][i];
-
-	    bufs[0][i] = (gf_mul (b0, matrixinv[0][0])
-			  ^ gf_mul (b1, matrixinv[0][1]));
-	    bufs[1][i] = (gf_mul (b0, matrixinv[1][0])
-			  ^ gf_mul (b1, matrixinv[1][1]));
-	  }
+	det_inv = grub_gf256_inv (det);
+	matrixinv[0][0] = grub_gf256_mul (grub_gf256_pow (powers[1] * idx[1]),
+					    det_inv);
+	matrixinv[1][1] = grub_gf256_mul (grub_gf256_pow (powers[0] * idx[0]),
+					    det_inv);
+	matrixinv[0][1] = grub_gf256_mul (grub_gf256_pow (powers[0] * idx[1]),
+					    det_inv);
+	matrixinv[1][0] = grub_gf256_mul (grub_gf256_pow (powers[1] * idx[0]),
+					    det_inv);
+	apply_matrix (bufs, s, 2, matrixinv);
 	return GRUB_ERR_NONE;
       }
       /* Otherwise use Gauss.  */
@@ -1122,7 +1183,7 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 
 	for (i = 0; i < nbufs; i++)
 	  for (j = 0; j < nbufs; j++)
-	    matrix1[i][j] = powx[(powers[i] * idx[j]) % 255];
+	    matrix1[i][j] = grub_gf256_pow (powers[i] * idx[j]);
 	for (i = 0; i < nbufs; i++)
 	  for (j = 0; j < nbufs; j++)
 	    matrix2[i][j] = 0;
@@ -1156,18 +1217,18 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 		    matrix2[i][j] = t;
 		  }
 	      }
-	    mul = powx[255 - powx_inv[matrix1[i][i]]];
+	    mul = grub_gf256_inv (matrix1[i][i]);
 	    for (j = 0; j < nbufs; j++)
-	      matrix1[i][j] = gf_mul (matrix1[i][j], mul);
+	      matrix1[i][j] = grub_gf256_mul (matrix1[i][j], mul);
 	    for (j = 0; j < nbufs; j++)
-	      matrix2[i][j] = gf_mul (matrix2[i][j], mul);
+	      matrix2[i][j] = grub_gf256_mul (matrix2[i][j], mul);
 	    for (j = i + 1; j < nbufs; j++)
 	      {
 		mul = matrix1[j][i];
 		for (k = 0; k < nbufs; k++)
-		  matrix1[j][k] ^= gf_mul (matrix1[i][k], mul);
+		  matrix1[j][k] ^= grub_gf256_mul (matrix1[i][k], mul);
 		for (k = 0; k < nbufs; k++)
-		  matrix2[j][k] ^= gf_mul (matrix2[i][k], mul);
+		  matrix2[j][k] ^= grub_gf256_mul (matrix2[i][k], mul);
 	      }
 	  }
 	for (i = nbufs - 1; i >= 0; i--)
@@ -1177,24 +1238,13 @@ recovery (grub_uint8_t *bufs[4], grub_size_t s, const int nbufs,
 		grub_uint8_t mul;
 		mul = matrix1[j][i];
 		for (k = 0; k < nbufs; k++)
-		  matrix1[j][k] ^= gf_mul (matrix1[i][k], mul);
+		  matrix1[j][k] ^= grub_gf256_mul (matrix1[i][k], mul);
 		for (k = 0; k < nbufs; k++)
-		  matrix2[j][k] ^= gf_mul (matrix2[i][k], mul);
+		  matrix2[j][k] ^= grub_gf256_mul (matrix2[i][k], mul);
 	      }
 	  }
 
-	for (i = 0; i < (int) s; i++)
-	  {
-	    grub_uint8_t b[nbufs];
-	    for (j = 0; j < nbufs; j++)
-	      b[j] = bufs[j][i];
-	    for (j = 0; j < nbufs; j++)
-	      {
-		bufs[j][i] = 0;
-		for (k = 0; k < nbufs; k++)
-		  bufs[j][i] ^= gf_mul (matrix2[j][k], b[k]);
-	      }
-	  }
+	apply_matrix (bufs, s, nbufs, matrix2);
 	return GRUB_ERR_NONE;
       }
     }      
@@ -1324,22 +1374,6 @@ read_device (grub_uint64_t offset, struct grub_zfs_device_desc *desc,
 	    unsigned i, j;
 	    grub_err_t err;
 
-	    /* Compute mul. x**s has a period of 255.  */
-	    if (powx[0] == 0)
-	      {
-		grub_uint8_t cur = 1;
-		for (i = 0; i < 255; i++)
-		  {
-		    powx[i] = cur;
-		    powx[i + 255] = cur;
-		    powx_inv[cur] = i;
-		    if (cur & 0x80)
-		      cur = (cur << 1) ^ poly;
-		    else
-		      cur <<= 1;
-		  }
-	      }
-
 	    /* Read redundancy data.  */
 	    for (n_redundancy = 0, cur_redundancy_pow = 0;
 		 n_redundancy < failed_devices;
@@ -1551,13 +1585,190 @@ zio_read_data (blkptr_t * bp, grub_zfs_endian_t endian, void *buf,
   return err;
 }
 
+/*
+ * Cache of verified and decompressed blocks, shared by all mounts.  Blocks
+ * are never overwritten in place, so the pool and the address and birth
+ * txg of a block identify its contents for good.  Only metadata and
+ * indirect blocks are kept: file data is usually read once, and going
+ * through the cache would only cost a copy.
+ */
+#define ZFS_CACHE_BUCKETS 256
+#define ZFS_CACHE_MAX_BYTES (4 << 20)
+
+struct zfs_cache_entry
+{
+  struct zfs_cache_entry *hash_next;
+  struct zfs_cache_entry *lru_prev;
+  struct zfs_cache_entry *lru_next;
+  grub_uint64_t guid;
+  dva_t dva;
+  grub_uint64_t birth;
+  zio_cksum_t cksum;
+  grub_size_t size;
+  void *buf;
+};
+
+static struct zfs_cache_entry *zfs_cache_table[ZFS_CACHE_BUCKETS];
+/* Most recently used first.  */
+static struct zfs_cache_entry *zfs_cache_lru_head, *zfs_cache_lru_tail;
+static struct grub_zfs_cache_stats zfs_cache_stats = {
+  .max_bytes = ZFS_CACHE_MAX_BYTES
+};
+
+static inline unsigned
+zfs_cache_hash (grub_uint64_t guid, const dva_t *dva, grub_uint64_t birth)
+{
+  grub_uint64_t h = guid ^ dva->dva_word[1] ^ birth;
+
+  h ^= h >> 32;
+  h ^= h >> 13;
+  return h % ZFS_CACHE_BUCKETS;
+}
+
+static inline int
+zfs_cache_wanted (const blkptr_t *bp, grub_zfs_endian_t endian)
+{
+  grub_uint64_t prop = grub_zfs_to_cpu64 (bp->blk_prop, endian);
+
+  if (BP_IS_HOLE (bp))
+    return 0;
+  /* Indirect blocks, or anything not file contents.  */
+  return ((prop >> 56) & 0x1f) != 0
+    || ((prop >> 48) & 0xff) != DMU_OT_PLAIN_FILE_CONTENTS;
+}
+
+static void
+zfs_cache_unlink_lru (struct zfs_cache_entry *e)
+{
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    zfs_cache_lru_head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    zfs_cache_lru_tail = e->lru_prev;
+}
+
+static void
+zfs_cache_link_lru (struct zfs_cache_entry *e)
+{
+  e->lru_prev = 0;
+  e->lru_next = zfs_cache_lru_head;
+  if (zfs_cache_lru_head)
+    zfs_cache_lru_head->lru_prev = e;
+  else
+    zfs_cache_lru_tail = e;
+  zfs_cache_lru_head = e;
+}
+
+static void
+zfs_cache_remove (struct zfs_cache_entry *e)
+{
+  struct zfs_cache_entry **p;
+
+  for (p = &zfs_cache_table[zfs_cache_hash (e->guid, &e->dva, e->birth)];
+       *p != e; p = &(*p)->hash_next);
+  *p = e->hash_next;
+  zfs_cache_unlink_lru (e);
+  zfs_cache_stats.entries--;
+  zfs_cache_stats.bytes -= e->size;
+  grub_free (e->buf);
+  grub_free (e);
+}
+
+/* Return the cached block BP of pool GUID, or NULL.  The buffer stays
+   valid until the next insertion.  */
+static struct zfs_cache_entry *
+zfs_cache_find (grub_uint64_t guid, const blkptr_t *bp)
+{
+  struct zfs_cache_entry *e;
+
+  for (e = zfs_cache_table[zfs_cache_hash (guid, &bp->blk_dva[0],
+					  bp->blk_birth)];
+       e; e = e->hash_next)
+    if (e->guid == guid && e->birth == bp->blk_birth
+	&& e->dva.dva_word[0] == bp->blk_dva[0].dva_word[0]
+	&& e->dva.dva_word[1] == bp->blk_dva[0].dva_word[1]
+	&& grub_memcmp (&e->cksum, &bp->blk_cksum, sizeof (e->cksum)) == 0)
+      break;
+
+  if (!e)
+    {
+      zfs_cache_stats.misses++;
+      return 0;
+    }
+
+  zfs_cache_stats.hits++;
+  if (e != zfs_cache_lru_head)
+    {
+      zfs_cache_unlink_lru (e);
+      zfs_cache_link_lru (e);
+    }
+  return e;
+}
+
+/* Keep BUF, the SIZE bytes of block BP of pool GUID, in the cache.  The
+   cache owns BUF if this returns 1.  */
+static int
+zfs_cache_insert (grub_uint64_t guid, const blkptr_t *bp, void *buf,
+		  grub_size_t size)
+{
+  struct zfs_cache_entry *e;
+  unsigned h;
+
+  if (size > ZFS_CACHE_MAX_BYTES / 4)
+    return 0;
+
+  while (zfs_cache_lru_tail
+	 && zfs_cache_stats.bytes + size > ZFS_CACHE_MAX_BYTES)
+    {
+      zfs_cache_remove (zfs_cache_lru_tail);
+      zfs_cache_stats.evictions++;
+    }
+
+  e = grub_malloc (sizeof (*e));
+  if (!e)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  e->guid = guid;
+  e->dva = bp->blk_dva[0];
+  e->birth = bp->blk_birth;
+  e->cksum = bp->blk_cksum;
+  e->size = size;
+  e->buf = buf;
+
+  h = zfs_cache_hash (guid, &bp->blk_dva[0], bp->blk_birth);
+  e->hash_next = zfs_cache_table[h];
+  zfs_cache_table[h] = e;
+  zfs_cache_link_lru (e);
+  zfs_cache_stats.entries++;
+  zfs_cache_stats.bytes += size;
+  return 1;
+}
+
+static void
+zfs_cache_clear (void)
+{
+  while (zfs_cache_lru_head)
+    zfs_cache_remove (zfs_cache_lru_head);
+}
+
+void
+grub_zfs_cache_get_performance (struct grub_zfs_cache_stats *stats)
+{
+  *stats = zfs_cache_stats;
+}
+
 /*
  * Read in a block of data, verify its checksum, decompress if needed,
  * and put the uncompressed data in buf.
  */
 static grub_err_t
-zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf, 
-	  grub_size_t *size, struct grub_zfs_data *data)
+zio_read_real (blkptr_t *bp, grub_zfs_endian_t endian, void **buf, 
+	       grub_size_t *size, struct grub_zfs_data *data)
 {
   grub_size_t lsize, psize;
   unsigned int comp, encrypted;
@@ -1686,6 +1897,49 @@ zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf,
   return GRUB_ERR_NONE;
 }
 
+/* Same as zio_read_real, through the block cache.  */
+static grub_err_t
+zio_read (blkptr_t *bp, grub_zfs_endian_t endian, void **buf, 
+	  grub_size_t *size, struct grub_zfs_data *data)
+{
+  struct zfs_cache_entry *e;
+  grub_size_t lsize;
+  void *copy;
+  grub_err_t err;
+
+  if (!zfs_cache_wanted (bp, endian))
+    return zio_read_real (bp, endian, buf, size, data);
+
+  e = zfs_cache_find (data->guid, bp);
+  if (e)
+    {
+      *buf = grub_malloc (e->size);
+      if (!*buf)
+	return grub_errno;
+      grub_memcpy (*buf, e->buf, e->size);
+      if (size)
+	*size = e->size;
+      return GRUB_ERR_NONE;
+    }
+
+  err = zio_read_real (bp, endian, buf, &lsize, data);
+  if (size)
+    *size = lsize;
+  if (err)
+    return err;
+
+  copy = grub_malloc (lsize);
+  if (!copy)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return GRUB_ERR_NONE;
+    }
+  grub_memcpy (copy, *buf, lsize);
+  if (!zfs_cache_insert (data->guid, bp, copy, lsize))
+    grub_free (copy);
+  return GRUB_ERR_NONE;
+}
+
 /*
  * Get the block from a block id.
  * push the block onto the stack.
@@ -1697,9 +1951,11 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
 {
   int level;
   grub_off_t idx;
-  blkptr_t *bp_array = dn->dn.dn_blkptr;
+  const blkptr_t *bp_array = dn->dn.dn_blkptr;
   int epbs = dn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
   blkptr_t *bp;
+  /* The indirect block BP_ARRAY points to if we have to free it, rather
+     than it being the dnode's or in the block cache.  */
   void *tmpbuf = 0;
   grub_zfs_endian_t endian;
   grub_err_t err = GRUB_ERR_NONE;
@@ -1714,11 +1970,9 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
       grub_dprintf ("zfs", "endian = %d\n", endian);
       idx = (blkid >> (epbs * level)) & ((1 << epbs) - 1);
       *bp = bp_array[idx];
-      if (bp_array != dn->dn.dn_blkptr)
-	{
-	  grub_free (bp_array);
-	  bp_array = 0;
-	}
+      grub_free (tmpbuf);
+      tmpbuf = 0;
+      bp_array = 0;
 
       if (BP_IS_HOLE (bp))
 	{
@@ -1726,7 +1980,7 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
 						dn->endian) 
 	    << SPA_MINBLOCKSHIFT;
 	  *buf = grub_malloc (size);
-	  if (*buf)
+	  if (!*buf)
 	    {
 	      err = grub_errno;
 	      break;
@@ -1743,14 +1997,29 @@ dmu_read (dnode_end_t * dn, grub_uint64_t blkid, void **buf,
 	  break;
 	}
       grub_dprintf ("zfs", "endian = %d\n", endian);
-      err = zio_read (bp, endian, &tmpbuf, 0, data);
+
+      /* Indirect blocks are used right from the cache, only the one block
+	 pointer we need is copied out before anything else is read.  */
+      {
+	struct zfs_cache_entry *e;
+	grub_size_t size;
+
+	e = zfs_cache_find (data->guid, bp);
+	if (e)
+	  bp_array = e->buf;
+	else
+	  {
+	    err = zio_read_real (bp, endian, &tmpbuf, &size, data);
+	    if (err)
+	      break;
+	    bp_array = tmpbuf;
+	    if (zfs_cache_insert (data->guid, bp, tmpbuf, size))
+	      tmpbuf = 0;
+	  }
+      }
       endian = (grub_zfs_to_cpu64 (bp->blk_prop, endian) >> 63) & 1;
-      if (err)
-	break;
-      bp_array = tmpbuf;
     }
-  if (bp_array != dn->dn.dn_blkptr)
-    grub_free (bp_array);
+  grub_free (tmpbuf);
   if (endian_out)
     *endian_out = endian;
 
@@ -3134,6 +3403,80 @@ nvlist_find_value (const char *nvlist_in, const char *name,
   return 0;
 }
 
+/* Call HOOK with the name of every pair in NVLIST until it returns
+   non-zero.  */
+static int
+nvlist_iterate_names (const char *nvlist_in,
+		      int NESTED_FUNC_ATTR (*hook) (const char *name,
+						    grub_size_t name_len))
+{
+  int name_len, encode_size;
+  const char *nvlist = nvlist_in;
+
+  if (nvlist[0] != NV_ENCODE_XDR || (nvlist[1] != NV_LITTLE_ENDIAN 
+				     && nvlist[1] != NV_BIG_ENDIAN))
+    {
+      grub_error (GRUB_ERR_BAD_FS, "incorrect nvlist");
+      return 0;
+    }
+
+  nvlist = nvlist + 4 * 3;
+  while ((encode_size = grub_be_to_cpu32 (grub_get_unaligned32 (nvlist))))
+    {
+      if (encode_size < 0
+	  || nvlist + 4 * 4 >= nvlist_in + VDEV_PHYS_SIZE
+	  || nvlist + encode_size > nvlist_in + VDEV_PHYS_SIZE)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect nvlist");
+	  return 0;
+	}
+
+      name_len = grub_be_to_cpu32 (grub_get_unaligned32 (nvlist + 4 * 2));
+      if (name_len < 0 || 4 * 3 + name_len > encode_size)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "incorrect nvlist");
+	  return 0;
+	}
+      if (hook (nvlist + 4 * 3, name_len))
+	return 1;
+
+      nvlist += encode_size;
+    }
+  return 0;
+}
+
+/* Fail if NVLIST, the features_for_read of a pool, names one we don't
+   know.  */
+static grub_err_t
+check_features (const char *nvlist)
+{
+  auto int NESTED_FUNC_ATTR check (const char *name, grub_size_t name_len);
+  int NESTED_FUNC_ATTR check (const char *name, grub_size_t name_len)
+  {
+    char *copy;
+    unsigned i;
+
+    if (name_len && !name[name_len - 1])
+      name_len--;
+    for (i = 0; spa_feature_names[i]; i++)
+      if (grub_strlen (spa_feature_names[i]) == name_len
+	  && grub_memcmp (spa_feature_names[i], name, name_len) == 0)
+	return 0;
+
+    copy = grub_strndup (name, name_len);
+    if (copy)
+      {
+	grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		    "unsupported zpool feature %s", copy);
+	grub_free (copy);
+      }
+    return 1;
+  }
+
+  nvlist_iterate_names (nvlist, check);
+  return grub_errno;
+}
+
 int
 grub_zfs_nvlist_lookup_uint64 (const char *nvlist, const char *name,
 			       grub_uint64_t * out)
@@ -3295,7 +3638,7 @@ unmount_device (struct grub_zfs_device_desc *desc)
   switch (desc->type)
     {
     case DEVICE_LEAF:
-      if (!desc->original && desc->dev)
+      if (!desc->original && !desc->cached && desc->dev)
 	grub_device_close (desc->dev);
       return;
     case DEVICE_RAIDZ:
@@ -3307,13 +3650,334 @@ unmount_device (struct grub_zfs_device_desc *desc)
     }
 }
 
+/* Pools seen so far, so that opening another file doesn't have to look at
+   every disk again.  An entry is good as long as the label of the device
+   being mounted still points to the same txg and no disk has come or gone.
+   It owns the devices of its leaf vdevs, except for the ones which were
+   only ever passed to zfs_mount.  An outdated entry is dropped from the
+   list at once but freed only when no mount uses it any longer.  */
+struct zfs_pool
+{
+  struct zfs_pool *next;
+  grub_uint64_t guid;
+  grub_uint64_t txg;
+  grub_uint32_t generation;
+  unsigned refs;
+  int dead;
+  struct grub_zfs_device_desc *devices;
+  unsigned n_devices;
+  dnode_end_t mos;
+};
+
+static struct zfs_pool *zfs_pools;
+
+static grub_uint64_t
+uberblock_txg (const uberblock_t *ub)
+{
+  grub_zfs_endian_t ub_endian;
+
+  ub_endian = (grub_zfs_to_cpu64 (ub->ub_magic,
+				  GRUB_ZFS_LITTLE_ENDIAN) == UBERBLOCK_MAGIC
+	       ? GRUB_ZFS_LITTLE_ENDIAN : GRUB_ZFS_BIG_ENDIAN);
+  return grub_zfs_to_cpu64 (ub->ub_txg, ub_endian);
+}
+
+static void
+pool_free_device (struct grub_zfs_device_desc *desc)
+{
+  unsigned i;
+
+  if (desc->type == DEVICE_LEAF)
+    {
+      if (desc->dev)
+	grub_device_close (desc->dev);
+      return;
+    }
+  if (!desc->children)
+    return;
+  for (i = 0; i < desc->n_children; i++)
+    pool_free_device (&desc->children[i]);
+  grub_free (desc->children);
+}
+
+static void
+pool_free (struct zfs_pool *pool)
+{
+  unsigned i;
+
+  for (i = 0; i < pool->n_devices; i++)
+    pool_free_device (&pool->devices[i]);
+  grub_free (pool->devices);
+  grub_free (pool);
+}
+
+static void
+pools_clear (void)
+{
+  struct zfs_pool *next;
+
+  for (; zfs_pools; zfs_pools = next)
+    {
+      next = zfs_pools->next;
+      if (zfs_pools->refs)
+	zfs_pools->dead = 1;
+      else
+	pool_free (zfs_pools);
+    }
+}
+
+static struct zfs_pool *
+pool_find (grub_uint64_t guid, grub_uint64_t txg)
+{
+  struct zfs_pool *pool, **prev;
+
+  for (prev = &zfs_pools; *prev; prev = &(*prev)->next)
+    if ((*prev)->guid == guid)
+      break;
+  pool = *prev;
+  if (pool && (pool->txg != txg
+	       || pool->generation != grub_disk_dev_generation))
+    {
+      grub_dprintf ("zfs", "pool %016llx changed\n",
+		    (unsigned long long) guid);
+      *prev = pool->next;
+      pool->dead = 1;
+      if (!pool->refs)
+	pool_free (pool);
+      pool = 0;
+    }
+  return pool;
+}
+
+/* Copy the cached SRC into the tree of a mount.  */
+static grub_err_t
+pool_clone_device (struct grub_zfs_device_desc *dst,
+		   const struct grub_zfs_device_desc *src)
+{
+  unsigned i;
+  grub_err_t err;
+
+  *dst = *src;
+  dst->children = 0;
+  dst->original = 0;
+  dst->cached = (src->dev != 0);
+  if (src->type == DEVICE_LEAF || !src->children)
+    return GRUB_ERR_NONE;
+
+  dst->children = grub_zalloc (src->n_children * sizeof (dst->children[0]));
+  if (!dst->children)
+    return grub_errno;
+  for (i = 0; i < src->n_children; i++)
+    {
+      err = pool_clone_device (&dst->children[i], &src->children[i]);
+      if (err)
+	return err;
+    }
+  return GRUB_ERR_NONE;
+}
+
+/* Hand over to the cached DST what SRC has found and DST hasn't,
+   in particular the devices SRC opened itself.  */
+static grub_err_t
+pool_merge_device (struct grub_zfs_device_desc *dst,
+		   struct grub_zfs_device_desc *src)
+{
+  unsigned i;
+  grub_err_t err;
+
+  /* Not filled in yet.  */
+  if (!dst->guid)
+    {
+      *dst = *src;
+      dst->dev = 0;
+      dst->children = 0;
+      dst->n_children = 0;
+      dst->original = 0;
+      dst->cached = 0;
+    }
+
+  if (dst->type != src->type || dst->guid != src->guid)
+    return GRUB_ERR_NONE;
+
+  if (src->type == DEVICE_LEAF)
+    {
+      if (!dst->dev && src->dev && !src->original && !src->cached)
+	{
+	  dst->dev = src->dev;
+	  dst->vdev_phys_sector = src->vdev_phys_sector;
+	  dst->current_uberblock = src->current_uberblock;
+	  src->cached = 1;
+	}
+      return GRUB_ERR_NONE;
+    }
+
+  if (!src->children)
+    return GRUB_ERR_NONE;
+  if (!dst->children)
+    {
+      dst->children = grub_zalloc (src->n_children
+				   * sizeof (dst->children[0]));
+      if (!dst->children)
+	return grub_errno;
+      dst->n_children = src->n_children;
+    }
+  if (dst->n_children != src->n_children)
+    return GRUB_ERR_NONE;
+
+  for (i = 0; i < src->n_children; i++)
+    {
+      err = pool_merge_device (&dst->children[i], &src->children[i]);
+      if (err)
+	return err;
+    }
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_zfs_device_desc *
+find_leaf (struct grub_zfs_device_desc *desc, grub_uint64_t guid)
+{
+  struct grub_zfs_device_desc *ret;
+  unsigned i;
+
+  if (desc->type == DEVICE_LEAF)
+    return desc->guid == guid ? desc : 0;
+  if (!desc->children)
+    return 0;
+  for (i = 0; i < desc->n_children; i++)
+    {
+      ret = find_leaf (&desc->children[i], guid);
+      if (ret)
+	return ret;
+    }
+  return 0;
+}
+
+/* Remember what mounted DATA has found out about its pool.  */
+static void
+pool_store (struct grub_zfs_data *data)
+{
+  struct zfs_pool *pool;
+  grub_uint64_t txg;
+  unsigned i, j;
+
+  /* Keep whatever error the caller is about to return.  */
+  grub_error_push ();
+
+  txg = uberblock_txg (&data->current_uberblock);
+  pool = pool_find (data->guid, txg);
+  if (!pool)
+    {
+      pool = grub_zalloc (sizeof (*pool));
+      if (!pool)
+	goto out;
+      pool->guid = data->guid;
+      pool->txg = txg;
+      pool->generation = grub_disk_dev_generation;
+      pool->mos = data->mos;
+      pool->next = zfs_pools;
+      zfs_pools = pool;
+    }
+
+  for (i = 0; i < data->n_devices_attached; i++)
+    {
+      for (j = 0; j < pool->n_devices; j++)
+	if (pool->devices[j].id == data->devices_attached[i].id)
+	  break;
+      if (j == pool->n_devices)
+	{
+	  struct grub_zfs_device_desc *tmp;
+
+	  tmp = grub_realloc (pool->devices,
+			      (j + 1) * sizeof (pool->devices[0]));
+	  if (!tmp)
+	    break;
+	  pool->devices = tmp;
+	  grub_memset (&pool->devices[j], 0, sizeof (pool->devices[j]));
+	  pool->n_devices++;
+	}
+      if (pool_merge_device (&pool->devices[j], &data->devices_attached[i]))
+	break;
+    }
+
+ out:
+  grub_error_pop ();
+}
+
+/* Replace the vdev tree and MOS which scan_disk has just begun with the
+   cached ones if they are still good.  Return 1 if they were.  */
+static int
+pool_load (struct grub_zfs_data *data)
+{
+  struct zfs_pool *pool;
+  struct grub_zfs_device_desc *devices, *orig, *leaf = 0;
+  unsigned i;
+
+  pool = pool_find (data->guid, uberblock_txg (&data->current_uberblock));
+  if (!pool || !pool->n_devices || !data->device_original)
+    return 0;
+
+  devices = grub_zalloc (pool->n_devices * sizeof (devices[0]));
+  if (!devices)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+  for (i = 0; i < pool->n_devices; i++)
+    if (pool_clone_device (&devices[i], &pool->devices[i]))
+      break;
+
+  orig = data->device_original;
+  if (i == pool->n_devices)
+    for (i = 0; i < pool->n_devices && !leaf; i++)
+      leaf = find_leaf (&devices[i], orig->guid);
+
+  if (!leaf)
+    {
+      for (i = 0; i < pool->n_devices; i++)
+	unmount_device (&devices[i]);
+      grub_free (devices);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  if (!leaf->dev)
+    {
+      leaf->dev = orig->dev;
+      leaf->vdev_phys_sector = orig->vdev_phys_sector;
+      leaf->current_uberblock = orig->current_uberblock;
+      leaf->original = orig->original;
+      leaf->cached = 0;
+    }
+
+  /* The tree scan_disk has built holds only the device we were given.  */
+  for (i = 0; i < data->n_devices_attached; i++)
+    unmount_device (&data->devices_attached[i]);
+  grub_free (data->devices_attached);
+
+  data->devices_attached = devices;
+  data->n_devices_attached = pool->n_devices;
+  data->n_devices_allocated = pool->n_devices;
+  data->device_original = leaf;
+  data->mos = pool->mos;
+  data->pool = pool;
+  pool->refs++;
+
+  grub_dprintf ("zfs", "pool %016llx from cache\n",
+		(unsigned long long) data->guid);
+  return 1;
+}
+
 static void
 zfs_unmount (struct grub_zfs_data *data)
 {
   unsigned i;
+  if (data->mounted)
+    pool_store (data);
   for (i = 0; i < data->n_devices_attached; i++)
     unmount_device (&data->devices_attached[i]);
   grub_free (data->devices_attached);
+  if (data->pool && !--data->pool->refs && data->pool->dead)
+    pool_free (data->pool);
   grub_free (data->dnode_buf);
   grub_free (data->dnode_mdn);
   grub_free (data->file_buf);
@@ -3365,6 +4029,14 @@ zfs_mount (grub_device_t dev)
       return NULL;
     }
 
+  /* The label of DEV is enough to tell whether what we know about its
+     pool is still current.  */
+  if (pool_load (data))
+    {
+      data->mounted = 1;
+      return data;
+    }
+
   ub = &(data->current_uberblock);
   ub_endian = (grub_zfs_to_cpu64 (ub->ub_magic, 
 				  GRUB_ZFS_LITTLE_ENDIAN) == UBERBLOCK_MAGIC 
@@ -3971,4 +4643,6 @@ GRUB_MOD_INIT (zfs)
 GRUB_MOD_FINI (zfs)
 {
   grub_fs_unregister (&grub_zfs_fs);
+  pools_clear ();
+  zfs_cache_clear ();
 }
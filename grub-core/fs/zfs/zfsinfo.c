@@ -324,6 +324,21 @@ grub_cmd_zfsinfo (grub_command_t cmd __attribute__ ((unused)), int argc,
   grub_free (nv);
   grub_free (nvlist);
 
+  {
+    struct grub_zfs_cache_stats stats;
+    unsigned long total;
+
+    grub_zfs_cache_get_performance (&stats);
+    total = stats.hits + stats.misses;
+    grub_printf_ (N_("Block cache: %lu hits, %lu misses, %lu%% hit rate, "
+		     "%lu evictions\n"),
+		  stats.hits, stats.misses,
+		  total ? (stats.hits * 100) / total : 0, stats.evictions);
+    grub_printf_ (N_("Block cache: %lu blocks, %lu of %lu KiB\n"),
+		  stats.entries, (unsigned long) (stats.bytes >> 10),
+		  (unsigned long) (stats.max_bytes >> 10));
+  }
+
   return GRUB_ERR_NONE;
 }
 
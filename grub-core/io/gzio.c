@@ -57,6 +57,38 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 #define INBUFSIZ  0x2000
 
+/* Checkpoints are taken every GZIO_CHECKPOINT_INTERVAL windows at first.
+   When GZIO_MAX_CHECKPOINTS have been taken, the interval is doubled and
+   every other checkpoint is dropped, so memory use stays bounded while
+   seeking never costs more than one interval of decompression.  */
+#define GZIO_CHECKPOINT_INTERVAL	32
+#define GZIO_MAX_CHECKPOINTS		64
+
+/* A snapshot of the decompressor state after a whole window, from which
+   decompression can be resumed.  */
+struct grub_gzio_checkpoint
+{
+  /* The uncompressed offset of the end of the window.  */
+  grub_off_t out_offset;
+  /* The compressed input position and bit buffer.  */
+  grub_off_t in_offset;
+  unsigned long bb;
+  unsigned bk;
+  /* The same for the start of the current block, after its type, to
+     rebuild its Huffman tables.  */
+  grub_off_t block_in_offset;
+  unsigned long block_bb;
+  unsigned block_bk;
+  int block_type;
+  int block_len;
+  int last_block;
+  int code_state;
+  unsigned inflate_n;
+  unsigned inflate_d;
+  /* The window preceding OUT_OFFSET.  */
+  grub_uint8_t slide[WSIZE];
+};
+
 /* The state stored in filesystem-specific data.  */
 struct grub_gzio
 {
@@ -82,6 +114,13 @@ struct grub_gzio
   /* The input buffer.  */
   grub_uint8_t inbuf[INBUFSIZ];
   int inbuf_d;
+  /* The offset of INBUF in the underlying file.  */
+  grub_off_t inbuf_off;
+  /* The input position and bit buffer at the start of the current block,
+     after its type.  */
+  grub_off_t block_in_offset;
+  unsigned long block_bb;
+  unsigned block_bk;
   /* The bit buffer.  */
   unsigned long bb;
   /* The bits in the bit buffer.  */
@@ -100,6 +139,11 @@ struct grub_gzio
   int bd;
   /* The original offset value.  */
   grub_off_t saved_offset;
+  /* Seek checkpoints, sorted by offset.  */
+  struct grub_gzio_checkpoint *checkpoints[GZIO_MAX_CHECKPOINTS];
+  unsigned num_checkpoints;
+  /* The current interval between checkpoints, in windows.  */
+  unsigned checkpoint_interval;
 };
 typedef struct grub_gzio *grub_gzio_t;
 
@@ -383,12 +427,22 @@ get_byte (grub_gzio_t gzio)
 		     || gzio->inbuf_d == INBUFSIZ))
     {
       gzio->inbuf_d = 0;
+      gzio->inbuf_off = grub_file_tell (gzio->file);
       grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
     }
 
   return gzio->inbuf[gzio->inbuf_d++];
 }
 
+/* Return the offset of the next input byte.  */
+static grub_off_t
+gzio_tell (grub_gzio_t gzio)
+{
+  if (gzio->mem_input)
+    return gzio->mem_input_off;
+  return gzio->inbuf_off + gzio->inbuf_d;
+}
+
 static void
 gzio_seek (grub_gzio_t gzio, grub_off_t off)
 {
@@ -404,6 +458,18 @@ gzio_seek (grub_gzio_t gzio, grub_off_t off)
     grub_file_seek (gzio->file, off);
 }
 
+/* Continue reading input at OFF with the bit buffer set to BB and BK.  */
+static void
+gzio_seek_bits (grub_gzio_t gzio, grub_off_t off, unsigned long bb,
+		unsigned bk)
+{
+  gzio_seek (gzio, off);
+  /* Force a refill of the input buffer.  */
+  gzio->inbuf_d = INBUFSIZ;
+  gzio->bb = bb;
+  gzio->bk = bk;
+}
+
 /* more function prototypes */
 static int huft_build (unsigned *, unsigned, unsigned, ush *, ush *,
 		       struct huft **, int *);
@@ -1016,6 +1082,10 @@ get_new_block (grub_gzio_t gzio)
   gzio->bb = b;
   gzio->bk = k;
 
+  gzio->block_in_offset = gzio_tell (gzio);
+  gzio->block_bb = b;
+  gzio->block_bk = k;
+
   switch (gzio->block_type)
     {
     case INFLATE_STORED:
@@ -1118,6 +1188,124 @@ initialize_tables (grub_gzio_t gzio)
   /* Reset memory allocation stuff.  */
   huft_free (gzio->tl);
   huft_free (gzio->td);
+  gzio->tl = 0;
+  gzio->td = 0;
+}
+
+/* Record a checkpoint at the current window if it falls on the
+   checkpoint interval.  */
+static void
+add_checkpoint (grub_gzio_t gzio)
+{
+  struct grub_gzio_checkpoint *cp;
+  grub_off_t window = gzio->saved_offset / WSIZE;
+
+  if (!gzio->checkpoint_interval)
+    gzio->checkpoint_interval = GZIO_CHECKPOINT_INTERVAL;
+
+  if (window % gzio->checkpoint_interval != 0
+      || (gzio->num_checkpoints
+	  && gzio->checkpoints[gzio->num_checkpoints - 1]->out_offset
+	  >= gzio->saved_offset))
+    return;
+
+  if (gzio->num_checkpoints == GZIO_MAX_CHECKPOINTS)
+    {
+      unsigned i, j;
+
+      /* Keep every other checkpoint.  */
+      gzio->checkpoint_interval *= 2;
+      for (i = 0, j = 0; i < gzio->num_checkpoints; i++)
+	if ((gzio->checkpoints[i]->out_offset / WSIZE)
+	    % gzio->checkpoint_interval == 0)
+	  gzio->checkpoints[j++] = gzio->checkpoints[i];
+	else
+	  grub_free (gzio->checkpoints[i]);
+      gzio->num_checkpoints = j;
+      if (window % gzio->checkpoint_interval != 0)
+	return;
+    }
+
+  cp = grub_malloc (sizeof (*cp));
+  if (!cp)
+    {
+      /* Checkpoints are only an optimization.  */
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+
+  cp->out_offset = gzio->saved_offset;
+  cp->in_offset = gzio_tell (gzio);
+  cp->bb = gzio->bb;
+  cp->bk = gzio->bk;
+  cp->block_in_offset = gzio->block_in_offset;
+  cp->block_bb = gzio->block_bb;
+  cp->block_bk = gzio->block_bk;
+  cp->block_type = gzio->block_type;
+  cp->block_len = gzio->block_len;
+  cp->last_block = gzio->last_block;
+  cp->code_state = gzio->code_state;
+  cp->inflate_n = gzio->inflate_n;
+  cp->inflate_d = gzio->inflate_d;
+  grub_memcpy (cp->slide, gzio->slide, WSIZE);
+
+  gzio->checkpoints[gzio->num_checkpoints++] = cp;
+}
+
+/* Return the last checkpoint whose window contains OFFSET or precedes
+   it, or NULL if there is none.  */
+static struct grub_gzio_checkpoint *
+find_checkpoint (grub_gzio_t gzio, grub_off_t offset)
+{
+  unsigned lo = 0, hi = gzio->num_checkpoints;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+      if (gzio->checkpoints[mid]->out_offset <= offset + WSIZE)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo ? gzio->checkpoints[lo - 1] : 0;
+}
+
+static void
+restore_checkpoint (grub_gzio_t gzio, struct grub_gzio_checkpoint *cp)
+{
+  huft_free (gzio->tl);
+  huft_free (gzio->td);
+  gzio->tl = 0;
+  gzio->td = 0;
+
+  /* Rebuild the Huffman tables of the block in progress.  */
+  if (cp->block_len && cp->block_type == INFLATE_FIXED)
+    init_fixed_block (gzio);
+  else if (cp->block_len && cp->block_type == INFLATE_DYNAMIC)
+    {
+      gzio_seek_bits (gzio, cp->block_in_offset, cp->block_bb, cp->block_bk);
+      init_dynamic_block (gzio);
+    }
+  /* The input has moved and the tables are gone, so start over.  */
+  if (grub_errno != GRUB_ERR_NONE)
+    {
+      initialize_tables (gzio);
+      return;
+    }
+
+  gzio_seek_bits (gzio, cp->in_offset, cp->bb, cp->bk);
+  gzio->block_in_offset = cp->block_in_offset;
+  gzio->block_bb = cp->block_bb;
+  gzio->block_bk = cp->block_bk;
+  gzio->block_type = cp->block_type;
+  gzio->block_len = cp->block_len;
+  gzio->last_block = cp->last_block;
+  gzio->code_state = cp->code_state;
+  gzio->inflate_n = cp->inflate_n;
+  gzio->inflate_d = cp->inflate_d;
+  grub_memcpy (gzio->slide, cp->slide, WSIZE);
+  gzio->saved_offset = cp->out_offset;
 }
 
 
@@ -1204,9 +1392,15 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
 		     char *buf, grub_size_t len)
 {
   grub_ssize_t ret = 0;
-
-  /* Do we reset decompression to the beginning of the file?  */
-  if (gzio->saved_offset > offset + WSIZE)
+  struct grub_gzio_checkpoint *cp;
+
+  /* Resume from the nearest checkpoint when seeking backward, or forward
+     past one.  Otherwise a backward seek restarts from the beginning.  */
+  cp = find_checkpoint (gzio, offset);
+  if (cp && (gzio->saved_offset > offset + WSIZE
+	     || cp->out_offset > gzio->saved_offset))
+    restore_checkpoint (gzio, cp);
+  else if (gzio->saved_offset > offset + WSIZE)
     initialize_tables (gzio);
 
   /*
@@ -1220,8 +1414,14 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
       register grub_size_t size;
       register char *srcaddr;
 
-      while (offset >= gzio->saved_offset)
-	inflate_window (gzio);
+      while (offset >= gzio->saved_offset && grub_errno == GRUB_ERR_NONE)
+	{
+	  inflate_window (gzio);
+	  if (gzio->file && grub_errno == GRUB_ERR_NONE)
+	    add_checkpoint (gzio);
+	}
+      if (grub_errno != GRUB_ERR_NONE)
+	break;
 
       srcaddr = (char *) ((offset & (WSIZE - 1)) + gzio->slide);
       size = gzio->saved_offset - offset;
@@ -1236,8 +1436,12 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
       offset += size;
     }
 
+  /* A window may be half decoded, so the next read must start over.  */
   if (grub_errno != GRUB_ERR_NONE)
-    ret = -1;
+    {
+      initialize_tables (gzio);
+      ret = -1;
+    }
 
   return ret;
 }
@@ -1253,10 +1457,13 @@ static grub_err_t
 grub_gzio_close (grub_file_t file)
 {
   grub_gzio_t gzio = file->data;
+  unsigned i;
 
   grub_file_close (gzio->file);
   huft_free (gzio->tl);
   huft_free (gzio->td);
+  for (i = 0; i < gzio->num_checkpoints; i++)
+    grub_free (gzio->checkpoints[i]);
   grub_free (gzio);
 
   /* No need to close the same device twice.  */
@@ -1292,6 +1499,53 @@ grub_zlib_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
   return ret;
 }
 
+struct grub_zlib_stream
+{
+  grub_off_t offset;
+  struct grub_gzio gzio;
+};
+
+struct grub_zlib_stream *
+grub_zlib_stream_open (const void *inbuf, grub_size_t insize)
+{
+  struct grub_zlib_stream *stream;
+
+  stream = grub_zalloc (sizeof (*stream));
+  if (! stream)
+    return 0;
+  stream->gzio.mem_input = (grub_uint8_t *) inbuf;
+  stream->gzio.mem_input_size = insize;
+
+  if (!test_zlib_header (&stream->gzio))
+    {
+      grub_free (stream);
+      return 0;
+    }
+  return stream;
+}
+
+grub_ssize_t
+grub_zlib_stream_read (struct grub_zlib_stream *stream, void *outbuf,
+		       grub_size_t len)
+{
+  grub_ssize_t ret;
+
+  ret = grub_gzio_read_real (&stream->gzio, stream->offset, outbuf, len);
+  if (ret > 0)
+    stream->offset += ret;
+  return ret;
+}
+
+void
+grub_zlib_stream_close (struct grub_zlib_stream *stream)
+{
+  if (! stream)
+    return;
+  huft_free (stream->gzio.tl);
+  huft_free (stream->gzio.td);
+  grub_free (stream);
+}
+
 
 
 static struct grub_fs grub_gzio_fs =
@@ -55,10 +55,28 @@ struct block_header
   grub_uint32_t csize;
   grub_uint32_t ucheck;
   grub_uint32_t ccheck;
+  grub_off_t data_off;		/* Position of block data in file.  */
   unsigned char *cdata;
   unsigned char *udata;
 };
 
+/* Entry of the block table built when the file is opened.  */
+struct block_entry
+{
+  grub_off_t off;		/* Position of block header in file.  */
+  grub_off_t uoff;		/* Offset of block in uncompressed data.  */
+};
+
+/* Number of decompressed blocks kept besides the current one.  */
+#define LZOPIO_CACHE_BLOCKS 4
+
+struct cached_block
+{
+  grub_size_t index;
+  unsigned char *udata;
+  unsigned long last_use;
+};
+
 struct grub_lzopio
 {
   grub_file_t file;
@@ -69,6 +87,12 @@ struct grub_lzopio
   grub_off_t saved_off;		/* Rounded down to block boundary.  */
   grub_off_t start_block_off;
   struct block_header block;
+  grub_size_t cur_block;
+  /* NUM_BLOCKS entries followed by one for the terminating block.  */
+  struct block_entry *blocks;
+  grub_size_t num_blocks;
+  struct cached_block cache[LZOPIO_CACHE_BLOCKS];
+  unsigned long cache_clock;
 };
 
 typedef struct grub_lzopio *grub_lzopio_t;
@@ -82,14 +106,6 @@ static struct grub_fs grub_lzopio_fs;
 static int
 read_block_header (struct grub_lzopio *lzopio)
 {
-  lzopio->saved_off += lzopio->block.usize;
-
-  /* Free cached block data if any.  */
-  grub_free (lzopio->block.udata);
-  grub_free (lzopio->block.cdata);
-  lzopio->block.udata = NULL;
-  lzopio->block.cdata = NULL;
-
   if (grub_file_read (lzopio->file, &lzopio->block.usize,
 		      sizeof (lzopio->block.usize)) !=
       sizeof (lzopio->block.usize))
@@ -148,19 +164,28 @@ read_block_header (struct grub_lzopio *lzopio)
 	}
     }
 
+  lzopio->block.data_off = grub_file_tell (lzopio->file);
+
   return 0;
 }
 
-/* Read block data into memory. File must be set to beginning of block data.
+/* Read block data into DEST, or into newly allocated memory if DEST is NULL.
  * Can't be called on last block.  */
 static int
-read_block_data (struct grub_lzopio *lzopio)
+read_block_data (struct grub_lzopio *lzopio, unsigned char *dest)
 {
-  lzopio->block.cdata = grub_malloc (lzopio->block.csize);
-  if (!lzopio->block.cdata)
-    return -1;
+  unsigned char *cdata = dest;
+
+  if (!cdata)
+    {
+      lzopio->block.cdata = grub_malloc (lzopio->block.csize);
+      if (!lzopio->block.cdata)
+	return -1;
+      cdata = lzopio->block.cdata;
+    }
 
-  if (grub_file_read (lzopio->file, lzopio->block.cdata, lzopio->block.csize)
+  grub_file_seek (lzopio->file, lzopio->block.data_off);
+  if (grub_file_read (lzopio->file, cdata, lzopio->block.csize)
       != (grub_ssize_t) lzopio->block.csize)
     return -1;
 
@@ -169,8 +194,7 @@ read_block_data (struct grub_lzopio *lzopio)
       grub_uint64_t context[(lzopio->ccheck_fun->contextsize + 7) / 8];
 
       lzopio->ccheck_fun->init (context);
-      lzopio->ccheck_fun->write (context, lzopio->block.cdata,
-				 lzopio->block.csize);
+      lzopio->ccheck_fun->write (context, cdata, lzopio->block.csize);
       lzopio->ccheck_fun->final (context);
 
       if (grub_memcmp
@@ -182,31 +206,41 @@ read_block_data (struct grub_lzopio *lzopio)
   return 0;
 }
 
-/* Read block data, uncompressed and also store it in memory.  */
-/* XXX Investigate possibility of in-place decompression to reduce memory
- * footprint. Or try to uncompress directly to buf if possible.  */
+/* Read block data and uncompress it.  If DEST is NULL, the uncompressed
+ * data is kept in memory as the current block, otherwise it's stored in DEST
+ * which must be big enough for the whole block.  */
 static int
-uncompress_block (struct grub_lzopio *lzopio)
+uncompress_block (struct grub_lzopio *lzopio, unsigned char *dest)
 {
   lzo_uint usize = lzopio->block.usize;
 
-  if (read_block_data (lzopio) < 0)
-    return -1;
-
   /* Incompressible data. */
   if (lzopio->block.csize == lzopio->block.usize)
     {
-      lzopio->block.udata = lzopio->block.cdata;
-      lzopio->block.cdata = NULL;
+      if (read_block_data (lzopio, dest) < 0)
+	return -1;
+
+      if (!dest)
+	{
+	  lzopio->block.udata = lzopio->block.cdata;
+	  lzopio->block.cdata = NULL;
+	}
     }
   else
     {
-      lzopio->block.udata = grub_malloc (lzopio->block.usize);
-      if (!lzopio->block.udata)
+      if (read_block_data (lzopio, NULL) < 0)
 	return -1;
 
+      if (!dest)
+	{
+	  lzopio->block.udata = grub_malloc (lzopio->block.usize);
+	  if (!lzopio->block.udata)
+	    return -1;
+	  dest = lzopio->block.udata;
+	}
+
       if (lzo1x_decompress_safe (lzopio->block.cdata, lzopio->block.csize,
-				 lzopio->block.udata, &usize, NULL)
+				 dest, &usize, NULL)
 	  != LZO_E_OK)
 	return -1;
 
@@ -215,8 +249,7 @@ uncompress_block (struct grub_lzopio *lzopio)
 	  grub_uint64_t context[(lzopio->ucheck_fun->contextsize + 7) / 8];
 
 	  lzopio->ucheck_fun->init (context);
-	  lzopio->ucheck_fun->write (context, lzopio->block.udata,
-				     lzopio->block.usize);
+	  lzopio->ucheck_fun->write (context, dest, lzopio->block.usize);
 	  lzopio->ucheck_fun->final (context);
 
 	  if (grub_memcmp
@@ -233,37 +266,125 @@ uncompress_block (struct grub_lzopio *lzopio)
   return 0;
 }
 
-/* Jump to next block and read its header.  */
-static int
-jump_block (struct grub_lzopio *lzopio)
+/* Keep the decompressed data of the current block for later, dropping the
+ * least recently used block if needed.  */
+static void
+release_block (struct grub_lzopio *lzopio)
 {
-  /* only jump if block was not decompressed (and read from disk) */
+  struct cached_block *slot = &lzopio->cache[0];
+  unsigned i;
+
+  grub_free (lzopio->block.cdata);
+  lzopio->block.cdata = NULL;
+
   if (!lzopio->block.udata)
+    return;
+
+  for (i = 0; i < LZOPIO_CACHE_BLOCKS; i++)
     {
-      grub_off_t off = grub_file_tell (lzopio->file) + lzopio->block.csize;
+      if (!lzopio->cache[i].udata)
+	{
+	  slot = &lzopio->cache[i];
+	  break;
+	}
+      if (lzopio->cache[i].last_use < slot->last_use)
+	slot = &lzopio->cache[i];
+    }
 
-      if (grub_file_seek (lzopio->file, off) == ((grub_off_t) - 1))
-	return -1;
+  grub_free (slot->udata);
+  slot->index = lzopio->cur_block;
+  slot->udata = lzopio->block.udata;
+  slot->last_use = ++lzopio->cache_clock;
+  lzopio->block.udata = NULL;
+}
+
+/* Make block N current, taking its data from the cache if possible.  */
+static int
+load_block (struct grub_lzopio *lzopio, grub_size_t n)
+{
+  unsigned i;
+
+  release_block (lzopio);
+
+  lzopio->cur_block = n;
+  lzopio->saved_off = lzopio->blocks[n].uoff;
+
+  if (grub_file_seek (lzopio->file, lzopio->blocks[n].off)
+      == ((grub_off_t) - 1))
+    return -1;
+
+  if (read_block_header (lzopio) < 0)
+    return -1;
+
+  for (i = 0; i < LZOPIO_CACHE_BLOCKS; i++)
+    if (lzopio->cache[i].udata && lzopio->cache[i].index == n)
+      {
+	lzopio->block.udata = lzopio->cache[i].udata;
+	lzopio->cache[i].udata = NULL;
+	break;
+      }
+
+  return 0;
+}
+
+/* Return the block containing uncompressed offset OFF.  */
+static grub_size_t
+find_block (struct grub_lzopio *lzopio, grub_off_t off)
+{
+  grub_size_t lo = 0, hi = lzopio->num_blocks;
+
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+      if (lzopio->blocks[mid].uoff <= off)
+	lo = mid;
+      else
+	hi = mid;
     }
 
-  return read_block_header (lzopio);
+  return lo;
 }
 
+/* Walk the block headers to find the uncompressed size and build the
+ * block table.  */
 static int
 calculate_uncompressed_size (grub_file_t file)
 {
   grub_lzopio_t lzopio = file->data;
   grub_off_t usize_total = 0;
-
-  if (read_block_header (lzopio) < 0)
-    return -1;
+  grub_size_t alloc = 0;
 
   /* FIXME: Don't do this for not easily seekable files.  */
-  while (lzopio->block.usize != 0)
+  while (1)
     {
+      grub_off_t off = grub_file_tell (lzopio->file);
+
+      if (lzopio->num_blocks == alloc)
+	{
+	  struct block_entry *blocks;
+
+	  alloc = alloc ? 2 * alloc : 32;
+	  blocks = grub_realloc (lzopio->blocks,
+				 alloc * sizeof (lzopio->blocks[0]));
+	  if (!blocks)
+	    return -1;
+	  lzopio->blocks = blocks;
+	}
+
+      lzopio->blocks[lzopio->num_blocks].off = off;
+      lzopio->blocks[lzopio->num_blocks].uoff = usize_total;
+
+      if (read_block_header (lzopio) < 0)
+	return -1;
+
+      if (lzopio->block.usize == 0)
+	break;
+
       usize_total += lzopio->block.usize;
+      lzopio->num_blocks++;
 
-      if (jump_block (lzopio) < 0)
+      if (grub_file_seek (lzopio->file, lzopio->block.data_off
+			  + lzopio->block.csize) == ((grub_off_t) - 1))
 	return -1;
     }
 
@@ -392,14 +513,10 @@ test_header (grub_file_t file)
   if (calculate_uncompressed_size (file) < 0)
     goto CORRUPTED;
 
-  /* Get back to start block.  */
-  grub_file_seek (lzopio->file, lzopio->start_block_off);
-
   /* Read first block - grub_lzopio_read() expects valid block.  */
-  if (read_block_header (lzopio) < 0)
+  if (load_block (lzopio, 0) < 0)
     goto CORRUPTED;
 
-  lzopio->saved_off = 0;
   return 1;
 
 CORRUPTED:
@@ -442,6 +559,9 @@ grub_lzopio_open (grub_file_t io)
     {
       grub_errno = GRUB_ERR_NONE;
       grub_file_seek (io, 0);
+      grub_free (lzopio->block.cdata);
+      grub_free (lzopio->block.udata);
+      grub_free (lzopio->blocks);
       grub_free (lzopio);
       grub_free (file);
 
@@ -457,28 +577,16 @@ grub_lzopio_read (grub_file_t file, char *buf, grub_size_t len)
   grub_lzopio_t lzopio = file->data;
   grub_ssize_t ret = 0;
   grub_off_t off;
+  grub_size_t n;
 
-  /* Backward seek before last read block.  */
-  if (lzopio->saved_off > grub_file_tell (file))
-    {
-      grub_file_seek (lzopio->file, lzopio->start_block_off);
-
-      if (read_block_header (lzopio) < 0)
-	goto CORRUPTED;
-
-      lzopio->saved_off = 0;
-    }
-
-  /* Forward to first block with requested data.  */
-  while (lzopio->saved_off + lzopio->block.usize <= grub_file_tell (file))
-    {
-      /* EOF, could be possible files with unknown size.  */
-      if (lzopio->block.usize == 0)
-	return 0;
+  /* EOF, could be possible files with unknown size.  */
+  if (grub_file_tell (file) >= file->size)
+    return 0;
 
-      if (jump_block (lzopio) < 0)
-	goto CORRUPTED;
-    }
+  /* Go straight to the block with requested data.  */
+  n = find_block (lzopio, grub_file_tell (file));
+  if (n != lzopio->cur_block && load_block (lzopio, n) < 0)
+    goto CORRUPTED;
 
   off = grub_file_tell (file) - lzopio->saved_off;
 
@@ -486,15 +594,25 @@ grub_lzopio_read (grub_file_t file, char *buf, grub_size_t len)
     {
       grub_size_t to_copy;
 
-      /* Block not decompressed yet.  */
-      if (!lzopio->block.udata && uncompress_block (lzopio) < 0)
-	goto CORRUPTED;
-
-      /* Copy requested data into buffer.  */
-      to_copy = lzopio->block.usize - off;
-      if (to_copy > len)
-	to_copy = len;
-      grub_memcpy (buf, lzopio->block.udata + off, to_copy);
+      /* Whole block requested, uncompress it directly into buffer.  */
+      if (!lzopio->block.udata && off == 0 && len >= lzopio->block.usize)
+	{
+	  if (uncompress_block (lzopio, (unsigned char *) buf) < 0)
+	    goto CORRUPTED;
+	  to_copy = lzopio->block.usize;
+	}
+      else
+	{
+	  /* Block not decompressed yet.  */
+	  if (!lzopio->block.udata && uncompress_block (lzopio, NULL) < 0)
+	    goto CORRUPTED;
+
+	  /* Copy requested data into buffer.  */
+	  to_copy = lzopio->block.usize - off;
+	  if (to_copy > len)
+	    to_copy = len;
+	  grub_memcpy (buf, lzopio->block.udata + off, to_copy);
+	}
 
       len -= to_copy;
       buf += to_copy;
@@ -502,7 +620,7 @@ grub_lzopio_read (grub_file_t file, char *buf, grub_size_t len)
       off = 0;
 
       /* Read next block if needed.  */
-      if (len > 0 && read_block_header (lzopio) < 0)
+      if (len > 0 && load_block (lzopio, lzopio->cur_block + 1) < 0)
 	goto CORRUPTED;
     }
 
@@ -518,10 +636,14 @@ static grub_err_t
 grub_lzopio_close (grub_file_t file)
 {
   grub_lzopio_t lzopio = file->data;
+  unsigned i;
 
   grub_file_close (lzopio->file);
   grub_free (lzopio->block.cdata);
   grub_free (lzopio->block.udata);
+  for (i = 0; i < LZOPIO_CACHE_BLOCKS; i++)
+    grub_free (lzopio->cache[i].udata);
+  grub_free (lzopio->blocks);
   grub_free (lzopio);
 
   /* Device must not be closed twice.  */
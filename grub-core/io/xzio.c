@@ -33,6 +33,15 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define VLI_MAX_DIGITS 9
 #define XZ_STREAM_FOOTER_SIZE 12
 
+/* The start of a block, from the stream index.  */
+struct grub_xzio_block
+{
+  /* Offset of the block header in the compressed file.  */
+  grub_off_t in_offset;
+  /* Offset of the block data in the uncompressed file.  */
+  grub_off_t out_offset;
+};
+
 struct grub_xzio
 {
   grub_file_t file;
@@ -41,6 +50,12 @@ struct grub_xzio
   grub_uint8_t inbuf[XZBUFSIZ];
   grub_uint8_t outbuf[XZBUFSIZ];
   grub_off_t saved_offset;
+  /* Block boundaries, or NULL if the index couldn't be used.  */
+  struct grub_xzio_block *blocks;
+  grub_size_t num_blocks;
+  /* Set when decoding didn't start at the first block, so the decoder
+     will reject the index.  */
+  int skipped_blocks;
 };
 
 typedef struct grub_xzio *grub_xzio_t;
@@ -122,7 +137,11 @@ test_footer (grub_file_t file)
   grub_uint8_t imarker;
   grub_uint64_t uncompressed_size_total = 0;
   grub_uint64_t uncompressed_size;
+  grub_uint64_t unpadded_size;
   grub_uint64_t records;
+  grub_off_t index_offset;
+  grub_off_t compressed_offset = STREAM_HEADER_SIZE;
+  grub_size_t i;
 
   grub_file_seek (xzio->file, xzio->file->size - FOOTER_MAGIC_SIZE);
   if (grub_file_read (xzio->file, footer, FOOTER_MAGIC_SIZE)
@@ -139,8 +158,8 @@ test_footer (grub_file_t file)
   backsize = (grub_le_to_cpu32 (backsize) + 1) * 4;
 
   /* Set file to the beginning of stream index.  */
-  grub_file_seek (xzio->file,
-		  xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize);
+  index_offset = xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize;
+  grub_file_seek (xzio->file, index_offset);
 
   /* Test index marker.  */
   if (grub_file_read (xzio->file, &imarker, sizeof (imarker))
@@ -150,24 +169,98 @@ test_footer (grub_file_t file)
   if (read_vli (xzio->file, &records) <= 0)
     goto ERROR;
 
-  for (; records != 0; records--)
+  /* Remember where each block starts, to be able to seek.  Without the
+     table the file is still readable, only sequentially.  */
+  if (records == (grub_size_t) records
+      && records < ((grub_size_t) -1) / sizeof (xzio->blocks[0]))
+    xzio->blocks = grub_malloc (records * sizeof (xzio->blocks[0]));
+  grub_errno = GRUB_ERR_NONE;
+
+  for (i = 0; i < records; i++)
     {
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Ignore unpadded.  */
+      if (read_vli (xzio->file, &unpadded_size) <= 0)
 	goto ERROR;
       if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Uncompressed.  */
 	goto ERROR;
 
+      if (xzio->blocks)
+	{
+	  xzio->blocks[i].in_offset = compressed_offset;
+	  xzio->blocks[i].out_offset = uncompressed_size_total;
+	}
+      compressed_offset += ALIGN_UP (unpadded_size, 4);
       uncompressed_size_total += uncompressed_size;
     }
 
+  /* Single stream with consistent sizes only.  */
+  if (xzio->blocks && compressed_offset == index_offset)
+    xzio->num_blocks = records;
+  else
+    {
+      grub_free (xzio->blocks);
+      xzio->blocks = 0;
+    }
+
   file->size = uncompressed_size_total;
   grub_file_seek (xzio->file, STREAM_HEADER_SIZE);
   return 1;
 
 ERROR:
+  grub_free (xzio->blocks);
+  xzio->blocks = 0;
   return 0;
 }
 
+/* Return the index of the block containing OFFSET.  */
+static grub_size_t
+find_block (grub_xzio_t xzio, grub_off_t offset)
+{
+  grub_size_t lo = 0, hi = xzio->num_blocks;
+
+  while (hi - lo > 1)
+    {
+      grub_size_t mid = (lo + hi) / 2;
+      if (xzio->blocks[mid].out_offset <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+/* Restart decoding at the beginning of block N.  */
+static grub_err_t
+jump_to_block (grub_xzio_t xzio, grub_size_t n)
+{
+  enum xz_ret ret;
+
+  xz_dec_reset (xzio->dec);
+  xzio->buf.out_pos = 0;
+
+  /* Feed the stream header again, leaving the decoder waiting for a
+     block.  */
+  grub_file_seek (xzio->file, 0);
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = grub_file_read (xzio->file, xzio->inbuf,
+				      STREAM_HEADER_SIZE);
+  if (xzio->buf.in_size != STREAM_HEADER_SIZE)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       N_("xz file corrupted or unsupported block options"));
+  ret = xz_dec_run (xzio->dec, &xzio->buf);
+  if (ret != XZ_OK)
+    return grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		       N_("xz file corrupted or unsupported block options"));
+
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = 0;
+  grub_file_seek (xzio->file, xzio->blocks[n].in_offset);
+  xzio->saved_offset = xzio->blocks[n].out_offset;
+  xzio->skipped_blocks = (n != 0);
+
+  return GRUB_ERR_NONE;
+}
+
 static grub_file_t
 grub_xzio_open (grub_file_t io)
 {
@@ -222,6 +315,7 @@ grub_xzio_open (grub_file_t io)
       grub_errno = GRUB_ERR_NONE;
       grub_file_seek (io, 0);
       xz_dec_end (xzio->dec);
+      grub_free (xzio->blocks);
       grub_free (xzio);
       grub_free (file);
 
@@ -240,8 +334,20 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
   grub_xzio_t xzio = file->data;
   grub_off_t current_offset;
 
-  /* If seek backward need to reset decoder and start from beginning of file.
-     TODO Possible improvement by jumping blocks.  */
+  /* Jump to the block containing the requested data when seeking
+     backward, or forward beyond the current block.  */
+  if (xzio->blocks)
+    {
+      grub_size_t n = find_block (xzio, file->offset);
+
+      if (file->offset < xzio->saved_offset
+	  || xzio->blocks[n].out_offset > xzio->saved_offset)
+	if (jump_to_block (xzio, n))
+	  return -1;
+    }
+
+  /* If seek backward need to reset decoder and start from beginning of
+     file.  */
   if (file->offset < xzio->saved_offset)
     {
       xz_dec_reset (xzio->dec);
@@ -270,6 +376,13 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
 	}
 
       xzret = xz_dec_run (xzio->dec, &xzio->buf);
+
+      /* After skipping blocks the index doesn't match what was decoded,
+	 but it only follows the last byte of data.  */
+      if (xzio->skipped_blocks && xzret != XZ_OK
+	  && current_offset + xzio->buf.out_pos >= file->size)
+	xzret = XZ_STREAM_END;
+
       switch (xzret)
 	{
 	case XZ_MEMLIMIT_ERROR:
@@ -320,6 +433,7 @@ grub_xzio_close (grub_file_t file)
   xz_dec_end (xzio->dec);
 
   grub_file_close (xzio->file);
+  grub_free (xzio->blocks);
   grub_free (xzio);
 
   /* Device must not be closed twice.  */
@@ -18,9 +18,12 @@
  */
 
 #include <grub/mm.h>
+#include <grub/misc.h>
 #include <grub/command.h>
 
 grub_command_t grub_command_list;
+/* The active command of each name.  */
+struct grub_hashmap grub_command_map;
 
 grub_command_t
 grub_register_command_prio (const char *name,
@@ -57,14 +60,20 @@ grub_register_command_prio (const char *name,
 	continue;
 
       if (cmd->prio >= (q->prio & GRUB_COMMAND_PRIO_MASK))
-	{
-	  q->prio &= ~GRUB_COMMAND_FLAG_ACTIVE;
-	  break;
-	}
+	break;
 
       inactive = 1;
     }
 
+  if (! inactive && grub_hashmap_insert (&grub_command_map, cmd->name, cmd))
+    {
+      grub_free (cmd);
+      return 0;
+    }
+
+  if (q && grub_strcmp (cmd->name, q->name) == 0)
+    q->prio &= ~GRUB_COMMAND_FLAG_ACTIVE;
+
   *p = cmd;
   cmd->next = q;
   if (q)
@@ -82,6 +91,15 @@ grub_unregister_command (grub_command_t cmd)
 {
   if ((cmd->prio & GRUB_COMMAND_FLAG_ACTIVE) && (cmd->next))
     cmd->next->prio |= GRUB_COMMAND_FLAG_ACTIVE;
+
+  /* The next one of the same name, if any, takes over.  */
+  if (grub_hashmap_find (&grub_command_map, cmd->name) == cmd)
+    {
+      if (cmd->next && grub_strcmp (cmd->next->name, cmd->name) == 0)
+	grub_hashmap_insert (&grub_command_map, cmd->next->name, cmd->next);
+      else
+	grub_hashmap_remove (&grub_command_map, cmd->name);
+    }
   grub_list_remove (GRUB_AS_LIST (cmd));
   grub_free (cmd);
 }
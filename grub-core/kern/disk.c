@@ -24,7 +24,11 @@
 #include <grub/misc.h>
 #include <grub/time.h>
 #include <grub/file.h>
+#include <grub/env.h>
 #include <grub/i18n.h>
+#if !defined (GRUB_UTIL) && !defined (GRUB_MACHINE_EMU)
+#include <grub/mm_private.h>
+#endif
 
 #define	GRUB_CACHE_TIMEOUT	2
 
@@ -32,7 +36,10 @@
 static grub_uint64_t grub_last_time = 0;
 
 
-/* Disk cache.  */
+/* Disk cache.  The cache is set-associative: a cache unit hashes to a set
+   of GRUB_DISK_CACHE_WAYS entries and, when the set is full, the least
+   recently used unlocked entry of that set is replaced.  This way two hot
+   regions which hash to the same set don't keep evicting each other.  */
 struct grub_disk_cache
 {
   enum grub_disk_dev_id dev_id;
@@ -40,69 +47,205 @@ struct grub_disk_cache
   grub_disk_addr_t sector;
   char *data;
   int lock;
+  grub_uint32_t last_use;
 };
 
-static struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
+static struct grub_disk_cache *grub_disk_cache_table;
+static unsigned grub_disk_cache_sets;
+static grub_uint32_t grub_disk_cache_clock;
+
+static struct grub_disk_cache_stats grub_disk_cache_total;
+static struct grub_disk_cache_stats
+grub_disk_cache_dev_stats[GRUB_DISK_CACHE_STATS_DEVICES];
+static unsigned grub_disk_cache_dev_stats_num;
 
 void (*grub_disk_firmware_fini) (void);
 int grub_disk_firmware_is_tainted;
+grub_size_t grub_disk_readahead = GRUB_DISK_READAHEAD_DEFAULT;
 
-#if DISK_CACHE_STATS
-static unsigned long grub_disk_cache_hits;
-static unsigned long grub_disk_cache_misses;
+/* Return the accounting slot for the disk DEV_ID/DISK_ID, allocating a new
+   one if there is still room.  */
+static struct grub_disk_cache_stats *
+grub_disk_cache_get_dev_stats (unsigned long dev_id, unsigned long disk_id)
+{
+  static struct grub_disk_cache_stats *last;
+  unsigned i;
 
-void
-grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
+  if (last && last->dev_id == dev_id && last->disk_id == disk_id)
+    return last;
+
+  for (i = 0; i < grub_disk_cache_dev_stats_num; i++)
+    if (grub_disk_cache_dev_stats[i].dev_id == dev_id
+	&& grub_disk_cache_dev_stats[i].disk_id == disk_id)
+      return (last = &grub_disk_cache_dev_stats[i]);
+
+  if (grub_disk_cache_dev_stats_num == GRUB_DISK_CACHE_STATS_DEVICES)
+    return 0;
+
+  last = &grub_disk_cache_dev_stats[grub_disk_cache_dev_stats_num++];
+  grub_memset (last, 0, sizeof (*last));
+  last->dev_id = dev_id;
+  last->disk_id = disk_id;
+  return last;
+}
+
+/* Release the data of CACHE and account for it.  */
+static void
+grub_disk_cache_drop (struct grub_disk_cache *cache)
 {
-  *hits = grub_disk_cache_hits;
-  *misses = grub_disk_cache_misses;
+  struct grub_disk_cache_stats *stats;
+
+  grub_free (cache->data);
+  cache->data = 0;
+  grub_disk_cache_total.entries--;
+  stats = grub_disk_cache_get_dev_stats (cache->dev_id, cache->disk_id);
+  if (stats)
+    stats->entries--;
 }
-#endif
 
+/* Compute the default number of cache entries: a fraction of the heap,
+   or GRUB_DISK_CACHE_NUM if the heap size isn't known.  */
 static unsigned
-grub_disk_cache_get_index (unsigned long dev_id, unsigned long disk_id,
-			   grub_disk_addr_t sector)
+grub_disk_cache_default_size (void)
+{
+  const char *val;
+  grub_size_t heap = 0;
+  unsigned long num;
+
+  val = grub_env_get ("disk_cache_size");
+  if (val)
+    {
+      num = grub_strtoul (val, 0, 0);
+      if (grub_errno)
+	grub_errno = GRUB_ERR_NONE;
+      else if (num)
+	return num;
+    }
+
+#if !defined (GRUB_UTIL) && !defined (GRUB_MACHINE_EMU)
+  {
+    grub_mm_region_t r;
+
+    for (r = grub_mm_base; r; r = r->next)
+      heap += r->size;
+  }
+#endif
+
+  if (!heap)
+    return GRUB_DISK_CACHE_NUM;
+
+  return (heap >> GRUB_DISK_CACHE_HEAP_SHIFT)
+    >> (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
+}
+
+static grub_err_t
+grub_disk_cache_alloc_table (unsigned num)
+{
+  struct grub_disk_cache *table;
+  unsigned sets;
+
+  if (num < GRUB_DISK_CACHE_MIN_NUM)
+    num = GRUB_DISK_CACHE_MIN_NUM;
+  if (num > GRUB_DISK_CACHE_MAX_NUM)
+    num = GRUB_DISK_CACHE_MAX_NUM;
+  sets = num / GRUB_DISK_CACHE_WAYS;
+
+  table = grub_zalloc (sets * GRUB_DISK_CACHE_WAYS * sizeof (table[0]));
+  if (!table)
+    return grub_errno;
+
+  if (grub_disk_cache_table)
+    {
+      unsigned i;
+
+      for (i = 0; i < grub_disk_cache_sets * GRUB_DISK_CACHE_WAYS; i++)
+	if (grub_disk_cache_table[i].data)
+	  grub_disk_cache_drop (&grub_disk_cache_table[i]);
+      grub_free (grub_disk_cache_table);
+    }
+  grub_disk_cache_table = table;
+  grub_disk_cache_sets = sets;
+  return GRUB_ERR_NONE;
+}
+
+/* Return the set in which the cache unit at SECTOR lives, or NULL if the
+   cache isn't available.  */
+static struct grub_disk_cache *
+grub_disk_cache_get_set (unsigned long dev_id, unsigned long disk_id,
+			 grub_disk_addr_t sector)
 {
-  return ((dev_id * 524287UL + disk_id * 2606459UL
-	   + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
-	  % GRUB_DISK_CACHE_NUM);
+  unsigned index;
+
+  if (!grub_disk_cache_table)
+    {
+      if (grub_disk_cache_alloc_table (grub_disk_cache_default_size ()))
+	{
+	  /* Run uncached and retry next time.  */
+	  grub_errno = GRUB_ERR_NONE;
+	  return 0;
+	}
+    }
+
+  index = ((dev_id * 524287UL + disk_id * 2606459UL
+	    + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
+	   % grub_disk_cache_sets);
+  return grub_disk_cache_table + index * GRUB_DISK_CACHE_WAYS;
+}
+
+static struct grub_disk_cache *
+grub_disk_cache_lookup (unsigned long dev_id, unsigned long disk_id,
+			grub_disk_addr_t sector)
+{
+  struct grub_disk_cache *set;
+  unsigned i;
+
+  set = grub_disk_cache_get_set (dev_id, disk_id, sector);
+  if (!set)
+    return 0;
+
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++)
+    if (set[i].data && set[i].sector == sector
+	&& set[i].dev_id == dev_id && set[i].disk_id == disk_id)
+      return &set[i];
+
+  return 0;
 }
 
 static void
 grub_disk_cache_invalidate (unsigned long dev_id, unsigned long disk_id,
 			    grub_disk_addr_t sector)
 {
-  unsigned index;
   struct grub_disk_cache *cache;
 
-  sector &= ~(GRUB_DISK_CACHE_SIZE - 1);
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  sector &= ~((grub_disk_addr_t) GRUB_DISK_CACHE_SIZE - 1);
+  cache = grub_disk_cache_lookup (dev_id, disk_id, sector);
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector && cache->data)
+  if (cache)
     {
       cache->lock = 1;
-      grub_free (cache->data);
-      cache->data = 0;
+      grub_disk_cache_drop (cache);
       cache->lock = 0;
     }
 }
 
+grub_uint32_t grub_disk_cache_generation;
+
 void
 grub_disk_cache_invalidate_all (void)
 {
   unsigned i;
 
-  for (i = 0; i < GRUB_DISK_CACHE_NUM; i++)
+  grub_disk_cache_generation++;
+
+  if (!grub_disk_cache_table)
+    return;
+
+  for (i = 0; i < grub_disk_cache_sets * GRUB_DISK_CACHE_WAYS; i++)
     {
       struct grub_disk_cache *cache = grub_disk_cache_table + i;
 
       if (cache->data && ! cache->lock)
-	{
-	  grub_free (cache->data);
-	  cache->data = 0;
-	}
+	grub_disk_cache_drop (cache);
     }
 }
 
@@ -111,24 +254,24 @@ grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
 		       grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned index;
+  struct grub_disk_cache_stats *stats;
 
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  cache = grub_disk_cache_lookup (dev_id, disk_id, sector);
+  stats = grub_disk_cache_get_dev_stats (dev_id, disk_id);
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  if (cache)
     {
       cache->lock = 1;
-#if DISK_CACHE_STATS
-      grub_disk_cache_hits++;
-#endif
+      cache->last_use = ++grub_disk_cache_clock;
+      grub_disk_cache_total.hits++;
+      if (stats)
+	stats->hits++;
       return cache->data;
     }
 
-#if DISK_CACHE_STATS
-  grub_disk_cache_misses++;
-#endif
+  grub_disk_cache_total.misses++;
+  if (stats)
+    stats->misses++;
 
   return 0;
 }
@@ -138,13 +281,9 @@ grub_disk_cache_unlock (unsigned long dev_id, unsigned long disk_id,
 			grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned index;
-
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = grub_disk_cache_lookup (dev_id, disk_id, sector);
+  if (cache)
     cache->lock = 0;
 }
 
@@ -152,39 +291,119 @@ static grub_err_t
 grub_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
 		       grub_disk_addr_t sector, const char *data)
 {
-  unsigned index;
-  struct grub_disk_cache *cache;
+  struct grub_disk_cache *set, *cache = 0;
+  struct grub_disk_cache_stats *stats;
+  char *buf;
+  unsigned i;
+
+  /* Allocate first: running out of memory flushes the cache.  */
+  buf = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  if (! buf)
+    return grub_errno;
 
-  index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + index;
+  set = grub_disk_cache_get_set (dev_id, disk_id, sector);
+  if (!set)
+    {
+      grub_free (buf);
+      return GRUB_ERR_NONE;
+    }
 
-  cache->lock = 1;
-  grub_free (cache->data);
-  cache->data = 0;
-  cache->lock = 0;
+  /* Pick the entry already holding this unit, an empty entry or the least
+     recently used unlocked one, in this order of preference.  */
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++)
+    {
+      if (set[i].data && set[i].sector == sector
+	  && set[i].dev_id == dev_id && set[i].disk_id == disk_id)
+	{
+	  cache = &set[i];
+	  break;
+	}
+      if (set[i].lock)
+	continue;
+      if (!cache || (cache->data && (!set[i].data
+				     || (grub_int32_t) (set[i].last_use
+							- cache->last_use) < 0)))
+	cache = &set[i];
+    }
 
-  cache->data = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
-  if (! cache->data)
-    return grub_errno;
+  if (!cache)
+    {
+      grub_free (buf);
+      return GRUB_ERR_NONE;
+    }
 
-  grub_memcpy (cache->data, data,
-	       GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  if (cache->data)
+    {
+      if (cache->sector != sector || cache->dev_id != dev_id
+	  || cache->disk_id != disk_id)
+	{
+	  grub_disk_cache_total.evictions++;
+	  stats = grub_disk_cache_get_dev_stats (cache->dev_id,
+						 cache->disk_id);
+	  if (stats)
+	    stats->evictions++;
+	}
+      cache->lock = 1;
+      grub_disk_cache_drop (cache);
+      cache->lock = 0;
+    }
+
+  grub_memcpy (buf, data, GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  cache->data = buf;
   cache->dev_id = dev_id;
   cache->disk_id = disk_id;
   cache->sector = sector;
+  cache->last_use = ++grub_disk_cache_clock;
+
+  grub_disk_cache_total.entries++;
+  stats = grub_disk_cache_get_dev_stats (dev_id, disk_id);
+  if (stats)
+    stats->entries++;
 
   return GRUB_ERR_NONE;
 }
 
-
+grub_err_t
+grub_disk_cache_resize (unsigned num)
+{
+  if (!num)
+    num = grub_disk_cache_default_size ();
+  return grub_disk_cache_alloc_table (num);
+}
+
+unsigned
+grub_disk_cache_get_size (void)
+{
+  return grub_disk_cache_sets * GRUB_DISK_CACHE_WAYS;
+}
+
+void
+grub_disk_cache_get_performance (struct grub_disk_cache_stats *total)
+{
+  *total = grub_disk_cache_total;
+}
+
+int
+grub_disk_cache_iterate_performance (int (*hook) (const struct grub_disk_cache_stats *stats))
+{
+  unsigned i;
+
+  for (i = 0; i < grub_disk_cache_dev_stats_num; i++)
+    if (hook (&grub_disk_cache_dev_stats[i]))
+      return 1;
+  return 0;
+}
+
 
 grub_disk_dev_t grub_disk_dev_list;
+grub_uint32_t grub_disk_dev_generation;
 
 void
 grub_disk_dev_register (grub_disk_dev_t dev)
 {
   dev->next = grub_disk_dev_list;
   grub_disk_dev_list = dev;
+  grub_disk_dev_changed ();
 }
 
 void
@@ -198,6 +417,7 @@ grub_disk_dev_unregister (grub_disk_dev_t dev)
         *p = q->next;
 	break;
       }
+  grub_disk_dev_changed ();
 }
 
 /* Return the location of the first ',', if any, which is not
@@ -388,6 +608,79 @@ transform_sector (grub_disk_t disk, grub_disk_addr_t sector)
   return sector >> (disk->log_sector_size - GRUB_DISK_SECTOR_BITS);
 }
 
+/* Read the cache units from SECTOR up to the read-ahead window in a single
+   request, store them in the cache and copy the requested part of the first
+   one to BUF.  Return 1 on success and 0 if the caller should fall back to
+   reading a single unit.  */
+static int
+grub_disk_read_ahead (grub_disk_t disk, grub_disk_addr_t sector,
+		      grub_off_t offset, grub_size_t size, void *buf)
+{
+  struct grub_disk_cache_stats *stats;
+  grub_disk_addr_t units, i;
+  char *tmp_buf;
+
+  units = grub_disk_readahead >> GRUB_DISK_CACHE_BITS;
+  if (disk->total_sectors != GRUB_DISK_SIZE_UNKNOWN)
+    {
+      grub_disk_addr_t total;
+
+      total = disk->total_sectors << (disk->log_sector_size
+				      - GRUB_DISK_SECTOR_BITS);
+      if (sector >= total)
+	return 0;
+      if (units > ((total - sector) >> GRUB_DISK_CACHE_BITS))
+	units = (total - sector) >> GRUB_DISK_CACHE_BITS;
+    }
+
+  /* Stop at the first unit which is already cached.  */
+  for (i = 1; i < units; i++)
+    if (grub_disk_cache_lookup (disk->dev->id, disk->id,
+				sector + (i << GRUB_DISK_CACHE_BITS)))
+      break;
+  units = i;
+  if (units < 2)
+    return 0;
+
+  tmp_buf = grub_malloc (units << (GRUB_DISK_CACHE_BITS
+				   + GRUB_DISK_SECTOR_BITS));
+  if (!tmp_buf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  if ((disk->dev->read) (disk, transform_sector (disk, sector),
+			 units << (GRUB_DISK_CACHE_BITS
+				   + GRUB_DISK_SECTOR_BITS
+				   - disk->log_sector_size), tmp_buf))
+    {
+      grub_free (tmp_buf);
+      grub_errno = GRUB_ERR_NONE;
+      return 0;
+    }
+
+  grub_memcpy (buf, tmp_buf + offset, size);
+  for (i = 0; i < units; i++)
+    grub_disk_cache_store (disk->dev->id, disk->id,
+			   sector + (i << GRUB_DISK_CACHE_BITS),
+			   tmp_buf + (i << (GRUB_DISK_CACHE_BITS
+					    + GRUB_DISK_SECTOR_BITS)));
+  grub_free (tmp_buf);
+  grub_errno = GRUB_ERR_NONE;
+
+  grub_disk_cache_total.readaheads++;
+  grub_disk_cache_total.readahead_units += units;
+  stats = grub_disk_cache_get_dev_stats (disk->dev->id, disk->id);
+  if (stats)
+    {
+      stats->readaheads++;
+      stats->readahead_units += units;
+    }
+
+  return 1;
+}
+
 /* Small read (less than cache size and not pass across cache unit boundaries).
    sector is already adjusted and is divisible by cache unit size.
  */
@@ -408,6 +701,12 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
       return GRUB_ERR_NONE;
     }
 
+  /* The disk is read sequentially: fetch the following units too.  */
+  if (disk->seq_reads >= GRUB_DISK_READAHEAD_THRESHOLD
+      && grub_disk_readahead > GRUB_DISK_CACHE_SIZE
+      && grub_disk_read_ahead (disk, sector, offset, size, buf))
+    return GRUB_ERR_NONE;
+
   /* Allocate a temporary buffer.  */
   tmp_buf = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
   if (! tmp_buf)
@@ -493,6 +792,12 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
   real_offset = offset;
   real_size = size;
 
+  if (sector == disk->next_sector)
+    disk->seq_reads++;
+  else
+    disk->seq_reads = 0;
+  disk->next_sector = sector + ((offset + size) >> GRUB_DISK_SECTOR_BITS);
+
   /* First read until first cache boundary.   */
   if (offset || (sector & (GRUB_DISK_CACHE_SIZE - 1)))
     {
@@ -559,13 +864,25 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 				   buf);
 	  if (err)
 	    return err;
-	  
-	  for (i = 0; i < agglomerate; i ++)
-	    grub_disk_cache_store (disk->dev->id, disk->id,
-				   sector + (i << GRUB_DISK_CACHE_BITS),
-				   (char *) buf
-				   + (i << (GRUB_DISK_CACHE_BITS
-					    + GRUB_DISK_SECTOR_BITS)));
+
+	  /* Bulk data is unlikely to be read again: don't let it push
+	     metadata out of the cache.  */
+	  if (agglomerate >= GRUB_DISK_BULK_UNITS)
+	    {
+	      struct grub_disk_cache_stats *stats;
+
+	      grub_disk_cache_total.bulk_units += agglomerate;
+	      stats = grub_disk_cache_get_dev_stats (disk->dev->id, disk->id);
+	      if (stats)
+		stats->bulk_units += agglomerate;
+	    }
+	  else
+	    for (i = 0; i < agglomerate; i ++)
+	      grub_disk_cache_store (disk->dev->id, disk->id,
+				     sector + (i << GRUB_DISK_CACHE_BITS),
+				     (char *) buf
+				     + (i << (GRUB_DISK_CACHE_BITS
+					      + GRUB_DISK_SECTOR_BITS)));
 
 	  sector += agglomerate << GRUB_DISK_CACHE_BITS;
 	  size -= agglomerate << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS);
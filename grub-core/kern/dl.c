@@ -31,6 +31,7 @@
 #include <grub/file.h>
 #include <grub/env.h>
 #include <grub/cache.h>
+#include <grub/hashmap.h>
 #include <grub/i18n.h>
 
 /* Platforms where modules are in a readonly area of memory.  */
@@ -101,36 +102,16 @@ struct grub_symbol
 };
 typedef struct grub_symbol *grub_symbol_t;
 
-/* The size of the symbol table.  */
-#define GRUB_SYMTAB_SIZE	509
-
-/* The symbol table (using an open-hash).  */
-static struct grub_symbol *grub_symtab[GRUB_SYMTAB_SIZE];
-
-/* Simple hash function.  */
-static unsigned
-grub_symbol_hash (const char *s)
-{
-  unsigned key = 0;
-
-  while (*s)
-    key = key * 65599 + *s++;
-
-  return (key + (key >> 5)) % GRUB_SYMTAB_SIZE;
-}
+/* The symbol table.  Symbols of the same name, should there be any, are
+   chained from the last one registered.  */
+struct grub_hashmap grub_dl_symtab;
 
 /* Resolve the symbol name NAME and return the address.
    Return NULL, if not found.  */
 static grub_symbol_t
 grub_dl_resolve_symbol (const char *name)
 {
-  grub_symbol_t sym;
-
-  for (sym = grub_symtab[grub_symbol_hash (name)]; sym; sym = sym->next)
-    if (grub_strcmp (sym->name, name) == 0)
-      return sym;
-
-  return 0;
+  return grub_hashmap_find (&grub_dl_symtab, name);
 }
 
 /* Register a symbol with the name NAME and the address ADDR.  */
@@ -139,7 +120,6 @@ grub_dl_register_symbol (const char *name, void *addr, int isfunc,
 			 grub_dl_t mod)
 {
   grub_symbol_t sym;
-  unsigned k;
 
   sym = (grub_symbol_t) grub_malloc (sizeof (*sym));
   if (! sym)
@@ -161,9 +141,14 @@ grub_dl_register_symbol (const char *name, void *addr, int isfunc,
   sym->mod = mod;
   sym->isfunc = isfunc;
 
-  k = grub_symbol_hash (name);
-  sym->next = grub_symtab[k];
-  grub_symtab[k] = sym;
+  sym->next = grub_dl_resolve_symbol (name);
+  if (grub_hashmap_insert (&grub_dl_symtab, sym->name, sym))
+    {
+      if (mod)
+	grub_free ((void *) sym->name);
+      grub_free (sym);
+      return grub_errno;
+    }
 
   return GRUB_ERR_NONE;
 }
@@ -172,28 +157,41 @@ grub_dl_register_symbol (const char *name, void *addr, int isfunc,
 static void
 grub_dl_unregister_symbols (grub_dl_t mod)
 {
-  unsigned i;
+  auto int remove_symbols (const char *name, void *data);
+  int remove_symbols (const char *name, void *data)
+  {
+    grub_symbol_t head = data, removed = 0, sym, *p;
+
+    for (p = &head, sym = *p; sym; sym = *p)
+      if (sym->mod == mod)
+	{
+	  *p = sym->next;
+	  sym->next = removed;
+	  removed = sym;
+	}
+      else
+	p = &sym->next;
+
+    /* NAME may belong to a symbol being freed, so update the table
+       first.  */
+    if (! head)
+      grub_hashmap_remove (&grub_dl_symtab, name);
+    else if (head != data)
+      grub_hashmap_insert (&grub_dl_symtab, head->name, head);
+
+    for (sym = removed; sym; sym = removed)
+      {
+	removed = sym->next;
+	grub_free ((void *) sym->name);
+	grub_free (sym);
+      }
+    return 0;
+  }
 
   if (! mod)
     grub_fatal ("core symbols cannot be unregistered");
 
-  for (i = 0; i < GRUB_SYMTAB_SIZE; i++)
-    {
-      grub_symbol_t sym, *p, q;
-
-      for (p = &grub_symtab[i], sym = *p; sym; sym = q)
-	{
-	  q = sym->next;
-	  if (sym->mod == mod)
-	    {
-	      *p = q;
-	      grub_free ((void *) sym->name);
-	      grub_free (sym);
-	    }
-	  else
-	    p = &sym->next;
-	}
-    }
+  grub_hashmap_iterate (&grub_dl_symtab, remove_symbols);
 }
 
 /* Return the address of a section whose index is N.  */
@@ -28,54 +28,11 @@ static struct grub_env_context initial_context;
 /* The current context.  */
 struct grub_env_context *grub_current_context = &initial_context;
 
-/* Return the hash representation of the string S.  */
-static unsigned int
-grub_env_hashval (const char *s)
-{
-  unsigned int i = 0;
-
-  /* XXX: This can be done much more efficiently.  */
-  while (*s)
-    i += 5 * *(s++);
-
-  return i % HASHSZ;
-}
-
 static struct grub_env_var *
 grub_env_find (const char *name)
 {
-  struct grub_env_var *var;
-  int idx = grub_env_hashval (name);
-
   /* Look for the variable in the current context.  */
-  for (var = grub_current_context->vars[idx]; var; var = var->next)
-    if (grub_strcmp (var->name, name) == 0)
-      return var;
-
-  return 0;
-}
-
-static void
-grub_env_insert (struct grub_env_context *context,
-		 struct grub_env_var *var)
-{
-  int idx = grub_env_hashval (var->name);
-
-  /* Insert the variable into the hashtable.  */
-  var->prevp = &context->vars[idx];
-  var->next = context->vars[idx];
-  if (var->next)
-    var->next->prevp = &(var->next);
-  context->vars[idx] = var;
-}
-
-static void
-grub_env_remove (struct grub_env_var *var)
-{
-  /* Remove the entry from the variable table.  */
-  *var->prevp = var->next;
-  if (var->next)
-    var->next->prevp = var->prevp;
+  return grub_hashmap_find (&grub_current_context->vars, name);
 }
 
 grub_err_t
@@ -117,7 +74,8 @@ grub_env_set (const char *name, const char *val)
   if (! var->value)
     goto fail;
 
-  grub_env_insert (grub_current_context, var);
+  if (grub_hashmap_insert (&grub_current_context->vars, var->name, var))
+    goto fail;
 
   return GRUB_ERR_NONE;
 
@@ -159,7 +117,7 @@ grub_env_unset (const char *name)
       return;
     }
 
-  grub_env_remove (var);
+  grub_hashmap_remove (&grub_current_context->vars, name);
 
   grub_free (var->name);
   grub_free (var->value);
@@ -171,33 +129,32 @@ grub_env_iterate (int (*func) (struct grub_env_var *var))
 {
   struct grub_env_sorted_var *sorted_list = 0;
   struct grub_env_sorted_var *sorted_var;
-  int i;
 
-  /* Add variables associated with this context into a sorted list.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *var;
+  auto int add_var (const char *name, void *data);
+  int add_var (const char *name, void *data)
+  {
+    struct grub_env_sorted_var *v, *p, **q;
 
-      for (var = grub_current_context->vars[i]; var; var = var->next)
-	{
-	  struct grub_env_sorted_var *p, **q;
+    v = grub_malloc (sizeof (*v));
+    if (! v)
+      return 1;
 
-	  sorted_var = grub_malloc (sizeof (*sorted_var));
-	  if (! sorted_var)
-	    goto fail;
+    v->var = data;
 
-	  sorted_var->var = var;
+    for (q = &sorted_list, p = *q; p; q = &((*q)->next), p = *q)
+      {
+	if (grub_strcmp (p->var->name, name) > 0)
+	  break;
+      }
 
-	  for (q = &sorted_list, p = *q; p; q = &((*q)->next), p = *q)
-	    {
-	      if (grub_strcmp (p->var->name, var->name) > 0)
-		break;
-	    }
+    v->next = *q;
+    *q = v;
+    return 0;
+  }
 
-	  sorted_var->next = *q;
-	  *q = sorted_var;
-	}
-    }
+  /* Add variables associated with this context into a sorted list.  */
+  if (grub_hashmap_iterate (&grub_current_context->vars, add_var))
+    goto fail;
 
   /* Iterate FUNC on the sorted list.  */
   for (sorted_var = sorted_list; sorted_var; sorted_var = sorted_var->next)
@@ -31,6 +31,18 @@ void (*EXPORT_VAR (grub_grubnet_fini)) (void);
 grub_file_filter_t grub_file_filters_all[GRUB_FILE_FILTER_MAX];
 grub_file_filter_t grub_file_filters_enabled[GRUB_FILE_FILTER_MAX];
 
+/* grub_file_getline reads ahead this much at a time, so that a config file
+   doesn't go through the filesystem and the filters byte by byte.  The
+   buffer holds a part of the file read from last; the file offset stays
+   where the last line ended.  */
+#define GRUB_FILE_LINEBUF_SIZE	4096
+
+static char *linebuf;
+static grub_file_t linebuf_file;
+static void *linebuf_data;
+static grub_off_t linebuf_offset;
+static grub_size_t linebuf_len;
+
 /* Get the device part of the filename NAME. It is enclosed by parentheses.  */
 char *
 grub_file_get_device_name (const char *name)
@@ -165,6 +177,9 @@ grub_file_read (grub_file_t file, void *buf, grub_size_t len)
 grub_err_t
 grub_file_close (grub_file_t file)
 {
+  if (file == linebuf_file)
+    linebuf_file = 0;
+
   if (file->fs->close)
     (file->fs->close) (file);
 
@@ -191,3 +206,94 @@ grub_file_seek (grub_file_t file, grub_off_t offset)
     
   return old;
 }
+
+/* Make the buffer hold the byte at the offset of FILE.  Return the number
+   of bytes from there on, 0 at the end of file or on error.  */
+static grub_size_t
+fill_linebuf (grub_file_t file)
+{
+  grub_off_t offset = file->offset;
+  grub_ssize_t len;
+
+  if (file == linebuf_file && file->data == linebuf_data
+      && offset >= linebuf_offset && offset < linebuf_offset + linebuf_len)
+    return linebuf_offset + linebuf_len - offset;
+
+  if (! linebuf)
+    {
+      linebuf = grub_malloc (GRUB_FILE_LINEBUF_SIZE);
+      if (! linebuf)
+	return 0;
+    }
+
+  linebuf_file = 0;
+  len = grub_file_read (file, linebuf, GRUB_FILE_LINEBUF_SIZE);
+  file->offset = offset;
+  if (len <= 0)
+    return 0;
+
+  linebuf_file = file;
+  linebuf_data = file->data;
+  linebuf_offset = offset;
+  linebuf_len = len;
+  return len;
+}
+
+char *
+grub_file_getline (grub_file_t file)
+{
+  grub_size_t pos = 0;
+  char *cmdline;
+  int have_newline = 0;
+  grub_size_t max_len = 64;
+  grub_size_t avail;
+
+  /* Initially locate some space.  */
+  cmdline = grub_malloc (max_len);
+  if (! cmdline)
+    return 0;
+
+  while ((avail = fill_linebuf (file)) > 0)
+    {
+      const char *start = linebuf + (file->offset - linebuf_offset);
+      const char *end = grub_memchr (start, '\n', avail);
+      const char *p;
+      grub_size_t len = end ? (grub_size_t) (end - start) : avail;
+
+      while (pos + len >= max_len)
+	{
+	  char *old_cmdline = cmdline;
+	  max_len = max_len * 2;
+	  cmdline = grub_realloc (cmdline, max_len);
+	  if (! cmdline)
+	    {
+	      grub_free (old_cmdline);
+	      return 0;
+	    }
+	}
+
+      /* Skip all carriage returns.  */
+      for (p = start; p < start + len; p++)
+	if (*p != '\r')
+	  cmdline[pos++] = *p;
+
+      if (end)
+	{
+	  file->offset += len + 1;
+	  have_newline = 1;
+	  break;
+	}
+      file->offset += len;
+    }
+
+  cmdline[pos] = '\0';
+
+  /* If the buffer is empty, don't return anything at all.  */
+  if (pos == 0 && !have_newline)
+    {
+      grub_free (cmdline);
+      cmdline = 0;
+    }
+
+  return cmdline;
+}
@@ -32,57 +32,108 @@ grub_fs_t grub_fs_list = 0;
 
 grub_fs_autoload_hook_t grub_fs_autoload_hook = 0;
 
-grub_fs_t
-grub_fs_probe (grub_device_t device)
+static int
+probe_hook (const char *filename __attribute__ ((unused)),
+	    const struct grub_dirhook_info *info __attribute__ ((unused)))
 {
-  grub_fs_t p;
-  auto int dummy_func (const char *filename,
-		       const struct grub_dirhook_info *info);
+  return 1;
+}
+
+/* Return non-zero if one of the signatures of FS is on DEVICE, or if FS
+   has none.  */
+static int
+grub_fs_magic_match (grub_device_t device, grub_fs_t fs)
+{
+  const struct grub_fs_magic *m;
+  char buf[GRUB_FS_MAGIC_MAX_SIZE];
 
-  int dummy_func (const char *filename __attribute__ ((unused)),
-		  const struct grub_dirhook_info *info  __attribute__ ((unused)))
+  if (! fs->magic)
+    return 1;
+
+  /* Signatures of different filesystems mostly share a few sectors, so
+     these reads are served by the disk cache.  */
+  for (m = fs->magic; m->size; m++)
     {
-      return 1;
+      if (grub_disk_read (device->disk, m->offset >> GRUB_DISK_SECTOR_BITS,
+			  m->offset & (GRUB_DISK_SECTOR_SIZE - 1),
+			  m->size, buf))
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  continue;
+	}
+      if (grub_memcmp (buf, m->value, m->size) == 0)
+	return 1;
     }
 
-  if (device->disk)
-    {
-      /* Make it sure not to have an infinite recursive calls.  */
-      static int count = 0;
+  return 0;
+}
 
-      for (p = grub_fs_list; p; p = p->next)
-	{
-	  grub_dprintf ("fs", "Detecting %s...\n", p->name);
+/* Check whether DEVICE holds filesystem P.  Return 1 if it does, 0 if it
+   doesn't and -1 on errors which should stop probing.  */
+static int
+grub_fs_try (grub_device_t device, grub_fs_t p)
+{
+  grub_dprintf ("fs", "Detecting %s...\n", p->name);
 
-	  /* This is evil: newly-created just mounted BtrFS after copying all
-	     GRUB files has a very peculiar unrecoverable corruption which
-	     will be fixed at sync but we'd rather not do a global sync and
-	     syncing just files doesn't seem to help. Relax the check for
-	     this time.  */
+  /* This is evil: newly-created just mounted BtrFS after copying all
+     GRUB files has a very peculiar unrecoverable corruption which
+     will be fixed at sync but we'd rather not do a global sync and
+     syncing just files doesn't seem to help. Relax the check for
+     this time.  */
 #ifdef GRUB_UTIL
-	  if (grub_strcmp (p->name, "btrfs") == 0)
-	    {
-	      char *label = 0;
-	      p->uuid (device, &label);
-	      if (label)
-		grub_free (label);
-	    }
-	  else
+  if (grub_strcmp (p->name, "btrfs") == 0)
+    {
+      char *label = 0;
+      p->uuid (device, &label);
+      if (label)
+	grub_free (label);
+    }
+  else
 #endif
-	    (p->dir) (device, "/", dummy_func);
-	  if (grub_errno == GRUB_ERR_NONE)
-	    return p;
+    (p->dir) (device, "/", probe_hook);
+  if (grub_errno == GRUB_ERR_NONE)
+    return 1;
 
-	  grub_error_push ();
-	  grub_dprintf ("fs", "%s detection failed.\n", p->name);
-	  grub_error_pop ();
+  grub_error_push ();
+  grub_dprintf ("fs", "%s detection failed.\n", p->name);
+  grub_error_pop ();
 
-	  if (grub_errno != GRUB_ERR_BAD_FS
-	      && grub_errno != GRUB_ERR_OUT_OF_RANGE)
-	    return 0;
+  if (grub_errno != GRUB_ERR_BAD_FS
+      && grub_errno != GRUB_ERR_OUT_OF_RANGE)
+    return -1;
 
-	  grub_errno = GRUB_ERR_NONE;
-	}
+  grub_errno = GRUB_ERR_NONE;
+  return 0;
+}
+
+grub_fs_t
+grub_fs_probe (grub_device_t device)
+{
+  grub_fs_t p;
+
+  if (device->disk)
+    {
+      /* Make it sure not to have an infinite recursive calls.  */
+      static int count = 0;
+      int ret;
+
+      /* Filesystems whose signature is on the device first, then those
+	 without any signature to look for.  */
+      for (p = grub_fs_list; p; p = p->next)
+	if (p->magic && grub_fs_magic_match (device, p))
+	  {
+	    ret = grub_fs_try (device, p);
+	    if (ret)
+	      return ret > 0 ? p : 0;
+	  }
+
+      for (p = grub_fs_list; p; p = p->next)
+	if (! p->magic)
+	  {
+	    ret = grub_fs_try (device, p);
+	    if (ret)
+	      return ret > 0 ? p : 0;
+	  }
 
       /* Let's load modules automatically.  */
       if (grub_fs_autoload_hook && count == 0)
@@ -93,7 +144,10 @@ grub_fs_probe (grub_device_t device)
 	    {
 	      p = grub_fs_list;
 
-	      (p->dir) (device, "/", dummy_func);
+	      if (! grub_fs_magic_match (device, p))
+		continue;
+
+	      (p->dir) (device, "/", probe_hook);
 	      if (grub_errno == GRUB_ERR_NONE)
 		{
 		  count--;
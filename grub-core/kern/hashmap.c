@@ -0,0 +1,192 @@
+/* hashmap.c - string-keyed hash map */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/hashmap.h>
+#include <grub/misc.h>
+#include <grub/mm.h>
+
+#define GRUB_HASHMAP_MIN_SIZE	16
+
+/* The key of removed entries.  */
+static const char removed_key[] = "";
+
+/* FNV-1a.  */
+grub_uint32_t
+grub_hashmap_hash (const char *key)
+{
+  grub_uint32_t hash = 2166136261U;
+
+  while (*key)
+    {
+      hash ^= (grub_uint8_t) *key++;
+      hash *= 16777619;
+    }
+  return hash;
+}
+
+/* Return the slot of KEY, or if it isn't there, the slot to put it in.
+   There is always a free slot, so this ends.  */
+static struct grub_hashmap_slot *
+find_slot (struct grub_hashmap *map, const char *key, grub_uint32_t hash)
+{
+  grub_size_t mask = map->size - 1;
+  grub_size_t i;
+  struct grub_hashmap_slot *reuse = NULL;
+
+  map->lookups++;
+  for (i = hash & mask; ; i = (i + 1) & mask)
+    {
+      struct grub_hashmap_slot *slot = &map->slots[i];
+
+      map->probes++;
+      if (! slot->key)
+	return reuse ? : slot;
+      if (slot->key == removed_key)
+	{
+	  if (! reuse)
+	    reuse = slot;
+	}
+      else if (slot->hash == hash && grub_strcmp (slot->key, key) == 0)
+	return slot;
+    }
+}
+
+/* Move the entries to a table of SIZE slots, dropping removed ones.  */
+static grub_err_t
+resize (struct grub_hashmap *map, grub_size_t size)
+{
+  struct grub_hashmap_slot *old = map->slots;
+  grub_size_t old_size = map->size;
+  grub_size_t i;
+
+  map->slots = grub_zalloc (size * sizeof (map->slots[0]));
+  if (! map->slots)
+    {
+      map->slots = old;
+      return grub_errno;
+    }
+  map->size = size;
+  map->removed = 0;
+  map->resizes++;
+
+  for (i = 0; i < old_size; i++)
+    if (old[i].key && old[i].key != removed_key)
+      {
+	grub_size_t j;
+
+	for (j = old[i].hash & (size - 1); map->slots[j].key;
+	     j = (j + 1) & (size - 1));
+	map->slots[j] = old[i];
+      }
+
+  grub_free (old);
+  return GRUB_ERR_NONE;
+}
+
+void *
+grub_hashmap_find (struct grub_hashmap *map, const char *key)
+{
+  struct grub_hashmap_slot *slot;
+
+  if (! map->size)
+    return NULL;
+
+  slot = find_slot (map, key, grub_hashmap_hash (key));
+  return slot->key && slot->key != removed_key ? slot->value : NULL;
+}
+
+grub_err_t
+grub_hashmap_insert (struct grub_hashmap *map, const char *key, void *value)
+{
+  grub_uint32_t hash = grub_hashmap_hash (key);
+  struct grub_hashmap_slot *slot = NULL;
+
+  if (map->size)
+    {
+      slot = find_slot (map, key, hash);
+      if (slot->key && slot->key != removed_key)
+	{
+	  slot->key = key;
+	  slot->value = value;
+	  return GRUB_ERR_NONE;
+	}
+    }
+
+  /* Keep at most three quarters of the slots used, counting removed
+     entries.  The new table is at most half full.  */
+  if (! slot || (map->count + map->removed + 1) * 4 > map->size * 3)
+    {
+      grub_size_t size = GRUB_HASHMAP_MIN_SIZE;
+
+      while (size < (map->count + 1) * 2)
+	size *= 2;
+      if (resize (map, size))
+	return grub_errno;
+      slot = find_slot (map, key, hash);
+    }
+
+  if (slot->key == removed_key)
+    map->removed--;
+  slot->hash = hash;
+  slot->key = key;
+  slot->value = value;
+  map->count++;
+  return GRUB_ERR_NONE;
+}
+
+void *
+grub_hashmap_remove (struct grub_hashmap *map, const char *key)
+{
+  struct grub_hashmap_slot *slot;
+
+  if (! map->size)
+    return NULL;
+
+  slot = find_slot (map, key, grub_hashmap_hash (key));
+  if (! slot->key || slot->key == removed_key)
+    return NULL;
+
+  slot->key = removed_key;
+  map->count--;
+  map->removed++;
+  return slot->value;
+}
+
+void
+grub_hashmap_clear (struct grub_hashmap *map)
+{
+  grub_free (map->slots);
+  map->slots = NULL;
+  map->size = 0;
+  map->count = 0;
+  map->removed = 0;
+}
+
+int
+grub_hashmap_iterate (struct grub_hashmap *map,
+		      int (*hook) (const char *key, void *value))
+{
+  grub_size_t i;
+
+  for (i = 0; i < map->size; i++)
+    if (map->slots[i].key && map->slots[i].key != removed_key
+	&& hook (map->slots[i].key, map->slots[i].value))
+      return 1;
+  return 0;
+}
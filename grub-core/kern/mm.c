@@ -56,6 +56,13 @@
   For safety, both allocated blocks and free ones are marked by magic
   numbers. Whenever anything unexpected is detected, GRUB aborts the
   operation.
+
+  Small blocks are the bulk of allocations (strings, list nodes, network
+  buffers) and walking the free ring for each of them gets slow once the
+  heap is fragmented.  So freed blocks of up to GRUB_MM_QUICK_CLASSES cells
+  are kept, still marked as used, on a list per size and handed out again
+  by the next allocation of the same size.  These lists are given back to
+  the regions when memory runs out.
  */
 
 #include <config.h>
@@ -80,6 +87,26 @@
 
 grub_mm_region_t grub_mm_base;
 
+/* Freed small blocks, by size in cells, linked through their headers.  */
+static grub_mm_header_t quick_list[GRUB_MM_QUICK_CLASSES];
+static unsigned quick_count[GRUB_MM_QUICK_CLASSES];
+
+#ifdef MM_DEBUG
+/* Allocation counts by size class, the last one is for bigger blocks.  */
+static struct
+{
+  unsigned long allocs;
+  unsigned long quick_allocs;
+  unsigned long frees;
+} class_stats[GRUB_MM_QUICK_CLASSES + 1];
+
+static inline unsigned
+size_class (grub_size_t n)
+{
+  return n <= GRUB_MM_QUICK_CLASSES ? n - 1 : GRUB_MM_QUICK_CLASSES;
+}
+#endif
+
 /* Get a header from the pointer PTR, and set *P and *R to a pointer
    to the header and a pointer to its region, respectively. PTR must
    be allocated.  */
@@ -292,6 +319,20 @@ grub_memalign (grub_size_t align, grub_size_t size)
   if (align == 0)
     align = 1;
 
+  if (align == 1 && n <= GRUB_MM_QUICK_CLASSES && quick_list[n - 1])
+    {
+      grub_mm_header_t p = quick_list[n - 1];
+
+      quick_list[n - 1] = p->next;
+      quick_count[n - 1]--;
+      p->magic = GRUB_MM_ALLOC_MAGIC;
+#ifdef MM_DEBUG
+      class_stats[size_class (n)].allocs++;
+      class_stats[size_class (n)].quick_allocs++;
+#endif
+      return p + 1;
+    }
+
  again:
 
   for (r = grub_mm_base; r; r = r->next)
@@ -300,14 +341,20 @@ grub_memalign (grub_size_t align, grub_size_t size)
 
       p = grub_real_malloc (&(r->first), n, align);
       if (p)
-	return p;
+	{
+#ifdef MM_DEBUG
+	  class_stats[size_class (n)].allocs++;
+#endif
+	  return p;
+	}
     }
 
   /* If failed, increase free memory somehow.  */
   switch (count)
     {
     case 0:
-      /* Invalidate disk caches.  */
+      /* Give back cached blocks and invalidate disk caches.  */
+      grub_mm_quick_flush ();
       grub_disk_cache_invalidate_all ();
       count++;
       goto again;
@@ -349,18 +396,10 @@ grub_zalloc (grub_size_t size)
   return ret;
 }
 
-/* Deallocate the pointer PTR.  */
-void
-grub_free (void *ptr)
+/* Put the block P back on the free ring of region R.  */
+static void
+free_block (grub_mm_header_t p, grub_mm_region_t r)
 {
-  grub_mm_header_t p;
-  grub_mm_region_t r;
-
-  if (! ptr)
-    return;
-
-  get_header_from_pointer (ptr, &p, &r);
-
   if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
     {
       p->magic = GRUB_MM_FREE_MAGIC;
@@ -415,6 +454,59 @@ grub_free (void *ptr)
     }
 }
 
+/* Deallocate the pointer PTR.  */
+void
+grub_free (void *ptr)
+{
+  grub_mm_header_t p;
+  grub_mm_region_t r;
+
+  if (! ptr)
+    return;
+
+  get_header_from_pointer (ptr, &p, &r);
+
+#ifdef MM_DEBUG
+  class_stats[size_class (p->size)].frees++;
+#endif
+
+  if (p->size <= GRUB_MM_QUICK_CLASSES
+      && quick_count[p->size - 1] < GRUB_MM_QUICK_MAX)
+    {
+      p->magic = GRUB_MM_QUICK_MAGIC;
+      p->next = quick_list[p->size - 1];
+      quick_list[p->size - 1] = p;
+      quick_count[p->size - 1]++;
+      return;
+    }
+
+  free_block (p, r);
+}
+
+void
+grub_mm_quick_flush (void)
+{
+  unsigned i;
+
+  for (i = 0; i < GRUB_MM_QUICK_CLASSES; i++)
+    {
+      while (quick_list[i])
+	{
+	  grub_mm_header_t p = quick_list[i];
+	  grub_mm_region_t r;
+
+	  if (p->magic != GRUB_MM_QUICK_MAGIC)
+	    grub_fatal ("quick magic is broken at %p: 0x%x", p, p->magic);
+
+	  quick_list[i] = p->next;
+	  p->magic = GRUB_MM_ALLOC_MAGIC;
+	  get_header_from_pointer (p + 1, &p, &r);
+	  free_block (p, r);
+	}
+      quick_count[i] = 0;
+    }
+}
+
 /* Reallocate SIZE bytes and return the pointer. The contents will be
    the same as that of PTR.  */
 void *
@@ -453,6 +545,53 @@ grub_realloc (void *ptr, grub_size_t size)
 #ifdef MM_DEBUG
 int grub_mm_debug = 0;
 
+/* Print the allocation counts by size class and how fragmented the free
+   space is.  */
+static void
+grub_mm_dump_stats (void)
+{
+  grub_mm_region_t r;
+  unsigned i;
+  unsigned long nfree = 0;
+  grub_size_t total = 0, largest = 0;
+
+  grub_printf ("size  allocs  quick  frees  cached\n");
+  for (i = 0; i <= GRUB_MM_QUICK_CLASSES; i++)
+    {
+      if (i < GRUB_MM_QUICK_CLASSES)
+	grub_printf ("%4u", (i + 1) << GRUB_MM_ALIGN_LOG2);
+      else
+	grub_printf ("more");
+      grub_printf ("  %6lu  %5lu  %5lu  %6u\n", class_stats[i].allocs,
+		   class_stats[i].quick_allocs, class_stats[i].frees,
+		   i < GRUB_MM_QUICK_CLASSES ? quick_count[i] : 0);
+    }
+
+  for (r = grub_mm_base; r; r = r->next)
+    {
+      grub_mm_header_t p;
+
+      if (r->first->magic != GRUB_MM_FREE_MAGIC)
+	continue;
+
+      p = r->first;
+      do
+	{
+	  grub_size_t size = p->size << GRUB_MM_ALIGN_LOG2;
+
+	  nfree++;
+	  total += size;
+	  if (size > largest)
+	    largest = size;
+	  p = p->next;
+	}
+      while (p != r->first);
+    }
+
+  grub_printf ("free: %" PRIuGRUB_SIZE " bytes in %lu blocks, largest %"
+	       PRIuGRUB_SIZE "\n", total, nfree, largest);
+}
+
 void
 grub_mm_dump_free (void)
 {
@@ -476,6 +615,7 @@ grub_mm_dump_free (void)
       while (p != r->first);
     }
 
+  grub_mm_dump_stats ();
   grub_printf ("\n");
 }
 
@@ -503,10 +643,14 @@ grub_mm_dump (unsigned lineno)
 	    case GRUB_MM_ALLOC_MAGIC:
 	      grub_printf ("A:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
 	      break;
+	    case GRUB_MM_QUICK_MAGIC:
+	      grub_printf ("Q:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
+	      break;
 	    }
 	}
     }
 
+  grub_mm_dump_stats ();
   grub_printf ("\n");
 }
 
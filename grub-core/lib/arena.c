@@ -0,0 +1,176 @@
+/* arena.c - allocations released all at once */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/arena.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/err.h>
+#include <grub/i18n.h>
+#include <grub/dl.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define ARENA_CHUNK_SIZE	4096
+#define ARENA_ALIGN		(sizeof (grub_uint64_t))
+
+struct grub_mm_arena_chunk
+{
+  struct grub_mm_arena_chunk *next;
+  grub_size_t size;
+  grub_uint64_t data[0];
+};
+
+struct grub_mm_arena
+{
+  struct grub_mm_arena_chunk *chunks;
+  /* Free space in the first chunk.  */
+  char *free;
+  grub_size_t left;
+};
+
+grub_mm_arena_t
+grub_mm_arena_new (void)
+{
+  return grub_zalloc (sizeof (struct grub_mm_arena));
+}
+
+void *
+grub_mm_arena_alloc (grub_mm_arena_t arena, grub_size_t size)
+{
+  struct grub_mm_arena_chunk *chunk;
+  void *ret;
+
+  if (size == 0)
+    size = ARENA_ALIGN;
+  if (size > ~(grub_size_t) 0 - ARENA_ALIGN - sizeof (*chunk))
+    {
+      grub_error (GRUB_ERR_OUT_OF_MEMORY, N_("out of memory"));
+      return 0;
+    }
+  size = ALIGN_UP (size, ARENA_ALIGN);
+
+  if (size <= arena->left)
+    {
+      ret = arena->free;
+      arena->free += size;
+      arena->left -= size;
+      return ret;
+    }
+
+  /* Big blocks get a chunk of their own behind the current one so that
+     its free space isn't wasted.  */
+  if (size > ARENA_CHUNK_SIZE / 4)
+    {
+      chunk = grub_malloc (sizeof (*chunk) + size);
+      if (! chunk)
+	return 0;
+      chunk->size = size;
+      if (arena->chunks)
+	{
+	  chunk->next = arena->chunks->next;
+	  arena->chunks->next = chunk;
+	}
+      else
+	{
+	  chunk->next = 0;
+	  arena->chunks = chunk;
+	}
+      return chunk->data;
+    }
+
+  chunk = grub_malloc (sizeof (*chunk) + ARENA_CHUNK_SIZE);
+  if (! chunk)
+    return 0;
+  chunk->size = ARENA_CHUNK_SIZE;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+
+  ret = chunk->data;
+  arena->free = (char *) chunk->data + size;
+  arena->left = ARENA_CHUNK_SIZE - size;
+  return ret;
+}
+
+char *
+grub_mm_arena_strdup (grub_mm_arena_t arena, const char *s)
+{
+  grub_size_t len;
+  char *p;
+
+  len = grub_strlen (s) + 1;
+  p = grub_mm_arena_alloc (arena, len);
+  if (! p)
+    return 0;
+
+  return grub_memcpy (p, s, len);
+}
+
+/* The first chunk of the normal size is kept, so that an arena reset after
+   each use rarely goes back to the heap.  */
+void
+grub_mm_arena_reset (grub_mm_arena_t arena)
+{
+  struct grub_mm_arena_chunk *chunk, *next, *keep = 0;
+
+  for (chunk = arena->chunks; chunk; chunk = next)
+    {
+      next = chunk->next;
+      if (! keep && chunk->size == ARENA_CHUNK_SIZE)
+	keep = chunk;
+      else
+	grub_free (chunk);
+    }
+
+  arena->chunks = keep;
+  if (keep)
+    {
+      keep->next = 0;
+      arena->free = (char *) keep->data;
+      arena->left = ARENA_CHUNK_SIZE;
+    }
+  else
+    {
+      arena->free = 0;
+      arena->left = 0;
+    }
+}
+
+void
+grub_mm_arena_free (grub_mm_arena_t arena)
+{
+  struct grub_mm_arena_chunk *chunk, *next;
+
+  if (! arena)
+    return;
+
+  for (chunk = arena->chunks; chunk; chunk = next)
+    {
+      next = chunk->next;
+      grub_free (chunk);
+    }
+  grub_free (arena);
+}
+
+GRUB_MOD_INIT(arena)
+{
+}
+
+GRUB_MOD_FINI(arena)
+{
+}
@@ -180,6 +180,12 @@ grub_crypto_ecb_decrypt (grub_crypto_cipher_handle_t cipher,
     return GPG_ERR_NOT_SUPPORTED;
   if (size % cipher->cipher->blocksize != 0)
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->ecb_decrypt)
+    {
+      cipher->cipher->ecb_decrypt (cipher->ctx, out, in,
+				   size / cipher->cipher->blocksize);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += cipher->cipher->blocksize, outptr += cipher->cipher->blocksize)
@@ -197,6 +203,12 @@ grub_crypto_ecb_encrypt (grub_crypto_cipher_handle_t cipher,
     return GPG_ERR_NOT_SUPPORTED;
   if (size % cipher->cipher->blocksize != 0)
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->ecb_encrypt)
+    {
+      cipher->cipher->ecb_encrypt (cipher->ctx, out, in,
+				   size / cipher->cipher->blocksize);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += cipher->cipher->blocksize, outptr += cipher->cipher->blocksize)
@@ -215,6 +227,12 @@ grub_crypto_cbc_encrypt (grub_crypto_cipher_handle_t cipher,
     return GPG_ERR_NOT_SUPPORTED;
   if (size % cipher->cipher->blocksize != 0)
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->cbc_encrypt)
+    {
+      cipher->cipher->cbc_encrypt (cipher->ctx, out, in,
+				   size / cipher->cipher->blocksize, iv_in);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (grub_uint8_t *) in + size;
   iv = iv_in;
   for (inptr = in, outptr = out; inptr < end;
@@ -240,6 +258,12 @@ grub_crypto_cbc_decrypt (grub_crypto_cipher_handle_t cipher,
     return GPG_ERR_NOT_SUPPORTED;
   if (size % cipher->cipher->blocksize != 0)
     return GPG_ERR_INV_ARG;
+  if (cipher->cipher->cbc_decrypt)
+    {
+      cipher->cipher->cbc_decrypt (cipher->ctx, out, in,
+				   size / cipher->cipher->blocksize, iv);
+      return GPG_ERR_NO_ERROR;
+    }
   end = (grub_uint8_t *) in + size;
   for (inptr = in, outptr = out; inptr < end;
        inptr += cipher->cipher->blocksize, outptr += cipher->cipher->blocksize)
@@ -380,6 +404,97 @@ grub_crypto_hmac_buffer (const struct gcry_md_spec *md,
   return grub_crypto_hmac_fini (hnd, out);
 }
 
+/* HMAC key with the padded key already hashed into the inner and outer
+   states.  Each HMAC then costs copying those states and hashing the data
+   and the inner digest, which matters for PBKDF2 where the same key is
+   used for thousands of short messages.  */
+struct grub_crypto_hmac_key
+{
+  const struct gcry_md_spec *md;
+  grub_size_t ctxsize;
+  grub_uint8_t *inner;
+  grub_uint8_t *outer;
+  grub_uint8_t *work;
+  grub_uint64_t ctx[0];
+};
+
+struct grub_crypto_hmac_key *
+grub_crypto_hmac_key_new (const struct gcry_md_spec *md,
+			  const void *key, grub_size_t keylen)
+{
+  struct grub_crypto_hmac_key *ret;
+  grub_uint8_t helpkey[md->mdlen];
+  grub_uint8_t pad[md->blocksize];
+  grub_size_t ctxsize;
+  unsigned i;
+
+  if (md->mdlen > md->blocksize)
+    return NULL;
+
+  ctxsize = ALIGN_UP (md->contextsize, sizeof (grub_uint64_t));
+  ret = grub_malloc (sizeof (*ret) + 3 * ctxsize);
+  if (!ret)
+    return NULL;
+
+  ret->md = md;
+  ret->ctxsize = ctxsize;
+  ret->inner = (grub_uint8_t *) ret->ctx;
+  ret->outer = ret->inner + ctxsize;
+  ret->work = ret->outer + ctxsize;
+
+  if (keylen > md->blocksize)
+    {
+      grub_crypto_hash (md, helpkey, key, keylen);
+      key = helpkey;
+      keylen = md->mdlen;
+    }
+
+  grub_memset (pad, 0, md->blocksize);
+  grub_memcpy (pad, key, keylen);
+  for (i = 0; i < md->blocksize; i++)
+    pad[i] ^= 0x36;
+  md->init (ret->inner);
+  md->write (ret->inner, pad, md->blocksize);
+
+  /* 0x36 ^ 0x5c turns the inner pad into the outer one.  */
+  for (i = 0; i < md->blocksize; i++)
+    pad[i] ^= 0x36 ^ 0x5c;
+  md->init (ret->outer);
+  md->write (ret->outer, pad, md->blocksize);
+
+  grub_memset (pad, 0, md->blocksize);
+  grub_memset (helpkey, 0, md->mdlen);
+
+  return ret;
+}
+
+void
+grub_crypto_hmac_key_buffer (struct grub_crypto_hmac_key *hkey,
+			     const void *data, grub_size_t datalen,
+			     void *out)
+{
+  const struct gcry_md_spec *md = hkey->md;
+
+  grub_memcpy (hkey->work, hkey->inner, md->contextsize);
+  md->write (hkey->work, data, datalen);
+  md->final (hkey->work);
+  /* OUT may be DATA, the inner digest is consumed before it's written.  */
+  grub_memcpy (out, md->read (hkey->work), md->mdlen);
+
+  grub_memcpy (hkey->work, hkey->outer, md->contextsize);
+  md->write (hkey->work, out, md->mdlen);
+  md->final (hkey->work);
+  grub_memcpy (out, md->read (hkey->work), md->mdlen);
+}
+
+void
+grub_crypto_hmac_key_free (struct grub_crypto_hmac_key *hkey)
+{
+  if (!hkey)
+    return;
+  grub_memset (hkey->ctx, 0, 3 * hkey->ctxsize);
+  grub_free (hkey);
+}
 
 grub_err_t
 grub_crypto_gcry_error (gcry_err_code_t in)
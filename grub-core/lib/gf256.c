@@ -0,0 +1,329 @@
+/* gf256.c - arithmetic in GF(2^8) for RAID6 and RAID-Z recovery.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/gf256.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* Lowest byte of the polynomial.  */
+#define GF256_POLY 0x1d
+
+/* x**y, twice so that sums of two logarithms need no reduction.  */
+static grub_uint8_t gf_exp[255 * 2];
+/* Such an s that x**s = y.  */
+static grub_uint8_t gf_log[256];
+
+/* The utilities get the SSE kernels too, so that the tests run them.  */
+#if (defined (__i386__) || defined (__x86_64__)) && GNUC_PREREQ (4, 4)
+#define GF256_SSSE3 1
+#endif
+
+#ifdef GF256_SSSE3
+#include <grub/i386/cpuid.h>
+
+/* Only the functions using PSHUFB may touch the XMM registers, the rest of
+   GRUB is compiled without SSE.  */
+#define SSSE3_FUNC __attribute__ ((target ("sse2,ssse3")))
+
+static int have_ssse3;
+static int use_ssse3;
+#endif
+
+static void
+init_tables (void)
+{
+  grub_uint8_t cur = 1;
+  int i;
+
+#ifdef GF256_SSSE3
+  {
+    grub_uint32_t ecx, edx;
+
+    grub_cpuid_features (&ecx, &edx);
+    have_ssse3 = (edx & GRUB_CPUID_EDX_SSE2) && (ecx & GRUB_CPUID_ECX_SSSE3);
+    use_ssse3 = have_ssse3;
+  }
+#endif
+
+  for (i = 0; i < 255; i++)
+    {
+      gf_exp[i] = cur;
+      gf_exp[i + 255] = cur;
+      gf_log[cur] = i;
+      if (cur & 0x80)
+	cur = (cur << 1) ^ GF256_POLY;
+      else
+	cur <<= 1;
+    }
+}
+
+/* Tables are set up, and the CPU checked, on first use, so that utilities
+   which don't run module initialization can use these functions too.  */
+static inline void
+check_tables (void)
+{
+  if (!gf_exp[0])
+    init_tables ();
+}
+
+grub_uint8_t
+grub_gf256_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  if (a == 0 || b == 0)
+    return 0;
+  check_tables ();
+  return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+grub_uint8_t
+grub_gf256_inv (grub_uint8_t a)
+{
+  check_tables ();
+  return gf_exp[255 - gf_log[a]];
+}
+
+grub_uint8_t
+grub_gf256_pow (unsigned n)
+{
+  check_tables ();
+  return gf_exp[n % 255];
+}
+
+unsigned
+grub_gf256_log (grub_uint8_t a)
+{
+  check_tables ();
+  return gf_log[a];
+}
+
+#ifdef GF256_SSSE3
+/* Multiply 16 bytes at a time by looking up the products of their low and
+   high nibbles in LO and HI.  SIZE is a multiple of 16.  */
+static SSSE3_FUNC void
+mul_block_ssse3 (grub_uint8_t *dst, const grub_uint8_t *src,
+		 const grub_uint8_t *lo, const grub_uint8_t *hi,
+		 grub_size_t size, int add)
+{
+  static const grub_uint8_t mask[16] __attribute__ ((aligned (16))) =
+    { 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+      0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f };
+
+#define MUL_16(xor_dst)						\
+  asm volatile ("movdqu (%[lo]), %%xmm4\n"				\
+		"movdqu (%[hi]), %%xmm5\n"				\
+		"movdqa (%[mask]), %%xmm6\n"				\
+		"1:\n"							\
+		"movdqu (%[src]), %%xmm0\n"				\
+		"movdqa %%xmm0, %%xmm1\n"				\
+		"psrlw $4, %%xmm1\n"					\
+		"pand %%xmm6, %%xmm0\n"					\
+		"pand %%xmm6, %%xmm1\n"					\
+		"movdqa %%xmm4, %%xmm2\n"				\
+		"pshufb %%xmm0, %%xmm2\n"				\
+		"movdqa %%xmm5, %%xmm3\n"				\
+		"pshufb %%xmm1, %%xmm3\n"				\
+		"pxor %%xmm3, %%xmm2\n"					\
+		xor_dst							\
+		"movdqu %%xmm2, (%[dst])\n"				\
+		"add $16, %[src]\n"					\
+		"add $16, %[dst]\n"					\
+		"sub $16, %[size]\n"					\
+		"jnz 1b\n"						\
+		: [src] "+r" (src), [dst] "+r" (dst), [size] "+r" (size)	\
+		: [lo] "r" (lo), [hi] "r" (hi), [mask] "r" (mask)	\
+		: "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6",	\
+		  "memory", "cc")
+
+  if (add)
+    MUL_16 ("movdqu (%[dst]), %%xmm0\n"
+	    "pxor %%xmm0, %%xmm2\n");
+  else
+    MUL_16 ("");
+#undef MUL_16
+}
+
+static SSSE3_FUNC void
+xor_block_sse2 (grub_uint8_t *dst, const grub_uint8_t *a,
+		const grub_uint8_t *b, grub_size_t size)
+{
+  asm volatile ("1:\n"
+		"movdqu (%[a]), %%xmm0\n"
+		"movdqu (%[b]), %%xmm1\n"
+		"pxor %%xmm1, %%xmm0\n"
+		"movdqu %%xmm0, (%[dst])\n"
+		"add $16, %[a]\n"
+		"add $16, %[b]\n"
+		"add $16, %[dst]\n"
+		"sub $16, %[size]\n"
+		"jnz 1b\n"
+		: [a] "+r" (a), [b] "+r" (b), [dst] "+r" (dst), [size] "+r" (size)
+		: : "xmm0", "xmm1", "memory", "cc");
+}
+#endif
+
+static void
+mul_block (grub_uint8_t *dst, const grub_uint8_t *src, grub_uint8_t c,
+	   grub_size_t size, int add)
+{
+  grub_uint8_t log_c;
+
+  check_tables ();
+  log_c = gf_log[c];
+
+#ifdef GF256_SSSE3
+  if (use_ssse3 && size >= 16)
+    {
+      grub_uint8_t lo[16], hi[16];
+      grub_size_t n = size & ~(grub_size_t) 15;
+      int i;
+
+      lo[0] = hi[0] = 0;
+      for (i = 1; i < 16; i++)
+	{
+	  lo[i] = gf_exp[gf_log[i] + log_c];
+	  hi[i] = gf_exp[gf_log[i << 4] + log_c];
+	}
+      mul_block_ssse3 (dst, src, lo, hi, n, add);
+      dst += n;
+      src += n;
+      size -= n;
+    }
+#endif
+
+  /* A table of all products pays off after a few hundred bytes, and is
+     faster than multiplying eight bytes at a time in a 64-bit word.  */
+  if (size >= sizeof (gf_log))
+    {
+      grub_uint8_t tab[256];
+      int i;
+
+      tab[0] = 0;
+      for (i = 1; i < 256; i++)
+	tab[i] = gf_exp[gf_log[i] + log_c];
+
+      if (add)
+	for (; size; size--, dst++, src++)
+	  *dst ^= tab[*src];
+      else
+	for (; size; size--, dst++, src++)
+	  *dst = tab[*src];
+      return;
+    }
+
+  for (; size; size--, dst++, src++)
+    {
+      grub_uint8_t p = *src ? gf_exp[gf_log[*src] + log_c] : 0;
+      *dst = add ? *dst ^ p : p;
+    }
+}
+
+void
+grub_gf256_mul_block (grub_uint8_t *dst, const grub_uint8_t *src,
+		      grub_uint8_t c, grub_size_t size)
+{
+  if (c == 0)
+    grub_memset (dst, 0, size);
+  else if (c == 1)
+    grub_memmove (dst, src, size);
+  else
+    mul_block (dst, src, c, size, 0);
+}
+
+void
+grub_gf256_mul_xor_block (grub_uint8_t *dst, const grub_uint8_t *src,
+			  grub_uint8_t c, grub_size_t size)
+{
+  if (c == 1)
+    grub_gf256_xor_block (dst, dst, src, size);
+  else if (c != 0)
+    mul_block (dst, src, c, size, 1);
+}
+
+void
+grub_gf256_xor_block (void *dst, const void *a, const void *b,
+		      grub_size_t size)
+{
+  grub_uint8_t *d = dst;
+  const grub_uint8_t *pa = a, *pb = b;
+
+#ifdef GF256_SSSE3
+  if (use_ssse3 && size >= 16)
+    {
+      grub_size_t n = size & ~(grub_size_t) 15;
+
+      xor_block_sse2 (d, pa, pb, n);
+      d += n;
+      pa += n;
+      pb += n;
+      size -= n;
+    }
+#endif
+
+  for (; size && ((grub_addr_t) d & (sizeof (grub_uint64_t) - 1));
+       size--, d++, pa++, pb++)
+    *d = *pa ^ *pb;
+
+  /* Four words per iteration, this loop is bound by memory anyway.  */
+  for (; size >= 4 * sizeof (grub_uint64_t);
+       size -= 4 * sizeof (grub_uint64_t), d += 4 * sizeof (grub_uint64_t),
+	 pa += 4 * sizeof (grub_uint64_t), pb += 4 * sizeof (grub_uint64_t))
+    {
+      grub_uint64_t w0, w1, w2, w3;
+
+      w0 = grub_get_unaligned64 (pa) ^ grub_get_unaligned64 (pb);
+      w1 = grub_get_unaligned64 (pa + 8) ^ grub_get_unaligned64 (pb + 8);
+      w2 = grub_get_unaligned64 (pa + 16) ^ grub_get_unaligned64 (pb + 16);
+      w3 = grub_get_unaligned64 (pa + 24) ^ grub_get_unaligned64 (pb + 24);
+      ((grub_uint64_t *) d)[0] = w0;
+      ((grub_uint64_t *) d)[1] = w1;
+      ((grub_uint64_t *) d)[2] = w2;
+      ((grub_uint64_t *) d)[3] = w3;
+    }
+
+  for (; size; size--, d++, pa++, pb++)
+    *d = *pa ^ *pb;
+}
+
+int
+grub_gf256_use_simd (int use)
+{
+  check_tables ();
+#ifdef GF256_SSSE3
+  use_ssse3 = use && have_ssse3;
+  return use_ssse3;
+#else
+  (void) use;
+  return 0;
+#endif
+}
+
+GRUB_MOD_INIT(gf256)
+{
+  check_tables ();
+#if defined (GF256_SSSE3) && !defined (GRUB_UTIL) && !defined (GRUB_MACHINE_EMU)
+  if (have_ssse3)
+    grub_cpu_enable_sse ();
+#endif
+}
+
+GRUB_MOD_FINI(gf256)
+{
+}
@@ -0,0 +1,417 @@
+/* aesni.c - AES using the AES-NI instructions */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/crypto.h>
+#include <grub/i386/cpuid.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+/* GRUB is compiled without SSE, so only the functions which execute the
+   AES instructions are allowed to touch the XMM registers.  */
+#define AESNI_FUNC __attribute__ ((target ("sse2,aes")))
+
+#define AESNI_BLOCKSIZE 16
+#define AESNI_MAX_ROUNDS 14
+
+struct aesni_context
+{
+  unsigned rounds;
+  grub_uint8_t enc[AESNI_MAX_ROUNDS + 1][AESNI_BLOCKSIZE];
+  grub_uint8_t dec[AESNI_MAX_ROUNDS + 1][AESNI_BLOCKSIZE];
+};
+
+static const grub_uint8_t sbox[256] =
+  {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+    0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+    0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+    0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+    0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+    0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+    0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+    0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+    0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+    0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+    0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+    0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+    0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+    0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+    0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+    0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+    0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+  };
+
+/* Round keys are computed with plain code, AES-NI only speeds up the
+   rounds themselves.  */
+static void
+expand_key (grub_uint8_t *w, const grub_uint8_t *key, unsigned nk,
+	    unsigned rounds)
+{
+  unsigned i, j;
+  grub_uint8_t t[4], tmp, rcon = 1;
+
+  grub_memcpy (w, key, 4 * nk);
+  for (i = nk; i < 4 * (rounds + 1); i++)
+    {
+      grub_memcpy (t, w + 4 * (i - 1), 4);
+      if (i % nk == 0)
+	{
+	  tmp = t[0];
+	  t[0] = sbox[t[1]] ^ rcon;
+	  t[1] = sbox[t[2]];
+	  t[2] = sbox[t[3]];
+	  t[3] = sbox[tmp];
+	  rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1b : 0);
+	}
+      else if (nk > 6 && i % nk == 4)
+	for (j = 0; j < 4; j++)
+	  t[j] = sbox[t[j]];
+      for (j = 0; j < 4; j++)
+	w[4 * i + j] = w[4 * (i - nk) + j] ^ t[j];
+    }
+}
+
+static AESNI_FUNC void
+inv_mix_columns (grub_uint8_t *out, const grub_uint8_t *in)
+{
+  asm volatile ("movdqu (%1), %%xmm0\n\t"
+		"aesimc %%xmm0, %%xmm0\n\t"
+		"movdqu %%xmm0, (%0)"
+		: : "r" (out), "r" (in) : "xmm0", "memory");
+}
+
+static gcry_err_code_t
+aesni_setkey (void *context, const unsigned char *key, unsigned keylen)
+{
+  struct aesni_context *ctx = context;
+  unsigned i;
+
+  switch (keylen)
+    {
+    case 16:
+      ctx->rounds = 10;
+      break;
+    case 24:
+      ctx->rounds = 12;
+      break;
+    case 32:
+      ctx->rounds = 14;
+      break;
+    default:
+      return GPG_ERR_INV_KEYLEN;
+    }
+
+  expand_key (ctx->enc[0], key, keylen / 4, ctx->rounds);
+
+  /* Keys for the equivalent inverse cipher used by AESDEC.  */
+  grub_memcpy (ctx->dec[0], ctx->enc[ctx->rounds], AESNI_BLOCKSIZE);
+  for (i = 1; i < ctx->rounds; i++)
+    inv_mix_columns (ctx->dec[i], ctx->enc[ctx->rounds - i]);
+  grub_memcpy (ctx->dec[ctx->rounds], ctx->enc[0], AESNI_BLOCKSIZE);
+
+  return GPG_ERR_NO_ERROR;
+}
+
+/* Run the rounds of INSN on one block, or on four blocks interleaved to
+   hide the latency of the AES instructions.  */
+#define AESNI_1(insn, keys, rounds, out, in)				\
+  do {									\
+    const grub_uint8_t *k_ = (keys)[0];					\
+    unsigned r_ = (rounds);						\
+    asm volatile ("movdqu (%[k]), %%xmm4\n\t"				\
+		  "movdqu (%[in]), %%xmm0\n\t"				\
+		  "pxor %%xmm4, %%xmm0\n"				\
+		  "1:\n\t"						\
+		  "add $16, %[k]\n\t"					\
+		  "movdqu (%[k]), %%xmm4\n\t"				\
+		  "dec %[r]\n\t"					\
+		  "jz 2f\n\t"						\
+		  insn " %%xmm4, %%xmm0\n\t"				\
+		  "jmp 1b\n"						\
+		  "2:\n\t"						\
+		  insn "last %%xmm4, %%xmm0\n\t"			\
+		  "movdqu %%xmm0, (%[out])"				\
+		  : [k] "+r" (k_), [r] "+r" (r_)			\
+		  : [in] "r" (in), [out] "r" (out)			\
+		  : "xmm0", "xmm4", "memory", "cc");			\
+  } while (0)
+
+#define AESNI_4(insn, keys, rounds, out, in)				\
+  do {									\
+    const grub_uint8_t *k_ = (keys)[0];					\
+    unsigned r_ = (rounds);						\
+    asm volatile ("movdqu (%[k]), %%xmm4\n\t"				\
+		  "movdqu (%[in]), %%xmm0\n\t"				\
+		  "movdqu 16(%[in]), %%xmm1\n\t"			\
+		  "movdqu 32(%[in]), %%xmm2\n\t"			\
+		  "movdqu 48(%[in]), %%xmm3\n\t"			\
+		  "pxor %%xmm4, %%xmm0\n\t"				\
+		  "pxor %%xmm4, %%xmm1\n\t"				\
+		  "pxor %%xmm4, %%xmm2\n\t"				\
+		  "pxor %%xmm4, %%xmm3\n"				\
+		  "1:\n\t"						\
+		  "add $16, %[k]\n\t"					\
+		  "movdqu (%[k]), %%xmm4\n\t"				\
+		  "dec %[r]\n\t"					\
+		  "jz 2f\n\t"						\
+		  insn " %%xmm4, %%xmm0\n\t"				\
+		  insn " %%xmm4, %%xmm1\n\t"				\
+		  insn " %%xmm4, %%xmm2\n\t"				\
+		  insn " %%xmm4, %%xmm3\n\t"				\
+		  "jmp 1b\n"						\
+		  "2:\n\t"						\
+		  insn "last %%xmm4, %%xmm0\n\t"			\
+		  insn "last %%xmm4, %%xmm1\n\t"			\
+		  insn "last %%xmm4, %%xmm2\n\t"			\
+		  insn "last %%xmm4, %%xmm3\n\t"			\
+		  "movdqu %%xmm0, (%[out])\n\t"				\
+		  "movdqu %%xmm1, 16(%[out])\n\t"			\
+		  "movdqu %%xmm2, 32(%[out])\n\t"			\
+		  "movdqu %%xmm3, 48(%[out])"				\
+		  : [k] "+r" (k_), [r] "+r" (r_)			\
+		  : [in] "r" (in), [out] "r" (out)			\
+		  : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4",		\
+		    "memory", "cc");					\
+  } while (0)
+
+static AESNI_FUNC void
+aesni_encrypt (void *context, unsigned char *out, const unsigned char *in)
+{
+  struct aesni_context *ctx = context;
+
+  AESNI_1 ("aesenc", ctx->enc, ctx->rounds, out, in);
+}
+
+static AESNI_FUNC void
+aesni_decrypt (void *context, unsigned char *out, const unsigned char *in)
+{
+  struct aesni_context *ctx = context;
+
+  AESNI_1 ("aesdec", ctx->dec, ctx->rounds, out, in);
+}
+
+static AESNI_FUNC void
+aesni_ecb_encrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks)
+{
+  struct aesni_context *ctx = context;
+
+  for (; nblocks >= 4; nblocks -= 4)
+    {
+      AESNI_4 ("aesenc", ctx->enc, ctx->rounds, out, in);
+      in += 4 * AESNI_BLOCKSIZE;
+      out += 4 * AESNI_BLOCKSIZE;
+    }
+  for (; nblocks; nblocks--)
+    {
+      AESNI_1 ("aesenc", ctx->enc, ctx->rounds, out, in);
+      in += AESNI_BLOCKSIZE;
+      out += AESNI_BLOCKSIZE;
+    }
+}
+
+static AESNI_FUNC void
+aesni_ecb_decrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks)
+{
+  struct aesni_context *ctx = context;
+
+  for (; nblocks >= 4; nblocks -= 4)
+    {
+      AESNI_4 ("aesdec", ctx->dec, ctx->rounds, out, in);
+      in += 4 * AESNI_BLOCKSIZE;
+      out += 4 * AESNI_BLOCKSIZE;
+    }
+  for (; nblocks; nblocks--)
+    {
+      AESNI_1 ("aesdec", ctx->dec, ctx->rounds, out, in);
+      in += AESNI_BLOCKSIZE;
+      out += AESNI_BLOCKSIZE;
+    }
+}
+
+/* CBC encryption is sequential by nature, only decryption gets batched.  */
+static void
+aesni_cbc_encrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks,
+		   unsigned char *iv)
+{
+  for (; nblocks; nblocks--)
+    {
+      grub_crypto_xor (out, in, iv, AESNI_BLOCKSIZE);
+      aesni_encrypt (context, out, out);
+      grub_memcpy (iv, out, AESNI_BLOCKSIZE);
+      in += AESNI_BLOCKSIZE;
+      out += AESNI_BLOCKSIZE;
+    }
+}
+
+static void
+aesni_cbc_decrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks,
+		   unsigned char *iv)
+{
+  grub_uint8_t prev[4 * AESNI_BLOCKSIZE];
+  grub_size_t n;
+
+  for (; nblocks; nblocks -= n)
+    {
+      n = nblocks < 4 ? nblocks : 4;
+      /* IN may be OUT, keep the ciphertext for chaining.  */
+      grub_memcpy (prev, in, n * AESNI_BLOCKSIZE);
+      aesni_ecb_decrypt (context, out, in, n);
+      grub_crypto_xor (out, out, iv, AESNI_BLOCKSIZE);
+      grub_crypto_xor (out + AESNI_BLOCKSIZE, out + AESNI_BLOCKSIZE, prev,
+		       (n - 1) * AESNI_BLOCKSIZE);
+      grub_memcpy (iv, prev + (n - 1) * AESNI_BLOCKSIZE, AESNI_BLOCKSIZE);
+      in += n * AESNI_BLOCKSIZE;
+      out += n * AESNI_BLOCKSIZE;
+    }
+}
+
+/* Multiply the XTS tweak by x in GF(2^128), little endian.  */
+static inline void
+xts_next_tweak (grub_uint8_t *out, const grub_uint8_t *in)
+{
+  grub_uint64_t lo, hi, carry;
+
+  grub_memcpy (&lo, in, 8);
+  grub_memcpy (&hi, in + 8, 8);
+  carry = hi >> 63;
+  hi = (hi << 1) | (lo >> 63);
+  lo = (lo << 1) ^ (carry * 0x87);
+  grub_memcpy (out, &lo, 8);
+  grub_memcpy (out + 8, &hi, 8);
+}
+
+static void
+aesni_xts_crypt (void *context, unsigned char *out,
+		 const unsigned char *in, grub_size_t nblocks,
+		 unsigned char *tweak, int do_encrypt)
+{
+  grub_uint8_t tweaks[4 * AESNI_BLOCKSIZE];
+  grub_size_t n, i;
+
+  for (; nblocks; nblocks -= n)
+    {
+      n = nblocks < 4 ? nblocks : 4;
+      grub_memcpy (tweaks, tweak, AESNI_BLOCKSIZE);
+      for (i = 1; i < n; i++)
+	xts_next_tweak (tweaks + i * AESNI_BLOCKSIZE,
+			tweaks + (i - 1) * AESNI_BLOCKSIZE);
+      xts_next_tweak (tweak, tweaks + (n - 1) * AESNI_BLOCKSIZE);
+
+      grub_crypto_xor (out, in, tweaks, n * AESNI_BLOCKSIZE);
+      if (do_encrypt)
+	aesni_ecb_encrypt (context, out, out, n);
+      else
+	aesni_ecb_decrypt (context, out, out, n);
+      grub_crypto_xor (out, out, tweaks, n * AESNI_BLOCKSIZE);
+      in += n * AESNI_BLOCKSIZE;
+      out += n * AESNI_BLOCKSIZE;
+    }
+}
+
+static void
+aesni_xts_encrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks,
+		   unsigned char *tweak)
+{
+  aesni_xts_crypt (context, out, in, nblocks, tweak, 1);
+}
+
+static void
+aesni_xts_decrypt (void *context, unsigned char *out,
+		   const unsigned char *in, grub_size_t nblocks,
+		   unsigned char *tweak)
+{
+  aesni_xts_crypt (context, out, in, nblocks, tweak, 0);
+}
+
+/* Same names as the portable implementation in gcry_rijndael so that this
+   one is picked whenever it's loaded.  */
+static const char *aesni_names[] =
+  {
+    "RIJNDAEL",
+    "AES128",
+    "AES-128",
+    "AES192",
+    "AES-192",
+    "RIJNDAEL192",
+    "AES256",
+    "AES-256",
+    "RIJNDAEL256",
+    NULL
+  };
+
+static gcry_cipher_spec_t aesni_spec =
+  {
+    .name = "AES",
+    .aliases = aesni_names,
+    .blocksize = AESNI_BLOCKSIZE,
+    .keylen = 128,
+    .contextsize = sizeof (struct aesni_context),
+    .setkey = aesni_setkey,
+    .encrypt = aesni_encrypt,
+    .decrypt = aesni_decrypt,
+    .ecb_encrypt = aesni_ecb_encrypt,
+    .ecb_decrypt = aesni_ecb_decrypt,
+    .cbc_encrypt = aesni_cbc_encrypt,
+    .cbc_decrypt = aesni_cbc_decrypt,
+    .xts_encrypt = aesni_xts_encrypt,
+    .xts_decrypt = aesni_xts_decrypt
+  };
+
+static int registered;
+
+GRUB_MOD_INIT(aesni)
+{
+  grub_uint32_t ecx, edx;
+
+  grub_cpuid_features (&ecx, &edx);
+  if (!(edx & GRUB_CPUID_EDX_SSE2) || !(ecx & GRUB_CPUID_ECX_AES))
+    return;
+
+  grub_cpu_enable_sse ();
+  grub_cipher_register (&aesni_spec);
+  registered = 1;
+}
+
+GRUB_MOD_FINI(aesni)
+{
+  if (registered)
+    grub_cipher_unregister (&aesni_spec);
+}
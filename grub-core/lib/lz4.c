@@ -0,0 +1,187 @@
+/* lz4.c - decompressor for LZ4 blocks.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A block is a list of sequences.  Each starts with a token byte whose
+   high nibble is the number of literals and whose low nibble is the match
+   length minus LZ4_MIN_MATCH, a nibble of 15 meaning that more length bytes
+   follow.  The literals come next, then the 16-bit little-endian distance
+   of the match.  The last sequence has literals only.  */
+
+#include <grub/dl.h>
+#include <grub/err.h>
+#include <grub/misc.h>
+#include <grub/lz4.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_RUN_MASK 15
+
+/* Inputs and outputs the fast path needs left: 16 bytes of literals and
+   the distance after at most 14 of them, then 3 words of match.  */
+#define LZ4_FAST_IN 16
+#define LZ4_FAST_OUT (14 + 24)
+
+static inline void
+copy_word (grub_uint8_t *dst, const grub_uint8_t *src)
+{
+  grub_set_unaligned64 (dst, grub_get_unaligned64 (src));
+}
+
+/* Copy LEN bytes a word at a time, writing up to 7 bytes beyond DST + LEN
+   and reading as far beyond SRC + LEN.  SRC must lie at least a word before
+   DST if they overlap.  */
+static inline void
+wild_copy (grub_uint8_t *dst, const grub_uint8_t *src, grub_size_t len)
+{
+  grub_uint8_t *end = dst + len;
+
+  do
+    {
+      copy_word (dst, src);
+      dst += 8;
+      src += 8;
+    }
+  while (dst < end);
+}
+
+/* Copy a match of LEN bytes from MATCH to OP exactly.  Once a part of it is
+   copied, the pattern to repeat is twice as long, so even a distance of 1
+   takes only a few copies.  */
+static void
+copy_match (grub_uint8_t *op, const grub_uint8_t *match, grub_size_t len)
+{
+  grub_size_t step;
+
+  while (len > (step = op - match))
+    {
+      grub_memcpy (op, match, step);
+      op += step;
+      len -= step;
+    }
+  grub_memcpy (op, match, len);
+}
+
+/* Add the extra length bytes at *IP to *LEN.  */
+static inline int
+read_length (const grub_uint8_t **ip, const grub_uint8_t *iend,
+	     grub_size_t *len)
+{
+  unsigned b;
+
+  do
+    {
+      if (*ip >= iend || *len > GRUB_ULONG_MAX / 2)
+	return -1;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return 0;
+}
+
+grub_ssize_t
+grub_lz4_decompress (const void *src, grub_size_t src_size,
+		     void *dst, grub_size_t dst_size)
+{
+  const grub_uint8_t *ip = src;
+  const grub_uint8_t *const iend = ip + src_size;
+  grub_uint8_t *op = dst;
+  grub_uint8_t *const ostart = dst;
+  grub_uint8_t *const oend = op + dst_size;
+
+  while (ip < iend)
+    {
+      unsigned token = *ip++;
+      grub_size_t len = token >> 4;
+      grub_size_t offset;
+      const grub_uint8_t *match;
+
+      /* Most sequences have a few literals and a short match from a word
+	 or more back.  With enough room on both sides they take a fixed
+	 number of word copies and no bounds checks but one.  */
+      if (len != LZ4_RUN_MASK && (token & LZ4_RUN_MASK) != LZ4_RUN_MASK
+	  && iend - ip >= LZ4_FAST_IN && oend - op >= LZ4_FAST_OUT)
+	{
+	  copy_word (op, ip);
+	  copy_word (op + 8, ip + 8);
+	  op += len;
+	  ip += len;
+
+	  offset = grub_le_to_cpu16 (grub_get_unaligned16 (ip));
+	  if (offset >= 8 && offset <= (grub_size_t) (op - ostart))
+	    {
+	      ip += 2;
+	      match = op - offset;
+	      copy_word (op, match);
+	      copy_word (op + 8, match + 8);
+	      copy_word (op + 16, match + 16);
+	      op += (token & LZ4_RUN_MASK) + LZ4_MIN_MATCH;
+	      continue;
+	    }
+	  /* Literals are done, leave the match to the careful path.  */
+	}
+      else
+	{
+	  if (len == LZ4_RUN_MASK && read_length (&ip, iend, &len) < 0)
+	    goto fail;
+	  if (len > (grub_size_t) (iend - ip)
+	      || len > (grub_size_t) (oend - op))
+	    goto fail;
+	  if (len + 8 <= (grub_size_t) (iend - ip)
+	      && len + 8 <= (grub_size_t) (oend - op))
+	    wild_copy (op, ip, len);
+	  else
+	    grub_memmove (op, ip, len);
+	  op += len;
+	  ip += len;
+
+	  /* Only the last sequence ends after its literals.  */
+	  if (ip == iend)
+	    break;
+	}
+
+      if (iend - ip < 2)
+	goto fail;
+      offset = grub_le_to_cpu16 (grub_get_unaligned16 (ip));
+      ip += 2;
+      if (offset == 0 || offset > (grub_size_t) (op - ostart))
+	goto fail;
+      match = op - offset;
+
+      len = token & LZ4_RUN_MASK;
+      if (len == LZ4_RUN_MASK && read_length (&ip, iend, &len) < 0)
+	goto fail;
+      len += LZ4_MIN_MATCH;
+      if (len > (grub_size_t) (oend - op))
+	goto fail;
+
+      if (offset >= 8 && len + 8 <= (grub_size_t) (oend - op))
+	wild_copy (op, match, len);
+      else
+	copy_match (op, match, len);
+      op += len;
+    }
+
+  return op - ostart;
+
+ fail:
+  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "corrupted LZ4 data");
+  return -1;
+}
@@ -48,7 +48,7 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  gcry_err_code_t rc;
+  struct grub_crypto_hmac_key *hkey;
   grub_uint8_t *tmp;
   grub_size_t tmplen = Slen + 4;
 
@@ -64,9 +64,17 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
   l = ((dkLen - 1) / hLen) + 1;
   r = dkLen - (l - 1) * hLen;
 
+  /* The key is the same for every iteration, so hash its pads once.  */
+  hkey = grub_crypto_hmac_key_new (md, P, Plen);
+  if (hkey == NULL)
+    return GPG_ERR_OUT_OF_MEMORY;
+
   tmp = grub_malloc (tmplen);
   if (tmp == NULL)
-    return GPG_ERR_OUT_OF_MEMORY;
+    {
+      grub_crypto_hmac_key_free (hkey);
+      return GPG_ERR_OUT_OF_MEMORY;
+    }
 
   grub_memcpy (tmp, S, Slen);
 
@@ -83,16 +91,10 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
 	      tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
 	      tmp[Slen + 3] = (i & 0x000000ff) >> 0;
 
-	      rc = grub_crypto_hmac_buffer (md, P, Plen, tmp, tmplen, U);
+	      grub_crypto_hmac_key_buffer (hkey, tmp, tmplen, U);
 	    }
 	  else
-	    rc = grub_crypto_hmac_buffer (md, P, Plen, U, hLen, U);
-
-	  if (rc != GPG_ERR_NO_ERROR)
-	    {
-	      grub_free (tmp);
-	      return rc;
-	    }
+	    grub_crypto_hmac_key_buffer (hkey, U, hLen, U);
 
 	  for (k = 0; k < hLen; k++)
 	    T[k] ^= U[k];
@@ -102,6 +104,9 @@ grub_crypto_pbkdf2 (const struct gcry_md_spec *md,
     }
 
   grub_free (tmp);
+  grub_crypto_hmac_key_free (hkey);
+  grub_memset (U, 0, hLen);
+  grub_memset (T, 0, hLen);
 
   return GPG_ERR_NO_ERROR;
 }
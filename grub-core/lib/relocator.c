@@ -439,6 +439,9 @@ malloc_in_range (struct grub_relocator *rel,
   if (end < start + size)
     return 0;
 
+  /* Blocks cached by grub_free aren't on the free lists scanned below.  */
+  grub_mm_quick_flush ();
+
   /* We have to avoid any allocations when filling scanline events. 
      Hence 2-stages.
    */
@@ -482,6 +482,16 @@ static enum xz_ret dec_stream_header(struct xz_dec *s)
 
 	s->hash_id = s->temp.buf[HEADER_MAGIC_SIZE + 1];
 
+	/* The decoder may have been reset to decode the header again. */
+	kfree(s->crc32_context);
+	kfree(s->hash_context);
+	kfree(s->index.hash.hash_context);
+	kfree(s->block.hash.hash_context);
+	s->crc32_context = NULL;
+	s->hash_context = NULL;
+	s->index.hash.hash_context = NULL;
+	s->block.hash.hash_context = NULL;
+
 	if (s->crc32)
 	{
 		s->crc32_context = kmalloc(s->crc32->contextsize, GFP_KERNEL);
@@ -502,28 +512,16 @@ static enum xz_ret dec_stream_header(struct xz_dec *s)
 				return XZ_OPTIONS_ERROR;
 			s->hash_context = kmalloc(s->hash->contextsize, GFP_KERNEL);
 			if (s->hash_context == NULL)
-			{
-				kfree(s->crc32_context);
 				return XZ_MEMLIMIT_ERROR;
-			}
 			
 			s->index.hash.hash_context = kmalloc(s->hash->contextsize,
 							     GFP_KERNEL);
 			if (s->index.hash.hash_context == NULL)
-			{
-				kfree(s->hash_context);
-				kfree(s->crc32_context);
 				return XZ_MEMLIMIT_ERROR;
-			}
 			
 			s->block.hash.hash_context = kmalloc(s->hash->contextsize, GFP_KERNEL);
 			if (s->block.hash.hash_context == NULL)
-			{
-				kfree(s->index.hash.hash_context);
-				kfree(s->hash_context);
-				kfree(s->crc32_context);
 				return XZ_MEMLIMIT_ERROR;
-			}
 
 			s->hash->init(s->hash_context);
 			s->hash->init(s->index.hash.hash_context);
@@ -26,6 +26,7 @@
 #include <grub/dl.h>
 #include <grub/file.h>
 #include <grub/priority_queue.h>
+#include <grub/env.h>
 #include <grub/i18n.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
@@ -42,6 +43,15 @@ enum
 enum
   {
     TFTP_DEFAULTSIZE_PACKET = 512,
+    /* Limits of the blksize option (RFC 2348).  */
+    TFTP_MIN_BLKSIZE = 8,
+    TFTP_MAX_BLKSIZE = 65464,
+    /* Limit of the windowsize option (RFC 7440).  */
+    TFTP_MAX_WINDOWSIZE = 65535,
+    /* Blocks sent before each acknowledgement unless overridden by
+       net_tftp_windowsize.  */
+    TFTP_DEFAULT_WINDOWSIZE = 16,
+    TFTP_DATA_HEADER_SIZE = 4
   };
 
 enum
@@ -102,6 +112,13 @@ typedef struct tftp_data
   grub_uint64_t file_size;
   grub_uint64_t block;
   grub_uint32_t block_size;
+  grub_uint32_t window_size;
+  /* Last block acknowledged.  */
+  grub_uint64_t acked;
+  /* The block we had when an out of sequence packet was last answered,
+     and the number of that packet.  */
+  grub_uint64_t reacked;
+  grub_uint16_t reack_trigger;
   int have_oack;
   struct grub_error_saved save_err;
   grub_net_udp_socket_t sock;
@@ -115,10 +132,13 @@ cmp (const void *a__, const void *b__)
   struct grub_net_buff *b_ = *(struct grub_net_buff **) b__;
   struct tftphdr *a = (struct tftphdr *) a_->data;
   struct tftphdr *b = (struct tftphdr *) b_->data;
-  /* We want the first elements to be on top.  */
-  if (grub_be_to_cpu16 (a->u.data.block) < grub_be_to_cpu16 (b->u.data.block))
+  /* Block numbers wrap around on big files, so compare them as serial
+     numbers.  We want the first elements to be on top.  */
+  grub_int16_t diff = grub_be_to_cpu16 (a->u.data.block)
+    - grub_be_to_cpu16 (b->u.data.block);
+  if (diff < 0)
     return +1;
-  if (grub_be_to_cpu16 (a->u.data.block) > grub_be_to_cpu16 (b->u.data.block))
+  if (diff > 0)
     return -1;
   return 0;
 }
@@ -148,6 +168,14 @@ ack (grub_net_udp_socket_t sock, grub_uint16_t block)
   return err;
 }
 
+/* Acknowledge everything received so far.  */
+static grub_err_t
+ack_received (tftp_data_t data)
+{
+  data->acked = data->block;
+  return ack (data->sock, grub_cpu_to_be16 ((grub_uint16_t) data->block));
+}
+
 static grub_err_t
 tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	      struct grub_net_buff *nb,
@@ -170,6 +198,7 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
     {
     case TFTP_OACK:
       data->block_size = TFTP_DEFAULTSIZE_PACKET;
+      data->window_size = 1;
       data->have_oack = 1; 
       for (ptr = nb->data + sizeof (tftph->opcode); ptr < nb->tail;)
 	{
@@ -179,13 +208,20 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	  if (grub_memcmp (ptr, "blksize\0", sizeof ("blksize\0") - 1) == 0)
 	    data->block_size = grub_strtoul ((char *) ptr + sizeof ("blksize\0")
 					     - 1, 0, 0);
+	  if (grub_memcmp (ptr, "windowsize\0", sizeof ("windowsize\0") - 1) == 0)
+	    data->window_size = grub_strtoul ((char *) ptr
+					      + sizeof ("windowsize\0") - 1,
+					      0, 0);
 	  while (ptr < nb->tail && *ptr)
 	    ptr++;
 	  ptr++;
 	}
+      if (data->window_size == 0)
+	data->window_size = 1;
       data->block = 0;
+      data->reacked = ~(grub_uint64_t) 0;
       grub_netbuff_free (nb);
-      err = ack (data->sock, 0);
+      err = ack_received (data);
       grub_error_save (&data->save_err);
       return GRUB_ERR_NONE;
     case TFTP_DATA:
@@ -195,9 +231,29 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	  grub_dprintf ("tftp", "TFTP packet too small\n");
 	  return GRUB_ERR_NONE;
 	}
-      err = ack (data->sock, tftph->u.data.block);
-      if (err)
-	return err;
+      /* The server sends a window of blocks and waits for our
+	 acknowledgement of the last one.  A block we already have means
+	 that acknowledgement was lost and one out of sequence that a block
+	 was lost, in both cases tell the server where to restart.  With
+	 bigger windows do it once per window the server sends, so that
+	 resent windows don't multiply: again only after a block arrived in
+	 sequence, or when the packet isn't after the one answered last,
+	 which means the server restarted the window because our answer
+	 was lost too.  */
+      {
+	grub_uint16_t num = grub_be_to_cpu16 (tftph->u.data.block);
+
+	if (num != (grub_uint16_t) (data->block + 1)
+	    && (data->window_size <= 1 || data->reacked != data->block
+		|| (grub_int16_t) (num - data->reack_trigger) <= 0))
+	  {
+	    data->reacked = data->block;
+	    data->reack_trigger = num;
+	    err = ack_received (data);
+	    if (err)
+	      return err;
+	  }
+      }
 
       err = grub_priority_queue_push (data->pq, &nb);
       if (err)
@@ -212,12 +268,14 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	      return GRUB_ERR_NONE;
 	    nb_top = *nb_top_p;
 	    tftph = (struct tftphdr *) nb_top->data;
-	    if (grub_be_to_cpu16 (tftph->u.data.block) >= data->block + 1)
+	    if ((grub_int16_t) (grub_be_to_cpu16 (tftph->u.data.block)
+				- (grub_uint16_t) (data->block + 1)) >= 0)
 	      break;
 	    grub_netbuff_free (nb_top);
 	    grub_priority_queue_pop (data->pq);
 	  }
-	if (grub_be_to_cpu16 (tftph->u.data.block) == data->block + 1)
+	while (grub_be_to_cpu16 (tftph->u.data.block)
+	       == (grub_uint16_t) (data->block + 1))
 	  {
 	    unsigned size;
 
@@ -230,6 +288,13 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	    size = nb_top->tail - nb_top->data;
 
 	    data->block++;
+	    if (size < data->block_size
+		|| data->block - data->acked >= data->window_size)
+	      {
+		err = ack_received (data);
+		if (err)
+		  return err;
+	      }
 	    if (size < data->block_size)
 	      {
 		file->device->net->eof = 1;
@@ -250,6 +315,16 @@ tftp_receive (grub_net_udp_socket_t sock __attribute__ ((unused)),
 	      grub_net_put_packet (&file->device->net->packs, nb_top);
 	    else
 	      grub_netbuff_free (nb_top);
+
+	    if (!data->sock)
+	      break;
+
+	    /* Later blocks may have arrived before this one.  */
+	    nb_top_p = grub_priority_queue_top (data->pq);
+	    if (!nb_top_p)
+	      break;
+	    nb_top = *nb_top_p;
+	    tftph = (struct tftphdr *) nb_top->data;
 	  }
       }
       return GRUB_ERR_NONE;
@@ -278,6 +353,58 @@ destroy_pq (tftp_data_t data)
   grub_priority_queue_destroy (data->pq);
 }
 
+/* Return the value of the environment variable NAME, or DEF if it isn't
+   set, clamped to MIN..MAX.  */
+static grub_uint32_t
+get_option (const char *name, grub_uint32_t def,
+	    grub_uint32_t min, grub_uint32_t max)
+{
+  const char *val;
+  unsigned long ret;
+
+  val = grub_env_get (name);
+  if (!val)
+    return def;
+
+  ret = grub_strtoul (val, 0, 0);
+  if (grub_errno)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return def;
+    }
+  if (ret < min)
+    return min;
+  if (ret > max)
+    return max;
+  return ret;
+}
+
+/* The biggest block which fits in a packet on the interface used to reach
+   ADDR, so that data packets don't need to be fragmented.  */
+static grub_uint32_t
+default_block_size (grub_net_network_level_address_t addr)
+{
+  struct grub_net_network_level_interface *inf;
+  grub_net_network_level_address_t gateway;
+  grub_size_t mtu;
+
+  if (grub_net_route_address (addr, &gateway, &inf))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return 1024;
+    }
+
+  mtu = inf->card->mtu;
+  if (mtu < GRUB_NET_OUR_MAX_IP_HEADER_SIZE + GRUB_NET_UDP_HEADER_SIZE
+      + TFTP_DATA_HEADER_SIZE + TFTP_DEFAULTSIZE_PACKET)
+    return TFTP_DEFAULTSIZE_PACKET;
+  mtu -= GRUB_NET_OUR_MAX_IP_HEADER_SIZE + GRUB_NET_UDP_HEADER_SIZE
+    + TFTP_DATA_HEADER_SIZE;
+  if (mtu > TFTP_MAX_BLKSIZE)
+    return TFTP_MAX_BLKSIZE;
+  return mtu;
+}
+
 static grub_err_t
 tftp_open (struct grub_file *file, const char *filename)
 {
@@ -292,11 +419,30 @@ tftp_open (struct grub_file *file, const char *filename)
   grub_err_t err;
   grub_uint8_t *nbd;
   grub_net_network_level_address_t addr;
+  char blksize[sizeof ("XXXXXXXXXX")];
+  char windowsize[sizeof ("XXXXXXXXXX")];
+  char timeout[sizeof ("XXXXXXXXXX")];
 
   data = grub_zalloc (sizeof (*data));
   if (!data)
     return grub_errno;
 
+  err = grub_net_resolve_address (file->device->net->server, &addr);
+  if (err)
+    {
+      grub_free (data);
+      return err;
+    }
+
+  grub_snprintf (blksize, sizeof (blksize), "%u",
+		 get_option ("net_tftp_blksize", default_block_size (addr),
+			     TFTP_MIN_BLKSIZE, TFTP_MAX_BLKSIZE));
+  grub_snprintf (windowsize, sizeof (windowsize), "%u",
+		 get_option ("net_tftp_windowsize", TFTP_DEFAULT_WINDOWSIZE,
+			     1, TFTP_MAX_WINDOWSIZE));
+  grub_snprintf (timeout, sizeof (timeout), "%u",
+		 get_option ("net_tftp_timeout", 0, 0, 255));
+
   nb.head = open_data;
   nb.end = open_data + sizeof (open_data);
   grub_netbuff_clear (&nb);
@@ -324,9 +470,29 @@ tftp_open (struct grub_file *file, const char *filename)
   rrqlen += grub_strlen ("blksize") + 1;
   rrq += grub_strlen ("blksize") + 1;
 
-  grub_strcpy (rrq, "1024");
-  rrqlen += grub_strlen ("1024") + 1;
-  rrq += grub_strlen ("1024") + 1;
+  grub_strcpy (rrq, blksize);
+  rrqlen += grub_strlen (blksize) + 1;
+  rrq += grub_strlen (blksize) + 1;
+
+  grub_strcpy (rrq, "windowsize");
+  rrqlen += grub_strlen ("windowsize") + 1;
+  rrq += grub_strlen ("windowsize") + 1;
+
+  grub_strcpy (rrq, windowsize);
+  rrqlen += grub_strlen (windowsize) + 1;
+  rrq += grub_strlen (windowsize) + 1;
+
+  /* Without a timeout option the server uses its own.  */
+  if (grub_strcmp (timeout, "0") != 0)
+    {
+      grub_strcpy (rrq, "timeout");
+      rrqlen += grub_strlen ("timeout") + 1;
+      rrq += grub_strlen ("timeout") + 1;
+
+      grub_strcpy (rrq, timeout);
+      rrqlen += grub_strlen (timeout) + 1;
+      rrq += grub_strlen (timeout) + 1;
+    }
 
   grub_strcpy (rrq, "tsize");
   rrqlen += grub_strlen ("tsize") + 1;
@@ -348,13 +514,6 @@ tftp_open (struct grub_file *file, const char *filename)
   if (!data->pq)
     return grub_errno;
 
-  err = grub_net_resolve_address (file->device->net->server, &addr);
-  if (err)
-    {
-      destroy_pq (data);
-      return err;
-    }
-
   data->sock = grub_net_udp_open (addr,
 				  TFTP_SERVER_PORT, tftp_receive,
 				  file);
@@ -56,9 +56,22 @@ static grub_err_t
 grub_env_new_context (int export_all)
 {
   struct grub_env_context *context;
-  int i;
   struct menu_pointer *menu;
 
+  auto int copy_var (const char *name, void *data);
+  int copy_var (const char *name, void *data)
+  {
+    struct grub_env_var *var = data;
+
+    if (! var->global && ! export_all)
+      return 0;
+    if (grub_env_set (name, var->value) != GRUB_ERR_NONE)
+      return 1;
+    grub_env_export (name);
+    grub_register_variable_hook (name, var->read_hook, var->write_hook);
+    return 0;
+  }
+
   context = grub_zalloc (sizeof (*context));
   if (! context)
     return grub_errno;
@@ -73,21 +86,10 @@ grub_env_new_context (int export_all)
   current_menu = menu;
 
   /* Copy exported variables.  */
-  for (i = 0; i < HASHSZ; i++)
+  if (grub_hashmap_iterate (&context->prev->vars, copy_var))
     {
-      struct grub_env_var *var;
-
-      for (var = context->prev->vars[i]; var; var = var->next)
-	if (var->global || export_all)
-	  {
-	    if (grub_env_set (var->name, var->value) != GRUB_ERR_NONE)
-	      {
-		grub_env_context_close ();
-		return grub_errno;
-	      }
-	    grub_env_export (var->name);
-	    grub_register_variable_hook (var->name, var->read_hook, var->write_hook);
-	  }
+      grub_env_context_close ();
+      return grub_errno;
     }
 
   return GRUB_ERR_NONE;
@@ -112,26 +114,26 @@ grub_err_t
 grub_env_context_close (void)
 {
   struct grub_env_context *context;
-  int i;
   struct menu_pointer *menu;
 
+  auto int free_var (const char *name, void *data);
+  int free_var (const char *name __attribute__ ((unused)), void *data)
+  {
+    struct grub_env_var *var = data;
+
+    grub_free (var->name);
+    grub_free (var->value);
+    grub_free (var);
+    return 0;
+  }
+
   if (! grub_current_context->prev)
     return grub_error (GRUB_ERR_BAD_ARGUMENT,
 		       "cannot close the initial context");
 
   /* Free the variables associated with this context.  */
-  for (i = 0; i < HASHSZ; i++)
-    {
-      struct grub_env_var *p, *q;
-
-      for (p = grub_current_context->vars[i]; p; p = q)
-	{
-	  q = p->next;
-          grub_free (p->name);
-	  grub_free (p->value);
-	  grub_free (p);
-	}
-    }
+  grub_hashmap_iterate (&grub_current_context->vars, free_var);
+  grub_hashmap_clear (&grub_current_context->vars);
 
   /* Restore the previous context.  */
   context = grub_current_context->prev;
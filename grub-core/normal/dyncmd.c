@@ -110,23 +110,14 @@ read_command_list (const char *prefix)
 	  if (file)
 	    {
 	      char *buf = NULL;
-	      grub_command_t ptr, last = 0, next;
+	      grub_command_t ptr, next;
 
 	      /* Override previous commands.lst.  */
 	      for (ptr = grub_command_list; ptr; ptr = next)
 		{
 		  next = ptr->next;
 		  if (ptr->flags & GRUB_COMMAND_FLAG_DYNCMD)
-		    {
-		      if (last)
-			last->next = ptr->next;
-		      else
-			grub_command_list = ptr->next;
-		      grub_free (ptr);
-		      grub_free (ptr->data); /* extcmd struct */
-		    }
-		  else
-		    last = ptr;
+		    grub_unregister_extcmd (ptr->data);
 		}
 
 	      for (;; grub_free (buf))
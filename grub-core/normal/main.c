@@ -40,64 +40,6 @@ GRUB_MOD_LICENSE ("GPLv3+");
 static int nested_level = 0;
 int grub_normal_exit_level = 0;
 
-/* Read a line from the file FILE.  */
-char *
-grub_file_getline (grub_file_t file)
-{
-  char c;
-  grub_size_t pos = 0;
-  char *cmdline;
-  int have_newline = 0;
-  grub_size_t max_len = 64;
-
-  /* Initially locate some space.  */
-  cmdline = grub_malloc (max_len);
-  if (! cmdline)
-    return 0;
-
-  while (1)
-    {
-      if (grub_file_read (file, &c, 1) != 1)
-	break;
-
-      /* Skip all carriage returns.  */
-      if (c == '\r')
-	continue;
-
-
-      if (pos >= max_len)
-	{
-	  char *old_cmdline = cmdline;
-	  max_len = max_len * 2;
-	  cmdline = grub_realloc (cmdline, max_len);
-	  if (! cmdline)
-	    {
-	      grub_free (old_cmdline);
-	      return 0;
-	    }
-	}
-
-      if (c == '\n')
-	{
-	  have_newline = 1;
-	  break;
-	}
-
-      cmdline[pos++] = c;
-    }
-
-  cmdline[pos] = '\0';
-
-  /* If the buffer is empty, don't return anything at all.  */
-  if (pos == 0 && !have_newline)
-    {
-      grub_free (cmdline);
-      cmdline = 0;
-    }
-
-  return cmdline;
-}
-
 void
 grub_normal_free_menu (grub_menu_t menu)
 {
@@ -134,31 +76,60 @@ grub_normal_free_menu (grub_menu_t menu)
   grub_env_unset_menu ();
 }
 
-static grub_menu_t
-read_config_file (const char *config)
+/* Read the lines of FILE, leaving out comment lines, into one text.  */
+static char *
+read_config_text (grub_file_t file)
 {
-  grub_file_t file;
+  char *text, *line;
+  grub_size_t len = 0, max_len = 256;
+
+  text = grub_malloc (max_len);
+  if (! text)
+    return 0;
 
-  auto grub_err_t getline (char **line, int cont);
-  grub_err_t getline (char **line, int cont __attribute__ ((unused)))
+  while ((line = grub_file_getline (file)))
     {
-      while (1)
-	{
-	  char *buf;
+      grub_size_t line_len = grub_strlen (line);
 
-	  *line = buf = grub_file_getline (file);
-	  if (! buf)
-	    return grub_errno;
+      if (line[0] == '#')
+	{
+	  grub_free (line);
+	  continue;
+	}
 
-	  if (buf[0] == '#')
-	    grub_free (*line);
-	  else
-	    break;
+      while (len + line_len + 2 > max_len)
+	{
+	  char *old_text = text;
+	  max_len *= 2;
+	  text = grub_realloc (text, max_len);
+	  if (! text)
+	    {
+	      grub_free (old_text);
+	      grub_free (line);
+	      return 0;
+	    }
 	}
 
-      return GRUB_ERR_NONE;
+      grub_memcpy (text + len, line, line_len);
+      len += line_len;
+      text[len++] = '\n';
+      grub_free (line);
     }
 
+  text[len] = '\0';
+  return text;
+}
+
+static grub_menu_t
+read_config_file (const char *config)
+{
+  grub_file_t file;
+  struct grub_script_source *src;
+  struct grub_script *script;
+  grub_size_t pos = 0;
+  char *text;
+  int r;
+
   grub_menu_t newmenu;
 
   newmenu = grub_env_get_menu ();
@@ -176,22 +147,35 @@ read_config_file (const char *config)
   if (! file)
     return 0;
 
+  /* The whole file is read first, so that the commands parsed out of it
+     can be reused when it is read again unchanged.  */
+  text = read_config_text (file);
+  grub_file_close (file);
+  if (! text)
+    return newmenu;
+
+  src = grub_script_source_get (text);
+  grub_free (text);
+  if (! src)
+    return newmenu;
+
   while (1)
     {
-      char *line;
-
       /* Print an error, if any.  */
       grub_print_error ();
       grub_errno = GRUB_ERR_NONE;
 
-      if ((getline (&line, 0)) || (! line))
+      r = grub_script_source_next (src, &pos, &script);
+      if (r == 0)
 	break;
-
-      grub_normal_parse_line (line, getline);
-      grub_free (line);
+      if (r > 0)
+	{
+	  grub_script_execute (script);
+	  grub_script_unref (script);
+	}
     }
 
-  grub_file_close (file);
+  grub_script_source_put (src);
 
   return newmenu;
 }
@@ -27,6 +27,7 @@
 #include <grub/menu_viewer.h>
 #include <grub/i18n.h>
 #include <grub/charset.h>
+#include <grub/arena.h>
 
 static grub_uint8_t grub_color_menu_normal;
 static grub_uint8_t grub_color_menu_highlight;
@@ -38,6 +39,8 @@ struct menu_viewer_data
   int num_entries;
   grub_menu_t menu;
   struct grub_term_output *term;
+  /* Memory for drawing the entries, released before each redraw.  */
+  grub_mm_arena_t arena;
 };
 
 static inline int
@@ -199,7 +202,7 @@ command-line or ESC to discard edits and return to the GRUB menu."),
 
 static void
 print_entry (int y, int highlight, grub_menu_entry_t entry,
-	     struct grub_term_output *term)
+	     struct grub_term_output *term, grub_mm_arena_t arena)
 {
   int x;
   const char *title;
@@ -211,7 +214,8 @@ print_entry (int y, int highlight, grub_menu_entry_t entry,
 
   title = entry ? entry->title : "";
   title_len = grub_strlen (title);
-  unicode_title = grub_malloc (title_len * sizeof (*unicode_title));
+  unicode_title = grub_mm_arena_alloc (arena,
+				       title_len * sizeof (*unicode_title));
   if (! unicode_title)
     /* XXX How to show this error?  */
     return;
@@ -219,11 +223,8 @@ print_entry (int y, int highlight, grub_menu_entry_t entry,
   len = grub_utf8_to_ucs4 (unicode_title, title_len,
                            (grub_uint8_t *) title, -1, 0);
   if (len < 0)
-    {
-      /* It is an invalid sequence.  */
-      grub_free (unicode_title);
-      return;
-    }
+    /* It is an invalid sequence.  */
+    return;
 
   grub_term_getcolor (term, &old_color_normal, &old_color_highlight);
   grub_term_setcolor (term, grub_color_menu_normal, grub_color_menu_highlight);
@@ -295,7 +296,6 @@ print_entry (int y, int highlight, grub_menu_entry_t entry,
 
   grub_term_setcolor (term, old_color_normal, old_color_highlight);
   grub_term_setcolorstate (term, GRUB_TERM_COLOR_NORMAL);
-  grub_free (unicode_title);
 }
 
 static void
@@ -315,10 +315,11 @@ print_entries (grub_menu_t menu, const struct menu_viewer_data *data)
 
   e = grub_menu_get_entry (menu, data->first);
 
+  grub_mm_arena_reset (data->arena);
   for (i = 0; i < data->num_entries; i++)
     {
       print_entry (GRUB_TERM_FIRST_ENTRY_Y + i, data->offset == i,
-		   e, data->term);
+		   e, data->term, data->arena);
       if (e)
 	e = e->next;
     }
@@ -422,12 +423,13 @@ menu_text_set_chosen_entry (int entry, void *dataptr)
     print_entries (data->menu, data);
   else
     {
+      grub_mm_arena_reset (data->arena);
       print_entry (GRUB_TERM_FIRST_ENTRY_Y + oldoffset, 0,
 		   grub_menu_get_entry (data->menu, data->first + oldoffset),
-		   data->term);
+		   data->term, data->arena);
       print_entry (GRUB_TERM_FIRST_ENTRY_Y + data->offset, 1,
 		   grub_menu_get_entry (data->menu, data->first + data->offset),
-		   data->term);
+		   data->term, data->arena);
     }
   grub_term_refresh (data->term);
 }
@@ -440,6 +442,8 @@ menu_text_fini (void *dataptr)
   grub_term_setcursor (data->term, 1);
   grub_term_cls (data->term);
 
+  grub_mm_arena_free (data->arena);
+  data->arena = 0;
 }
 
 static void
@@ -472,6 +476,14 @@ grub_menu_try_text (struct grub_term_output *term,
       return grub_errno;
     }
 
+  data->arena = grub_mm_arena_new ();
+  if (!data->arena)
+    {
+      grub_free (data);
+      grub_free (instance);
+      return grub_errno;
+    }
+
   data->term = term;
   instance->data = data;
   instance->set_chosen_entry = menu_text_set_chosen_entry;
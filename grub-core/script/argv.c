@@ -40,12 +40,32 @@ round_up_exp (unsigned v)
   return v;
 }
 
+/* Grow P, of OLD bytes, to NEW bytes.  An arena can't give memory back, so
+   P is only moved when it has to grow past OLD.  */
+static void *
+argv_realloc (struct grub_script_argv *argv, void *p, grub_size_t old,
+	      grub_size_t new)
+{
+  void *q;
+
+  if (! argv->arena)
+    return grub_realloc (p, new);
+
+  if (p && new <= old)
+    return p;
+
+  q = grub_mm_arena_alloc (argv->arena, new);
+  if (q && p)
+    grub_memcpy (q, p, old);
+  return q;
+}
+
 void
 grub_script_argv_free (struct grub_script_argv *argv)
 {
   unsigned i;
 
-  if (argv->args)
+  if (argv->args && ! argv->arena)
     {
       for (i = 0; i < argv->argc; i++)
 	grub_free (argv->args[i]);
@@ -63,7 +83,7 @@ int
 grub_script_argv_make (struct grub_script_argv *argv, int argc, char **args)
 {
   int i;
-  struct grub_script_argv r = { 0, 0, 0 };
+  struct grub_script_argv r = { 0, 0, 0, 0 };
 
   for (i = 0; i < argc; i++)
     if (grub_script_argv_next (&r)
@@ -85,7 +105,9 @@ grub_script_argv_next (struct grub_script_argv *argv)
   if (argv->args && argv->argc && argv->args[argv->argc - 1] == 0)
     return 0;
 
-  p = grub_realloc (p, round_up_exp ((argv->argc + 2) * sizeof (char *)));
+  p = argv_realloc (argv, p,
+		    p ? round_up_exp ((argv->argc + 1) * sizeof (char *)) : 0,
+		    round_up_exp ((argv->argc + 2) * sizeof (char *)));
   if (! p)
     return 1;
 
@@ -111,7 +133,8 @@ grub_script_argv_append (struct grub_script_argv *argv, const char *s,
 
   a = p ? grub_strlen (p) : 0;
 
-  p = grub_realloc (p, round_up_exp ((a + slen + 1) * sizeof (char)));
+  p = argv_realloc (argv, p, p ? round_up_exp ((a + 1) * sizeof (char)) : 0,
+		    round_up_exp ((a + slen + 1) * sizeof (char)));
   if (! p)
     return 1;
 
@@ -0,0 +1,371 @@
+/* cache.c - keep parsed scripts for texts that run again.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/time.h>
+#include <grub/i18n.h>
+#include <grub/script_sh.h>
+
+/* Menu entries, submenus and config files run the same text over and over.
+   A text is parsed a command at a time as it runs, like before, but each
+   command parsed is kept along with where it starts and ends in the text,
+   and texts are looked up by their contents.  Parsing doesn't depend on
+   anything but the text, except that it defines functions, so commands
+   that define one are parsed every time.  */
+#define GRUB_SCRIPT_CACHE_BUCKETS	32
+#define GRUB_SCRIPT_CACHE_MAX_BYTES	(256 * 1024)
+
+struct grub_script_cache_cmd
+{
+  grub_size_t start;
+  grub_size_t end;
+  struct grub_script *script;
+};
+
+struct grub_script_source
+{
+  struct grub_script_source *next;
+  struct grub_script_source *lru_prev;
+  struct grub_script_source *lru_next;
+  grub_uint32_t hash;
+  /* Runs of the text going on.  */
+  unsigned users;
+  /* Whether it is in the cache.  If not, it goes when the last run ends.  */
+  int cached;
+  /* Commands parsed, sorted by start.  */
+  struct grub_script_cache_cmd *cmds;
+  unsigned ncmds;
+  unsigned alloc;
+  grub_size_t len;
+  char text[0];
+};
+
+static struct grub_script_source *source_table[GRUB_SCRIPT_CACHE_BUCKETS];
+/* Most recently used first.  */
+static struct grub_script_source *source_lru_head, *source_lru_tail;
+static struct grub_script_cache_stats cache_stats;
+
+static grub_uint32_t
+source_hash (const char *text, grub_size_t *len)
+{
+  grub_uint32_t hash = 0;
+  const char *p;
+
+  for (p = text; *p; p++)
+    hash = hash * 31 + (grub_uint8_t) *p;
+  *len = p - text;
+  return hash;
+}
+
+static void
+source_lru_unlink (struct grub_script_source *src)
+{
+  if (src->lru_prev)
+    src->lru_prev->lru_next = src->lru_next;
+  else
+    source_lru_head = src->lru_next;
+  if (src->lru_next)
+    src->lru_next->lru_prev = src->lru_prev;
+  else
+    source_lru_tail = src->lru_prev;
+}
+
+static void
+source_lru_link (struct grub_script_source *src)
+{
+  src->lru_prev = NULL;
+  src->lru_next = source_lru_head;
+  if (source_lru_head)
+    source_lru_head->lru_prev = src;
+  else
+    source_lru_tail = src;
+  source_lru_head = src;
+}
+
+static void
+source_free (struct grub_script_source *src)
+{
+  unsigned i;
+
+  for (i = 0; i < src->ncmds; i++)
+    grub_script_unref (src->cmds[i].script);
+  grub_free (src->cmds);
+  grub_free (src);
+}
+
+/* Take SRC out of the cache, freeing it unless it is running.  */
+static void
+source_remove (struct grub_script_source *src)
+{
+  struct grub_script_source **p;
+
+  for (p = &source_table[src->hash % GRUB_SCRIPT_CACHE_BUCKETS]; *p;
+       p = &(*p)->next)
+    if (*p == src)
+      {
+	*p = src->next;
+	break;
+      }
+  source_lru_unlink (src);
+  src->cached = 0;
+  cache_stats.entries--;
+  cache_stats.bytes -= src->len;
+  if (! src->users)
+    source_free (src);
+}
+
+void
+grub_script_cache_flush (void)
+{
+  while (source_lru_head)
+    source_remove (source_lru_head);
+}
+
+void
+grub_script_cache_get_performance (struct grub_script_cache_stats *stats)
+{
+  *stats = cache_stats;
+}
+
+/* Find TEXT in the cache, or add it.  The result must be given back with
+   grub_script_source_put.  */
+struct grub_script_source *
+grub_script_source_get (const char *text)
+{
+  struct grub_script_source *src;
+  grub_uint32_t hash;
+  grub_size_t len;
+
+  hash = source_hash (text, &len);
+  for (src = source_table[hash % GRUB_SCRIPT_CACHE_BUCKETS]; src;
+       src = src->next)
+    if (src->hash == hash && src->len == len
+	&& grub_memcmp (src->text, text, len) == 0)
+      {
+	source_lru_unlink (src);
+	source_lru_link (src);
+	src->users++;
+	return src;
+      }
+
+  src = grub_zalloc (sizeof (*src) + len + 1);
+  if (! src)
+    return NULL;
+  src->hash = hash;
+  src->len = len;
+  src->users = 1;
+  grub_memcpy (src->text, text, len + 1);
+
+  /* A text too big for the cache is still run through it, uncached.  */
+  if (len > GRUB_SCRIPT_CACHE_MAX_BYTES)
+    return src;
+
+  while (source_lru_tail
+	 && cache_stats.bytes + len > GRUB_SCRIPT_CACHE_MAX_BYTES)
+    {
+      source_remove (source_lru_tail);
+      cache_stats.evictions++;
+    }
+
+  src->cached = 1;
+  src->next = source_table[hash % GRUB_SCRIPT_CACHE_BUCKETS];
+  source_table[hash % GRUB_SCRIPT_CACHE_BUCKETS] = src;
+  source_lru_link (src);
+  cache_stats.entries++;
+  cache_stats.bytes += len;
+  return src;
+}
+
+void
+grub_script_source_put (struct grub_script_source *src)
+{
+  if (--src->users == 0 && ! src->cached)
+    source_free (src);
+}
+
+static unsigned long
+count_lines (struct grub_script_source *src, grub_size_t start,
+	     grub_size_t end)
+{
+  unsigned long lines = 0;
+  grub_size_t i;
+
+  if (end > src->len)
+    end = src->len;
+  for (i = start; i < end; i++)
+    if (src->text[i] == '\n')
+      lines++;
+  return lines ? : 1;
+}
+
+/* Index of the first command of SRC starting at or after START.  */
+static unsigned
+find_cmd (struct grub_script_source *src, grub_size_t start)
+{
+  unsigned lo = 0, hi = src->ncmds;
+
+  while (lo < hi)
+    {
+      unsigned mid = lo + (hi - lo) / 2;
+
+      if (src->cmds[mid].start < start)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Remember SCRIPT as the command from START to END of SRC.  Failing to is
+   not an error.  */
+static void
+add_cmd (struct grub_script_source *src, grub_size_t start, grub_size_t end,
+	 struct grub_script *script)
+{
+  unsigned i = find_cmd (src, start);
+
+  if (src->ncmds == src->alloc)
+    {
+      unsigned alloc = src->alloc ? src->alloc * 2 : 8;
+      struct grub_script_cache_cmd *cmds;
+
+      cmds = grub_realloc (src->cmds, alloc * sizeof (cmds[0]));
+      if (! cmds)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  return;
+	}
+      src->cmds = cmds;
+      src->alloc = alloc;
+    }
+
+  grub_memmove (src->cmds + i + 1, src->cmds + i,
+		(src->ncmds - i) * sizeof (src->cmds[0]));
+  src->cmds[i].start = start;
+  src->cmds[i].end = end;
+  src->cmds[i].script = grub_script_ref (script);
+  src->ncmds++;
+}
+
+/* Parse the command of SRC at *POS, or find it parsed already, and move
+   *POS past it.  Return 1 and the command in *SCRIPT, which must be given
+   back with grub_script_unref, 0 at the end of the text, or -1 if it
+   doesn't parse.  */
+int
+grub_script_source_next (struct grub_script_source *src, grub_size_t *pos,
+			 struct grub_script **script)
+{
+  grub_size_t offset = *pos;
+  grub_size_t start = offset;
+  unsigned functions;
+  grub_uint64_t t;
+  unsigned i;
+  char *first_line;
+
+  /* Hand out the text a line at a time.  Past its end there is a last
+     empty line, then nothing.  */
+  auto grub_err_t getline (char **line, int cont);
+  grub_err_t getline (char **line, int cont __attribute__ ((unused)))
+  {
+    const char *p;
+
+    if (offset > src->len)
+      {
+	*line = 0;
+	return 0;
+      }
+
+    p = grub_strchr (src->text + offset, '\n');
+    if (p)
+      {
+	*line = grub_strndup (src->text + offset, p - (src->text + offset));
+	offset = p - src->text + 1;
+      }
+    else
+      {
+	*line = grub_strdup (src->text + offset);
+	offset = src->len + 1;
+      }
+    return 0;
+  }
+
+  *script = 0;
+  if (offset > src->len)
+    return 0;
+
+  i = find_cmd (src, start);
+  if (i < src->ncmds && src->cmds[i].start == start)
+    {
+      cache_stats.hits++;
+      cache_stats.lines_reused += count_lines (src, start, src->cmds[i].end);
+      *script = grub_script_ref (src->cmds[i].script);
+      *pos = src->cmds[i].end;
+      return 1;
+    }
+
+  getline (&first_line, 0);
+  *pos = offset;
+  if (! first_line)
+    return -1;
+
+  functions = grub_script_functions_created;
+  t = grub_get_time_ms ();
+  *script = grub_script_parse (first_line, getline);
+  grub_free (first_line);
+  cache_stats.parse_ms += grub_get_time_ms () - t;
+  cache_stats.misses++;
+  cache_stats.lines_parsed += count_lines (src, start, offset);
+  *pos = offset;
+
+  if (! *script)
+    return -1;
+
+  if (src->cached && functions == grub_script_functions_created)
+    add_cmd (src, start, offset, *script);
+  return 1;
+}
+
+grub_err_t
+grub_script_cache_info (grub_command_t cmd __attribute__ ((unused)),
+			int argc __attribute__ ((unused)),
+			char *argv[] __attribute__ ((unused)))
+{
+  struct grub_script_cache_stats stats;
+  grub_uint64_t saved = 0;
+
+  grub_script_cache_get_performance (&stats);
+
+  /* Parsing is too quick to time a command at a time, so estimate what
+     the reused lines would have cost from the average.  */
+  if (stats.lines_parsed)
+    saved = grub_divmod64 (stats.parse_ms * stats.lines_reused,
+			   stats.lines_parsed, 0);
+
+  grub_printf_ (N_("Script cache: %lu hits, %lu misses, %lu evictions\n"),
+		stats.hits, stats.misses, stats.evictions);
+  grub_printf_ (N_("%lu texts cached, %lu KiB of %lu KiB\n"),
+		stats.entries, (unsigned long) (stats.bytes >> 10),
+		(unsigned long) (GRUB_SCRIPT_CACHE_MAX_BYTES >> 10));
+  grub_printf_ (N_("%lu lines parsed in %llu ms, %lu lines reused,"
+		   " about %llu ms saved\n"),
+		stats.lines_parsed, (unsigned long long) stats.parse_ms,
+		stats.lines_reused, (unsigned long long) saved);
+  return GRUB_ERR_NONE;
+}
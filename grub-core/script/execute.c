@@ -49,6 +49,51 @@ struct grub_script_scope
 };
 static struct grub_script_scope *scope = 0;
 
+/* The arguments of a command are allocated from an arena for the nesting
+   level it runs at, and released at once when it's done.  Deeper levels use
+   the heap.  */
+#define GRUB_SCRIPT_ARGV_ARENAS	8
+static grub_mm_arena_t argv_arenas[GRUB_SCRIPT_ARGV_ARENAS];
+static unsigned argv_depth;
+
+static grub_mm_arena_t
+argv_arena_get (void)
+{
+  grub_mm_arena_t arena = 0;
+
+  if (argv_depth < GRUB_SCRIPT_ARGV_ARENAS)
+    {
+      if (! argv_arenas[argv_depth])
+	{
+	  argv_arenas[argv_depth] = grub_mm_arena_new ();
+	  grub_errno = GRUB_ERR_NONE;
+	}
+      arena = argv_arenas[argv_depth];
+    }
+  argv_depth++;
+  return arena;
+}
+
+static void
+argv_arena_put (grub_mm_arena_t arena)
+{
+  argv_depth--;
+  if (arena)
+    grub_mm_arena_reset (arena);
+}
+
+void
+grub_script_argv_arenas_free (void)
+{
+  unsigned i;
+
+  for (i = 0; i < GRUB_SCRIPT_ARGV_ARENAS; i++)
+    {
+      grub_mm_arena_free (argv_arenas[i]);
+      argv_arenas[i] = 0;
+    }
+}
+
 /* Wildcard translator for GRUB script.  */
 struct grub_script_wildcard_translator *grub_wildcard_translator;
 
@@ -137,7 +182,7 @@ grub_script_setparams (grub_command_t cmd __attribute__((unused)),
 		       int argc, char **args)
 {
   struct grub_script_scope *new_scope;
-  struct grub_script_argv argv = { 0, 0, 0 };
+  struct grub_script_argv argv = { 0, 0, 0, 0 };
 
   if (! scope)
     return GRUB_ERR_INVALID_COMMAND;
@@ -212,7 +257,7 @@ static char **
 grub_script_env_get (const char *name, grub_script_arg_type_t type)
 {
   unsigned i;
-  struct grub_script_argv result = { 0, 0, 0 };
+  struct grub_script_argv result = { 0, 0, 0, 0 };
 
   if (grub_script_argv_next (&result))
     goto fail;
@@ -531,7 +576,8 @@ gettext_append (struct grub_script_argv *result, const char *orig_str)
   return rval;
 }
 
-/* Convert arguments in ARGLIST into ARGV form.  */
+/* Convert arguments in ARGLIST into ARGV form, in the arena of ARGV if it
+   has one.  */
 static int
 grub_script_arglist_to_argv (struct grub_script_arglist *arglist,
 			     struct grub_script_argv *argv)
@@ -539,7 +585,7 @@ grub_script_arglist_to_argv (struct grub_script_arglist *arglist,
   int i;
   char **values = 0;
   struct grub_script_arg *arg = 0;
-  struct grub_script_argv result = { 0, 0, 0 };
+  struct grub_script_argv result = { 0, 0, 0, argv->arena };
 
   auto int append (const char *s, int escape_type);
   int append (const char *s, int escape_type)
@@ -736,29 +782,18 @@ grub_script_execute_sourcecode (const char *source, int argc, char **args)
 {
   grub_err_t ret = 0;
   struct grub_script *parsed_script;
+  struct grub_script_source *src;
   struct grub_script_scope new_scope;
   struct grub_script_scope *old_scope;
+  grub_size_t pos = 0;
+  int r;
 
-  auto grub_err_t getline (char **line, int cont);
-  grub_err_t getline (char **line, int cont __attribute__ ((unused)))
-  {
-    const char *p;
-
-    if (! source)
-      {
-	*line = 0;
-	return 0;
-      }
-
-    p = grub_strchr (source, '\n');
-
-    if (p)
-      *line = grub_strndup (source, p - source);
-    else
-      *line = grub_strdup (source);
-    source = p ? p + 1 : 0;
+  if (! source)
     return 0;
-  }
+
+  src = grub_script_source_get (source);
+  if (! src)
+    return grub_errno;
 
   new_scope.argv.argc = argc;
   new_scope.argv.args = args;
@@ -767,23 +802,16 @@ grub_script_execute_sourcecode (const char *source, int argc, char **args)
   old_scope = scope;
   scope = &new_scope;
 
-  while (source)
+  while ((r = grub_script_source_next (src, &pos, &parsed_script)) > 0)
     {
-      char *line;
-
-      getline (&line, 0);
-      parsed_script = grub_script_parse (line, getline);
-      if (! parsed_script)
-	{
-	  ret = grub_errno;
-	  break;
-	}
-
       ret = grub_script_execute (parsed_script);
-      grub_free (line);
+      grub_script_unref (parsed_script);
     }
+  if (r < 0)
+    ret = grub_errno;
 
   scope = old_scope;
+  grub_script_source_put (src);
   return ret;
 }
 
@@ -800,11 +828,15 @@ grub_script_execute_cmdline (struct grub_script_cmd *cmd)
   int argc;
   char **args;
   int invert;
-  struct grub_script_argv argv = { 0, 0, 0 };
+  struct grub_script_argv argv = { 0, 0, 0, 0 };
 
   /* Lookup the command.  */
+  argv.arena = argv_arena_get ();
   if (grub_script_arglist_to_argv (cmdline->arglist, &argv) || ! argv.args[0])
-    return grub_errno;
+    {
+      argv_arena_put (argv.arena);
+      return grub_errno;
+    }
 
   invert = 0;
   argc = argv.argc - 1;
@@ -815,6 +847,7 @@ grub_script_execute_cmdline (struct grub_script_cmd *cmd)
       if (argv.argc < 2 || ! argv.args[1])
 	{
 	  grub_script_argv_free (&argv);
+	  argv_arena_put (argv.arena);
 	  return grub_error (GRUB_ERR_BAD_ARGUMENT,
 			     N_("no command is specified"));
 	}
@@ -853,6 +886,7 @@ grub_script_execute_cmdline (struct grub_script_cmd *cmd)
 	  grub_script_env_set ("?", errnobuf);
 
 	  grub_script_argv_free (&argv);
+	  argv_arena_put (argv.arena);
 	  grub_print_error ();
 
 	  return 0;
@@ -891,6 +925,7 @@ grub_script_execute_cmdline (struct grub_script_cmd *cmd)
 
   /* Free arguments.  */
   grub_script_argv_free (&argv);
+  argv_arena_put (argv.arena);
 
   if (grub_errno == GRUB_ERR_TEST_FAILURE)
     grub_errno = GRUB_ERR_NONE;
@@ -956,11 +991,15 @@ grub_script_execute_cmdfor (struct grub_script_cmd *cmd)
 {
   unsigned i;
   grub_err_t result;
-  struct grub_script_argv argv = { 0, 0, 0 };
+  struct grub_script_argv argv = { 0, 0, 0, 0 };
   struct grub_script_cmdfor *cmdfor = (struct grub_script_cmdfor *) cmd;
 
+  argv.arena = argv_arena_get ();
   if (grub_script_arglist_to_argv (cmdfor->words, &argv))
-    return grub_errno;
+    {
+      argv_arena_put (argv.arena);
+      return grub_errno;
+    }
 
   active_loops++;
   result = 0;
@@ -983,6 +1022,7 @@ grub_script_execute_cmdfor (struct grub_script_cmd *cmd)
 
   active_loops--;
   grub_script_argv_free (&argv);
+  argv_arena_put (argv.arena);
   return result;
 }
 
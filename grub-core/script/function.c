@@ -23,6 +23,8 @@
 #include <grub/charset.h>
 
 grub_script_function_t grub_script_function_list;
+struct grub_hashmap grub_script_function_map;
+unsigned grub_script_functions_created;
 
 grub_script_function_t
 grub_script_function_create (struct grub_script_arg *functionname_arg,
@@ -31,6 +33,17 @@ grub_script_function_create (struct grub_script_arg *functionname_arg,
   grub_script_function_t func;
   grub_script_function_t *p;
 
+  grub_script_functions_created++;
+
+  /* If the function already exists, overwrite the old function.  */
+  func = grub_hashmap_find (&grub_script_function_map, functionname_arg->str);
+  if (func)
+    {
+      grub_script_free (func->func);
+      func->func = cmd;
+      return func;
+    }
+
   func = (grub_script_function_t) grub_malloc (sizeof (*func));
   if (! func)
     return 0;
@@ -42,6 +55,13 @@ grub_script_function_create (struct grub_script_arg *functionname_arg,
       return 0;
     }
 
+  if (grub_hashmap_insert (&grub_script_function_map, func->name, func))
+    {
+      grub_free (func->name);
+      grub_free (func);
+      return 0;
+    }
+
   func->func = cmd;
 
   /* Keep the list sorted for simplicity.  */
@@ -54,22 +74,8 @@ grub_script_function_create (struct grub_script_arg *functionname_arg,
       p = &((*p)->next);
     }
 
-  /* If the function already exists, overwrite the old function.  */
-  if (*p && grub_strcmp ((*p)->name, func->name) == 0)
-    {
-      grub_script_function_t q;
-
-      q = *p;
-      grub_script_free (q->func);
-      q->func = cmd;
-      grub_free (func);
-      func = q;
-    }
-  else
-    {
-      func->next = *p;
-      *p = func;
-    }
+  func->next = *p;
+  *p = func;
 
   return func;
 }
@@ -83,6 +89,7 @@ grub_script_function_remove (const char *name)
     if (grub_strcmp (name, q->name) == 0)
       {
         *p = q->next;
+	grub_hashmap_remove (&grub_script_function_map, q->name);
 	grub_free (q->name);
 	grub_script_free (q->func);
         grub_free (q);
@@ -95,10 +102,7 @@ grub_script_function_find (char *functionname)
 {
   grub_script_function_t func;
 
-  for (func = grub_script_function_list; func; func = func->next)
-    if (grub_strcmp (functionname, func->name) == 0)
-      break;
-
+  func = grub_hashmap_find (&grub_script_function_map, functionname);
   if (! func)
     {
       char tmp[21];
@@ -46,6 +46,7 @@ static grub_command_t cmd_continue;
 static grub_command_t cmd_shift;
 static grub_command_t cmd_setparams;
 static grub_command_t cmd_return;
+static grub_command_t cmd_scriptcache;
 
 void
 grub_script_init (void)
@@ -70,6 +71,10 @@ grub_script_init (void)
 					 has exactly the same semanics as bash
 					 equivalent.  */
 				      N_("Return from a function."));
+  cmd_scriptcache = grub_register_command ("scriptcache",
+					   grub_script_cache_info, 0,
+					   N_("Show parsed script cache"
+					      " statistics."));
 }
 
 void
@@ -94,4 +99,11 @@ grub_script_fini (void)
   if (cmd_return)
     grub_unregister_command (cmd_return);
   cmd_return = 0;
+
+  if (cmd_scriptcache)
+    grub_unregister_command (cmd_scriptcache);
+  cmd_scriptcache = 0;
+
+  grub_script_cache_flush ();
+  grub_script_argv_arenas_free ();
 }
@@ -23,6 +23,7 @@
 #include <grub/mm.h>
 #include <grub/misc.h>
 #include <grub/bufio.h>
+#include <grub/deflate.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
@@ -54,732 +55,459 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #define PNG_FILTER_VALUE_LAST	5
 
 #define PNG_CHUNK_IHDR		0x49484452
+#define PNG_CHUNK_PLTE		0x504c5445
+#define PNG_CHUNK_TRNS		0x74524e53
 #define PNG_CHUNK_IDAT		0x49444154
 #define PNG_CHUNK_IEND		0x49454e44
 
-#define Z_DEFLATED		8
-#define Z_FLAG_DICT		32
+/* Chunks longer than this are invalid.  */
+#define PNG_CHUNK_MAX		0x7fffffff
 
-#define INFLATE_STORED		0
-#define INFLATE_FIXED		1
-#define INFLATE_DYNAMIC		2
-
-#define WSIZE			0x8000
-
-#define DEFLATE_HCLEN_BASE	4
-#define DEFLATE_HCLEN_MAX	19
-#define DEFLATE_HLIT_BASE	257
-#define DEFLATE_HLIT_MAX	288
-#define DEFLATE_HDIST_BASE	1
-#define DEFLATE_HDIST_MAX	30
-
-#define DEFLATE_HUFF_LEN	16
+/* The first allocation for the compressed image data, grown by doubling.  */
+#define PNG_IDAT_MIN		0x10000
 
 #ifdef PNG_DEBUG
 static grub_command_t cmd;
 #endif
 
-struct huff_table
-{
-  int *values, *maxval, *offset;
-  int num_values, max_length;
-};
-
 struct grub_png_data
 {
   grub_file_t file;
   struct grub_video_bitmap **bitmap;
 
-  int bit_count, bit_save;
-
-  grub_uint32_t next_offset;
-
-  int image_width, image_height, bpp, is_16bit, raw_bytes;
-  grub_uint8_t *image_data;
+  int image_width, image_height;
+  int color_type, color_bits, interlace;
 
-  int inside_idat, idat_remain;
+  /* Samples per pixel, bits per pixel, and bytes per output pixel.  */
+  int channels, pixel_bits, bpp;
 
-  int code_values[DEFLATE_HLIT_MAX];
-  int code_maxval[DEFLATE_HUFF_LEN];
-  int code_offset[DEFLATE_HUFF_LEN];
+  /* RGBA entries, made opaque unless tRNS says otherwise.  */
+  grub_uint8_t palette[256][4];
+  int palette_size, palette_alpha;
 
-  int dist_values[DEFLATE_HDIST_MAX];
-  int dist_maxval[DEFLATE_HUFF_LEN];
-  int dist_offset[DEFLATE_HUFF_LEN];
-
-  struct huff_table code_table;
-  struct huff_table dist_table;
-
-  grub_uint8_t slide[WSIZE];
-  int wp;
-
-  grub_uint8_t *cur_rgb;
-
-  int cur_column, cur_filter, first_line;
+  /* The concatenated IDAT chunks.  */
+  grub_uint8_t *idat;
+  grub_size_t idat_size, idat_alloc;
 };
 
-static grub_uint32_t
-grub_png_get_dword (struct grub_png_data *data)
+/* The first pixel of a pass and the steps to its next column and row.  */
+struct grub_png_pass
 {
-  grub_uint32_t r;
-
-  r = 0;
-  grub_file_read (data->file, &r, sizeof (grub_uint32_t));
-
-  return grub_be_to_cpu32 (r);
-}
-
-static grub_uint8_t
-grub_png_get_byte (struct grub_png_data *data)
-{
-  grub_uint8_t r;
-
-  if ((data->inside_idat) && (data->idat_remain == 0))
-    {
-      grub_uint32_t len, type;
-
-      do
-	{
-          /* Skip crc checksum.  */
-	  grub_png_get_dword (data);
-
-          if (data->file->offset != data->next_offset)
-            {
-              grub_error (GRUB_ERR_BAD_FILE_TYPE,
-                          "png: chunk size error");
-              return 0;
-            }
-
-	  len = grub_png_get_dword (data);
-	  type = grub_png_get_dword (data);
-	  if (type != PNG_CHUNK_IDAT)
-	    {
-	      grub_error (GRUB_ERR_BAD_FILE_TYPE,
-			  "png: unexpected end of data");
-	      return 0;
-	    }
-
-          data->next_offset = data->file->offset + len + 4;
-	}
-      while (len == 0);
-      data->idat_remain = len;
-    }
-
-  r = 0;
-  grub_file_read (data->file, &r, 1);
-
-  if (data->inside_idat)
-    data->idat_remain--;
+  int x0, y0, dx, dy;
+};
 
-  return r;
-}
+/* Adam7 interlacing.  */
+static const struct grub_png_pass adam7[] =
+  {
+    { 0, 0, 8, 8 },
+    { 4, 0, 8, 8 },
+    { 0, 4, 4, 8 },
+    { 2, 0, 4, 4 },
+    { 0, 2, 2, 4 },
+    { 1, 0, 2, 2 },
+    { 0, 1, 1, 2 }
+  };
+
+static const struct grub_png_pass no_interlace[] =
+  {
+    { 0, 0, 1, 1 }
+  };
 
-static int
-grub_png_get_bits (struct grub_png_data *data, int num)
+static grub_err_t
+grub_png_read (struct grub_png_data *data, void *buf, grub_size_t len)
 {
-  int code, shift;
-
-  if (data->bit_count == 0)
+  if (grub_file_read (data->file, buf, len) != (grub_ssize_t) len)
     {
-      data->bit_save = grub_png_get_byte (data);
-      data->bit_count = 8;
+      if (!grub_errno)
+	grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: unexpected end of file");
+      return grub_errno;
     }
-
-  code = 0;
-  shift = 0;
-  while (grub_errno == 0)
-    {
-      int n;
-
-      n = data->bit_count;
-      if (n > num)
-	n = num;
-
-      code += (int) (data->bit_save & ((1 << n) - 1)) << shift;
-      num -= n;
-      if (!num)
-	{
-	  data->bit_count -= n;
-	  data->bit_save >>= n;
-	  break;
-	}
-
-      shift += n;
-
-      data->bit_save = grub_png_get_byte (data);
-      data->bit_count = 8;
-    }
-
-  return code;
+  return GRUB_ERR_NONE;
 }
 
 static grub_err_t
-grub_png_decode_image_header (struct grub_png_data *data)
+grub_png_decode_image_header (struct grub_png_data *data, grub_uint32_t len)
 {
-  int color_type;
-  int color_bits;
+  grub_uint8_t hdr[13];
+  int valid_bits;
 
-  data->image_width = grub_png_get_dword (data);
-  data->image_height = grub_png_get_dword (data);
-
-  if ((!data->image_height) || (!data->image_width))
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid image size");
-
-  color_bits = grub_png_get_byte (data);
-  if ((color_bits != 8) && (color_bits != 16))
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-                       "png: bit depth must be 8 or 16");
-  data->is_16bit = (color_bits == 16);
+  if (len != sizeof (hdr))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: chunk size error");
+  if (grub_png_read (data, hdr, sizeof (hdr)))
+    return grub_errno;
 
-  color_type = grub_png_get_byte (data);
-  if (color_type == PNG_COLOR_TYPE_RGB)
-    {
-      if (grub_video_bitmap_create (data->bitmap, data->image_width,
-				    data->image_height,
-				    GRUB_VIDEO_BLIT_FORMAT_RGB_888))
-	return grub_errno;
-      data->bpp = 3;
-    }
-  else if (color_type == PNG_COLOR_TYPE_RGBA)
-    {
-      if (grub_video_bitmap_create (data->bitmap, data->image_width,
-				    data->image_height,
-				    GRUB_VIDEO_BLIT_FORMAT_RGBA_8888))
-	return grub_errno;
-      data->bpp = 4;
-    }
-  else
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-		       "png: color type not supported");
+  data->image_width = grub_be_to_cpu32 (grub_get_unaligned32 (hdr));
+  data->image_height = grub_be_to_cpu32 (grub_get_unaligned32 (hdr + 4));
+  data->color_bits = hdr[8];
+  data->color_type = hdr[9];
 
-  if (data->is_16bit)
-    {
-      data->bpp <<= 1;
-
-      data->image_data = grub_malloc (data->image_height *
-                                      data->image_width *  data->bpp);
-      if (grub_errno)
-        return grub_errno;
+  /* The bitmap takes up to 4 bytes a pixel and its size must fit in an
+     unsigned int.  */
+  if (data->image_width <= 0 || data->image_height <= 0
+      || ((grub_uint64_t) data->image_width * data->image_height * 4
+	  > GRUB_UINT_MAX))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid image size");
 
-      data->cur_rgb = data->image_data;
-    }
-  else
+  switch (data->color_type)
     {
-      data->image_data = 0;
-      data->cur_rgb = (*data->bitmap)->data;
+    case PNG_COLOR_TYPE_GRAY:
+      data->channels = 1;
+      valid_bits = 1 | 2 | 4 | 8 | 16;
+      break;
+    case PNG_COLOR_TYPE_PALETTE:
+      data->channels = 1;
+      valid_bits = 1 | 2 | 4 | 8;
+      break;
+    case PNG_COLOR_TYPE_RGB:
+      data->channels = 3;
+      valid_bits = 8 | 16;
+      break;
+    case PNG_COLOR_TYPE_GRAYA:
+      data->channels = 2;
+      valid_bits = 8 | 16;
+      break;
+    case PNG_COLOR_TYPE_RGBA:
+      data->channels = 4;
+      valid_bits = 8 | 16;
+      break;
+    default:
+      return grub_error (GRUB_ERR_BAD_FILE_TYPE,
+			 "png: color type not supported");
     }
 
-  data->raw_bytes = data->image_height * (data->image_width + 1) * data->bpp;
+  if (data->color_bits > 16 || !(data->color_bits & valid_bits)
+      || (data->color_bits & (data->color_bits - 1)))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid bit depth");
+  data->pixel_bits = data->channels * data->color_bits;
 
-  data->cur_column = 0;
-  data->first_line = 1;
+  /* A line of samples and its filter byte, counted in bits.  */
+  if ((grub_uint64_t) data->image_width * data->pixel_bits + 15
+      > GRUB_ULONG_MAX)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid image size");
 
-  if (grub_png_get_byte (data) != PNG_COMPRESSION_BASE)
+  if (hdr[10] != PNG_COMPRESSION_BASE)
     return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 		       "png: compression method not supported");
 
-  if (grub_png_get_byte (data) != PNG_FILTER_TYPE_BASE)
+  if (hdr[11] != PNG_FILTER_TYPE_BASE)
     return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 		       "png: filter method not supported");
 
-  if (grub_png_get_byte (data) != PNG_INTERLACE_NONE)
+  data->interlace = hdr[12];
+  if (data->interlace != PNG_INTERLACE_NONE
+      && data->interlace != PNG_INTERLACE_ADAM7)
     return grub_error (GRUB_ERR_BAD_FILE_TYPE,
 		       "png: interlace method not supported");
 
-  /* Skip crc checksum.  */
-  grub_png_get_dword (data);
-
-  return grub_errno;
-}
-
-/* Order of the bit length code lengths.  */
-static const grub_uint8_t bitorder[] = {
-  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
-};
-
-/* Copy lengths for literal codes 257..285.  */
-static const int cplens[] = {
-  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
-  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0
-};
-
-/* Extra bits for literal codes 257..285.  */
-static const grub_uint8_t cplext[] = {
-  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
-  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 99, 99
-};				/* 99==invalid  */
-
-/* Copy offsets for distance codes 0..29.  */
-static const int cpdist[] = {
-  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
-  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
-  8193, 12289, 16385, 24577
-};
-
-/* Extra bits for distance codes.  */
-static const grub_uint8_t cpdext[] = {
-  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
-  7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
-  12, 12, 13, 13
-};
-
-static void
-grub_png_init_huff_table (struct huff_table *ht, int cur_maxlen,
-			  int *cur_values, int *cur_maxval, int *cur_offset)
-{
-  ht->values = cur_values;
-  ht->maxval = cur_maxval;
-  ht->offset = cur_offset;
-  ht->num_values = 0;
-  ht->max_length = cur_maxlen;
-  grub_memset (cur_maxval, 0, sizeof (int) * cur_maxlen);
-}
-
-static void
-grub_png_insert_huff_item (struct huff_table *ht, int code, int len)
-{
-  int i, n;
-
-  if (len == 0)
-    return;
-
-  if (len > ht->max_length)
-    {
-      grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid code length");
-      return;
-    }
-
-  n = 0;
-  for (i = len; i < ht->max_length; i++)
-    n += ht->maxval[i];
-
-  for (i = 0; i < n; i++)
-    ht->values[ht->num_values - i] = ht->values[ht->num_values - i - 1];
-
-  ht->values[ht->num_values - n] = code;
-  ht->num_values++;
-  ht->maxval[len - 1]++;
+  return GRUB_ERR_NONE;
 }
 
-static void
-grub_png_build_huff_table (struct huff_table *ht)
+static grub_err_t
+grub_png_decode_palette (struct grub_png_data *data, grub_uint32_t len)
 {
-  int base, ofs, i;
-
-  base = 0;
-  ofs = 0;
-  for (i = 0; i < ht->max_length; i++)
-    {
-      base += ht->maxval[i];
-      ofs += ht->maxval[i];
-
-      ht->maxval[i] = base;
-      ht->offset[i] = ofs - base;
-
-      base <<= 1;
-    }
-}
+  grub_uint8_t buf[256 * 3];
+  int i;
 
-static int
-grub_png_get_huff_code (struct grub_png_data *data, struct huff_table *ht)
-{
-  int code, i;
+  if (len % 3 || len > sizeof (buf))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid palette");
+  if (grub_png_read (data, buf, len))
+    return grub_errno;
 
-  code = 0;
-  for (i = 0; i < ht->max_length; i++)
+  data->palette_size = len / 3;
+  for (i = 0; i < data->palette_size; i++)
     {
-      code = (code << 1) + grub_png_get_bits (data, 1);
-      if (code < ht->maxval[i])
-	return ht->values[code + ht->offset[i]];
+      data->palette[i][0] = buf[i * 3];
+      data->palette[i][1] = buf[i * 3 + 1];
+      data->palette[i][2] = buf[i * 3 + 2];
+      data->palette[i][3] = 0xff;
     }
-  return 0;
+  return GRUB_ERR_NONE;
 }
 
+/* Only palette transparency is applied; a transparent color key of a gray
+   or RGB image is ignored.  */
 static grub_err_t
-grub_png_init_fixed_block (struct grub_png_data *data)
+grub_png_decode_transparency (struct grub_png_data *data, grub_uint32_t len)
 {
-  int i;
-
-  grub_png_init_huff_table (&data->code_table, DEFLATE_HUFF_LEN,
-			    data->code_values, data->code_maxval,
-			    data->code_offset);
-
-  for (i = 0; i < 144; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 8);
-
-  for (; i < 256; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 9);
-
-  for (; i < 280; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 7);
-
-  for (; i < DEFLATE_HLIT_MAX; i++)
-    grub_png_insert_huff_item (&data->code_table, i, 8);
+  grub_uint8_t buf[256];
+  grub_uint32_t i;
 
-  grub_png_build_huff_table (&data->code_table);
+  if (data->color_type != PNG_COLOR_TYPE_PALETTE)
+    return GRUB_ERR_NONE;
 
-  grub_png_init_huff_table (&data->dist_table, DEFLATE_HUFF_LEN,
-			    data->dist_values, data->dist_maxval,
-			    data->dist_offset);
-
-  for (i = 0; i < DEFLATE_HDIST_MAX; i++)
-    grub_png_insert_huff_item (&data->dist_table, i, 5);
-
-  grub_png_build_huff_table (&data->dist_table);
+  if (len > (grub_uint32_t) data->palette_size)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: invalid transparency");
+  if (grub_png_read (data, buf, len))
+    return grub_errno;
 
-  return grub_errno;
+  for (i = 0; i < len; i++)
+    data->palette[i][3] = buf[i];
+  data->palette_alpha = 1;
+  return GRUB_ERR_NONE;
 }
 
+/* Append the chunk to the compressed data with a single read.  */
 static grub_err_t
-grub_png_init_dynamic_block (struct grub_png_data *data)
+grub_png_read_image_data (struct grub_png_data *data, grub_uint32_t len)
 {
-  int nl, nd, nb, i, prev;
-  struct huff_table cl;
-  int cl_values[sizeof (bitorder)];
-  int cl_maxval[8];
-  int cl_offset[8];
-  grub_uint8_t lens[DEFLATE_HCLEN_MAX];
-
-  nl = DEFLATE_HLIT_BASE + grub_png_get_bits (data, 5);
-  nd = DEFLATE_HDIST_BASE + grub_png_get_bits (data, 5);
-  nb = DEFLATE_HCLEN_BASE + grub_png_get_bits (data, 4);
-
-  if ((nl > DEFLATE_HLIT_MAX) || (nd > DEFLATE_HDIST_MAX) ||
-      (nb > DEFLATE_HCLEN_MAX))
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: too much data");
-
-  grub_png_init_huff_table (&cl, 8, cl_values, cl_maxval, cl_offset);
-
-  for (i = 0; i < nb; i++)
-    lens[bitorder[i]] = grub_png_get_bits (data, 3);
-
-  for (; i < DEFLATE_HCLEN_MAX; i++)
-    lens[bitorder[i]] = 0;
-
-  for (i = 0; i < DEFLATE_HCLEN_MAX; i++)
-    grub_png_insert_huff_item (&cl, i, lens[i]);
-
-  grub_png_build_huff_table (&cl);
-
-  grub_png_init_huff_table (&data->code_table, DEFLATE_HUFF_LEN,
-			    data->code_values, data->code_maxval,
-			    data->code_offset);
-
-  grub_png_init_huff_table (&data->dist_table, DEFLATE_HUFF_LEN,
-			    data->dist_values, data->dist_maxval,
-			    data->dist_offset);
-
-  prev = 0;
-  for (i = 0; i < nl + nd; i++)
+  if (len > data->idat_alloc - data->idat_size)
     {
-      int n, code;
-      struct huff_table *ht;
+      grub_size_t alloc = data->idat_alloc ? : PNG_IDAT_MIN;
+      grub_uint8_t *idat;
 
-      if (grub_errno)
-	return grub_errno;
-
-      if (i < nl)
+      while (alloc - data->idat_size < len)
 	{
-	  ht = &data->code_table;
-	  code = i;
-	}
-      else
-	{
-	  ht = &data->dist_table;
-	  code = i - nl;
+	  if (alloc > GRUB_ULONG_MAX / 2)
+	    return grub_error (GRUB_ERR_OUT_OF_MEMORY, "png: image too big");
+	  alloc *= 2;
 	}
 
-      n = grub_png_get_huff_code (data, &cl);
-      if (n < 16)
-	{
-	  grub_png_insert_huff_item (ht, code, n);
-	  prev = n;
-	}
-      else if (n == 16)
-	{
-	  int c;
-
-	  c = 3 + grub_png_get_bits (data, 2);
-	  while (c > 0)
-	    {
-	      grub_png_insert_huff_item (ht, code++, prev);
-	      i++;
-	      c--;
-	    }
-	  i--;
-	}
-      else if (n == 17)
-	i += 3 + grub_png_get_bits (data, 3) - 1;
-      else
-	i += 11 + grub_png_get_bits (data, 7) - 1;
+      idat = grub_realloc (data->idat, alloc);
+      if (!idat)
+	return grub_errno;
+      data->idat = idat;
+      data->idat_alloc = alloc;
     }
 
-  grub_png_build_huff_table (&data->code_table);
-  grub_png_build_huff_table (&data->dist_table);
+  if (grub_png_read (data, data->idat + data->idat_size, len))
+    return grub_errno;
+  data->idat_size += len;
+  return GRUB_ERR_NONE;
+}
 
-  return grub_errno;
+static inline grub_uint8_t
+grub_png_paeth (grub_uint8_t a, grub_uint8_t b, grub_uint8_t c)
+{
+  int p = a + b - c;
+  int pa = p > a ? p - a : a - p;
+  int pb = p > b ? p - b : b - p;
+  int pc = p > c ? p - c : c - p;
+
+  if (pa <= pb && pa <= pc)
+    return a;
+  if (pb <= pc)
+    return b;
+  return c;
 }
 
+/* Undo the filter of a whole scanline of LEN bytes in place.  PREV is the
+   unfiltered previous line of the pass, all zero for its first line.
+   Bytes DIST apart belong to neighbouring pixels.  */
 static grub_err_t
-grub_png_output_byte (struct grub_png_data *data, grub_uint8_t n)
+grub_png_unfilter (grub_uint8_t *cur, const grub_uint8_t *prev,
+		   grub_size_t len, grub_size_t dist, int filter)
 {
-  int row_bytes;
-
-  if (--data->raw_bytes < 0)
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "image size overflown");
+  grub_size_t i;
 
-  if (data->cur_column == 0)
+  switch (filter)
     {
-      if (n >= PNG_FILTER_VALUE_LAST)
-	return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid filter value");
-
-      data->cur_filter = n;
+    case PNG_FILTER_VALUE_NONE:
+      break;
+
+    case PNG_FILTER_VALUE_SUB:
+      for (i = dist; i < len; i++)
+	cur[i] += cur[i - dist];
+      break;
+
+    case PNG_FILTER_VALUE_UP:
+      for (i = 0; i < len; i++)
+	cur[i] += prev[i];
+      break;
+
+    case PNG_FILTER_VALUE_AVG:
+      for (i = 0; i < dist; i++)
+	cur[i] += prev[i] >> 1;
+      for (; i < len; i++)
+	cur[i] += (cur[i - dist] + prev[i]) >> 1;
+      break;
+
+    case PNG_FILTER_VALUE_PAETH:
+      /* With no left neighbour the predictor is the byte above.  */
+      for (i = 0; i < dist; i++)
+	cur[i] += prev[i];
+      for (; i < len; i++)
+	cur[i] += grub_png_paeth (cur[i - dist], prev[i], prev[i - dist]);
+      break;
+
+    default:
+      return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: unknown filter type");
     }
-  else
-    *(data->cur_rgb++) = n;
-
-  data->cur_column++;
-  row_bytes = data->image_width * data->bpp;
-  if (data->cur_column == row_bytes + 1)
-    {
-      grub_uint8_t *blank_line = NULL;
-      grub_uint8_t *cur = data->cur_rgb - row_bytes;
-      grub_uint8_t *left = cur;
-      grub_uint8_t *up;
-
-      if (data->first_line)
-	{
-	  blank_line = grub_zalloc (row_bytes);
-	  if (blank_line == NULL)
-	    return grub_errno;
-
-	  up = blank_line;
-	}
-      else
-	up = cur - row_bytes;
-
-      switch (data->cur_filter)
-	{
-	case PNG_FILTER_VALUE_SUB:
-	  {
-	    int i;
-
-	    cur += data->bpp;
-	    for (i = data->bpp; i < row_bytes; i++, cur++, left++)
-	      *cur += *left;
-
-	    break;
-	  }
-	case PNG_FILTER_VALUE_UP:
-	  {
-	    int i;
-
-	    for (i = 0; i < row_bytes; i++, cur++, up++)
-	      *cur += *up;
 
-	    break;
-	  }
-	case PNG_FILTER_VALUE_AVG:
-	  {
-	    int i;
-
-	    for (i = 0; i < data->bpp; i++, cur++, up++)
-	      *cur += *up >> 1;
-
-	    for (; i < row_bytes; i++, cur++, up++, left++)
-	      *cur += ((int) *up + (int) *left) >> 1;
-
-	    break;
-	  }
-	case PNG_FILTER_VALUE_PAETH:
-	  {
-	    int i;
-	    grub_uint8_t *upper_left = up;
-
-	    for (i = 0; i < data->bpp; i++, cur++, up++)
-	      *cur += *up;
-
-	    for (; i < row_bytes; i++, cur++, up++, left++, upper_left++)
-	      {
-		int a, b, c, pa, pb, pc;
-
-                a = *left;
-                b = *up;
-                c = *upper_left;
-
-                pa = b - c;
-                pb = a - c;
-                pc = pa + pb;
-
-                if (pa < 0)
-                  pa = -pa;
-
-                if (pb < 0)
-                  pb = -pb;
-
-                if (pc < 0)
-                  pc = -pc;
+  return GRUB_ERR_NONE;
+}
 
-                *cur += ((pa <= pb) && (pa <= pc)) ? a : (pb <= pc) ? b : c;
-	      }
-	  }
-	}
+/* Reduce the WIDTH pixels of the unfiltered line LINE to 8-bit samples in
+   SAMPLES, unpacking small bit depths.  Return where the samples are,
+   which is LINE itself if it has 8-bit samples already.  */
+static const grub_uint8_t *
+grub_png_get_samples (struct grub_png_data *data, const grub_uint8_t *line,
+		      grub_uint8_t *samples, int width)
+{
+  int i, n = width * data->channels;
 
-      grub_free (blank_line);
+  if (data->color_bits == 8)
+    return line;
 
-      data->cur_column = 0;
-      data->first_line = 0;
+  if (data->color_bits == 16)
+    {
+      /* Keep the upper byte.  */
+      for (i = 0; i < n; i++)
+	samples[i] = line[i * 2];
+      return samples;
     }
 
-  return grub_errno;
+  {
+    int bits = data->color_bits;
+    unsigned mask = (1 << bits) - 1;
+    /* Gray levels are spread over the full range, palette indices kept.  */
+    unsigned scale = data->color_type == PNG_COLOR_TYPE_PALETTE
+      ? 1 : 0xff / mask;
+
+    for (i = 0; i < n; i++)
+      {
+	int bit = i * bits;
+	samples[i] = ((line[bit >> 3] >> (8 - bits - (bit & 7))) & mask) * scale;
+      }
+  }
+  return samples;
 }
 
-static grub_err_t
-grub_png_read_dynamic_block (struct grub_png_data *data)
+/* Store WIDTH pixels from SAMPLES in bitmap row Y from column X0 on, every
+   DX columns.  */
+static void
+grub_png_put_pixels (struct grub_png_data *data, const grub_uint8_t *samples,
+		     int width, int y, int x0, int dx)
 {
-  while (grub_errno == 0)
-    {
-      int n;
+  grub_uint8_t *d;
+  int i, step = dx * data->bpp;
 
-      n = grub_png_get_huff_code (data, &data->code_table);
-      if (n < 256)
-	{
-	  data->slide[data->wp] = n;
-	  grub_png_output_byte (data, n);
+  d = (grub_uint8_t *) (*data->bitmap)->data
+    + ((grub_size_t) y * data->image_width + x0) * data->bpp;
 
-	  data->wp++;
-	  if (data->wp >= WSIZE)
-	    data->wp = 0;
-	}
-      else if (n == 256)
-	break;
+  switch (data->color_type)
+    {
+    case PNG_COLOR_TYPE_RGB:
+    case PNG_COLOR_TYPE_RGBA:
+      /* The samples are laid out as the bitmap wants them.  */
+      if (dx == 1)
+	grub_memcpy (d, samples, width * data->bpp);
       else
-	{
-	  int len, dist, pos;
-
-	  n -= 257;
-	  len = cplens[n];
-	  if (cplext[n])
-	    len += grub_png_get_bits (data, cplext[n]);
-
-	  n = grub_png_get_huff_code (data, &data->dist_table);
-	  dist = cpdist[n];
-	  if (cpdext[n])
-	    dist += grub_png_get_bits (data, cpdext[n]);
-
-	  pos = data->wp - dist;
-	  if (pos < 0)
-	    pos += WSIZE;
-
-	  while (len > 0)
-	    {
-	      data->slide[data->wp] = data->slide[pos];
-	      grub_png_output_byte (data, data->slide[data->wp]);
+	for (i = 0; i < width; i++, d += step, samples += data->bpp)
+	  grub_memcpy (d, samples, data->bpp);
+      break;
 
-	      data->wp++;
-	      if (data->wp >= WSIZE)
-		data->wp = 0;
+    case PNG_COLOR_TYPE_GRAY:
+      for (i = 0; i < width; i++, d += step)
+	d[0] = d[1] = d[2] = *samples++;
+      break;
 
-	      pos++;
-	      if (pos >= WSIZE)
-		pos = 0;
-
-	      len--;
-	    }
+    case PNG_COLOR_TYPE_GRAYA:
+      for (i = 0; i < width; i++, d += step, samples += 2)
+	{
+	  d[0] = d[1] = d[2] = samples[0];
+	  d[3] = samples[1];
 	}
-    }
+      break;
 
-  return grub_errno;
+    case PNG_COLOR_TYPE_PALETTE:
+      for (i = 0; i < width; i++, d += step)
+	grub_memcpy (d, data->palette[*samples++], data->bpp);
+      break;
+    }
 }
 
 static grub_err_t
 grub_png_decode_image_data (struct grub_png_data *data)
 {
-  grub_uint8_t cmf, flg;
-  int final;
-
-  cmf = grub_png_get_byte (data);
-  flg = grub_png_get_byte (data);
-
-  if ((cmf & 0xF) != Z_DEFLATED)
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-		       "png: only support deflate compression method");
-
-  if (flg & Z_FLAG_DICT)
-    return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-		       "png: dictionary not supported");
+  struct grub_zlib_stream *stream;
+  grub_uint8_t *cur = 0, *prev = 0, *samples = 0;
+  grub_size_t max_line;
+  int pass, num_passes;
+  const struct grub_png_pass *passes;
+
+  if (data->color_type == PNG_COLOR_TYPE_PALETTE && !data->palette_size)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: missing palette");
+
+  data->bpp = ((data->color_type & PNG_COLOR_MASK_ALPHA)
+	       || data->palette_alpha) ? 4 : 3;
+  if (grub_video_bitmap_create (data->bitmap, data->image_width,
+				data->image_height,
+				data->bpp == 4 ? GRUB_VIDEO_BLIT_FORMAT_RGBA_8888
+				: GRUB_VIDEO_BLIT_FORMAT_RGB_888))
+    return grub_errno;
 
-  do
+  if (data->interlace == PNG_INTERLACE_ADAM7)
     {
-      int block_type;
+      passes = adam7;
+      num_passes = ARRAY_SIZE (adam7);
+    }
+  else
+    {
+      passes = no_interlace;
+      num_passes = ARRAY_SIZE (no_interlace);
+    }
 
-      final = grub_png_get_bits (data, 1);
-      block_type = grub_png_get_bits (data, 2);
+  /* The filter byte, then the line.  */
+  max_line = ((grub_size_t) data->image_width * data->pixel_bits + 7) / 8 + 1;
+  cur = grub_malloc (max_line);
+  prev = grub_malloc (max_line);
+  samples = grub_malloc ((grub_size_t) data->image_width * data->channels);
+  stream = grub_zlib_stream_open (data->idat, data->idat_size);
+  if (!cur || !prev || !samples || !stream)
+    goto out;
 
-      switch (block_type)
-	{
-	case INFLATE_STORED:
-	  {
-	    grub_uint16_t i, len;
+  for (pass = 0; pass < num_passes; pass++)
+    {
+      int x0 = passes[pass].x0, dx = passes[pass].dx;
+      int y0 = passes[pass].y0, dy = passes[pass].dy;
+      int width = (data->image_width - x0 + dx - 1) / dx;
+      int y;
+      grub_size_t line_len;
 
-	    data->bit_count = 0;
-	    len = grub_png_get_byte (data);
-	    len += ((grub_uint16_t) grub_png_get_byte (data)) << 8;
+      if (width <= 0 || y0 >= data->image_height)
+	continue;
 
-            /* Skip NLEN field.  */
-	    grub_png_get_byte (data);
-	    grub_png_get_byte (data);
+      line_len = ((grub_size_t) width * data->pixel_bits + 7) / 8 + 1;
+      grub_memset (prev, 0, line_len);
 
-	    for (i = 0; i < len; i++)
-	      grub_png_output_byte (data, grub_png_get_byte (data));
+      for (y = y0; y < data->image_height; y += dy)
+	{
+	  grub_uint8_t *t;
 
-	    break;
-	  }
+	  if (grub_zlib_stream_read (stream, cur, line_len)
+	      != (grub_ssize_t) line_len)
+	    {
+	      if (!grub_errno)
+		grub_error (GRUB_ERR_BAD_FILE_TYPE,
+			    "png: unexpected end of data");
+	      goto out;
+	    }
 
-	case INFLATE_FIXED:
-          grub_png_init_fixed_block (data);
-	  grub_png_read_dynamic_block (data);
-	  break;
+	  if (grub_png_unfilter (cur + 1, prev + 1, line_len - 1,
+				 (data->pixel_bits + 7) / 8, cur[0]))
+	    goto out;
 
-	case INFLATE_DYNAMIC:
-	  grub_png_init_dynamic_block (data);
-	  grub_png_read_dynamic_block (data);
-	  break;
+	  grub_png_put_pixels (data, grub_png_get_samples (data, cur + 1,
+							   samples, width),
+			       width, y, x0, dx);
 
-	default:
-	  return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-			     "png: unknown block type");
+	  t = prev;
+	  prev = cur;
+	  cur = t;
 	}
     }
-  while ((!final) && (grub_errno == 0));
-
-  /* Skip adler checksum.  */
-  grub_png_get_dword (data);
-
-  /* Skip crc checksum.  */
-  grub_png_get_dword (data);
 
+ out:
+  grub_zlib_stream_close (stream);
+  grub_free (cur);
+  grub_free (prev);
+  grub_free (samples);
   return grub_errno;
 }
 
 static const grub_uint8_t png_magic[8] =
   { 0x89, 0x50, 0x4e, 0x47, 0xd, 0xa, 0x1a, 0x0a };
 
-static void
-grub_png_convert_image (struct grub_png_data *data)
-{
-  int i;
-  grub_uint8_t *d1, *d2;
-
-  d1 = (*data->bitmap)->data;
-  d2 = data->image_data + 1;
-
-  /* Only copy the upper 8 bit.  */
-  for (i = 0; i < (data->image_width * data->image_height * data->bpp >> 1);
-       i++, d1++, d2+=2)
-    *d1 = *d2;
-}
-
 static grub_err_t
 grub_png_decode_png (struct grub_png_data *data)
 {
@@ -793,44 +521,48 @@ grub_png_decode_png (struct grub_png_data *data)
 
   while (1)
     {
-      grub_uint32_t len, type;
+      grub_uint32_t hdr[2], len, type;
+      grub_off_t next_offset;
+
+      if (grub_png_read (data, hdr, sizeof (hdr)))
+	return grub_errno;
+      len = grub_be_to_cpu32 (hdr[0]);
+      type = grub_be_to_cpu32 (hdr[1]);
+
+      if (len > PNG_CHUNK_MAX)
+	return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: chunk size error");
+      if (type != PNG_CHUNK_IHDR && !data->image_width)
+	return grub_error (GRUB_ERR_BAD_FILE_TYPE, "png: missing header");
 
-      len = grub_png_get_dword (data);
-      type = grub_png_get_dword (data);
-      data->next_offset = data->file->offset + len + 4;
+      /* Past the chunk and its crc, which is not checked.  */
+      next_offset = data->file->offset + len + 4;
 
       switch (type)
 	{
 	case PNG_CHUNK_IHDR:
-	  grub_png_decode_image_header (data);
+	  grub_png_decode_image_header (data, len);
 	  break;
 
-	case PNG_CHUNK_IDAT:
-	  data->inside_idat = 1;
-	  data->idat_remain = len;
-	  data->bit_count = 0;
+	case PNG_CHUNK_PLTE:
+	  grub_png_decode_palette (data, len);
+	  break;
 
-	  grub_png_decode_image_data (data);
+	case PNG_CHUNK_TRNS:
+	  grub_png_decode_transparency (data, len);
+	  break;
 
-	  data->inside_idat = 0;
+	case PNG_CHUNK_IDAT:
+	  grub_png_read_image_data (data, len);
 	  break;
 
 	case PNG_CHUNK_IEND:
-          if (data->is_16bit)
-            grub_png_convert_image (data);
-
-	  return grub_errno;
-
-	default:
-	  grub_file_seek (data->file, data->file->offset + len + 4);
+	  return grub_png_decode_image_data (data);
 	}
 
       if (grub_errno)
-        break;
+	break;
 
-      if (data->file->offset != data->next_offset)
-        return grub_error (GRUB_ERR_BAD_FILE_TYPE,
-                           "png: chunk size error");
+      grub_file_seek (data->file, next_offset);
     }
 
   return grub_errno;
@@ -855,7 +587,7 @@ grub_video_reader_png (struct grub_video_bitmap **bitmap,
 
       grub_png_decode_png (data);
 
-      grub_free (data->image_data);
+      grub_free (data->idat);
       grub_free (data);
     }
 
@@ -0,0 +1,38 @@
+/* arena.h - allocations released all at once */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_ARENA_HEADER
+#define GRUB_ARENA_HEADER	1
+
+#include <grub/types.h>
+
+/* An arena hands out memory from big chunks and frees nothing until it is
+   released as a whole, which suits short-lived data such as the strings of
+   one menu render or one script run.  */
+typedef struct grub_mm_arena *grub_mm_arena_t;
+
+grub_mm_arena_t grub_mm_arena_new (void);
+void *grub_mm_arena_alloc (grub_mm_arena_t arena, grub_size_t size);
+char *grub_mm_arena_strdup (grub_mm_arena_t arena, const char *s);
+/* Free everything allocated from ARENA but keep ARENA usable.  Some of its
+   memory is kept for the next allocations.  */
+void grub_mm_arena_reset (grub_mm_arena_t arena);
+void grub_mm_arena_free (grub_mm_arena_t arena);
+
+#endif /* ! GRUB_ARENA_HEADER */
@@ -22,6 +22,7 @@
 #include <grub/symbol.h>
 #include <grub/err.h>
 #include <grub/list.h>
+#include <grub/hashmap.h>
 
 typedef enum grub_command_flags
   {
@@ -78,6 +79,7 @@ struct grub_command
 typedef struct grub_command *grub_command_t;
 
 extern grub_command_t EXPORT_VAR(grub_command_list);
+extern struct grub_hashmap EXPORT_VAR(grub_command_map);
 
 grub_command_t
 EXPORT_FUNC(grub_register_command_prio) (const char *name,
@@ -108,7 +110,7 @@ grub_register_command_p1 (const char *name,
 static inline grub_command_t
 grub_command_find (const char *name)
 {
-  return grub_named_list_find (GRUB_AS_NAMED_LIST (grub_command_list), name);
+  return grub_hashmap_find (&grub_command_map, name);
 }
 
 static inline grub_err_t
@@ -107,6 +107,20 @@ typedef void (*gcry_cipher_stdecrypt_t) (void *c,
 					 const unsigned char *inbuf,
 					 unsigned int n);
 
+/* Type for the functions handling many blocks at once.  */
+typedef void (*gcry_cipher_blocks_t) (void *c,
+				      unsigned char *outbuf,
+				      const unsigned char *inbuf,
+				      grub_size_t nblocks);
+
+/* Same with chaining state, the IV for CBC and the encrypted tweak for
+   XTS, updated for the next block.  */
+typedef void (*gcry_cipher_blocks_iv_t) (void *c,
+					 unsigned char *outbuf,
+					 const unsigned char *inbuf,
+					 grub_size_t nblocks,
+					 unsigned char *iv);
+
 typedef struct gcry_cipher_oid_spec
 {
   const char *oid;
@@ -127,6 +141,13 @@ typedef struct gcry_cipher_spec
   gcry_cipher_decrypt_t decrypt;
   gcry_cipher_stencrypt_t stencrypt;
   gcry_cipher_stdecrypt_t stdecrypt;
+  /* Optional, faster than calling encrypt or decrypt for every block.  */
+  gcry_cipher_blocks_t ecb_encrypt;
+  gcry_cipher_blocks_t ecb_decrypt;
+  gcry_cipher_blocks_iv_t cbc_encrypt;
+  gcry_cipher_blocks_iv_t cbc_decrypt;
+  gcry_cipher_blocks_iv_t xts_encrypt;
+  gcry_cipher_blocks_iv_t xts_decrypt;
 #ifdef GRUB_UTIL
   const char *modname;
 #endif
@@ -282,6 +303,19 @@ grub_crypto_hmac_buffer (const struct gcry_md_spec *md,
 			 const void *key, grub_size_t keylen,
 			 const void *data, grub_size_t datalen, void *out);
 
+/* HMAC key prepared for computing many HMACs with it.  */
+struct grub_crypto_hmac_key;
+
+struct grub_crypto_hmac_key *
+grub_crypto_hmac_key_new (const struct gcry_md_spec *md,
+			  const void *key, grub_size_t keylen);
+void
+grub_crypto_hmac_key_buffer (struct grub_crypto_hmac_key *hkey,
+			     const void *data, grub_size_t datalen,
+			     void *out);
+void
+grub_crypto_hmac_key_free (struct grub_crypto_hmac_key *hkey);
+
 extern gcry_md_spec_t _gcry_digest_spec_md5;
 extern gcry_md_spec_t _gcry_digest_spec_sha1;
 extern gcry_md_spec_t _gcry_digest_spec_sha256;
@@ -94,6 +94,16 @@ struct grub_cryptodisk
 };
 typedef struct grub_cryptodisk *grub_cryptodisk_t;
 
+/* How cryptomount was asked to unlock a device.  */
+struct grub_cryptodisk_key_options
+{
+  /* Key slot to try, or -1 for any.  */
+  int slot;
+  /* Key to use instead of asking for a passphrase, or NULL.  */
+  const grub_uint8_t *key;
+  grub_size_t key_len;
+};
+
 struct grub_cryptodisk_dev
 {
   struct grub_cryptodisk_dev *next;
@@ -101,7 +111,8 @@ struct grub_cryptodisk_dev
 
   grub_cryptodisk_t (*scan) (grub_disk_t disk, const char *check_uuid,
 			     int boot_only);
-  grub_err_t (*recover_key) (grub_disk_t disk, grub_cryptodisk_t dev);
+  grub_err_t (*recover_key) (grub_disk_t disk, grub_cryptodisk_t dev,
+			     const struct grub_cryptodisk_key_options *opts);
 };
 typedef struct grub_cryptodisk_dev *grub_cryptodisk_dev_t;
 
@@ -133,6 +144,32 @@ grub_cryptodisk_decrypt (struct grub_cryptodisk *dev,
 grub_err_t
 grub_cryptodisk_insert (grub_cryptodisk_t newdev, const char *name,
 			grub_disk_t source);
+
+/* Keyring shared by all volumes.  Passphrases are returned in the order
+   they were added, NULL past the last one.  Volume keys are looked up by
+   an identifier chosen by the backend, which must tell the key apart.  */
+const grub_uint8_t *
+grub_cryptodisk_keyring_get_passphrase (unsigned idx, grub_size_t *len);
+void
+grub_cryptodisk_keyring_add_passphrase (const grub_uint8_t *pass,
+					grub_size_t len);
+void
+grub_cryptodisk_keyring_forget_passphrase (const grub_uint8_t *pass,
+					   grub_size_t len);
+gcry_err_code_t
+grub_cryptodisk_keyring_pbkdf2 (const gcry_md_spec_t *md,
+				const grub_uint8_t *pass, grub_size_t passlen,
+				const grub_uint8_t *salt, grub_size_t saltlen,
+				unsigned int iterations,
+				grub_uint8_t *key, grub_size_t keylen);
+int
+grub_cryptodisk_keyring_find_key (const void *id, grub_size_t idlen,
+				  grub_uint8_t *key, grub_size_t keylen);
+void
+grub_cryptodisk_keyring_add_key (const void *id, grub_size_t idlen,
+				 const grub_uint8_t *key, grub_size_t keylen);
+void
+grub_cryptodisk_keyring_clear (void);
 #ifdef GRUB_UTIL
 grub_err_t
 grub_cryptodisk_cheat_insert (grub_cryptodisk_t newdev, const char *name,
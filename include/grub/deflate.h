@@ -23,4 +23,17 @@ grub_ssize_t
 grub_zlib_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
 		      char *outbuf, grub_size_t outsize);
 
+/* Decompress the zlib stream INBUF of INSIZE bytes piece by piece, each
+   read continuing where the previous one stopped.  INBUF must stay valid
+   until the stream is closed.  */
+struct grub_zlib_stream;
+
+struct grub_zlib_stream *
+grub_zlib_stream_open (const void *inbuf, grub_size_t insize);
+grub_ssize_t
+grub_zlib_stream_read (struct grub_zlib_stream *stream, void *outbuf,
+		       grub_size_t len);
+void
+grub_zlib_stream_close (struct grub_zlib_stream *stream);
+
 #endif
@@ -118,6 +118,11 @@ struct grub_disk
   /* The partition information. This is machine-specific.  */
   struct grub_partition *partition;
 
+  /* The sector just after the last read and the number of consecutive
+     reads which started there, used to detect sequential access.  */
+  grub_disk_addr_t next_sector;
+  unsigned seq_reads;
+
   /* Called when a sector was read. OFFSET is between 0 and
      the sector size minus 1, and LENGTH is between 0 and the sector size.  */
   void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
@@ -141,8 +146,33 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 #define GRUB_DISK_SECTOR_SIZE	0x200
 #define GRUB_DISK_SECTOR_BITS	9
 
-/* The maximum number of disk caches.  */
-#define GRUB_DISK_CACHE_NUM	1021
+/* The number of disk cache entries used when the heap size is unknown.  */
+#define GRUB_DISK_CACHE_NUM	1024
+
+/* Bounds on the number of disk cache entries.  */
+#define GRUB_DISK_CACHE_MIN_NUM	128
+#define GRUB_DISK_CACHE_MAX_NUM	8192
+
+/* The number of entries in one set of the disk cache.  */
+#define GRUB_DISK_CACHE_WAYS	8
+
+/* By default the disk cache may grow up to 1/(2^N) of the heap.  */
+#define GRUB_DISK_CACHE_HEAP_SHIFT	3
+
+/* The maximum number of disks with separate cache statistics.  */
+#define GRUB_DISK_CACHE_STATS_DEVICES	32
+
+/* The number of consecutive sequential reads after which read-ahead
+   kicks in.  */
+#define GRUB_DISK_READAHEAD_THRESHOLD	2
+
+/* The default read-ahead window, in 512B units.  */
+#define GRUB_DISK_READAHEAD_DEFAULT	(16 << GRUB_DISK_CACHE_BITS)
+
+/* Runs of at least this many uncached cache units read in one request are
+   considered bulk data and copied straight to the caller, bypassing the
+   cache.  */
+#define GRUB_DISK_BULK_UNITS	16
 
 /* The size of a disk cache in 512B units. Must be at least as big as the
    largest supported sector size, currently 16K.  */
@@ -155,8 +185,24 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 /* This is called from the memory manager.  */
 void grub_disk_cache_invalidate_all (void);
 
+/* Incremented whenever the disk cache is dropped, which happens when the
+   disks were left closed for a while or memory ran short.  Caches of what
+   was read from disks should be dropped along with it.  */
+extern grub_uint32_t EXPORT_VAR(grub_disk_cache_generation);
+
 void EXPORT_FUNC(grub_disk_dev_register) (grub_disk_dev_t dev);
 void EXPORT_FUNC(grub_disk_dev_unregister) (grub_disk_dev_t dev);
+
+/* Incremented whenever disks may have appeared or disappeared, so that
+   anything remembering the list of devices knows it has to look again.  */
+extern grub_uint32_t EXPORT_VAR(grub_disk_dev_generation);
+
+static inline void
+grub_disk_dev_changed (void)
+{
+  grub_disk_dev_generation++;
+}
+
 static inline int
 grub_disk_dev_iterate (int (*hook) (const char *name))
 {
@@ -186,10 +232,35 @@ grub_err_t EXPORT_FUNC(grub_disk_write) (grub_disk_t disk,
 
 grub_uint64_t EXPORT_FUNC(grub_disk_get_size) (grub_disk_t disk);
 
-#if DISK_CACHE_STATS
+/* Disk cache statistics, either for all disks or for a single one.  */
+struct grub_disk_cache_stats
+{
+  enum grub_disk_dev_id dev_id;
+  unsigned long disk_id;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  /* The number of cache units currently held.  */
+  unsigned long entries;
+  /* Read-ahead requests issued and the cache units they fetched.  */
+  unsigned long readaheads;
+  unsigned long readahead_units;
+  /* Cache units read straight to the caller, bypassing the cache.  */
+  unsigned long bulk_units;
+};
+
 void
-EXPORT_FUNC(grub_disk_cache_get_performance) (unsigned long *hits, unsigned long *misses);
-#endif
+EXPORT_FUNC(grub_disk_cache_get_performance) (struct grub_disk_cache_stats *total);
+int
+EXPORT_FUNC(grub_disk_cache_iterate_performance) (int (*hook) (const struct grub_disk_cache_stats *stats));
+/* Resize the disk cache to NUM entries, or to the default size if NUM
+   is 0.  The cache is flushed.  */
+grub_err_t EXPORT_FUNC(grub_disk_cache_resize) (unsigned num);
+unsigned EXPORT_FUNC(grub_disk_cache_get_size) (void);
+
+/* The read-ahead window for sequential reads, in 512B units.  0 disables
+   read-ahead.  */
+extern grub_size_t EXPORT_VAR(grub_disk_readahead);
 
 extern void (* EXPORT_VAR(grub_disk_firmware_fini)) (void);
 extern int EXPORT_VAR(grub_disk_firmware_is_tainted);
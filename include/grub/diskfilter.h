@@ -72,6 +72,9 @@ struct grub_diskfilter_pv {
   struct grub_diskfilter_pv *next;
   /* Optional.  */
   grub_uint8_t *internal_id;
+  /* Time spent reading and sectors read, to pick the fastest mirror.  */
+  grub_uint64_t read_ms;
+  grub_uint64_t read_sectors;
 #ifdef GRUB_UTIL
   char **partmaps;
 #endif
@@ -20,15 +20,13 @@
 #define GRUB_ENV_PRIVATE_HEADER	1
 
 #include <grub/env.h>
-
-/* The size of the hash table.  */
-#define	HASHSZ	13
+#include <grub/hashmap.h>
 
 /* A hashtable for quick lookup of variables.  */
 struct grub_env_context
 {
-  /* A hash table for variables.  */
-  struct grub_env_var *vars[HASHSZ];
+  /* The variables by name.  */
+  struct grub_hashmap vars;
 
   /* One level deeper on the stack.  */
   struct grub_env_context *prev;
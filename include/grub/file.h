@@ -106,6 +106,11 @@ grub_ssize_t EXPORT_FUNC(grub_file_read) (grub_file_t file, void *buf,
 grub_off_t EXPORT_FUNC(grub_file_seek) (grub_file_t file, grub_off_t offset);
 grub_err_t EXPORT_FUNC(grub_file_close) (grub_file_t file);
 
+/* Read the next line of FILE without the newline and any carriage returns.
+   The result must be freed by the caller; it is NULL at the end of file
+   or on error.  */
+char *EXPORT_FUNC(grub_file_getline) (grub_file_t file);
+
 /* Return value of grub_file_size() in case file size is unknown. */
 #define GRUB_FILE_SIZE_UNKNOWN	 0xffffffffffffffffULL
 
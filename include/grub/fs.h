@@ -41,6 +41,18 @@ struct grub_dirhook_info
   grub_int32_t mtime;
 };
 
+/* The longest signature a filesystem can register.  */
+#define GRUB_FS_MAGIC_MAX_SIZE	16
+
+/* A signature found at a fixed place on every instance of a filesystem.  */
+struct grub_fs_magic
+{
+  /* Offset from the start of the device, in bytes.  */
+  grub_uint64_t offset;
+  const char *value;
+  grub_size_t size;
+};
+
 /* Filesystem descriptor.  */
 struct grub_fs
 {
@@ -78,6 +90,11 @@ struct grub_fs
   /* Get writing time of filesystem. */
   grub_err_t (*mtime) (grub_device_t device, grub_int32_t *timebuf);
 
+  /* Signatures at least one of which is present on this filesystem,
+     terminated by an entry with a zero SIZE.  Devices without any of them
+     aren't probed for it.  NULL if there is no reliable signature.  */
+  const struct grub_fs_magic *magic;
+
 #ifdef GRUB_UTIL
   /* Determine sectors available for embedding.  */
   grub_err_t (*embed) (grub_device_t device, unsigned int *nsectors,
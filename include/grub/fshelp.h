@@ -59,6 +59,26 @@ EXPORT_FUNC(grub_fshelp_find_file) (const char *path,
 				    char *(*read_symlink) (grub_fshelp_node_t node),
 				    enum grub_fshelp_filetype expect);
 
+/* Like grub_fshelp_find_file, but remember the nodes found for the
+   filesystem FSNAME on DISK, including the paths which don't exist, until
+   the disk cache is dropped.  DUP_NODE returns a malloc'ed copy of NODE
+   for the mount ROOT belongs to; NODE may come from an earlier mount which
+   is gone, so only ROOT may be used to get at the mount.  */
+grub_err_t
+EXPORT_FUNC(grub_fshelp_find_file_cached) (const char *path,
+					   grub_fshelp_node_t rootnode,
+					   grub_fshelp_node_t *foundnode,
+					   int (*iterate_dir) (grub_fshelp_node_t dir,
+							       int NESTED_FUNC_ATTR
+							       (*hook) (const char *filename,
+									enum grub_fshelp_filetype filetype,
+									grub_fshelp_node_t node)),
+					   char *(*read_symlink) (grub_fshelp_node_t node),
+					   enum grub_fshelp_filetype expect,
+					   grub_disk_t disk, const char *fsname,
+					   grub_fshelp_node_t (*dup_node) (grub_fshelp_node_t node,
+									   grub_fshelp_node_t root));
+
 
 /* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
    beginning with the block POS.  READ_HOOK should be set before
@@ -76,6 +96,22 @@ EXPORT_FUNC(grub_fshelp_read_file) (grub_disk_t disk, grub_fshelp_node_t node,
 				    grub_off_t filesize, int log2blocksize,
 				    grub_disk_addr_t blocks_start);
 
+/* Like grub_fshelp_read_file, but GET_EXTENT translates the file block
+   BLOCK to a disk block and stores in *COUNT how many file blocks starting
+   at BLOCK are contiguous on disk (or, if 0 is returned, how many are
+   sparse).  Each extent is then read with a single disk request.  */
+grub_ssize_t
+EXPORT_FUNC(grub_fshelp_read_file_extents) (grub_disk_t disk, grub_fshelp_node_t node,
+					    void NESTED_FUNC_ATTR (*read_hook) (grub_disk_addr_t sector,
+										unsigned offset,
+										unsigned length),
+					    grub_off_t pos, grub_size_t len, char *buf,
+					    grub_disk_addr_t (*get_extent) (grub_fshelp_node_t node,
+									    grub_disk_addr_t block,
+									    grub_disk_addr_t *count),
+					    grub_off_t filesize, int log2blocksize,
+					    grub_disk_addr_t blocks_start);
+
 unsigned int
 EXPORT_FUNC(grub_fshelp_log2blksize) (unsigned int blksize,
 				      unsigned int *pow);
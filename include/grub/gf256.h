@@ -0,0 +1,50 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_GF256_HEADER
+#define GRUB_GF256_HEADER	1
+
+#include <grub/types.h>
+
+/* Arithmetic in GF(2^8) modulo x^8 + x^4 + x^3 + x^2 + 1, the field used
+   by RAID6 and RAID-Z parity.  Powers are of the generator x (2).  */
+
+grub_uint8_t grub_gf256_mul (grub_uint8_t a, grub_uint8_t b);
+/* A must not be 0.  */
+grub_uint8_t grub_gf256_inv (grub_uint8_t a);
+/* x ** N.  */
+grub_uint8_t grub_gf256_pow (unsigned n);
+/* Such an N that x ** N = A, which must not be 0.  */
+unsigned grub_gf256_log (grub_uint8_t a);
+
+/* DST = SRC * C, byte by byte.  DST and SRC may be the same.  */
+void grub_gf256_mul_block (grub_uint8_t *dst, const grub_uint8_t *src,
+			   grub_uint8_t c, grub_size_t size);
+/* DST ^= SRC * C, byte by byte.  */
+void grub_gf256_mul_xor_block (grub_uint8_t *dst, const grub_uint8_t *src,
+			       grub_uint8_t c, grub_size_t size);
+/* DST = A ^ B.  DST may be the same as A or B.  */
+void grub_gf256_xor_block (void *dst, const void *a, const void *b,
+			   grub_size_t size);
+
+/* Whether the block functions use SIMD instructions when the CPU has them,
+   which they do by default.  Return whether they are used now.  Tests and
+   benchmarks switch them off to compare.  */
+int grub_gf256_use_simd (int use);
+
+#endif /* ! GRUB_GF256_HEADER */
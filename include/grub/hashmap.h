@@ -0,0 +1,69 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_HASHMAP_HEADER
+#define GRUB_HASHMAP_HEADER	1
+
+#include <grub/symbol.h>
+#include <grub/types.h>
+#include <grub/err.h>
+
+/* A map from strings to pointers, open addressed with linear probing.
+   Keys aren't copied: a key is normally the name inside its value, and
+   must live as long as its entry.  A map of all zeroes is empty.  */
+struct grub_hashmap_slot
+{
+  grub_uint32_t hash;
+  /* NULL if the slot was never used.  */
+  const char *key;
+  void *value;
+};
+
+struct grub_hashmap
+{
+  struct grub_hashmap_slot *slots;
+  /* A power of two, or 0 before the first insertion.  */
+  grub_size_t size;
+  grub_size_t count;
+  /* Slots of removed entries, which lookups go past.  */
+  grub_size_t removed;
+
+  /* Statistics.  */
+  unsigned long lookups;
+  unsigned long probes;
+  unsigned long resizes;
+};
+
+grub_uint32_t EXPORT_FUNC(grub_hashmap_hash) (const char *key);
+void *EXPORT_FUNC(grub_hashmap_find) (struct grub_hashmap *map,
+				      const char *key);
+/* Map KEY to VALUE, replacing both the key and the value if KEY is there
+   already.  Only adding a new key can fail.  */
+grub_err_t EXPORT_FUNC(grub_hashmap_insert) (struct grub_hashmap *map,
+					     const char *key, void *value);
+/* Return the value KEY was mapped to, or NULL.  */
+void *EXPORT_FUNC(grub_hashmap_remove) (struct grub_hashmap *map,
+					const char *key);
+void EXPORT_FUNC(grub_hashmap_clear) (struct grub_hashmap *map);
+/* Call HOOK on every entry, in no particular order, until it returns
+   nonzero.  HOOK may remove entries or replace values, but not add keys.  */
+int EXPORT_FUNC(grub_hashmap_iterate) (struct grub_hashmap *map,
+				       int (*hook) (const char *key,
+						    void *value));
+
+#endif /* ! GRUB_HASHMAP_HEADER */
@@ -19,6 +19,69 @@
 #ifndef GRUB_CPU_CPUID_HEADER
 #define GRUB_CPU_CPUID_HEADER 1
 
+#include <grub/types.h>
+#include <grub/i386/tsc.h>
+
 extern unsigned char grub_cpuid_has_longmode;
 
+/* Feature flags of leaf 1.  */
+#define GRUB_CPUID_ECX_SSSE3	(1 << 9)
+#define GRUB_CPUID_ECX_AES	(1 << 25)
+#define GRUB_CPUID_EDX_SSE2	(1 << 26)
+
+#ifdef __x86_64__
+#define grub_cpuid(num,a,b,c,d) \
+  asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "0" (num))
+#else
+/* %ebx may hold the GOT pointer.  */
+#define grub_cpuid(num,a,b,c,d) \
+  asm volatile ("xchgl %%ebx, %1; cpuid; xchgl %%ebx, %1" \
+		: "=a" (a), "=r" (b), "=c" (c), "=d" (d)  \
+		: "0" (num))
+#endif
+
+/* Get the feature flags of leaf 1 into *ECX and *EDX, which are 0 if the CPU
+   has no CPUID or no such leaf.  */
+static __inline void
+grub_cpuid_features (grub_uint32_t *ecx, grub_uint32_t *edx)
+{
+  grub_uint32_t a, b, c, d;
+
+  *ecx = *edx = 0;
+  if (! grub_cpu_is_cpuid_supported ())
+    return;
+
+  grub_cpuid (0, a, b, c, d);
+  if (a < 1)
+    return;
+
+  grub_cpuid (1, a, b, c, d);
+  *ecx = c;
+  *edx = d;
+}
+
+#if !defined (GRUB_UTIL) && !defined (GRUB_MACHINE_EMU)
+#define GRUB_CPU_CR0_MP		(1 << 1)
+#define GRUB_CPU_CR0_EM		(1 << 2)
+#define GRUB_CPU_CR4_OSFXSR	(1 << 9)
+
+/* Let SSE instructions run.  Firmware doesn't necessarily leave them on, and
+   GRUB itself is compiled without SSE.  */
+static __inline void
+grub_cpu_enable_sse (void)
+{
+  unsigned long cr0, cr4;
+
+  asm volatile ("mov %%cr4, %0" : "=r" (cr4));
+  if (!(cr4 & GRUB_CPU_CR4_OSFXSR))
+    asm volatile ("mov %0, %%cr4" : : "r" (cr4 | GRUB_CPU_CR4_OSFXSR));
+
+  asm volatile ("mov %%cr0, %0" : "=r" (cr0));
+  if ((cr0 & (GRUB_CPU_CR0_EM | GRUB_CPU_CR0_MP)) != GRUB_CPU_CR0_MP)
+    asm volatile ("mov %0, %%cr0"
+		  : : "r" ((cr0 & ~GRUB_CPU_CR0_EM) | GRUB_CPU_CR0_MP));
+  asm volatile ("clts");
+}
+#endif
+
 #endif
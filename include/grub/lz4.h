@@ -0,0 +1,31 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRUB_LZ4_HEADER
+#define GRUB_LZ4_HEADER	1
+
+#include <grub/types.h>
+
+/* Decompress the raw LZ4 block SRC of SRC_SIZE bytes, without any frame
+   around it, into DST which has room for DST_SIZE bytes.  Return the number
+   of bytes produced, or -1 with grub_errno set if the block is corrupted or
+   doesn't fit.  */
+grub_ssize_t grub_lz4_decompress (const void *src, grub_size_t src_size,
+				  void *dst, grub_size_t dst_size);
+
+#endif /* ! GRUB_LZ4_HEADER */
@@ -24,6 +24,8 @@
 /* Magic words.  */
 #define GRUB_MM_FREE_MAGIC	0x2d3c2808
 #define GRUB_MM_ALLOC_MAGIC	0x6db08fa4
+/* Freed small block kept on a size class list.  */
+#define GRUB_MM_QUICK_MAGIC	0x5ac1e3b7
 
 typedef struct grub_mm_header
 {
@@ -57,8 +59,17 @@ typedef struct grub_mm_region
 }
 *grub_mm_region_t;
 
+/* Blocks of up to this many cells, header included, are recycled through
+   per size class lists instead of going back to the region free list.  */
+#define GRUB_MM_QUICK_CLASSES	8
+/* How many freed blocks each size class keeps at most.  */
+#define GRUB_MM_QUICK_MAX	64
+
 #ifndef GRUB_MACHINE_EMU
 extern grub_mm_region_t EXPORT_VAR (grub_mm_base);
+
+/* Give the blocks kept on the size class lists back to their regions.  */
+void EXPORT_FUNC(grub_mm_quick_flush) (void);
 #endif
 
 #endif
@@ -24,6 +24,8 @@
 #include <grub/err.h>
 #include <grub/parser.h>
 #include <grub/command.h>
+#include <grub/hashmap.h>
+#include <grub/arena.h>
 
 struct grub_script_mem;
 
@@ -80,6 +82,8 @@ struct grub_script_argv
   unsigned argc;
   char **args;
   struct grub_script *script;
+  /* If set, the arguments are allocated from it and freed with it.  */
+  grub_mm_arena_t arena;
 };
 
 /* Pluggable wildcard translator.  */
@@ -242,6 +246,7 @@ void grub_script_init (void);
 void grub_script_fini (void);
 
 void grub_script_mem_free (struct grub_script_mem *mem);
+void grub_script_argv_arenas_free (void);
 
 void grub_script_argv_free    (struct grub_script_argv *argv);
 int grub_script_argv_make     (struct grub_script_argv *argv, int argc, char **args);
@@ -328,6 +333,31 @@ grub_err_t grub_script_execute_cmdwhile (struct grub_script_cmd *cmd);
 grub_err_t grub_script_execute (struct grub_script *script);
 grub_err_t grub_script_execute_sourcecode (const char *source, int argc, char **args);
 
+/* A text parsed a command at a time and kept in the parsed script cache.  */
+struct grub_script_source;
+
+struct grub_script_cache_stats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  unsigned long entries;
+  grub_size_t bytes;
+  unsigned long lines_parsed;
+  unsigned long lines_reused;
+  grub_uint64_t parse_ms;
+};
+
+struct grub_script_source *grub_script_source_get (const char *text);
+int grub_script_source_next (struct grub_script_source *src, grub_size_t *pos,
+			     struct grub_script **script);
+void grub_script_source_put (struct grub_script_source *src);
+void grub_script_cache_flush (void);
+void grub_script_cache_get_performance (struct grub_script_cache_stats *stats);
+
+/* SCRIPTCACHE command showing the statistics.  */
+grub_err_t grub_script_cache_info (grub_command_t cmd, int argc, char *argv[]);
+
 /* Break command for loops.  */
 grub_err_t grub_script_break (grub_command_t cmd, int argc, char *argv[]);
 
@@ -366,6 +396,10 @@ struct grub_script_function
 typedef struct grub_script_function *grub_script_function_t;
 
 extern grub_script_function_t grub_script_function_list;
+/* The functions by name.  */
+extern struct grub_hashmap grub_script_function_map;
+/* Bumped by every function definition, which happens when parsing.  */
+extern unsigned grub_script_functions_created;
 
 #define FOR_SCRIPT_FUNCTIONS(var) for((var) = grub_script_function_list; \
 				      (var); (var) = (var)->next)
@@ -26,4 +26,23 @@ void grub_search_fs_uuid (const char *key, const char *var, int no_floppy,
 void grub_search_label (const char *key, const char *var, int no_floppy,
 			char **hints, unsigned nhints);
 
+/* What the search index knows of a device.  */
+struct grub_search_index_info
+{
+  char *name;
+  /* Filesystem name, UUID and label, NULL when unknown.  */
+  char *fs;
+  char *uuid;
+  char *label;
+};
+
+/* Call HOOK for every device with what was found on it, probing all devices on first use or when disks
+   have been added or removed.  If USE_SEED is set, entries from the hint
+   file written by grub-install may be passed first; those aren't verified
+   and may be repeated later.  */
+void grub_search_index_iterate (int no_floppy, int use_seed,
+				int (*hook) (const struct grub_search_index_info *info));
+/* Forget the index, e.g. when it turned out to be wrong.  */
+void grub_search_index_invalidate (void);
+
 #endif
@@ -34,9 +34,15 @@ typedef enum grub_zfs_endian
   } grub_zfs_endian_t;
 
 /*
- * On-disk version number.
+ * On-disk version numbers.  Pools past the last numbered version list the
+ * features they use instead.
  */
-#define	SPA_VERSION			33ULL
+#define	SPA_VERSION_INITIAL		1ULL
+#define	SPA_VERSION_BEFORE_FEATURES	33ULL
+#define	SPA_VERSION_FEATURES		5000ULL
+#define	SPA_VERSION_IS_SUPPORTED(v) \
+	(((v) >= SPA_VERSION_INITIAL && (v) <= SPA_VERSION_BEFORE_FEATURES) \
+	 || (v) == SPA_VERSION_FEATURES)
 
 /*
  * The following are configuration names used in the nvlist describing a pool's
@@ -76,6 +82,7 @@ typedef enum grub_zfs_endian
 #define	ZPOOL_CONFIG_DDT_HISTOGRAM	"ddt_histogram"
 #define	ZPOOL_CONFIG_DDT_OBJ_STATS	"ddt_object_stats"
 #define	ZPOOL_CONFIG_DDT_STATS		"ddt_stats"
+#define	ZPOOL_CONFIG_FEATURES_FOR_READ	"features_for_read"
 /*
  * The persistent vdev state is stored as separate values rather than a single
  * 'vdev_state' entry.  This is because a device can be in multiple states, such
@@ -129,6 +136,20 @@ char *grub_zfs_nvlist_lookup_nvlist_array (const char *nvlist,
 					   grub_size_t index);
 int grub_zfs_nvlist_lookup_nvlist_array_get_nelm (const char *nvlist,
 						  const char *name);
+
+/* Statistics of the cache of decompressed metadata and indirect blocks.  */
+struct grub_zfs_cache_stats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  /* The number of blocks currently held and their size.  */
+  unsigned long entries;
+  grub_size_t bytes;
+  grub_size_t max_bytes;
+};
+
+void grub_zfs_cache_get_performance (struct grub_zfs_cache_stats *stats);
 grub_err_t
 grub_zfs_add_key (grub_uint8_t *key_in,
 		  grub_size_t keylen,
@@ -0,0 +1,234 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <grub/test.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/mm.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define BENCH_LINES 3000
+
+/* Files whose contents are in memory, counting the reads.  */
+static unsigned long mem_reads;
+
+static grub_ssize_t
+mem_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  mem_reads++;
+  memcpy (buf, (char *) file->data + file->offset, len);
+  return len;
+}
+
+static struct grub_fs mem_fs =
+  {
+    .name = "mem",
+    .read = mem_read
+  };
+
+static grub_file_t
+mem_open (const char *contents, grub_size_t size)
+{
+  grub_file_t file = grub_zalloc (sizeof (*file));
+
+  file->fs = &mem_fs;
+  file->data = (void *) contents;
+  file->size = size;
+  return file;
+}
+
+/* The reader as it was, a byte at a time.  */
+static char *
+getline_bytewise (grub_file_t file)
+{
+  grub_size_t pos = 0, max_len = 64;
+  int have_newline = 0;
+  char *line = malloc (max_len);
+  char c;
+
+  while (grub_file_read (file, &c, 1) == 1)
+    {
+      if (c == '\r')
+	continue;
+      if (pos + 1 >= max_len)
+	line = realloc (line, max_len *= 2);
+      if (c == '\n')
+	{
+	  have_newline = 1;
+	  break;
+	}
+      line[pos++] = c;
+    }
+  line[pos] = '\0';
+  if (pos == 0 && !have_newline)
+    {
+      free (line);
+      return NULL;
+    }
+  return line;
+}
+
+/* Compare the lines of CONTENTS with what the bytewise reader finds.  */
+static void
+check_lines (const char *what, const char *contents, grub_size_t size)
+{
+  grub_file_t file = mem_open (contents, size);
+  grub_file_t ref = mem_open (contents, size);
+  unsigned n = 0;
+
+  while (1)
+    {
+      char *line = grub_file_getline (file);
+      char *expect = getline_bytewise (ref);
+
+      if (!line || !expect)
+	{
+	  grub_test_assert (!line && !expect, "%s: line %u missing", what, n);
+	  grub_free (line);
+	  free (expect);
+	  break;
+	}
+      grub_test_assert (strcmp (line, expect) == 0,
+			"%s: line %u is `%s', expected `%s'", what, n,
+			line, expect);
+      grub_test_assert (file->offset == ref->offset,
+			"%s: offset %llu after line %u, expected %llu", what,
+			(unsigned long long) file->offset, n,
+			(unsigned long long) ref->offset);
+      grub_free (line);
+      free (expect);
+      n++;
+    }
+  grub_file_close (file);
+  grub_file_close (ref);
+}
+
+static char *
+make_config (grub_size_t *size)
+{
+  char *buf = malloc (BENCH_LINES * 80);
+  grub_size_t len = 0;
+  unsigned i;
+
+  for (i = 0; i < BENCH_LINES; i++)
+    len += sprintf (buf + len, i % 3 ? "\tlinux /snap%u/vmlinuz root=/dev/sda1 ro\n"
+		    : "menuentry 'Snapshot %u' {\n", i);
+  *size = len;
+  return buf;
+}
+
+static double
+elapsed_ms (clock_t start)
+{
+  return (double) (clock () - start) * 1000 / CLOCKS_PER_SEC;
+}
+
+/* Not a check, but shows what reading a big grub.cfg costs.  */
+static void
+getline_bench (void)
+{
+  grub_size_t size;
+  char *config = make_config (&size);
+  grub_file_t file;
+  unsigned long reads;
+  clock_t start;
+  char *line;
+
+  mem_reads = 0;
+  file = mem_open (config, size);
+  start = clock ();
+  while ((line = getline_bytewise (file)))
+    free (line);
+  printf ("getline: %u lines bytewise in %.2f ms, %lu reads\n", BENCH_LINES,
+	  elapsed_ms (start), mem_reads);
+  grub_file_close (file);
+
+  reads = mem_reads;
+  file = mem_open (config, size);
+  start = clock ();
+  while ((line = grub_file_getline (file)))
+    grub_free (line);
+  printf ("getline: %u lines buffered in %.2f ms, %lu reads\n", BENCH_LINES,
+	  elapsed_ms (start), mem_reads - reads);
+  grub_file_close (file);
+
+  free (config);
+}
+
+static void
+getline_test (void)
+{
+  static const char *cases[] =
+    {
+      "",
+      "\n",
+      "no newline",
+      "one\ntwo\n\nfour\r\nfive",
+      "\r\r\n\r\ncr\rin\rthe middle\r",
+      "trailing\n\n\n",
+    };
+  grub_file_t a, b;
+  char *la, *lb;
+  char *big;
+  grub_size_t size, i;
+  int done = 0;
+
+  for (i = 0; i < ARRAY_SIZE (cases); i++)
+    check_lines (cases[i], cases[i], strlen (cases[i]));
+
+  /* Lines longer than the read-ahead, and lines across its end.  */
+  size = 3 * 4096 + 123;
+  big = malloc (size);
+  for (i = 0; i < size; i++)
+    big[i] = (i % 5000 == 4999 || i % 97 == 0) && i > 6000 ? '\n'
+      : (i % 13 == 0 ? '\r' : 'a' + i % 26);
+  check_lines ("long lines", big, size);
+  free (big);
+
+  big = make_config (&size);
+  check_lines ("config", big, size);
+
+  /* Two files read in turns don't mix up each other's lines.  B starts a
+     line later than A.  */
+  i = (char *) memchr (big, '\n', size) - big + 1;
+  a = mem_open (big, size);
+  b = mem_open (big + i, size - i);
+  grub_free (grub_file_getline (a));
+  while (!done)
+    {
+      la = grub_file_getline (a);
+      lb = grub_file_getline (b);
+      grub_test_assert ((!la && !lb) || (la && lb && strcmp (la, lb) == 0),
+			"interleaved files read `%s' and `%s'", la, lb);
+      done = !la || !lb;
+      grub_free (la);
+      grub_free (lb);
+    }
+  grub_file_close (a);
+  grub_file_close (b);
+  free (big);
+
+  getline_bench ();
+}
+
+GRUB_UNIT_TEST ("getline_test", getline_test);
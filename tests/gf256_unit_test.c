@@ -0,0 +1,207 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2012  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <grub/test.h>
+#include <grub/gf256.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define BUF_SIZE 4096
+#define BENCH_SIZE (1 << 20)
+#define BENCH_ROUNDS 64
+
+/* Multiplication by shifting and adding, the obviously right way.  */
+static grub_uint8_t
+slow_mul (grub_uint8_t a, grub_uint8_t b)
+{
+  grub_uint8_t r = 0;
+
+  for (; b; b >>= 1)
+    {
+      if (b & 1)
+	r ^= a;
+      a = (a & 0x80) ? (a << 1) ^ 0x1d : a << 1;
+    }
+  return r;
+}
+
+static double
+rate (clock_t start)
+{
+  double secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+  if (secs <= 0)
+    return 0;
+  return (double) BENCH_SIZE * BENCH_ROUNDS / secs / (1 << 20);
+}
+
+/* Not a check, but shows what degraded RAID reads can expect.  */
+static void
+gf256_bench (int simd)
+{
+  grub_uint8_t *src, *dst;
+  const char *how = simd ? "SIMD" : "scalar";
+  clock_t start;
+  unsigned i, r;
+
+  src = malloc (BENCH_SIZE);
+  dst = calloc (1, BENCH_SIZE);
+  grub_test_assert (src && dst, "out of memory");
+  if (!src || !dst)
+    {
+      free (src);
+      free (dst);
+      return;
+    }
+  for (i = 0; i < BENCH_SIZE; i++)
+    src[i] = rand ();
+
+  if (!simd)
+    {
+      start = clock ();
+      for (r = 0; r < BENCH_ROUNDS; r++)
+	for (i = 0; i < BENCH_SIZE; i++)
+	  dst[i] ^= slow_mul (src[i], 0x8e);
+      printf ("gf256: bytewise multiply-add %.0f MiB/s\n", rate (start));
+    }
+
+  start = clock ();
+  for (r = 0; r < BENCH_ROUNDS; r++)
+    grub_gf256_mul_xor_block (dst, src, 0x8e, BENCH_SIZE);
+  printf ("gf256: %s block multiply-add %.0f MiB/s\n", how, rate (start));
+
+  start = clock ();
+  for (r = 0; r < BENCH_ROUNDS; r++)
+    grub_gf256_xor_block (dst, dst, src, BENCH_SIZE);
+  printf ("gf256: %s block xor %.0f MiB/s\n", how, rate (start));
+
+  free (src);
+  free (dst);
+}
+
+/* Every constant, with lengths and alignments hitting the head and tail
+   handling of the block functions.  */
+static void
+check_blocks (const grub_uint8_t *src, const char *how)
+{
+  static grub_uint8_t dst[BUF_SIZE], expect[BUF_SIZE];
+  unsigned c, i;
+
+  for (c = 0; c < 256; c++)
+    {
+      unsigned off = c % 16, len = BUF_SIZE - 32 - (c * 7) % 600;
+
+      for (i = 0; i < BUF_SIZE; i++)
+	dst[i] = expect[i] = i;
+      for (i = 0; i < len; i++)
+	expect[i + off] = slow_mul (src[i + (c % 5)], c);
+      grub_gf256_mul_block (dst + off, src + (c % 5), c, len);
+      grub_test_assert (memcmp (dst, expect, BUF_SIZE) == 0,
+			"%s multiplication by %u failed", how, c);
+
+      for (i = 0; i < len; i++)
+	expect[i + off] ^= slow_mul (src[i + 3], c);
+      grub_gf256_mul_xor_block (dst + off, src + 3, c, len);
+      grub_test_assert (memcmp (dst, expect, BUF_SIZE) == 0,
+			"%s multiply-add by %u failed", how, c);
+
+      for (i = 0; i < len % 100; i++)
+	expect[i + off] ^= src[i + 1];
+      grub_gf256_xor_block (dst + off, dst + off, src + 1, len % 100);
+      grub_test_assert (memcmp (dst, expect, BUF_SIZE) == 0,
+			"%s xor of %u bytes failed", how, len % 100);
+    }
+}
+
+/* The SIMD kernels against the scalar code, on the same input.  */
+static void
+compare_simd (const grub_uint8_t *src)
+{
+  static grub_uint8_t scalar[BUF_SIZE], simd[BUF_SIZE];
+  unsigned round;
+
+  for (round = 0; round < 1000; round++)
+    {
+      unsigned off = rand () % 16, len = rand () % (BUF_SIZE - 16);
+      grub_uint8_t c = rand ();
+
+      memset (scalar, 0x5a, BUF_SIZE);
+      memset (simd, 0x5a, BUF_SIZE);
+
+      grub_gf256_use_simd (0);
+      grub_gf256_mul_xor_block (scalar + off, src, c, len);
+      grub_gf256_xor_block (scalar, scalar, src + off, BUF_SIZE - 16);
+      grub_gf256_use_simd (1);
+      grub_gf256_mul_xor_block (simd + off, src, c, len);
+      grub_gf256_xor_block (simd, simd, src + off, BUF_SIZE - 16);
+
+      if (memcmp (scalar, simd, BUF_SIZE) != 0)
+	{
+	  grub_test_assert (0, "SIMD and scalar differ for %u bytes * %u",
+			    len, c);
+	  return;
+	}
+    }
+}
+
+static void
+gf256_test (void)
+{
+  static grub_uint8_t src[BUF_SIZE];
+  unsigned a, b, i;
+  int simd;
+
+  for (a = 0; a < 256; a++)
+    for (b = 0; b < 256; b++)
+      if (grub_gf256_mul (a, b) != slow_mul (a, b))
+	{
+	  grub_test_assert (0, "%u * %u = %u, expected %u", a, b,
+			    grub_gf256_mul (a, b), slow_mul (a, b));
+	  return;
+	}
+
+  for (a = 1; a < 256; a++)
+    {
+      grub_test_assert (grub_gf256_mul (a, grub_gf256_inv (a)) == 1,
+			"wrong inverse of %u", a);
+      grub_test_assert (grub_gf256_pow (grub_gf256_log (a)) == a,
+			"wrong logarithm of %u", a);
+    }
+
+  for (i = 0; i < BUF_SIZE; i++)
+    src[i] = rand ();
+
+  grub_gf256_use_simd (0);
+  check_blocks (src, "scalar");
+  gf256_bench (0);
+
+  simd = grub_gf256_use_simd (1);
+  if (simd)
+    {
+      check_blocks (src, "SIMD");
+      compare_simd (src);
+      gf256_bench (1);
+    }
+  else
+    printf ("gf256: no SIMD kernels for this CPU\n");
+}
+
+GRUB_UNIT_TEST ("gf256_test", gf256_test);
@@ -0,0 +1,102 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <grub/test.h>
+#include <grub/hashmap.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define NKEYS 5000
+#define ROUNDS 200000
+
+static char keys[NKEYS][12];
+static int present[NKEYS];
+static unsigned long iterated;
+
+static int
+count_entry (const char *key, void *value)
+{
+  if (key == value)
+    iterated++;
+  return 0;
+}
+
+static void
+hashmap_test (void)
+{
+  struct grub_hashmap map;
+  unsigned long count = 0;
+  int i;
+
+  memset (&map, 0, sizeof (map));
+  for (i = 0; i < NKEYS; i++)
+    sprintf (keys[i], "key%d", i);
+
+  /* Random insertions, removals and lookups against a plain array.  */
+  for (i = 0; i < ROUNDS; i++)
+    {
+      int k = rand () % NKEYS;
+      void *v;
+
+      switch (rand () % 3)
+	{
+	case 0:
+	  grub_test_assert (grub_hashmap_insert (&map, keys[k], keys[k]) == 0,
+			    "inserting %s failed", keys[k]);
+	  count += !present[k];
+	  present[k] = 1;
+	  break;
+
+	case 1:
+	  v = grub_hashmap_remove (&map, keys[k]);
+	  grub_test_assert (v == (present[k] ? keys[k] : NULL),
+			    "removing %s returned %p", keys[k], v);
+	  count -= present[k];
+	  present[k] = 0;
+	  break;
+
+	default:
+	  v = grub_hashmap_find (&map, keys[k]);
+	  grub_test_assert (v == (present[k] ? keys[k] : NULL),
+			    "finding %s returned %p", keys[k], v);
+	}
+    }
+
+  grub_test_assert (map.count == count, "%lu entries, expected %lu",
+		    (unsigned long) map.count, count);
+  grub_test_assert (map.count * 4 <= map.size * 3, "%lu entries in %lu slots",
+		    (unsigned long) map.count, (unsigned long) map.size);
+
+  /* Iteration sees every entry once.  */
+  grub_hashmap_iterate (&map, count_entry);
+  grub_test_assert (iterated == count, "iterated over %lu entries",
+		    iterated);
+
+  printf ("hashmap: %lu lookups, %lu.%02lu probes each, %lu resizes\n",
+	  map.lookups, map.probes / map.lookups,
+	  (map.probes * 100 / map.lookups) % 100, map.resizes);
+
+  grub_hashmap_clear (&map);
+  grub_test_assert (grub_hashmap_find (&map, keys[0]) == NULL,
+		    "cleared map isn't empty");
+}
+
+GRUB_UNIT_TEST ("hashmap_test", hashmap_test);
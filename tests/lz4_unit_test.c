@@ -0,0 +1,273 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2013  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <grub/test.h>
+#include <grub/err.h>
+#include <grub/lz4.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define BUF_SIZE 65536
+/* Bytes after the output which must be left alone.  */
+#define GUARD 64
+#define BENCH_ROUNDS 256
+
+/* Made by the lz4 tool at -9.  */
+static const char vector_text[] =
+  "GRUB GRUB GRUB loads the kernel, GRUB loads the initrd, GRUB loads the "
+  "kernel and the initrd again and again.";
+static const grub_uint8_t vector[] =
+  {
+    0x56, 0x47, 0x52, 0x55, 0x42, 0x20, 0x05, 0x00, 0xfc, 0x02, 0x6c, 0x6f,
+    0x61, 0x64, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6b, 0x65, 0x72, 0x6e,
+    0x65, 0x6c, 0x2c, 0x17, 0x00, 0x7f, 0x69, 0x6e, 0x69, 0x74, 0x72, 0x64,
+    0x2c, 0x2e, 0x00, 0x03, 0x47, 0x20, 0x61, 0x6e, 0x64, 0x26, 0x00, 0xf0,
+    0x02, 0x20, 0x61, 0x67, 0x61, 0x69, 0x6e, 0x20, 0x61, 0x6e, 0x64, 0x20,
+    0x61, 0x67, 0x61, 0x69, 0x6e, 0x2e
+  };
+
+/* A match of distance 1 running into a length byte: "a" * 21.  */
+static const grub_uint8_t run_vector[] = { 0x1f, 'a', 0x01, 0x00, 0x01 };
+
+static grub_uint8_t *
+put_length (grub_uint8_t *op, grub_size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/* A greedy compressor finding matches through a hash of 4 bytes.  It isn't
+   clever, but writes every kind of sequence: long literal runs, long
+   matches and overlapping ones.  */
+static grub_size_t
+compress_block (const grub_uint8_t *src, grub_size_t size, grub_uint8_t *dst)
+{
+  static grub_uint32_t table[4096];
+  const grub_uint8_t *ip = src, *anchor = src, *end = src + size;
+  grub_uint8_t *op = dst;
+
+  memset (table, 0xff, sizeof (table));
+
+  while (ip + 12 <= end)
+    {
+      grub_uint32_t v, h, ref;
+      grub_size_t lit, len;
+
+      memcpy (&v, ip, 4);
+      h = (v * 2654435761U) >> 20;
+      ref = table[h];
+      table[h] = ip - src;
+      if (ref == 0xffffffff || ip - src - ref > 65535
+	  || memcmp (src + ref, ip, 4) != 0)
+	{
+	  ip++;
+	  continue;
+	}
+
+      for (len = 4; ip + len < end - 5 && src[ref + len] == ip[len]; len++);
+
+      lit = ip - anchor;
+      *op++ = ((lit < 15 ? lit : 15) << 4)
+	| (len - 4 < 15 ? len - 4 : 15);
+      if (lit >= 15)
+	op = put_length (op, lit - 15);
+      memcpy (op, anchor, lit);
+      op += lit;
+      *op++ = (ip - src - ref) & 0xff;
+      *op++ = (ip - src - ref) >> 8;
+      if (len - 4 >= 15)
+	op = put_length (op, len - 4 - 15);
+      ip += len;
+      anchor = ip;
+    }
+
+  /* The last literals.  */
+  {
+    grub_size_t lit = end - anchor;
+
+    *op++ = (lit < 15 ? lit : 15) << 4;
+    if (lit >= 15)
+      op = put_length (op, lit - 15);
+    memcpy (op, anchor, lit);
+    op += lit;
+  }
+  return op - dst;
+}
+
+/* Decompress SRC into a buffer of DST_SIZE bytes with a guard behind it,
+   checking that the guard is intact.  */
+static grub_ssize_t
+decompress (const grub_uint8_t *src, grub_size_t src_size,
+	    grub_uint8_t *dst, grub_size_t dst_size)
+{
+  grub_ssize_t ret;
+  grub_size_t i;
+
+  memset (dst + dst_size, 0xa5, GUARD);
+  ret = grub_lz4_decompress (src, src_size, dst, dst_size);
+  for (i = 0; i < GUARD; i++)
+    if (dst[dst_size + i] != 0xa5)
+      {
+	grub_test_assert (0, "wrote past %lu bytes of output",
+			  (unsigned long) dst_size);
+	break;
+      }
+  if (ret < 0)
+    grub_errno = GRUB_ERR_NONE;
+  return ret;
+}
+
+/* Text-like data: words repeated with variations, and some runs.  */
+static void
+make_data (grub_uint8_t *buf, grub_size_t size)
+{
+  static const char *const words[] =
+    { "menuentry ", "linux ", "/vmlinuz ", "root=", "initrd ", "{\n",
+      "}\n", "insmod ", "part_gpt ", "search ", "--fs-uuid " };
+  grub_size_t i = 0, j;
+
+  while (i < size)
+    {
+      const char *w = words[rand () % (sizeof (words) / sizeof (words[0]))];
+      grub_size_t n = strlen (w);
+
+      if (rand () % 16 == 0)
+	{
+	  n = rand () % 300;
+	  if (n > size - i)
+	    n = size - i;
+	  memset (buf + i, rand () % 2 ? ' ' : 0, n);
+	}
+      else if (rand () % 8 == 0)
+	{
+	  n = rand () % 40;
+	  if (n > size - i)
+	    n = size - i;
+	  for (j = 0; j < n; j++)
+	    buf[i + j] = rand ();
+	}
+      else
+	{
+	  if (n > size - i)
+	    n = size - i;
+	  memcpy (buf + i, w, n);
+	}
+      i += n;
+    }
+}
+
+static void
+lz4_bench (const grub_uint8_t *comp, grub_size_t comp_size,
+	   grub_uint8_t *out, grub_size_t size)
+{
+  clock_t start;
+  double secs;
+  unsigned r;
+
+  start = clock ();
+  for (r = 0; r < BENCH_ROUNDS; r++)
+    grub_lz4_decompress (comp, comp_size, out, size);
+  secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+  if (secs > 0)
+    printf ("lz4: %.0f MiB/s decompressed\n",
+	    (double) size * BENCH_ROUNDS / secs / (1 << 20));
+}
+
+static void
+lz4_test (void)
+{
+  static grub_uint8_t data[BUF_SIZE], comp[BUF_SIZE * 2], out[BUF_SIZE + GUARD];
+  grub_size_t comp_size, i, size;
+  grub_ssize_t ret;
+  unsigned round;
+
+  ret = decompress (vector, sizeof (vector), out, BUF_SIZE);
+  grub_test_assert (ret == sizeof (vector_text) - 1
+		    && memcmp (out, vector_text, ret) == 0,
+		    "lz4 tool vector decompressed wrong");
+
+  ret = decompress (run_vector, sizeof (run_vector), out, BUF_SIZE);
+  grub_test_assert (ret == 21 && memcmp (out, "aaaaaaaaaaaaaaaaaaaaa", 21) == 0,
+		    "run of distance 1 decompressed wrong");
+
+  /* Exactly the room needed is enough, a byte less isn't.  */
+  ret = decompress (vector, sizeof (vector), out, sizeof (vector_text) - 1);
+  grub_test_assert (ret == sizeof (vector_text) - 1,
+		    "output of exactly the right size refused");
+  ret = decompress (vector, sizeof (vector), out, sizeof (vector_text) - 2);
+  grub_test_assert (ret < 0, "output too small accepted");
+
+  /* Distances of 0 or before the start of the output.  */
+  {
+    static const grub_uint8_t zero[] = { 0x10, 'a', 0x00, 0x00 };
+    static const grub_uint8_t before[] = { 0x10, 'a', 0x02, 0x00 };
+
+    grub_test_assert (decompress (zero, sizeof (zero), out, BUF_SIZE) < 0,
+		      "distance 0 accepted");
+    grub_test_assert (decompress (before, sizeof (before), out, BUF_SIZE) < 0,
+		      "distance before the output accepted");
+  }
+
+  /* Every truncation of the vector either fails or gives a prefix.  */
+  for (i = 0; i < sizeof (vector); i++)
+    {
+      ret = decompress (vector, i, out, BUF_SIZE);
+      grub_test_assert (ret < 0 || memcmp (out, vector_text, ret) == 0,
+			"truncation to %lu bytes gave wrong data",
+			(unsigned long) i);
+    }
+
+  for (round = 0; round < 64; round++)
+    {
+      size = round ? rand () % BUF_SIZE : BUF_SIZE;
+      make_data (data, size);
+      comp_size = compress_block (data, size, comp);
+
+      ret = decompress (comp, comp_size, out, size);
+      if (ret != (grub_ssize_t) size || memcmp (out, data, size) != 0)
+	{
+	  grub_test_assert (0, "round trip of %lu bytes failed",
+			    (unsigned long) size);
+	  return;
+	}
+
+      /* Truncated: never more than the whole, or past the output.  */
+      ret = decompress (comp, rand () % (comp_size + 1), out, size);
+      grub_test_assert (ret <= (grub_ssize_t) size,
+			"truncated input gave too much");
+
+      /* Corrupted: anything but writing out of bounds.  */
+      for (i = 0; i < 16; i++)
+	comp[rand () % comp_size] = rand ();
+      decompress (comp, comp_size, out, size);
+    }
+
+  make_data (data, BUF_SIZE);
+  comp_size = compress_block (data, BUF_SIZE, comp);
+  printf ("lz4: %lu bytes compressed to %lu\n", (unsigned long) BUF_SIZE,
+	  (unsigned long) comp_size);
+  lz4_bench (comp, comp_size, out, BUF_SIZE);
+}
+
+GRUB_UNIT_TEST ("lz4_test", lz4_test);